@@ -7,16 +7,15 @@ void arch_early_init()
 {
     setup_vectors();
     smp_init();
+    percpu_init(current_cpu_id);
     acpi_init();
     dtb_init();
     irq_init();
 }
 
-extern task_t *idle_tasks[MAX_CPU_NUM];
-
 void arch_init()
 {
-    arch_set_current(idle_tasks[current_cpu_id]);
+    arch_set_current(arch_this_cpu()->idle);
 
     arch_enable_interrupt();
 }
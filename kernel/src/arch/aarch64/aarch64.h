@@ -5,6 +5,7 @@
 #include "acpi/acpi.h"
 #include "drivers/chars/keyboard.h"
 #include "drivers/chars/mouse.h"
+#include "drivers/msi_arch.h"
 #include "acpi/gic.h"
 #include "mm/page_table.h"
 #include "irq/ptrace.h"
@@ -24,3 +25,18 @@ static inline void arch_pause()
 {
     asm volatile("nop");
 }
+
+// 通用定时器的计数, 只用于测量本 CPU 上的短时间间隔
+static inline uint64_t arch_cycles()
+{
+    uint64_t cnt;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(cnt));
+    return cnt;
+}
+
+static inline uint64_t arch_cycles_hz()
+{
+    uint64_t freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return freq;
+}
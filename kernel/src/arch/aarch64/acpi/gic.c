@@ -259,4 +259,5 @@ irq_controller_t gic_controller =
         .unmask = gic_unmask,
         .mask = gic_mask,
         .ack = gic_ack,
+        .name = "GICv3",
 };
@@ -0,0 +1,11 @@
+#pragma once
+
+// 还没有 GIC ITS, 这些只是为了让 msi.c 能够编译, irq_alloc_vectors 不会分配出向量
+
+#define ia64_pci_get_arch_msi_message_address(processor) (0UL)
+
+#define ia64_pci_get_arch_msi_message_data(vector, processor, edge_trigger, assert) ((uint32_t)(vector))
+
+#define msi_arch_dest(cpu) (cpu)
+
+#define msi_arch_eoi()
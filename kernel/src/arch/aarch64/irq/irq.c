@@ -2,6 +2,7 @@
 #include <interrupt/irq_manager.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <task/hrtimer.h>
 
 void arch_enable_interrupt()
 {
@@ -13,6 +14,13 @@ void arch_disable_interrupt()
     asm volatile("msr daifset, #3");
 }
 
+bool arch_interrupt_enabled()
+{
+    uint64_t daif;
+    asm volatile("mrs %0, daif" : "=r"(daif));
+    return !(daif & (1 << 7));
+}
+
 void irq_init()
 {
     gic_v3_init();
@@ -36,7 +44,15 @@ void timer_handler(uint64_t irq_num, void *parameter, struct pt_regs *regs)
 {
     current_task->jiffies++;
 
+    hrtimer_interrupt();
+
     uint64_t ctrl;
     asm volatile("mrs %0, cntp_ctl_el0" : "=r"(ctrl));
     asm volatile("msr cntp_ctl_el0, %0" ::"r"(ctrl | (1 << 2))); // 清除ISTATUS位
 }
+
+// 通用定时器仍为周期模式, hrtimer 在每个 tick 中检查到期
+void arch_timer_program(uint64_t expires)
+{
+    (void)expires;
+}
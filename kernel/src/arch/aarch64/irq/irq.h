@@ -6,8 +6,13 @@
 
 #define ARCH_TIMER_IRQ TIMER_IRQ
 
+// 还没有 ITS, 不能分配 MSI 向量
+#define ARCH_IRQ_DYNAMIC_START 0
+#define ARCH_IRQ_DYNAMIC_END 0
+
 void arch_enable_interrupt();
 void arch_disable_interrupt();
+bool arch_interrupt_enabled();
 
 void irq_init();
 
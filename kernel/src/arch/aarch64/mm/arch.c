@@ -30,6 +30,10 @@ uint64_t get_arch_page_table_flags(uint64_t flags)
         attr |= ARCH_PT_FLAG_XN;
     if (flags & PT_FLAG_U)
         attr |= ARCH_PT_FLAG_USER;
+    if (flags & PT_FLAG_COW)
+        attr |= ARCH_PT_FLAG_COW;
+    if (flags & PT_FLAG_SHARED)
+        attr |= ARCH_PT_FLAG_SHARED;
 
     return attr;
 }
@@ -72,6 +76,9 @@ task_mm_info_t *clone_page_table(task_mm_info_t *cr3_old, uint64_t clone_flags)
     copy_page_table_inner(cr3_old->page_table_addr, new, 3);
     new_info->page_table_addr = new;
     new_info->ref_count = 1;
+    new_info->mmap_start = cr3_old->mmap_start;
+    new_info->brk_start = cr3_old->brk_start;
+    new_info->brk_end = cr3_old->brk_end;
     return new_info;
 }
 
@@ -100,7 +107,11 @@ static void free_page_table_inner(uint64_t phys_addr, int level)
 
 void free_page_table(task_mm_info_t *directory)
 {
+    if (__atomic_sub_fetch(&directory->ref_count, 1, __ATOMIC_SEQ_CST) != 0)
+        return;
+
     free_page_table_inner(directory->page_table_addr, 4);
+    free(directory);
 }
 
 // 内存屏障和TLB操作
@@ -115,3 +126,8 @@ void arch_flush_tlb(uint64_t vaddr)
     dsb(ish);    // 等待TLB操作完成
     isb();       // 流水线同步
 }
+
+// tlbi ...is 由硬件广播到所有核心, 没有需要处理的处理器间请求
+void arch_flush_tlb_pending()
+{
+}
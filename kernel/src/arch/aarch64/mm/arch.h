@@ -16,6 +16,8 @@
 #define ARCH_PT_FLAG_INNER_SH ((uint64_t)3 << 8)
 #define ARCH_PT_FLAG_ACCESS ((uint64_t)1 << 10)
 #define ARCH_PT_FLAG_XN ((uint64_t)1 << 54)
+#define ARCH_PT_FLAG_COW ((uint64_t)1 << 55)
+#define ARCH_PT_FLAG_SHARED ((uint64_t)1 << 56)
 #define ARCH_PT_FLAG_WB ((uint64_t)0 << 2)
 #define ARCH_PT_FLAG_FB ((uint64_t)1 << 2)
 #define ARCH_ADDR_MASK ((uint64_t)0x0000FFFFFFFFF000)
@@ -27,3 +29,4 @@
 
 uint64_t get_arch_page_table_flags(uint64_t flags);
 void arch_flush_tlb(uint64_t vaddr);
+void arch_flush_tlb_pending();
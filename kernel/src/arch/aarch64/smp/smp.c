@@ -60,12 +60,14 @@ void ap_kmain(struct limine_mp_info *cpu)
 
     setup_vectors();
 
+    percpu_init(current_cpu_id);
+
     while (!task_initialized)
     {
         asm volatile("nop");
     }
 
-    arch_set_current(idle_tasks[current_cpu_id]);
+    arch_set_current(arch_this_cpu()->idle);
 
     gic_v3_init_percpu();
 
@@ -86,7 +86,13 @@ void aarch64_do_syscall(struct pt_regs *frame)
         frame->x0 = current_task->ppid;
         break;
     case SYS_WAIT4:
-        frame->x0 = sys_waitpid(arg1, (int *)arg2, arg3);
+        frame->x0 = sys_wait4((int64_t)arg1, (int *)arg2, arg3, (struct rusage *)arg4);
+        break;
+    case SYS_WAITID:
+        frame->x0 = sys_waitid((int)arg1, arg2, (struct siginfo *)arg3, arg4, (struct rusage *)arg5);
+        break;
+    case SYS_GETRUSAGE:
+        frame->x0 = sys_getrusage((int)arg1, (struct rusage *)arg2);
         break;
     case SYS_PRCTL:
         frame->x0 = sys_prctl(arg1, arg2, arg3, arg4, arg5);
@@ -281,12 +287,16 @@ void aarch64_do_syscall(struct pt_regs *frame)
         }
         else
         {
-            if (tasks[arg1] == NULL)
+            rcu_read_lock();
+            task_t *task = task_find_by_pid(arg1);
+            if (task)
+                task->pgid = arg2;
+            rcu_read_unlock();
+            if (task == NULL)
             {
                 frame->x0 = (uint64_t)-ENOENT;
                 break;
             }
-            tasks[arg1]->pgid = arg2;
         }
         frame->x0 = 0;
         break;
@@ -353,13 +363,13 @@ void aarch64_do_syscall(struct pt_regs *frame)
         frame->x0 = sys_timer_create((clockid_t)arg1, (struct sigevent *)arg2, (timer_t *)arg3);
         break;
     case SYS_TIMER_SETTIME:
-        frame->x0 = sys_timer_settime((timer_t)arg1, (const struct itimerval *)arg2, (struct itimerval *)arg3);
+        frame->x0 = sys_timer_settime((timer_t)arg1, arg2, (const struct itimerspec *)arg3, (struct itimerspec *)arg4);
         break;
     case SYS_TIMERFD_CREATE:
         frame->x0 = sys_timerfd_create(arg1, arg2);
         break;
     case SYS_TIMERFD_SETTIME:
-        frame->x0 = sys_timerfd_settime(arg1, arg2, (const struct itimerval *)arg3, (struct itimerval *)arg4);
+        frame->x0 = sys_timerfd_settime(arg1, arg2, (const struct itimerspec *)arg3, (struct itimerspec *)arg4);
         break;
     case SYS_FLOCK:
         frame->x0 = sys_flock(arg1, arg2);
@@ -392,7 +402,7 @@ void aarch64_do_syscall(struct pt_regs *frame)
         frame->x0 = 0;
         break;
     case SYS_UMASK:
-        frame->x0 = 0;
+        frame->x0 = sys_umask(arg1);
         break;
     case SYS_SETPRIORITY:
         frame->x0 = 0;
@@ -34,7 +34,16 @@ void arch_context_init(arch_context_t *context, uint64_t page_table_addr, uint64
 
 void arch_context_copy(arch_context_t *dst, arch_context_t *src, uint64_t stack, uint64_t clone_flags)
 {
-    dst->mm = clone_page_table(src->mm, clone_flags);
+    if (clone_flags & CLONE_VM)
+    {
+        // 线程直接共享地址空间, 与地址空间大小无关
+        __atomic_add_fetch(&src->mm->ref_count, 1, __ATOMIC_SEQ_CST);
+        dst->mm = src->mm;
+    }
+    else
+    {
+        dst->mm = clone_page_table(src->mm, clone_flags);
+    }
     dst->usermode = src->usermode;
     dst->ctx = (struct pt_regs *)stack - 1;
     memcpy(dst->ctx, src->ctx, sizeof(struct pt_regs));
@@ -54,6 +63,14 @@ void arch_set_current(task_t *current)
     asm volatile("msr TPIDR_EL1, %0" ::"r"(current));
 }
 
+// TPIDR_EL1 保存当前任务, 本 CPU 的数据区按 CPU 编号索引
+cpu_local_t *arch_this_cpu()
+{
+    return &cpu_locals[current_cpu_id];
+}
+
+void arch_set_this_cpu(cpu_local_t *cpu) {}
+
 extern void arch_context_switch_with_next(arch_context_t *next);
 extern void arch_context_switch_with_prev_next(arch_context_t *prev, arch_context_t *next);
 
@@ -90,8 +107,6 @@ void arch_task_switch_to(struct pt_regs *ctx, task_t *prev, task_t *next)
 
     arch_set_current(next);
 
-    sched_update_itimer();
-
     arch_switch_with_context(prev->arch_context, next->arch_context, next->kernel_stack);
 }
 
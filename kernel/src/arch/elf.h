@@ -55,3 +55,7 @@ typedef struct
 #define PT_HIPROC 2147483647
 
 #define PF_EXEC 1
+
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
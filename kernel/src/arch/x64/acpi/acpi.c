@@ -2,6 +2,7 @@
 #include <drivers/bus/pci.h>
 #include <mm/mm.h>
 #include <arch/x64/acpi/acpi.h>
+#include <arch/x64/time/tsc.h>
 
 #define load_table(name, func)                             \
     do                                                     \
@@ -70,6 +71,7 @@ void acpi_init()
     map_page_range(get_current_page_dir(false), (uint64_t)xsdt, xsdt_paddr, DEFAULT_PAGE_SIZE, PT_FLAG_R | PT_FLAG_W);
 
     load_table(HPET, hpet_setup);
+    tsc_init();
     load_table(APIC, apic_setup);
     load_table(MCFG, pcie_setup);
     // load_table(FACP, facp_setup);
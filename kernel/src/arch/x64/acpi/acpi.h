@@ -217,6 +217,7 @@ void *find_table(const char *name);
 void acpi_init();
 
 void hpet_setup(Hpet *hpet);
+uint64_t hpet_nano_time();
 uint64_t nanoTime();
 void usleep(uint64_t nano);
 
@@ -234,6 +235,7 @@ void usleep(uint64_t nano);
 
 #define APIC_ICR_LOW 0x300
 #define APIC_ICR_HIGH 0x310
+#define APIC_ICR_BUSY (1 << 12)
 
 void apic_setup(MADT *madt);
 void send_eoi(uint32_t irq);
@@ -241,8 +243,16 @@ uint64_t lapic_id();
 
 void lapic_write(uint32_t reg, uint32_t value);
 uint32_t lapic_read(uint32_t reg);
+void lapic_timer_oneshot(uint64_t ns);
+void lapic_timer_deadline(uint64_t tsc);
+void lapic_send_ipi(uint32_t cpu, uint8_t vector);
+
+extern bool lapic_tsc_deadline;
+
+extern uint32_t cpuid_to_lapicid[MAX_CPU_NUM];
 
 uint32_t get_cpuid_by_lapic_id(uint32_t lapic_id);
+uint32_t arch_current_cpu_id();
 
 void ioapic_enable(uint8_t vector);
 void ioapic_add(uint8_t vector, uint32_t irq);
@@ -251,11 +261,13 @@ int64_t apic_mask(uint64_t irq);
 int64_t apic_unmask(uint64_t irq);
 int64_t apic_install(uint64_t irq, uint64_t arg);
 int64_t apic_ack(uint64_t irq);
+int64_t apic_set_affinity(uint64_t irq, uint32_t cpu);
 
 struct irq_controller;
 extern struct irq_controller apic_controller;
+extern struct irq_controller lapic_ipi_controller;
 
-#define current_cpu_id get_cpuid_by_lapic_id(lapic_id())
+#define current_cpu_id arch_current_cpu_id()
 
 void smp_init();
 void tss_init();
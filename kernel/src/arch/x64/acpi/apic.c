@@ -9,14 +9,15 @@ bool x2apic_mode;
 uint64_t lapic_address;
 uint64_t ioapic_address;
 
-tss_t tss[MAX_CPU_NUM];
+DEFINE_PER_CPU(tss_t, tss);
 
 void tss_init()
 {
     uint64_t sp = phys_to_virt(alloc_frames(STACK_SIZE / DEFAULT_PAGE_SIZE)) + STACK_SIZE;
-    uint64_t offset = 10 + current_cpu_id * 2;
-    set_tss64((uint32_t *)&tss[current_cpu_id], sp, sp, sp, sp, sp, sp, sp, sp, sp, sp);
-    set_tss_descriptor(offset, &tss[current_cpu_id]);
+    uint32_t cpu = current_cpu_id;
+    uint64_t offset = 10 + cpu * 2;
+    set_tss64((uint32_t *)&per_cpu(tss, cpu), sp, sp, sp, sp, sp, sp, sp, sp, sp, sp);
+    set_tss_descriptor(offset, &per_cpu(tss, cpu));
     load_TR(offset);
 }
 
@@ -79,6 +80,25 @@ uint32_t lapic_read(uint32_t reg)
     return *(uint32_t *)((uint64_t)lapic_address + reg);
 }
 
+// 固定投递模式, 物理目标
+void lapic_send_ipi(uint32_t cpu, uint8_t vector)
+{
+    uint32_t apic_id = cpuid_to_lapicid[cpu];
+
+    if (x2apic_mode)
+    {
+        // x2APIC 的 ICR 是一个 64 位 MSR, 写入即发送
+        wrmsr(0x800 + (APIC_ICR_LOW >> 4), ((uint64_t)apic_id << 32) | vector);
+        return;
+    }
+
+    while (lapic_read(APIC_ICR_LOW) & APIC_ICR_BUSY)
+        arch_pause();
+
+    lapic_write(APIC_ICR_HIGH, apic_id << 24);
+    lapic_write(APIC_ICR_LOW, vector);
+}
+
 uint64_t lapic_id()
 {
     uint32_t phy_id = lapic_read(LAPIC_REG_ID);
@@ -86,8 +106,11 @@ uint64_t lapic_id()
 }
 
 uint64_t calibrated_timer_initial = 0;
+uint64_t lapic_timer_freq = 0;
+bool lapic_tsc_deadline = false;
 
 void lapic_timer_stop();
+void lapic_timer_deadline_mode();
 
 void local_apic_init(bool is_print)
 {
@@ -102,22 +125,37 @@ void local_apic_init(bool is_print)
     lapic_timer_stop();
 
     lapic_write(LAPIC_REG_SPURIOUS, 0xff | (1 << 8));
-    lapic_write(LAPIC_REG_TIMER_DIV, 11);
-    lapic_write(LAPIC_REG_TIMER, APIC_TIMER_INTERRUPT_VECTOR);
 
-    uint64_t b = nanoTime();
-    lapic_write(LAPIC_REG_TIMER_INITCNT, ~((uint32_t)0));
-    for (;;)
-        if (nanoTime() - b >= 10000000)
-            break;
-    uint64_t lapic_timer = (~(uint32_t)0) - lapic_read(LAPIC_REG_TIMER_CURCNT);
-    calibrated_timer_initial = (uint64_t)((uint64_t)(lapic_timer * 1000) / 250);
-    if (is_print)
+    lapic_tsc_deadline = tsc_deadline_supported();
+    if (lapic_tsc_deadline)
     {
-        printk("Calibrated LAPIC timer: %d ticks per second\n", calibrated_timer_initial);
+        // TSC-deadline 模式不需要校准 LAPIC 定时器
+        lapic_timer_deadline_mode();
+        if (is_print)
+        {
+            printk("LAPIC timer: TSC-deadline mode\n");
+        }
+    }
+    else
+    {
+        lapic_write(LAPIC_REG_TIMER_DIV, 11);
+        lapic_write(LAPIC_REG_TIMER, APIC_TIMER_INTERRUPT_VECTOR);
+
+        uint64_t b = nanoTime();
+        lapic_write(LAPIC_REG_TIMER_INITCNT, ~((uint32_t)0));
+        for (;;)
+            if (nanoTime() - b >= 10000000)
+                break;
+        uint64_t lapic_timer = (~(uint32_t)0) - lapic_read(LAPIC_REG_TIMER_CURCNT);
+        lapic_timer_freq = lapic_timer * 100;
+        calibrated_timer_initial = (uint64_t)((uint64_t)(lapic_timer * 1000) / 250);
+        if (is_print)
+        {
+            printk("Calibrated LAPIC timer: %d ticks per second\n", calibrated_timer_initial);
+        }
+        lapic_write(LAPIC_REG_TIMER, lapic_read(LAPIC_REG_TIMER) | (1 << 17));
+        lapic_write(LAPIC_REG_TIMER_INITCNT, calibrated_timer_initial);
     }
-    lapic_write(LAPIC_REG_TIMER, lapic_read(LAPIC_REG_TIMER) | (1 << 17));
-    lapic_write(LAPIC_REG_TIMER_INITCNT, calibrated_timer_initial);
     if (is_print)
     {
         printk("Setup local %s\n", x2apic_mode ? "x2APIC" : "xAPIC");
@@ -135,6 +173,14 @@ void local_apic_ap_init()
     lapic_timer_stop();
 
     lapic_write(LAPIC_REG_SPURIOUS, 0xff | (1 << 8));
+
+    if (lapic_tsc_deadline)
+    {
+        lapic_timer_deadline_mode();
+        return;
+    }
+
+    // 复用 BSP 的校准结果
     lapic_write(LAPIC_REG_TIMER_DIV, 11);
     lapic_write(LAPIC_REG_TIMER, APIC_TIMER_INTERRUPT_VECTOR);
 
@@ -180,6 +226,35 @@ void lapic_timer_stop()
     lapic_write(LAPIC_REG_TIMER, (1 << 16));
 }
 
+void lapic_timer_deadline_mode()
+{
+    lapic_write(LAPIC_REG_TIMER, APIC_TIMER_INTERRUPT_VECTOR | (2 << 17));
+    // 保证 LVT 写入先于 IA32_TSC_DEADLINE 生效
+    asm volatile("mfence" ::: "memory");
+    wrmsr(IA32_TSC_DEADLINE, 0);
+}
+
+void lapic_timer_deadline(uint64_t tsc)
+{
+    wrmsr(IA32_TSC_DEADLINE, tsc ? tsc : 1);
+}
+
+void lapic_timer_oneshot(uint64_t ns)
+{
+    // 最多 1s, 防止计数溢出; 到期后由 hrtimer 重新编程
+    if (ns > 1000000000ULL)
+        ns = 1000000000ULL;
+
+    uint64_t count = ns * lapic_timer_freq / 1000000000ULL;
+    if (count == 0)
+        count = 1;
+    if (count > 0xffffffff)
+        count = 0xffffffff;
+
+    lapic_write(LAPIC_REG_TIMER, APIC_TIMER_INTERRUPT_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INITCNT, (uint32_t)count);
+}
+
 void apic_setup(MADT *madt)
 {
     lapic_address = phys_to_virt((uint64_t)madt->local_apic_address);
@@ -226,11 +301,15 @@ void ap_entry(struct limine_mp_info *cpu)
 {
     close_interrupt;
 
+    arch_set_this_cpu(NULL);
+
     uint64_t cr3 = (uint64_t)virt_to_phys(get_current_page_dir(false));
     asm volatile("movq %0, %%cr3" ::"r"(cr3) : "memory");
 
     sse_init();
 
+    percpu_init(cpu->processor_id);
+
     printk("APU %d starting...\n", cpu->processor_id);
 
     gdtidt_setup();
@@ -241,14 +320,20 @@ void ap_entry(struct limine_mp_info *cpu)
 
     local_apic_ap_init();
 
+    fpu_init();
+
     syscall_init();
 
+    vdso_cpu_init(current_cpu_id);
+
     while (!task_initialized)
     {
         arch_pause();
     }
 
-    arch_set_current(idle_tasks[current_cpu_id]);
+    arch_set_current(arch_this_cpu()->idle);
+
+    apic_timer_ap_init();
 
     while (1)
     {
@@ -276,6 +361,16 @@ uint32_t get_cpuid_by_lapic_id(uint32_t lapic_id)
     return 0;
 }
 
+// percpu_init 之前只能通过 lapic id 查表
+uint32_t arch_current_cpu_id()
+{
+    cpu_local_t *cpu = arch_this_cpu();
+    if (cpu)
+        return cpu->cpu_id;
+
+    return get_cpuid_by_lapic_id(lapic_id());
+}
+
 void apu_startup(struct limine_mp_response *mp_response)
 {
     cpu_count = mp_response->cpu_count;
@@ -286,7 +381,10 @@ void apu_startup(struct limine_mp_response *mp_response)
         cpuid_to_lapicid[cpu->processor_id] = cpu->lapic_id;
 
         if (cpu->lapic_id == mp_response->bsp_lapic_id)
+        {
+            percpu_init(cpu->processor_id);
             continue;
+        }
 
         cpu->goto_address = ap_entry;
     }
@@ -323,9 +421,36 @@ int64_t apic_ack(uint64_t irq)
     return 0;
 }
 
+// 物理目标模式, 只改重定向表项高 32 位中的目标 APIC ID
+int64_t apic_set_affinity(uint64_t irq, uint32_t cpu)
+{
+    uint32_t index = 0x10 + (irq - 32) * 2;
+    uint32_t high = ioapic_read(index + 1);
+
+    high &= 0x00FFFFFF;
+    high |= cpuid_to_lapicid[cpu] << 24;
+    ioapic_write(index + 1, high);
+
+    return 0;
+}
+
+// 处理器间中断只需要本地 APIC 的 EOI
+int64_t lapic_ipi_ack(uint64_t irq)
+{
+    lapic_write(0xb0, 0);
+    return 0;
+}
+
+irq_controller_t lapic_ipi_controller = {
+    .ack = lapic_ipi_ack,
+    .name = "LAPIC-IPI",
+};
+
 irq_controller_t apic_controller = {
     .mask = apic_mask,
     .unmask = apic_unmask,
     .install = apic_install,
     .ack = apic_ack,
+    .set_affinity = apic_set_affinity,
+    .name = "IO-APIC",
 };
@@ -1,6 +1,7 @@
 #include <drivers/kernel_logger.h>
 #include <arch/x64/acpi/acpi.h>
 #include <mm/mm.h>
+#include <arch/x64/time/tsc.h>
 
 HpetInfo *hpet_addr;
 static uint32_t hpetPeriod = 0;
@@ -33,7 +34,7 @@ void usleep(uint64_t nano)
     }
 }
 
-uint64_t nanoTime()
+uint64_t hpet_nano_time()
 {
     if (hpet_addr == NULL)
         return 0;
@@ -41,6 +42,13 @@ uint64_t nanoTime()
     return mcv * hpetPeriod;
 }
 
+uint64_t nanoTime()
+{
+    if (tsc_clocksource)
+        return tsc_nano_time();
+    return hpet_nano_time();
+}
+
 void hpet_setup(Hpet *hpet)
 {
     hpet_addr = (HpetInfo *)phys_to_virt(hpet->base_address.address);
@@ -16,3 +16,7 @@
 #define ENTRY(name)            \
     .global SYMBOL_NAME(name); \
     SYMBOL_NAME_LABEL(name)
+
+// cpu_local_t 中供 syscall 入口通过 %gs 访问的字段偏移
+#define CPU_LOCAL_SYSCALL_STACK 0
+#define CPU_LOCAL_SYSCALL_USER_RSP 8
@@ -3,16 +3,62 @@
 #include <interrupt/irq_manager.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <task/hrtimer.h>
 
-void apic_timer_handler(uint64_t irq_num, void *data, struct pt_regs *regs)
+static DEFINE_PER_CPU(hrtimer_t, sched_tick);
+
+static hrtimer_restart_t sched_tick_handler(hrtimer_t *timer)
 {
     current_task->jiffies++;
 
     if (current_cpu_id == 0)
+    {
         jiffies += 100;
+        vdso_update();
+    }
+
+    hrtimer_forward(timer, nanoTime(), APIC_TIMER_TICK_NS);
+
+    return HRTIMER_RESTART;
+}
+
+void apic_timer_handler(uint64_t irq_num, void *data, struct pt_regs *regs)
+{
+    hrtimer_interrupt();
+}
+
+void arch_timer_program(uint64_t expires)
+{
+    if (lapic_tsc_deadline)
+    {
+        lapic_timer_deadline(ns_to_tsc(expires));
+        return;
+    }
+
+    uint64_t now = nanoTime();
+
+    lapic_timer_oneshot(expires > now ? expires - now : 0);
+}
+
+// LAPIC 定时器切换为一次性模式, 由 hrtimer 队列驱动
+static void apic_timer_percpu_init()
+{
+    uint32_t cpu = current_cpu_id;
+
+    hrtimer_cpu_init(cpu);
+
+    hrtimer_init(&per_cpu(sched_tick, cpu), sched_tick_handler, NULL);
+    hrtimer_start(&per_cpu(sched_tick, cpu), nanoTime() + APIC_TIMER_TICK_NS);
 }
 
 void apic_timer_init()
 {
     irq_regist_irq(APIC_TIMER_INTERRUPT_VECTOR, apic_timer_handler, APIC_TIMER_INTERRUPT_VECTOR - 32, NULL, &apic_controller, "APIC TIMER");
+
+    apic_timer_percpu_init();
+}
+
+void apic_timer_ap_init()
+{
+    apic_timer_percpu_init();
 }
@@ -2,7 +2,11 @@
 
 #include <libs/klibc.h>
 
+// 调度 tick 周期, 与原先周期模式的间隔一致
+#define APIC_TIMER_TICK_NS 40000000ULL
+
 struct pt_regs;
 
 void apic_timer_handler(uint64_t irq_num, void *data, struct pt_regs *regs);
 void apic_timer_init();
+void apic_timer_ap_init();
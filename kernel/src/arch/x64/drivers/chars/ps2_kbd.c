@@ -558,7 +558,7 @@ uint32_t read_str(char *buffstr)
     while (kb_is_ocupied())
         arch_pause();
 
-    task_t *task = tasks[0];
+    task_t *task = task_find_by_pid(0);
     if (!task)
         return 0;
 
@@ -24,6 +24,8 @@ irq_controller_t mouse_controller =
         .unmask = apic_unmask,
         .mask = apic_mask,
         .ack = apic_ack,
+        .set_affinity = apic_set_affinity,
+        .name = "IO-APIC",
 };
 
 void mouse_wait(uint8_t a_type)
@@ -11,3 +11,15 @@
  *
  */
 #define ia64_pci_get_arch_msi_message_data(vector, processor, edge_trigger, assert) ((uint32_t)((vector & 0xff) | (edge_trigger == 1 ? 0 : (1 << 15)) | ((assert == 0) ? 0 : (1 << 14))))
+
+/**
+ * @brief 把 cpu 号转换成 message address 中的目标 APIC ID
+ *
+ */
+#define msi_arch_dest(cpu) (cpuid_to_lapicid[cpu])
+
+/**
+ * @brief MSI 不经过 IOAPIC, 只需要应答 LAPIC
+ *
+ */
+#define msi_arch_eoi() lapic_write(0xb0, 0)
@@ -40,6 +40,10 @@
     extern void IRQ_NAME(number);                                              \
     __asm__(".section .text\n\t" SYMBOL_NAME_STR(IRQ) #number "interrupt:\n\t" \
                                                               "cli\n\t"        \
+    "testb $3, 8(%rsp)\n\t"                                                    \
+    "jz 1f\n\t"                                                                \
+    "swapgs\n\t"                                                               \
+    "1:\n\t"                                                                   \
     "pushq $0x00\n\t" SAVE_ALL_REGS                                            \
     "movq %rsp, %rdi\n\t"                                                      \
     "leaq ret_from_intr(%rip), %rax\n\t"                                       \
@@ -74,7 +78,76 @@ Build_IRQ(0x36);
 Build_IRQ(0x37);
 Build_IRQ(0x38);
 Build_IRQ(0x39);
+Build_IRQ(0x3a);
+Build_IRQ(0x3b);
+Build_IRQ(0x3c);
+Build_IRQ(0x3d);
+Build_IRQ(0x3e);
+Build_IRQ(0x3f);
 Build_IRQ(0x40);
+Build_IRQ(0x41);
+Build_IRQ(0x42);
+Build_IRQ(0x43);
+Build_IRQ(0x44);
+Build_IRQ(0x45);
+Build_IRQ(0x46);
+Build_IRQ(0x47);
+Build_IRQ(0x48);
+Build_IRQ(0x49);
+Build_IRQ(0x4a);
+Build_IRQ(0x4b);
+Build_IRQ(0x4c);
+Build_IRQ(0x4d);
+Build_IRQ(0x4e);
+Build_IRQ(0x4f);
+Build_IRQ(0x50);
+Build_IRQ(0x51);
+Build_IRQ(0x52);
+Build_IRQ(0x53);
+Build_IRQ(0x54);
+Build_IRQ(0x55);
+Build_IRQ(0x56);
+Build_IRQ(0x57);
+Build_IRQ(0x58);
+Build_IRQ(0x59);
+Build_IRQ(0x5a);
+Build_IRQ(0x5b);
+Build_IRQ(0x5c);
+Build_IRQ(0x5d);
+Build_IRQ(0x5e);
+Build_IRQ(0x5f);
+Build_IRQ(0x60);
+Build_IRQ(0x61);
+Build_IRQ(0x62);
+Build_IRQ(0x63);
+Build_IRQ(0x64);
+Build_IRQ(0x65);
+Build_IRQ(0x66);
+Build_IRQ(0x67);
+Build_IRQ(0x68);
+Build_IRQ(0x69);
+Build_IRQ(0x6a);
+Build_IRQ(0x6b);
+Build_IRQ(0x6c);
+Build_IRQ(0x6d);
+Build_IRQ(0x6e);
+Build_IRQ(0x6f);
+Build_IRQ(0x70);
+Build_IRQ(0x71);
+Build_IRQ(0x72);
+Build_IRQ(0x73);
+Build_IRQ(0x74);
+Build_IRQ(0x75);
+Build_IRQ(0x76);
+Build_IRQ(0x77);
+Build_IRQ(0x78);
+Build_IRQ(0x79);
+Build_IRQ(0x7a);
+Build_IRQ(0x7b);
+Build_IRQ(0x7c);
+Build_IRQ(0x7d);
+Build_IRQ(0x7e);
+Build_IRQ(0x7f);
 
 // 初始化中断数组
 void (*interrupt_table[])(void) =
@@ -105,14 +178,83 @@ void (*interrupt_table[])(void) =
         IRQ0x37interrupt,
         IRQ0x38interrupt,
         IRQ0x39interrupt,
+        IRQ0x3ainterrupt,
+        IRQ0x3binterrupt,
+        IRQ0x3cinterrupt,
+        IRQ0x3dinterrupt,
+        IRQ0x3einterrupt,
+        IRQ0x3finterrupt,
         IRQ0x40interrupt,
+        IRQ0x41interrupt,
+        IRQ0x42interrupt,
+        IRQ0x43interrupt,
+        IRQ0x44interrupt,
+        IRQ0x45interrupt,
+        IRQ0x46interrupt,
+        IRQ0x47interrupt,
+        IRQ0x48interrupt,
+        IRQ0x49interrupt,
+        IRQ0x4ainterrupt,
+        IRQ0x4binterrupt,
+        IRQ0x4cinterrupt,
+        IRQ0x4dinterrupt,
+        IRQ0x4einterrupt,
+        IRQ0x4finterrupt,
+        IRQ0x50interrupt,
+        IRQ0x51interrupt,
+        IRQ0x52interrupt,
+        IRQ0x53interrupt,
+        IRQ0x54interrupt,
+        IRQ0x55interrupt,
+        IRQ0x56interrupt,
+        IRQ0x57interrupt,
+        IRQ0x58interrupt,
+        IRQ0x59interrupt,
+        IRQ0x5ainterrupt,
+        IRQ0x5binterrupt,
+        IRQ0x5cinterrupt,
+        IRQ0x5dinterrupt,
+        IRQ0x5einterrupt,
+        IRQ0x5finterrupt,
+        IRQ0x60interrupt,
+        IRQ0x61interrupt,
+        IRQ0x62interrupt,
+        IRQ0x63interrupt,
+        IRQ0x64interrupt,
+        IRQ0x65interrupt,
+        IRQ0x66interrupt,
+        IRQ0x67interrupt,
+        IRQ0x68interrupt,
+        IRQ0x69interrupt,
+        IRQ0x6ainterrupt,
+        IRQ0x6binterrupt,
+        IRQ0x6cinterrupt,
+        IRQ0x6dinterrupt,
+        IRQ0x6einterrupt,
+        IRQ0x6finterrupt,
+        IRQ0x70interrupt,
+        IRQ0x71interrupt,
+        IRQ0x72interrupt,
+        IRQ0x73interrupt,
+        IRQ0x74interrupt,
+        IRQ0x75interrupt,
+        IRQ0x76interrupt,
+        IRQ0x77interrupt,
+        IRQ0x78interrupt,
+        IRQ0x79interrupt,
+        IRQ0x7ainterrupt,
+        IRQ0x7binterrupt,
+        IRQ0x7cinterrupt,
+        IRQ0x7dinterrupt,
+        IRQ0x7einterrupt,
+        IRQ0x7finterrupt,
 };
 
 void generic_interrupt_table_init()
 {
-    for (int i = 0x20; i <= 0x40; ++i)
+    for (int i = 0; i < sizeof(interrupt_table) / sizeof(interrupt_table[0]); ++i)
     {
-        set_intr_gate(i, 0, interrupt_table[i - 0x20]);
+        set_intr_gate(0x20 + i, 0, interrupt_table[i]);
     }
 }
 
@@ -125,3 +267,10 @@ void arch_disable_interrupt()
 {
     close_interrupt;
 }
+
+bool arch_interrupt_enabled()
+{
+    uint64_t rflags;
+    asm volatile("pushfq\n\tpopq %0" : "=r"(rflags));
+    return rflags & (1 << 9);
+}
@@ -5,7 +5,15 @@
 #define PS2_KBD_INTERRUPT_VECTOR 0x21
 #define PS2_MOUSE_INTERRUPT_VECTOR 0x22
 
+// 0x20 + IOAPIC 引脚号留给传统中断, 之后的向量按需分配给 MSI/MSI-X
+#define ARCH_IRQ_DYNAMIC_START 0x40
+#define ARCH_IRQ_DYNAMIC_END 0x7f
+
+// 处理器间中断, 不经过 IOAPIC
+#define TLB_SHOOTDOWN_VECTOR 0x7f
+
 void generic_interrupt_table_init();
 
 void arch_enable_interrupt();
 void arch_disable_interrupt();
+bool arch_interrupt_enabled();
@@ -148,11 +148,10 @@ void do_undefined_opcode(struct pt_regs *regs, uint64_t error_code)
 // 7 #NM 设备异常（FPU不存在）
 void do_dev_not_avaliable(struct pt_regs *regs, uint64_t error_code)
 {
+    (void)regs;
     (void)error_code;
-    dump_regs(regs, "do_dev_not_avaliable(7)");
 
-    while (1)
-        asm volatile("hlt");
+    fpu_handle_nm();
 }
 
 // 8 #DF 双重错误
@@ -252,7 +251,12 @@ void do_page_fault(struct pt_regs *regs, uint64_t error_code)
     asm volatile("movq %%cr2, %0"
                          : "=r"(cr2)::"memory");
 
-    (void)error_code;
+    cpu_stat_inc(CPU_STAT_PGFAULT);
+
+    // 对写时复制页的写入, 包括内核代替用户写入的情况
+    if ((error_code & 0x3) == 0x3 && cr2 < USER_BRK_END && arch_handle_cow_fault(get_current_page_dir(true), cr2))
+        return;
+
     dump_regs(regs, "do_page_fault(14) cr2 = %#018lx", cr2);
 
     if (regs->rsp <= get_physical_memory_offset())
@@ -4,6 +4,9 @@
 #include <libs/klibc.h>
 #include <mm/mm.h>
 #include <task/task.h>
+#include <arch/x64/vdso/vdso.h>
+#include <mm/page_cache.h>
+#include <interrupt/irq_manager.h>
 
 uint64_t *get_current_page_dir(bool user)
 {
@@ -31,6 +34,16 @@ uint64_t get_arch_page_table_flags(uint64_t flags)
     //     result |= ARCH_PT_FLAG_NX;
     // }
 
+    if ((flags & PT_FLAG_COW) != 0)
+    {
+        result |= ARCH_PT_FLAG_COW;
+    }
+
+    if ((flags & PT_FLAG_SHARED) != 0)
+    {
+        result |= ARCH_PT_FLAG_SHARED;
+    }
+
     return result;
 }
 
@@ -61,6 +74,10 @@ bool is_reserved_memory_region(uint64_t pml4_idx, uint64_t pdpt_idx, uint64_t pd
     {
         return true;
     }
+    if (is_vdso_region(vaddr))
+    {
+        return true;
+    }
     return false;
 }
 
@@ -72,10 +89,17 @@ task_mm_info_t *clone_page_table(task_mm_info_t *old, uint64_t clone_flags)
     if (cr3_new == 0)
     {
         printk("Cannot clone page table: no page can be allocated");
+        free(new);
+        __atomic_add_fetch(&old->ref_count, 1, __ATOMIC_SEQ_CST);
         return old;
     }
 
     new->page_table_addr = cr3_new;
+    new->ref_count = 1;
+    new->cpu_mask = 0;
+    new->mmap_start = old->mmap_start;
+    new->brk_start = old->brk_start;
+    new->brk_end = old->brk_end;
     uint64_t cr3_old = old->page_table_addr;
 
     // 4层嵌套for循环，简单粗暴
@@ -188,6 +212,14 @@ task_mm_info_t *clone_page_table(task_mm_info_t *old, uint64_t clone_flags)
 
                     uint64_t *page_old = (uint64_t *)phys_to_virt(pte_old & 0x00007FFFFFFFF000);
 
+                    // 页缓存的共享页只增加引用, 写时复制的标记一并保留
+                    if (pte_old & ARCH_PT_FLAG_SHARED)
+                    {
+                        pt_new[pt_idx] = pte_old;
+                        page_cache_ref(pte_old & 0x00007FFFFFFFF000);
+                        continue;
+                    }
+
                     if ((is_stack_memory_region(pml4_idx, pdpt_idx, pd_idx, pt_idx) && (clone_flags & CLONE_VM)) || (is_reserved_memory_region(pml4_idx, pdpt_idx, pd_idx, pt_idx)))
                     {
                         pt_new[pt_idx] = pte_old;
@@ -234,6 +266,10 @@ static void free_page_table_inner(uint64_t phys_addr, int level)
         {
             free_page_table_inner(pte & 0x00007FFFFFFFF000, level - 1);
         }
+        else if (pte & ARCH_PT_FLAG_SHARED)
+        {
+            page_cache_put(pte & 0x00007FFFFFFFF000);
+        }
         else
         {
             free_frames(pte & 0x00007FFFFFFFF000, 1);
@@ -245,10 +281,13 @@ static void free_page_table_inner(uint64_t phys_addr, int level)
 
 void free_page_table(task_mm_info_t *directory)
 {
-    if (directory->ref_count == 1)
+    if (__atomic_sub_fetch(&directory->ref_count, 1, __ATOMIC_SEQ_CST) == 0)
     {
         uint64_t *pml4 = phys_to_virt((uint64_t *)directory->page_table_addr);
 
+        // vDSO 页为所有进程共享
+        vdso_unmap(pml4);
+
         for (int i = 0; i < 256; i++)
         {
             if (!(pml4[i] & ARCH_PT_FLAG_VALID))
@@ -261,15 +300,149 @@ void free_page_table(task_mm_info_t *directory)
             pml4[i] = 0; // 清除PML4条目
         }
 
-        free_frames((uint64_t)directory, 1);
+        free_frames(directory->page_table_addr, 1);
+        free(directory);
     }
-    else
+}
+
+// 同一时刻只有一个发起者, 目标 CPU 刷新后清掉自己在 tlb_shootdown_pending 中的位
+static spinlock_t tlb_shootdown_lock = {0};
+static uint64_t tlb_shootdown_vaddr;
+static uint64_t tlb_shootdown_pending;
+static bool tlb_shootdown_ready = false;
+
+// 系统调用在关中断下运行, 关中断自旋等待可能被发起者持有的锁时要调用, 否则两边会互相等待
+void arch_flush_tlb_pending()
+{
+    uint64_t bit = 1UL << current_cpu_id;
+
+    if (!(__atomic_load_n(&tlb_shootdown_pending, __ATOMIC_ACQUIRE) & bit))
+        return;
+
+    flush_tlb(__atomic_load_n(&tlb_shootdown_vaddr, __ATOMIC_RELAXED));
+    __atomic_fetch_and(&tlb_shootdown_pending, ~bit, __ATOMIC_RELEASE);
+}
+
+static void tlb_shootdown_handler(uint64_t irq_num, void *data, struct pt_regs *regs)
+{
+    arch_flush_tlb_pending();
+}
+
+void tlb_shootdown_init()
+{
+    irq_regist_irq(TLB_SHOOTDOWN_VECTOR, tlb_shootdown_handler, 0, NULL, &lapic_ipi_controller, "TLB SHOOTDOWN");
+
+    tlb_shootdown_ready = true;
+}
+
+// 刷新本 CPU, 再等待当前地址空间活跃的其他 CPU 刷新完成
+// 调用者不能持有其他 CPU 可能在关中断下自旋等待的锁
+void arch_flush_tlb(uint64_t vaddr)
+{
+    flush_tlb(vaddr);
+
+    // 内核地址空间和启动阶段只刷新本 CPU
+    task_t *task = current_task;
+    if (!tlb_shootdown_ready || vaddr >= USER_BRK_END || !task)
+        return;
+
+    task_mm_info_t *mm = task->arch_context->mm;
+
+    bool irq = arch_interrupt_enabled();
+    arch_disable_interrupt();
+
+    // 与 arch_switch_mm 先置位再加载 CR3 配对: 读不到某个 CPU 的位时它一定会看到新的页表项
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64_t targets = __atomic_load_n(&mm->cpu_mask, __ATOMIC_SEQ_CST) & ~(1UL << current_cpu_id);
+
+    if (targets)
     {
-        directory->ref_count--;
+        while (!spin_trylock(&tlb_shootdown_lock))
+        {
+            arch_flush_tlb_pending();
+            arch_pause();
+        }
+
+        __atomic_store_n(&tlb_shootdown_vaddr, vaddr, __ATOMIC_RELAXED);
+        __atomic_store_n(&tlb_shootdown_pending, targets, __ATOMIC_RELEASE);
+
+        for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        {
+            if (targets & (1UL << cpu))
+                lapic_send_ipi(cpu, TLB_SHOOTDOWN_VECTOR);
+        }
+
+        while (__atomic_load_n(&tlb_shootdown_pending, __ATOMIC_ACQUIRE))
+            arch_pause();
+
+        spin_unlock(&tlb_shootdown_lock);
     }
+
+    if (irq)
+        arch_enable_interrupt();
 }
 
-void arch_flush_tlb(uint64_t vaddr)
+static spinlock_t cow_lock = {0};
+
+// 写时复制: 复制到私有页后恢复写权限, 共享页减去一个引用
+bool arch_handle_cow_fault(uint64_t *pml4, uint64_t vaddr)
 {
-    asm volatile("invlpg (%0)" ::"r"(vaddr) : "memory");
+    spin_lock_irqsave(&cow_lock);
+
+    uint64_t *table = pml4;
+    for (uint64_t level = 1; level < ARCH_MAX_PT_LEVEL; level++)
+    {
+        uint64_t entry = table[PAGE_CALC_PAGE_TABLE_INDEX(vaddr, level)];
+        if (!ARCH_PT_IS_TABLE(entry) || ARCH_PT_IS_LARGE(entry))
+        {
+            spin_unlock_irqrestore(&cow_lock);
+            return false;
+        }
+        table = (uint64_t *)phys_to_virt(entry & 0x00007FFFFFFFF000);
+    }
+
+    uint64_t *ptep = &table[PAGE_CALC_PAGE_TABLE_INDEX(vaddr, ARCH_MAX_PT_LEVEL)];
+    uint64_t pte = *ptep;
+
+    if (!(pte & ARCH_PT_FLAG_VALID))
+    {
+        spin_unlock_irqrestore(&cow_lock);
+        return false;
+    }
+
+    // 另一个共享地址空间的线程已经处理过, 它会负责刷新其他 CPU
+    if (pte & ARCH_PT_FLAG_WRITEABLE)
+    {
+        spin_unlock_irqrestore(&cow_lock);
+        flush_tlb(vaddr);
+        return true;
+    }
+
+    if (!(pte & ARCH_PT_FLAG_COW))
+    {
+        spin_unlock_irqrestore(&cow_lock);
+        return false;
+    }
+
+    uint64_t old = pte & 0x00007FFFFFFFF000;
+    uint64_t new = alloc_frames(1);
+    if (new == 0 || new == (uint64_t)-1)
+    {
+        spin_unlock_irqrestore(&cow_lock);
+        return false;
+    }
+
+    fast_memcpy(phys_to_virt((void *)new), phys_to_virt((void *)old), DEFAULT_PAGE_SIZE);
+
+    *ptep = new | (pte & ~0x00007FFFFFFFF000 & ~(ARCH_PT_FLAG_COW | ARCH_PT_FLAG_SHARED)) | ARCH_PT_FLAG_WRITEABLE;
+
+    spin_unlock_irqrestore(&cow_lock);
+
+    // 其他 CPU 可能在 cow_lock 上关中断自旋, 解锁后再 shootdown; 旧页在所有 CPU 刷新后才释放
+    arch_flush_tlb(vaddr);
+
+    if (pte & ARCH_PT_FLAG_SHARED)
+        page_cache_put(old);
+
+    return true;
 }
@@ -13,6 +13,11 @@
 #define ARCH_PT_FLAG_HUGE (0x1UL << 7)
 #define ARCH_PT_FLAG_NX (0x1UL << 63)
 
+// 软件使用的位
+#define ARCH_PT_FLAG_COW (0x1UL << 9)
+#define ARCH_PT_FLAG_SHARED (0x1UL << 10)
+#define ARCH_ADDR_MASK (0x000FFFFFFFFFF000UL)
+
 #define ARCH_PT_TABLE_FLAGS (ARCH_PT_FLAG_VALID | ARCH_PT_FLAG_WRITEABLE)
 
 #define ARCH_PT_IS_TABLE(x) (((x) & (ARCH_PT_FLAG_VALID | ARCH_PT_FLAG_WRITEABLE)) == (ARCH_PT_FLAG_VALID | ARCH_PT_FLAG_WRITEABLE))
@@ -20,3 +25,6 @@
 
 uint64_t get_arch_page_table_flags(uint64_t flags);
 void arch_flush_tlb(uint64_t vaddr);
+void arch_flush_tlb_pending();
+void tlb_shootdown_init();
+bool arch_handle_cow_fault(uint64_t *pml4, uint64_t vaddr);
@@ -367,6 +367,9 @@
 #define SYS_CACHESTAT 451
 #define SYS_FCHMODAT2 452
 
+// naos 私有的系统调用
+#define SYS_SPAWN 500
+
 #define FB_TYPE_PACKED_PIXELS 0      /* Packed Pixels	*/
 #define FB_TYPE_PLANES 1             /* Non interleaved planes */
 #define FB_TYPE_INTERLEAVED_PLANES 2 /* Interleaved planes	*/
@@ -5,19 +5,8 @@
 #include <mm/mm_syscall.h>
 #include <net/net_syscall.h>
 
-uint64_t switch_to_kernel_stack()
-{
-    return current_task->syscall_stack;
-}
-
-void *real_memcpy(void *dst, const void *src, size_t len)
-{
-#if defined(__x86_64__)
-    return fast_memcpy(dst, src, len);
-#else
-    return memcpy(dst, src, len);
-#endif
-}
+_Static_assert(offsetof(cpu_local_t, syscall_stack) == CPU_LOCAL_SYSCALL_STACK, "syscall entry expects syscall_stack at CPU_LOCAL_SYSCALL_STACK");
+_Static_assert(offsetof(cpu_local_t, syscall_user_rsp) == CPU_LOCAL_SYSCALL_USER_RSP, "syscall entry expects syscall_user_rsp at CPU_LOCAL_SYSCALL_USER_RSP");
 
 void syscall_init()
 {
@@ -67,506 +56,867 @@ char release[] = BUILD_VERSION;
 char version[] = BUILD_VERSION;
 char machine[] = "x86_64";
 
-void syscall_handler(struct pt_regs *regs, struct pt_regs *user_regs)
+// 只返回成功的桩实现
+SYSCALL_DEFINE(nop)
 {
-    regs->rip = regs->rcx;
-    regs->rflags = regs->r11;
-    regs->cs = SELECTOR_USER_CS;
-    regs->ss = SELECTOR_USER_DS;
-    regs->ds = SELECTOR_USER_DS;
-    regs->es = SELECTOR_USER_DS;
-    regs->rsp = (uint64_t)(user_regs + 1);
+    return 0;
+}
 
-    uint64_t idx = regs->rax & 0xFFFFFFFF;
+SYSCALL_DEFINE(open)
+{
+    return sys_open((const char *)arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(openat)
+{
+    return sys_openat(arg1, (const char *)arg2, arg3, arg4);
+}
+
+SYSCALL_DEFINE(close)
+{
+    return sys_close(arg1);
+}
+
+SYSCALL_DEFINE(lseek)
+{
+    return sys_lseek(arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(read)
+{
+    return sys_read(arg1, (void *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(write)
+{
+    return sys_write(arg1, (const void *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(pread64)
+{
+    sys_lseek(arg1, arg4, SEEK_SET);
+    return sys_read(arg1, (void *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(pwrite64)
+{
+    sys_lseek(arg1, arg4, SEEK_SET);
+    return sys_write(arg1, (void *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(ioctl)
+{
+    return sys_ioctl(arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(readv)
+{
+    return sys_readv(arg1, (struct iovec *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(writev)
+{
+    return sys_writev(arg1, (struct iovec *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(clone)
+{
+    return sys_clone(regs, arg1, arg2, (int *)arg3, (int *)arg4, arg5);
+}
+
+SYSCALL_DEFINE(fork)
+{
+    return task_fork(regs, false);
+}
+
+SYSCALL_DEFINE(vfork)
+{
+    return task_fork(regs, true);
+}
+
+SYSCALL_DEFINE(execve)
+{
+    return task_execve((const char *)arg1, (const char **)arg2, (const char **)arg3);
+}
+
+SYSCALL_DEFINE(spawn)
+{
+    return sys_spawn((const char *)arg1, (const char **)arg2, (const char **)arg3);
+}
+
+SYSCALL_DEFINE(exit)
+{
+    return task_exit((int64_t)arg1);
+}
+
+SYSCALL_DEFINE(exit_group)
+{
+    return task_exit((int64_t)arg1);
+}
+
+SYSCALL_DEFINE(getpid)
+{
+    if (arg1 == UINT64_MAX && arg2 == UINT64_MAX && arg3 == UINT64_MAX && arg4 == UINT64_MAX && arg5 == UINT64_MAX)
+        return 1;
+    return current_task->pid;
+}
+
+SYSCALL_DEFINE(getppid)
+{
+    return current_task->ppid;
+}
+
+SYSCALL_DEFINE(wait4)
+{
+    return sys_wait4((int64_t)arg1, (int *)arg2, arg3, (struct rusage *)arg4);
+}
+
+SYSCALL_DEFINE(waitid)
+{
+    return sys_waitid((int)arg1, arg2, (struct siginfo *)arg3, arg4, (struct rusage *)arg5);
+}
+
+SYSCALL_DEFINE(getrusage)
+{
+    return sys_getrusage((int)arg1, (struct rusage *)arg2);
+}
 
-    uint64_t arg1 = regs->rdi;
-    uint64_t arg2 = regs->rsi;
-    uint64_t arg3 = regs->rdx;
-    uint64_t arg4 = regs->r10;
-    uint64_t arg5 = regs->r8;
-    uint64_t arg6 = regs->r9;
+SYSCALL_DEFINE(prctl)
+{
+    return sys_prctl(arg1, arg2, arg3, arg4, arg5);
+}
 
-    switch (idx)
+SYSCALL_DEFINE(arch_prctl)
+{
+    return sys_arch_prctl(arg1, arg2);
+}
+
+SYSCALL_DEFINE(brk)
+{
+    return sys_brk(arg1);
+}
+
+SYSCALL_DEFINE(rt_sigprocmask)
+{
+    return sys_ssetmask(arg1, (sigset_t *)arg2, (sigset_t *)arg3);
+}
+
+SYSCALL_DEFINE(getdents64)
+{
+    return sys_getdents(arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(chdir)
+{
+    return sys_chdir((const char *)arg1);
+}
+
+SYSCALL_DEFINE(fchdir)
+{
+    return sys_fchdir(arg1);
+}
+
+SYSCALL_DEFINE(getcwd)
+{
+    return sys_getcwd((char *)arg1, arg2);
+}
+
+SYSCALL_DEFINE(mmap)
+{
+    return sys_mmap(arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+SYSCALL_DEFINE(munmap)
+{
+    return sys_munmap(arg1, arg2);
+}
+
+SYSCALL_DEFINE(clock_gettime)
+{
+    switch (arg1)
     {
-    case SYS_OPEN:
-        regs->rax = sys_open((const char *)arg1, arg2, arg3);
-        break;
-    case SYS_OPENAT:
-        regs->rax = sys_openat(arg1, (const char *)arg2, arg3, arg4);
-        break;
-    case SYS_CLOSE:
-        regs->rax = sys_close(arg1);
-        break;
-    case SYS_LSEEK:
-        regs->rax = sys_lseek(arg1, arg2, arg3);
-        break;
-    case SYS_READ:
-        regs->rax = sys_read(arg1, (void *)arg2, arg3);
-        break;
-    case SYS_WRITE:
-        regs->rax = sys_write(arg1, (const void *)arg2, arg3);
-        break;
-    case SYS_PREAD64:
-        sys_lseek(arg1, arg4, SEEK_SET);
-        regs->rax = sys_read(arg1, (void *)arg2, arg3);
-        break;
-    case SYS_PWRITE64:
-        sys_lseek(arg1, arg4, SEEK_SET);
-        regs->rax = sys_write(arg1, (void *)arg2, arg3);
-        break;
-    case SYS_IOCTL:
-        regs->rax = sys_ioctl(arg1, arg2, arg3);
-        break;
-    case SYS_READV:
-        regs->rax = sys_readv(arg1, (struct iovec *)arg2, arg3);
-        break;
-    case SYS_WRITEV:
-        regs->rax = sys_writev(arg1, (struct iovec *)arg2, arg3);
-        break;
-    case SYS_CLONE:
-        regs->rax = sys_clone(regs, arg1, arg2, (int *)arg3, (int *)arg4, arg5);
-        break;
-    case SYS_FORK:
-        regs->rax = task_fork(regs, false);
-        break;
-    case SYS_VFORK:
-        regs->rax = task_fork(regs, true);
-        break;
-    case SYS_EXECVE:
-        regs->rax = task_execve((const char *)arg1, (const char **)arg2, (const char **)arg3);
-        break;
-    case SYS_EXIT:
-        regs->rax = task_exit((int64_t)arg1);
-        break;
-    case SYS_EXIT_GROUP:
-        regs->rax = task_exit((int64_t)arg1);
-        break;
-    case SYS_GETPID:
-        if (arg1 == UINT64_MAX && arg2 == UINT64_MAX && arg3 == UINT64_MAX && arg4 == UINT64_MAX && arg5 == UINT64_MAX)
-            regs->rax = 1;
-        else
-            regs->rax = current_task->pid;
-        break;
-    case SYS_GETPPID:
-        regs->rax = current_task->ppid;
-        break;
-    case SYS_WAIT4:
-        regs->rax = sys_waitpid(arg1, (int *)arg2, arg3);
-        break;
-    case SYS_PRCTL:
-        regs->rax = sys_prctl(arg1, arg2, arg3, arg4, arg5);
-        break;
-    case SYS_ARCH_PRCTL:
-        regs->rax = sys_arch_prctl(arg1, arg2);
-        break;
-    case SYS_BRK:
-        regs->rax = sys_brk(arg1);
-        break;
-    case SYS_RT_SIGPROCMASK:
-        regs->rax = sys_ssetmask(arg1, (sigset_t *)arg2, (sigset_t *)arg3);
-        break;
-    case SYS_GETDENTS64:
-        regs->rax = sys_getdents(arg1, arg2, arg3);
-        break;
-    case SYS_CHDIR:
-        regs->rax = sys_chdir((const char *)arg1);
-        break;
-    case SYS_FCHDIR:
-        regs->rax = sys_fchdir(arg1);
-        break;
-    case SYS_GETCWD:
-        regs->rax = sys_getcwd((char *)arg1, arg2);
-        break;
-    case SYS_MMAP:
-        regs->rax = sys_mmap(arg1, arg2, arg3, arg4, arg5, arg6);
-        break;
-    case SYS_MPROTECT:
-        regs->rax = 0;
-        break;
-    case SYS_MUNMAP:
-        regs->rax = sys_munmap(arg1, arg2);
-        break;
-    case SYS_MADVISE:
-        regs->rax = 0;
-        break;
-    case SYS_CLOCK_GETTIME:
-        tm time;
-        time_read(&time);
-        uint64_t timestamp = mktime(&time);
-        switch (arg1)
-        {
-        case 1: // <- todo
-        case 6: // CLOCK_MONOTONIC_COARSE
-        case 4: // CLOCK_MONOTONIC_RAW
-        case 0:
-        {
-            if (arg2)
-            {
-                struct timespec *ts = (struct timespec *)arg2;
-                ts->tv_sec = timestamp;
-                ts->tv_nsec = 0;
-            }
-            regs->rax = 0;
-            break;
-        }
-        default:
-            printk("clock not supported\n");
-            regs->rax = (uint64_t)-EINVAL;
-            break;
-        }
-        break;
-    case SYS_GETTIMEOFDAY:
-        tm time_day;
-        time_read(&time_day);
-        uint64_t timestamp_day = mktime(&time_day);
-        if (arg1)
-        {
-            struct timespec *ts = (struct timespec *)arg1;
-            ts->tv_sec = timestamp_day;
-            ts->tv_nsec = 0;
-        }
-        regs->rax = 0;
-        break;
-    case SYS_CLOCK_GETRES:
-        ((struct timespec *)arg2)->tv_nsec = 1000000;
-        regs->rax = 0;
-        break;
-    case SYS_RT_SIGACTION:
-        regs->rax = sys_sigaction(arg1, (sigaction_t *)arg2, (sigaction_t *)arg3);
-        break;
-    case SYS_RT_SIGSUSPEND:
-        regs->rax = sys_sigsuspend((const sigset_t *)arg1);
-        break;
-    case SYS_KILL:
-        regs->rax = sys_kill(arg1, arg2);
-        break;
-    case SYS_RT_SIGRETURN:
-        sys_sigreturn();
-        regs->rax = 0;
-        break;
-    case SYS_FCNTL:
-        regs->rax = sys_fcntl(arg1, arg2, arg3);
-        break;
-    case SYS_SOCKET:
-        regs->rax = sys_socket(arg1, arg2, arg3);
-        break;
-    case SYS_SOCKETPAIR:
-        regs->rax = sys_socketpair(arg1, arg2, arg3, (void *)arg4);
-        break;
-    case SYS_GETSOCKNAME:
-        regs->rax = sys_getsockname(arg1, (struct sockaddr_un *)arg2, (socklen_t *)arg3);
-        break;
-    case SYS_GETPEERNAME:
+    case 0: // CLOCK_REALTIME
+    case 5: // CLOCK_REALTIME_COARSE
+        if (arg2)
+            ns_to_timespec(realtime_nano_time(), (struct timespec *)arg2);
+        return 0;
+    case 1: // CLOCK_MONOTONIC
+    case 4: // CLOCK_MONOTONIC_RAW
+    case 6: // CLOCK_MONOTONIC_COARSE
+    case 7: // CLOCK_BOOTTIME
+        if (arg2)
+            ns_to_timespec(nanoTime(), (struct timespec *)arg2);
+        return 0;
+    default:
+        printk("clock not supported\n");
+        return (uint64_t)-EINVAL;
+    }
+}
+
+SYSCALL_DEFINE(gettimeofday)
+{
+    if (arg1)
     {
-        int fd = arg1;
-        struct sockaddr_un *addr = (struct sockaddr_un *)arg2;
-        socklen_t *addrlen = (socklen_t *)arg3;
-        regs->rax = sys_getpeername(fd, addr, addrlen);
-        break;
+        uint64_t realtime = realtime_nano_time();
+        struct timeval *tv = (struct timeval *)arg1;
+        tv->tv_sec = realtime / 1000000000ULL;
+        tv->tv_usec = (realtime % 1000000000ULL) / 1000;
     }
-    case SYS_BIND:
-        regs->rax = sys_bind(arg1, (const struct sockaddr_un *)arg2, arg3);
-        break;
-    case SYS_LISTEN:
-        regs->rax = sys_listen(arg1, arg2);
-        break;
-    case SYS_ACCEPT:
-        regs->rax = sys_accept(arg1, (struct sockaddr_un *)arg2, (socklen_t *)arg3);
-        break;
-    case SYS_CONNECT:
-        regs->rax = sys_connect(arg1, (const struct sockaddr_un *)arg2, arg3);
-        break;
-    case SYS_SENDTO:
-        regs->rax = sys_send(arg1, (const void *)arg2, arg3, arg4, (struct sockaddr_un *)arg5, (socklen_t)arg6);
-        break;
-    case SYS_RECVFROM:
-        regs->rax = sys_recv(arg1, (void *)arg2, arg3, arg4, (struct sockaddr_un *)arg5, (socklen_t *)arg6);
-        break;
-    case SYS_SENDMSG:
-        regs->rax = sys_sendmsg(arg1, (const struct msghdr *)arg2, arg3);
-        break;
-    case SYS_RECVMSG:
-        regs->rax = sys_recvmsg(arg1, (struct msghdr *)arg2, arg3);
-        break;
-    case SYS_SHUTDOWN:
-        regs->rax = sys_shutdown(arg1, arg2);
-        break;
-    case SYS_SET_TID_ADDRESS:
-        regs->rax = current_task->pid;
-        break;
-    case SYS_POLL:
-        regs->rax = sys_poll((struct pollfd *)arg1, arg2, arg3);
-        break;
-    case SYS_SIGALTSTACK:
-        regs->rax = 0;
-        break;
-    case SYS_GETTID:
-        regs->rax = current_task->pid;
-        break;
-    case SYS_FUTEX:
-        regs->rax = sys_futex((int *)arg1, arg2, arg3, (const struct timespec *)arg4, (int *)arg5, arg6);
-        break;
-    case SYS_PIPE:
-        regs->rax = sys_pipe((int *)arg1);
-        break;
-    case SYS_PIPE2:
-        // todo: support flags
-        regs->rax = sys_pipe((int *)arg1);
-        break;
-    case SYS_STAT:
-        regs->rax = sys_stat((const char *)arg1, (struct stat *)arg2);
-        break;
-    case SYS_LSTAT:
-        regs->rax = sys_stat((const char *)arg1, (struct stat *)arg2);
-        break;
-    case SYS_STATFS:
-        regs->rax = 0;
-        break;
-    case SYS_FSTATFS:
-        regs->rax = 0;
-        break;
-    case SYS_FSTAT:
-        regs->rax = sys_fstat(arg1, (struct stat *)arg2);
-        break;
-    case SYS_NEWFSTATAT:
-        regs->rax = sys_newfstatat(arg1, (const char *)arg2, (struct stat *)arg3, arg4);
-        break;
-    case SYS_STATX:
-        regs->rax = sys_statx(arg1, (const char *)arg2, arg3, arg4, (struct statx *)arg5);
-        break;
-    case SYS_SYSINFO:
-        break;
-    case SYS_UNAME:
-        struct utsname *utsname = (struct utsname *)arg1;
-        memcpy(utsname->sysname, sysname, sizeof(sysname));
-        memcpy(utsname->nodename, nodename, sizeof(nodename));
-        memcpy(utsname->release, release, sizeof(release));
-        memcpy(utsname->version, version, sizeof(version));
-        memcpy(utsname->machine, machine, sizeof(machine));
-        regs->rax = 0;
-        break;
-    case SYS_GETUID:
-        regs->rax = current_task->uid;
-        break;
-    case SYS_GETGID:
-        regs->rax = current_task->gid;
-        break;
-    case SYS_GETEUID:
-        regs->rax = current_task->euid;
-        break;
-    case SYS_GETEGID:
-        regs->rax = current_task->egid;
-        break;
-    case SYS_SETPGID:
-        if (!arg1)
-        {
-            current_task->pgid = (int64_t)arg2;
-        }
-        else
-        {
-            if (tasks[arg1] == NULL)
-            {
-                regs->rax = (uint64_t)-ENOENT;
-                break;
-            }
-            tasks[arg1]->pgid = arg2;
-        }
-        regs->rax = 0;
-        break;
-    case SYS_GETPGID:
-        regs->rax = current_task->pgid;
-        break;
-    case SYS_SETUID:
-        current_task->uid = arg1;
-        regs->rax = 0;
-        break;
-    case SYS_SETGID:
-        current_task->gid = arg1;
-        regs->rax = 0;
-        break;
-    case SYS_DUP:
-        regs->rax = sys_dup(arg1);
-        break;
-    case SYS_DUP2:
-        regs->rax = sys_dup2(arg1, arg2);
-        break;
-    case SYS_GETRLIMIT:
-        regs->rax = sys_get_rlimit(arg1, (struct rlimit *)arg2);
-        break;
-    case SYS_PRLIMIT64:
-        regs->rax = sys_prlimit64(arg1, arg2, (struct rlimit *)arg3, (struct rlimit *)arg4);
-        break;
-    case SYS_ACCESS:
-        regs->rax = sys_access((char *)arg1, arg2);
-        break;
-    case SYS_FACCESSAT:
-        regs->rax = sys_faccessat(arg1, (const char *)arg2, arg3);
-        break;
-    case SYS_FACCESSAT2:
-        regs->rax = sys_faccessat2(arg1, (const char *)arg2, arg3, arg4);
-        break;
-    case SYS_SELECT:
-        regs->rax = sys_select(arg1, (uint8_t *)arg2, (uint8_t *)arg3, (uint8_t *)arg4, (struct timeval *)arg5);
-        break;
-    case SYS_PSELECT6:
-        regs->rax = sys_pselect6(arg1, (fd_set *)arg2, (fd_set *)arg3, (fd_set *)arg4, (struct timespec *)arg5, (WeirdPselect6 *)arg6);
-        break;
-    case SYS_READLINK:
-        regs->rax = sys_readlink((char *)arg1, (char *)arg2, arg3);
-        break;
-    case SYS_READLINKAT:
-        regs->rax = sys_readlinkat(arg1, (char *)arg2, (char *)arg3, arg4);
-        break;
-    case SYS_RENAME:
-        regs->rax = sys_rename((const char *)arg1, (const char *)arg2);
-        break;
-    case SYS_UNLINK:
-        regs->rax = sys_unlink((const char *)arg1);
-        break;
-    case SYS_UNLINKAT:
-        regs->rax = sys_unlinkat(arg1, (const char *)arg2, arg3);
-        break;
-    case SYS_MOUNT:
-        regs->rax = sys_mount((char *)arg1, (char *)arg2, (char *)arg3, arg4, (void *)arg5);
-        break;
-    case SYS_NANOSLEEP:
-        regs->rax = sys_nanosleep((struct timespec *)arg1, (struct timespec *)arg2);
-        break;
-    case SYS_EPOLL_CREATE1:
-        regs->rax = sys_epoll_create1(arg1);
-        break;
-    case SYS_EPOLL_CREATE:
-        regs->rax = sys_epoll_create(arg1);
-        break;
-    case SYS_EPOLL_CTL:
-        regs->rax = sys_epoll_ctl(arg1, arg2, arg3, (struct epoll_event *)arg4);
-        break;
-    case SYS_EPOLL_PWAIT:
-        regs->rax = sys_epoll_pwait(arg1, (struct epoll_event *)arg2, arg3, arg4, (sigset_t *)arg5, arg6);
-        break;
-    case SYS_EPOLL_WAIT:
-        regs->rax = sys_epoll_wait(arg1, (struct epoll_event *)arg2, arg3, arg4);
-        break;
-    case SYS_LINK:
-        regs->rax = sys_link((const char *)arg1, (const char *)arg2);
-        break;
-    case SYS_EVENTFD2:
-        regs->rax = sys_eventfd2(arg1, arg2);
-        break;
-    case SYS_SIGNALFD:
-        regs->rax = sys_signalfd(arg1, (const sigset_t *)arg2, arg3);
-        break;
-    case SYS_SIGNALFD4:
-        regs->rax = sys_signalfd4(arg1, (const sigset_t *)arg2, arg3, arg4);
-        break;
-    case SYS_TIMER_CREATE:
-        regs->rax = sys_timer_create((clockid_t)arg1, (struct sigevent *)arg2, (timer_t *)arg3);
-        break;
-    case SYS_TIMER_SETTIME:
-        regs->rax = sys_timer_settime((timer_t)arg1, (const struct itimerval *)arg2, (struct itimerval *)arg3);
-        break;
-    case SYS_TIMERFD_CREATE:
-        regs->rax = sys_timerfd_create(arg1, arg2);
-        break;
-    case SYS_TIMERFD_SETTIME:
-        regs->rax = sys_timerfd_settime(arg1, arg2, (const struct itimerval *)arg3, (struct itimerval *)arg4);
-        break;
-    case SYS_FLOCK:
-        regs->rax = sys_flock(arg1, arg2);
-        break;
-    case SYS_SETFSUID:
-        regs->rax = 0;
-        break;
-    case SYS_SETFSGID:
-        regs->rax = 0;
-        break;
-    case SYS_SETSOCKOPT:
-        regs->rax = sys_setsockopt(arg1, arg2, arg3, (const void *)arg4, arg5);
-        break;
-    case SYS_GETSOCKOPT:
-        regs->rax = sys_getsockopt(arg1, arg2, arg3, (void *)arg4, (socklen_t *)arg5);
-        break;
-    case SYS_SETRESUID:
-        regs->rax = 0;
-        break;
-    case SYS_GETRESUID:
-        regs->rax = 0;
-        break;
-    case SYS_SETITIMER:
-        regs->rax = sys_setitimer(arg1, (struct itimerval *)arg2, (struct itimerval *)arg3);
-        break;
-    case SYS_CHOWN:
-        regs->rax = 0;
-        break;
-    case SYS_FCHOWN:
-        regs->rax = 0;
-        break;
-    case SYS_CHMOD:
-        regs->rax = 0;
-        break;
-    case SYS_FCHMOD:
-        regs->rax = 0;
-        break;
-    case SYS_UMASK:
-        regs->rax = 0;
-        break;
-    case SYS_MKDIR:
-        regs->rax = sys_mkdir((const char *)arg1, arg2);
-        break;
-    case SYS_RMDIR:
-        regs->rax = sys_unlink((const char *)arg1);
-        break;
-    case SYS_SETPRIORITY:
-        regs->rax = 0;
-        break;
-    case SYS_MEMBARRIER:
-        regs->rax = 0;
-        break;
-    case SYS_SETSID:
-        regs->rax = 0;
-        break;
-    case SYS_SET_ROBUST_LIST:
-        regs->rax = 0;
-        break;
-    case SYS_RSEQ:
-        regs->rax = 0;
-        break;
-    case SYS_SCHED_GETAFFINITY:
-        regs->rax = 0;
-        break;
-    case SYS_GETRANDOM:
-        void *buffer = (void *)arg1;
-        size_t get_len = (size_t)arg2;
-        uint32_t flags = (uint32_t)arg3;
-
-        if (get_len == 0 || get_len > 1024 * 1024)
-        {
-            regs->rax = (uint64_t)-EINVAL;
-            break;
-        }
-
-        for (size_t i = 0; i < get_len; i++)
-        {
-            tm time;
-            time_read(&time);
-            uint64_t next = mktime(&time);
-            next = next * 1103515245 + 12345;
-            uint8_t rand_byte = ((uint8_t)(next / 65536) % 32768);
-            memcpy(buffer + i, &rand_byte, 1);
-        }
-
-        regs->rax = get_len;
-        break;
+    return 0;
+}
 
-    default:
-        regs->rax = (uint64_t)-ENOSYS;
-        break;
+SYSCALL_DEFINE(time)
+{
+    uint64_t sec = realtime_nano_time() / 1000000000ULL;
+    if (arg1)
+        *(int64_t *)arg1 = sec;
+    return sec;
+}
+
+SYSCALL_DEFINE(clock_getres)
+{
+    if (arg2)
+    {
+        ((struct timespec *)arg2)->tv_sec = 0;
+        ((struct timespec *)arg2)->tv_nsec = 1;
+    }
+    return 0;
+}
+
+SYSCALL_DEFINE(getcpu)
+{
+    if (arg1)
+        *(uint32_t *)arg1 = current_cpu_id;
+    if (arg2)
+        *(uint32_t *)arg2 = 0;
+    return 0;
+}
+
+SYSCALL_DEFINE(rt_sigaction)
+{
+    return sys_sigaction(arg1, (sigaction_t *)arg2, (sigaction_t *)arg3);
+}
+
+SYSCALL_DEFINE(rt_sigsuspend)
+{
+    return sys_sigsuspend((const sigset_t *)arg1);
+}
+
+SYSCALL_DEFINE(kill)
+{
+    return sys_kill(arg1, arg2);
+}
+
+SYSCALL_DEFINE(rt_sigreturn)
+{
+    sys_sigreturn();
+    return 0;
+}
+
+SYSCALL_DEFINE(fcntl)
+{
+    return sys_fcntl(arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(socket)
+{
+    return sys_socket(arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(socketpair)
+{
+    return sys_socketpair(arg1, arg2, arg3, (void *)arg4);
+}
+
+SYSCALL_DEFINE(getsockname)
+{
+    return sys_getsockname(arg1, (struct sockaddr_un *)arg2, (socklen_t *)arg3);
+}
+
+SYSCALL_DEFINE(getpeername)
+{
+    return sys_getpeername(arg1, (struct sockaddr_un *)arg2, (socklen_t *)arg3);
+}
+
+SYSCALL_DEFINE(bind)
+{
+    return sys_bind(arg1, (const struct sockaddr_un *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(listen)
+{
+    return sys_listen(arg1, arg2);
+}
+
+SYSCALL_DEFINE(accept)
+{
+    return sys_accept(arg1, (struct sockaddr_un *)arg2, (socklen_t *)arg3);
+}
+
+SYSCALL_DEFINE(connect)
+{
+    return sys_connect(arg1, (const struct sockaddr_un *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(sendto)
+{
+    return sys_send(arg1, (const void *)arg2, arg3, arg4, (struct sockaddr_un *)arg5, (socklen_t)arg6);
+}
+
+SYSCALL_DEFINE(recvfrom)
+{
+    return sys_recv(arg1, (void *)arg2, arg3, arg4, (struct sockaddr_un *)arg5, (socklen_t *)arg6);
+}
+
+SYSCALL_DEFINE(sendmsg)
+{
+    return sys_sendmsg(arg1, (const struct msghdr *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(recvmsg)
+{
+    return sys_recvmsg(arg1, (struct msghdr *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(shutdown)
+{
+    return sys_shutdown(arg1, arg2);
+}
+
+SYSCALL_DEFINE(set_tid_address)
+{
+    return current_task->pid;
+}
+
+SYSCALL_DEFINE(poll)
+{
+    return sys_poll((struct pollfd *)arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(gettid)
+{
+    return current_task->pid;
+}
+
+SYSCALL_DEFINE(futex)
+{
+    return sys_futex((int *)arg1, arg2, arg3, (const struct timespec *)arg4, (int *)arg5, arg6);
+}
+
+SYSCALL_DEFINE(pipe)
+{
+    return sys_pipe((int *)arg1);
+}
+
+SYSCALL_DEFINE(pipe2)
+{
+    // todo: support flags
+    return sys_pipe((int *)arg1);
+}
+
+SYSCALL_DEFINE(stat)
+{
+    return sys_stat((const char *)arg1, (struct stat *)arg2);
+}
+
+SYSCALL_DEFINE(lstat)
+{
+    return sys_stat((const char *)arg1, (struct stat *)arg2);
+}
+
+SYSCALL_DEFINE(fstat)
+{
+    return sys_fstat(arg1, (struct stat *)arg2);
+}
+
+SYSCALL_DEFINE(newfstatat)
+{
+    return sys_newfstatat(arg1, (const char *)arg2, (struct stat *)arg3, arg4);
+}
+
+SYSCALL_DEFINE(statx)
+{
+    return sys_statx(arg1, (const char *)arg2, arg3, arg4, (struct statx *)arg5);
+}
+
+SYSCALL_DEFINE(sysinfo)
+{
+    return 0;
+}
+
+SYSCALL_DEFINE(uname)
+{
+    struct utsname *utsname = (struct utsname *)arg1;
+    memcpy(utsname->sysname, sysname, sizeof(sysname));
+    memcpy(utsname->nodename, nodename, sizeof(nodename));
+    memcpy(utsname->release, release, sizeof(release));
+    memcpy(utsname->version, version, sizeof(version));
+    memcpy(utsname->machine, machine, sizeof(machine));
+    return 0;
+}
+
+SYSCALL_DEFINE(getuid)
+{
+    return current_task->uid;
+}
+
+SYSCALL_DEFINE(getgid)
+{
+    return current_task->gid;
+}
+
+SYSCALL_DEFINE(geteuid)
+{
+    return current_task->euid;
+}
+
+SYSCALL_DEFINE(getegid)
+{
+    return current_task->egid;
+}
+
+SYSCALL_DEFINE(setpgid)
+{
+    if (!arg1)
+    {
+        current_task->pgid = (int64_t)arg2;
+    }
+    else
+    {
+        rcu_read_lock();
+        task_t *task = task_find_by_pid(arg1);
+        if (task)
+            task->pgid = arg2;
+        rcu_read_unlock();
+        if (task == NULL)
+            return (uint64_t)-ENOENT;
     }
+    return 0;
+}
+
+SYSCALL_DEFINE(getpgid)
+{
+    return current_task->pgid;
+}
+
+SYSCALL_DEFINE(setuid)
+{
+    current_task->uid = arg1;
+    return 0;
+}
+
+SYSCALL_DEFINE(setgid)
+{
+    current_task->gid = arg1;
+    return 0;
+}
+
+SYSCALL_DEFINE(dup)
+{
+    return sys_dup(arg1);
+}
+
+SYSCALL_DEFINE(dup2)
+{
+    return sys_dup2(arg1, arg2);
+}
+
+SYSCALL_DEFINE(getrlimit)
+{
+    return sys_get_rlimit(arg1, (struct rlimit *)arg2);
+}
+
+SYSCALL_DEFINE(prlimit64)
+{
+    return sys_prlimit64(arg1, arg2, (struct rlimit *)arg3, (struct rlimit *)arg4);
+}
+
+SYSCALL_DEFINE(access)
+{
+    return sys_access((char *)arg1, arg2);
+}
+
+SYSCALL_DEFINE(faccessat)
+{
+    return sys_faccessat(arg1, (const char *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(faccessat2)
+{
+    return sys_faccessat2(arg1, (const char *)arg2, arg3, arg4);
+}
+
+SYSCALL_DEFINE(select)
+{
+    return sys_select(arg1, (uint8_t *)arg2, (uint8_t *)arg3, (uint8_t *)arg4, (struct timeval *)arg5);
+}
+
+SYSCALL_DEFINE(pselect6)
+{
+    return sys_pselect6(arg1, (fd_set *)arg2, (fd_set *)arg3, (fd_set *)arg4, (struct timespec *)arg5, (WeirdPselect6 *)arg6);
+}
+
+SYSCALL_DEFINE(readlink)
+{
+    return sys_readlink((char *)arg1, (char *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(readlinkat)
+{
+    return sys_readlinkat(arg1, (char *)arg2, (char *)arg3, arg4);
+}
+
+SYSCALL_DEFINE(rename)
+{
+    return sys_rename((const char *)arg1, (const char *)arg2);
+}
+
+SYSCALL_DEFINE(unlink)
+{
+    return sys_unlink((const char *)arg1);
+}
+
+SYSCALL_DEFINE(unlinkat)
+{
+    return sys_unlinkat(arg1, (const char *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(mount)
+{
+    return sys_mount((char *)arg1, (char *)arg2, (char *)arg3, arg4, (void *)arg5);
+}
+
+SYSCALL_DEFINE(nanosleep)
+{
+    return sys_nanosleep((struct timespec *)arg1, (struct timespec *)arg2);
+}
+
+SYSCALL_DEFINE(epoll_create1)
+{
+    return sys_epoll_create1(arg1);
+}
+
+SYSCALL_DEFINE(epoll_create)
+{
+    return sys_epoll_create(arg1);
+}
 
-    if (regs->rax == (uint64_t)-ENOSYS)
+SYSCALL_DEFINE(epoll_ctl)
+{
+    return sys_epoll_ctl(arg1, arg2, arg3, (struct epoll_event *)arg4);
+}
+
+SYSCALL_DEFINE(epoll_pwait)
+{
+    return sys_epoll_pwait(arg1, (struct epoll_event *)arg2, arg3, arg4, (sigset_t *)arg5, arg6);
+}
+
+SYSCALL_DEFINE(epoll_wait)
+{
+    return sys_epoll_wait(arg1, (struct epoll_event *)arg2, arg3, arg4);
+}
+
+SYSCALL_DEFINE(link)
+{
+    return sys_link((const char *)arg1, (const char *)arg2);
+}
+
+SYSCALL_DEFINE(eventfd2)
+{
+    return sys_eventfd2(arg1, arg2);
+}
+
+SYSCALL_DEFINE(signalfd)
+{
+    return sys_signalfd(arg1, (const sigset_t *)arg2, arg3);
+}
+
+SYSCALL_DEFINE(signalfd4)
+{
+    return sys_signalfd4(arg1, (const sigset_t *)arg2, arg3, arg4);
+}
+
+SYSCALL_DEFINE(timer_create)
+{
+    return sys_timer_create((clockid_t)arg1, (struct sigevent *)arg2, (timer_t *)arg3);
+}
+
+SYSCALL_DEFINE(timer_settime)
+{
+    return sys_timer_settime((timer_t)arg1, arg2, (const struct itimerspec *)arg3, (struct itimerspec *)arg4);
+}
+
+SYSCALL_DEFINE(timerfd_create)
+{
+    return sys_timerfd_create(arg1, arg2);
+}
+
+SYSCALL_DEFINE(timerfd_settime)
+{
+    return sys_timerfd_settime(arg1, arg2, (const struct itimerspec *)arg3, (struct itimerspec *)arg4);
+}
+
+SYSCALL_DEFINE(flock)
+{
+    return sys_flock(arg1, arg2);
+}
+
+SYSCALL_DEFINE(setsockopt)
+{
+    return sys_setsockopt(arg1, arg2, arg3, (const void *)arg4, arg5);
+}
+
+SYSCALL_DEFINE(getsockopt)
+{
+    return sys_getsockopt(arg1, arg2, arg3, (void *)arg4, (socklen_t *)arg5);
+}
+
+SYSCALL_DEFINE(setitimer)
+{
+    return sys_setitimer(arg1, (struct itimerval *)arg2, (struct itimerval *)arg3);
+}
+
+SYSCALL_DEFINE(mkdir)
+{
+    return sys_mkdir((const char *)arg1, arg2);
+}
+
+SYSCALL_DEFINE(rmdir)
+{
+    return sys_unlink((const char *)arg1);
+}
+
+SYSCALL_DEFINE(getrandom)
+{
+    void *buffer = (void *)arg1;
+    size_t get_len = (size_t)arg2;
+    uint32_t flags = (uint32_t)arg3;
+
+    if (get_len == 0 || get_len > 1024 * 1024)
+        return (uint64_t)-EINVAL;
+
+    for (size_t i = 0; i < get_len; i++)
+    {
+        tm time;
+        time_read(&time);
+        uint64_t next = mktime(&time);
+        next = next * 1103515245 + 12345;
+        uint8_t rand_byte = ((uint8_t)(next / 65536) % 32768);
+        memcpy(buffer + i, &rand_byte, 1);
+    }
+
+    return get_len;
+}
+
+SYSCALL_DEFINE(setpriority)
+{
+    return sys_setpriority(arg1, arg2, arg3);
+}
+
+SYSCALL_DEFINE(getpriority)
+{
+    return sys_getpriority(arg1, arg2);
+}
+
+SYSCALL_DEFINE(sched_setscheduler)
+{
+    return sys_sched_setscheduler(arg1, arg2, (const struct sched_param *)arg3);
+}
+
+SYSCALL_DEFINE(sched_getscheduler)
+{
+    return sys_sched_getscheduler(arg1);
+}
+
+SYSCALL_DEFINE(sched_setparam)
+{
+    return sys_sched_setparam(arg1, (const struct sched_param *)arg2);
+}
+
+SYSCALL_DEFINE(sched_getparam)
+{
+    return sys_sched_getparam(arg1, (struct sched_param *)arg2);
+}
+
+SYSCALL_DEFINE(sched_get_priority_max)
+{
+    return sys_sched_get_priority_max(arg1);
+}
+
+SYSCALL_DEFINE(sched_get_priority_min)
+{
+    return sys_sched_get_priority_min(arg1);
+}
+
+SYSCALL_DEFINE(umask)
+{
+    return sys_umask(arg1);
+}
+
+SYSCALL_DEFINE(unshare)
+{
+    return sys_unshare(arg1);
+}
+
+// 按系统调用号索引, 未实现的项为 NULL
+static const syscall_handler_t syscall_table[MAX_SYSCALL_NUM] = {
+    [SYS_OPEN] = syscall_open,
+    [SYS_OPENAT] = syscall_openat,
+    [SYS_CLOSE] = syscall_close,
+    [SYS_LSEEK] = syscall_lseek,
+    [SYS_READ] = syscall_read,
+    [SYS_WRITE] = syscall_write,
+    [SYS_PREAD64] = syscall_pread64,
+    [SYS_PWRITE64] = syscall_pwrite64,
+    [SYS_IOCTL] = syscall_ioctl,
+    [SYS_READV] = syscall_readv,
+    [SYS_WRITEV] = syscall_writev,
+    [SYS_CLONE] = syscall_clone,
+    [SYS_FORK] = syscall_fork,
+    [SYS_VFORK] = syscall_vfork,
+    [SYS_EXECVE] = syscall_execve,
+    [SYS_SPAWN] = syscall_spawn,
+    [SYS_EXIT] = syscall_exit,
+    [SYS_EXIT_GROUP] = syscall_exit_group,
+    [SYS_GETPID] = syscall_getpid,
+    [SYS_GETPPID] = syscall_getppid,
+    [SYS_WAIT4] = syscall_wait4,
+    [SYS_WAITID] = syscall_waitid,
+    [SYS_GETRUSAGE] = syscall_getrusage,
+    [SYS_PRCTL] = syscall_prctl,
+    [SYS_ARCH_PRCTL] = syscall_arch_prctl,
+    [SYS_BRK] = syscall_brk,
+    [SYS_RT_SIGPROCMASK] = syscall_rt_sigprocmask,
+    [SYS_GETDENTS64] = syscall_getdents64,
+    [SYS_CHDIR] = syscall_chdir,
+    [SYS_FCHDIR] = syscall_fchdir,
+    [SYS_GETCWD] = syscall_getcwd,
+    [SYS_MMAP] = syscall_mmap,
+    [SYS_MPROTECT] = syscall_nop,
+    [SYS_MUNMAP] = syscall_munmap,
+    [SYS_MADVISE] = syscall_nop,
+    [SYS_CLOCK_GETTIME] = syscall_clock_gettime,
+    [SYS_GETTIMEOFDAY] = syscall_gettimeofday,
+    [SYS_TIME] = syscall_time,
+    [SYS_CLOCK_GETRES] = syscall_clock_getres,
+    [SYS_GETCPU] = syscall_getcpu,
+    [SYS_RT_SIGACTION] = syscall_rt_sigaction,
+    [SYS_RT_SIGSUSPEND] = syscall_rt_sigsuspend,
+    [SYS_KILL] = syscall_kill,
+    [SYS_RT_SIGRETURN] = syscall_rt_sigreturn,
+    [SYS_FCNTL] = syscall_fcntl,
+    [SYS_SOCKET] = syscall_socket,
+    [SYS_SOCKETPAIR] = syscall_socketpair,
+    [SYS_GETSOCKNAME] = syscall_getsockname,
+    [SYS_GETPEERNAME] = syscall_getpeername,
+    [SYS_BIND] = syscall_bind,
+    [SYS_LISTEN] = syscall_listen,
+    [SYS_ACCEPT] = syscall_accept,
+    [SYS_CONNECT] = syscall_connect,
+    [SYS_SENDTO] = syscall_sendto,
+    [SYS_RECVFROM] = syscall_recvfrom,
+    [SYS_SENDMSG] = syscall_sendmsg,
+    [SYS_RECVMSG] = syscall_recvmsg,
+    [SYS_SHUTDOWN] = syscall_shutdown,
+    [SYS_SET_TID_ADDRESS] = syscall_set_tid_address,
+    [SYS_POLL] = syscall_poll,
+    [SYS_SIGALTSTACK] = syscall_nop,
+    [SYS_GETTID] = syscall_gettid,
+    [SYS_FUTEX] = syscall_futex,
+    [SYS_PIPE] = syscall_pipe,
+    [SYS_PIPE2] = syscall_pipe2,
+    [SYS_STAT] = syscall_stat,
+    [SYS_LSTAT] = syscall_lstat,
+    [SYS_STATFS] = syscall_nop,
+    [SYS_FSTATFS] = syscall_nop,
+    [SYS_FSTAT] = syscall_fstat,
+    [SYS_NEWFSTATAT] = syscall_newfstatat,
+    [SYS_STATX] = syscall_statx,
+    [SYS_SYSINFO] = syscall_sysinfo,
+    [SYS_UNAME] = syscall_uname,
+    [SYS_GETUID] = syscall_getuid,
+    [SYS_GETGID] = syscall_getgid,
+    [SYS_GETEUID] = syscall_geteuid,
+    [SYS_GETEGID] = syscall_getegid,
+    [SYS_SETPGID] = syscall_setpgid,
+    [SYS_GETPGID] = syscall_getpgid,
+    [SYS_SETUID] = syscall_setuid,
+    [SYS_SETGID] = syscall_setgid,
+    [SYS_DUP] = syscall_dup,
+    [SYS_DUP2] = syscall_dup2,
+    [SYS_GETRLIMIT] = syscall_getrlimit,
+    [SYS_PRLIMIT64] = syscall_prlimit64,
+    [SYS_ACCESS] = syscall_access,
+    [SYS_FACCESSAT] = syscall_faccessat,
+    [SYS_FACCESSAT2] = syscall_faccessat2,
+    [SYS_SELECT] = syscall_select,
+    [SYS_PSELECT6] = syscall_pselect6,
+    [SYS_READLINK] = syscall_readlink,
+    [SYS_READLINKAT] = syscall_readlinkat,
+    [SYS_RENAME] = syscall_rename,
+    [SYS_UNLINK] = syscall_unlink,
+    [SYS_UNLINKAT] = syscall_unlinkat,
+    [SYS_MOUNT] = syscall_mount,
+    [SYS_NANOSLEEP] = syscall_nanosleep,
+    [SYS_EPOLL_CREATE1] = syscall_epoll_create1,
+    [SYS_EPOLL_CREATE] = syscall_epoll_create,
+    [SYS_EPOLL_CTL] = syscall_epoll_ctl,
+    [SYS_EPOLL_PWAIT] = syscall_epoll_pwait,
+    [SYS_EPOLL_WAIT] = syscall_epoll_wait,
+    [SYS_LINK] = syscall_link,
+    [SYS_EVENTFD2] = syscall_eventfd2,
+    [SYS_SIGNALFD] = syscall_signalfd,
+    [SYS_SIGNALFD4] = syscall_signalfd4,
+    [SYS_TIMER_CREATE] = syscall_timer_create,
+    [SYS_TIMER_SETTIME] = syscall_timer_settime,
+    [SYS_TIMERFD_CREATE] = syscall_timerfd_create,
+    [SYS_TIMERFD_SETTIME] = syscall_timerfd_settime,
+    [SYS_FLOCK] = syscall_flock,
+    [SYS_SETFSUID] = syscall_nop,
+    [SYS_SETFSGID] = syscall_nop,
+    [SYS_SETSOCKOPT] = syscall_setsockopt,
+    [SYS_GETSOCKOPT] = syscall_getsockopt,
+    [SYS_SETRESUID] = syscall_nop,
+    [SYS_GETRESUID] = syscall_nop,
+    [SYS_SETITIMER] = syscall_setitimer,
+    [SYS_CHOWN] = syscall_nop,
+    [SYS_FCHOWN] = syscall_nop,
+    [SYS_CHMOD] = syscall_nop,
+    [SYS_FCHMOD] = syscall_nop,
+    [SYS_UMASK] = syscall_umask,
+    [SYS_MKDIR] = syscall_mkdir,
+    [SYS_RMDIR] = syscall_rmdir,
+    [SYS_SETPRIORITY] = syscall_setpriority,
+    [SYS_GETPRIORITY] = syscall_getpriority,
+    [SYS_SCHED_SETSCHEDULER] = syscall_sched_setscheduler,
+    [SYS_SCHED_GETSCHEDULER] = syscall_sched_getscheduler,
+    [SYS_SCHED_SETPARAM] = syscall_sched_setparam,
+    [SYS_SCHED_GETPARAM] = syscall_sched_getparam,
+    [SYS_SCHED_GET_PRIORITY_MAX] = syscall_sched_get_priority_max,
+    [SYS_SCHED_GET_PRIORITY_MIN] = syscall_sched_get_priority_min,
+    [SYS_UNSHARE] = syscall_unshare,
+    [SYS_MEMBARRIER] = syscall_nop,
+    [SYS_SETSID] = syscall_nop,
+    [SYS_SET_ROBUST_LIST] = syscall_nop,
+    [SYS_RSEQ] = syscall_nop,
+    [SYS_SCHED_GETAFFINITY] = syscall_nop,
+    [SYS_GETRANDOM] = syscall_getrandom,
+};
+
+void syscall_handler(struct pt_regs *regs)
+{
+    uint64_t idx = regs->rax & 0xFFFFFFFF;
+
+    syscall_handler_t handler = idx < MAX_SYSCALL_NUM ? syscall_table[idx] : NULL;
+    if (!handler)
     {
         char buf[32];
         int len = sprintf(buf, "syscall %d not implemented\n", idx);
         serial_printk(buf, len);
+
+        regs->rax = (uint64_t)-ENOSYS;
+        return;
     }
+
+    regs->rax = handler(regs, regs->rdi, regs->rsi, regs->rdx, regs->r10, regs->r8, regs->r9);
 }
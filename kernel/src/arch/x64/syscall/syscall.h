@@ -21,6 +21,16 @@ struct utsname
 #define MSR_LSTAR 0xC0000082        // LSTAR MSR寄存器
 #define MSR_SYSCALL_MASK 0xC0000084 // SYSCALL_MASK MSR寄存器
 
+#define MAX_SYSCALL_NUM 512
+
+struct pt_regs;
+
+typedef uint64_t (*syscall_handler_t)(struct pt_regs *regs, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6);
+
+#define SYSCALL_DEFINE(name) static uint64_t syscall_##name(struct pt_regs *regs, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6)
+
 extern void syscall_exception();
 
+void syscall_handler(struct pt_regs *regs);
+
 void syscall_init();
@@ -9,14 +9,13 @@ void arch_context_init(arch_context_t *context, uint64_t page_table_addr, uint64
 
     if (!context->fpu_ctx)
     {
-        context->fpu_ctx = alloc_frames_bytes(sizeof(fpu_context_t));
-        memset(context->fpu_ctx, 0, sizeof(fpu_context_t));
-        context->fpu_ctx->mxscr = 0x1f80;
-        context->fpu_ctx->fcw = 0x037f;
+        context->fpu_ctx = fpu_alloc_state();
     }
+    context->fpu_cpu = -1;
     context->mm = malloc(sizeof(task_mm_info_t));
     context->mm->page_table_addr = page_table_addr;
     context->mm->ref_count = 1;
+    context->mm->cpu_mask = 0;
     context->ctx = (struct pt_regs *)stack - 1;
     context->ctx->rip = entry;
     context->ctx->rsp = stack;
@@ -47,17 +46,27 @@ void arch_context_init(arch_context_t *context, uint64_t page_table_addr, uint64
 
 void arch_context_copy(arch_context_t *dst, arch_context_t *src, uint64_t stack, uint64_t clone_flags)
 {
-    dst->mm = clone_page_table(src->mm, clone_flags);
+    if (clone_flags & CLONE_VM)
+    {
+        // 线程直接共享地址空间, 与地址空间大小无关
+        __atomic_add_fetch(&src->mm->ref_count, 1, __ATOMIC_SEQ_CST);
+        dst->mm = src->mm;
+    }
+    else
+    {
+        dst->mm = clone_page_table(src->mm, clone_flags);
+    }
     dst->ctx = (struct pt_regs *)stack - 1;
     memcpy(dst->ctx, src->ctx, sizeof(struct pt_regs));
     dst->ctx->ds = SELECTOR_USER_DS;
     dst->ctx->es = SELECTOR_USER_DS;
     dst->ctx->rax = 0;
-    dst->fpu_ctx = alloc_frames_bytes(sizeof(fpu_context_t));
-    memset(dst->fpu_ctx, 0, sizeof(fpu_context_t));
+    dst->fpu_ctx = fpu_alloc_state();
+    dst->fpu_cpu = -1;
     if (src->fpu_ctx)
     {
-        memcpy(dst->fpu_ctx, src->fpu_ctx, sizeof(fpu_context_t));
+        fpu_flush(src);
+        memcpy(dst->fpu_ctx, src->fpu_ctx, fpu_xstate_size);
         dst->fpu_ctx->mxscr = 0x1f80;
         dst->fpu_ctx->fcw = 0x037f;
     }
@@ -69,23 +78,67 @@ void arch_context_copy(arch_context_t *dst, arch_context_t *src, uint64_t stack,
 
 void arch_context_free(arch_context_t *context)
 {
+    // 退出的任务不会再访问用户地址, 切换时不会再经过 arch_switch_mm 清除本 CPU
+    __atomic_fetch_and(&context->mm->cpu_mask, ~(1UL << current_cpu_id), __ATOMIC_SEQ_CST);
+
     if (context->fpu_ctx)
     {
-        free_frames_bytes(context->fpu_ctx, sizeof(fpu_context_t));
+        fpu_release(context);
+        fpu_free_state(context->fpu_ctx);
+        context->fpu_ctx = NULL;
     }
 }
 
+// percpu_init 之前 GS_BASE 指向这里, self 为空
+static cpu_local_t boot_cpu_local;
+
+// 内核态下 GS_BASE 指向本 CPU 的 cpu_local_t, 用户的 gs 基址放在 KERNEL_GS_BASE
+// 从用户态进出内核时由入口和 Restore_all 执行 swapgs 交换
+void arch_set_this_cpu(cpu_local_t *cpu)
+{
+    wrmsr(IA32_GS_BASE, (uint64_t)(cpu ? cpu : &boot_cpu_local));
+}
+
+// 内核态加载 gs 选择子会把 GS_BASE 清零, 先换到用户的那一份上再加载, 调用时需关中断
+static inline void load_user_gs(uint64_t selector)
+{
+    asm volatile("swapgs\n\t"
+                 "movq %0, %%gs\n\t"
+                 "swapgs" ::"r"(selector) : "memory");
+}
+
 task_t *arch_get_current()
 {
-    return (task_t *)read_kgsbase();
+    cpu_local_t *cpu = arch_this_cpu();
+    return cpu ? cpu->current : NULL;
 }
 
 void arch_set_current(task_t *current)
 {
-    write_kgsbase((uint64_t)current);
+    cpu_local_t *cpu = arch_this_cpu();
+
+    if (cpu->current != current)
+        cpu_stat_inc(CPU_STAT_CTXT);
+
+    cpu->current = current;
+    cpu->syscall_stack = current->syscall_stack;
+}
+
+// 先置位再加载 CR3, 与 arch_flush_tlb 中修改页表项后读取 cpu_mask 配对
+// 加载 CR3 会清空旧地址空间的非全局 TLB 项, 之后本 CPU 不再需要它的 shootdown
+void arch_switch_mm(task_mm_info_t *prev, task_mm_info_t *next)
+{
+    uint64_t bit = 1UL << current_cpu_id;
+
+    __atomic_fetch_or(&next->cpu_mask, bit, __ATOMIC_SEQ_CST);
+
+    asm volatile("movq %0, %%cr3\n\t" ::"r"(next->page_table_addr) : "memory");
+
+    if (prev && prev != next)
+        __atomic_fetch_and(&prev->cpu_mask, ~bit, __ATOMIC_SEQ_CST);
 }
 
-extern tss_t tss[MAX_CPU_NUM];
+DECLARE_PER_CPU(tss_t, tss);
 
 extern void task_signal();
 
@@ -97,29 +150,25 @@ void arch_switch_with_context(arch_context_t *prev, arch_context_t *next, uint64
         asm volatile("movq %%gs, %0\n\t" : "=r"(prev->gs));
 
         prev->fsbase = read_fsbase();
-        prev->gsbase = read_gsbase();
-
-        if (prev->fpu_ctx)
-        {
-            asm volatile("fxsave (%0)" ::"r"(prev->fpu_ctx));
-        }
+        prev->gsbase = read_kgsbase();
     }
 
-    // Start to switch
-    if (next->fpu_ctx)
+    // FPU 状态在下一次使用时由 #NM 恢复
+    fpu_switch(prev);
+
+    // 同一地址空间内的线程切换不需要刷新 TLB, 本 CPU 仍在 cpu_mask 中, 会收到 shootdown
+    if (!prev || prev->mm != next->mm)
     {
-        asm volatile("fxrstor (%0)" ::"r"(next->fpu_ctx));
+        arch_switch_mm(prev ? prev->mm : NULL, next->mm);
     }
 
-    asm volatile("movq %0, %%cr3\n\t" ::"r"(next->mm->page_table_addr));
-
-    tss[current_cpu_id].rsp0 = kernel_stack;
+    per_cpu(tss, arch_this_cpu()->cpu_id).rsp0 = kernel_stack;
 
     asm volatile("movq %0, %%fs\n\t" ::"r"(next->fs));
-    asm volatile("movq %0, %%gs\n\t" ::"r"(next->gs));
+    load_user_gs(next->gs);
 
     write_fsbase(next->fsbase);
-    write_gsbase(next->gsbase);
+    write_kgsbase(next->gsbase);
 
     asm volatile(
         "movq %0, %%rsp\n\t"
@@ -143,8 +192,6 @@ void arch_task_switch_to(struct pt_regs *ctx, task_t *prev, task_t *next)
 
     arch_set_current(next);
 
-    sched_update_itimer();
-
     arch_switch_with_context(prev->arch_context, next->arch_context, next->kernel_stack);
 }
 
@@ -164,9 +211,8 @@ void arch_context_to_user_mode(arch_context_t *context, uint64_t entry, uint64_t
     context->fs = SELECTOR_USER_DS;
     context->gs = SELECTOR_USER_DS;
 
-    asm volatile("movq %0, %%fs\n\t"
-                 "movq %0, %%gs\n\t" ::"r"(context->fs),
-                 "r"(context->gs));
+    asm volatile("movq %0, %%fs\n\t" ::"r"(context->fs));
+    load_user_gs(context->gs);
 
     context->ctx->rflags = (0UL << 12) | (0b10) | (1UL << 9);
 }
@@ -175,7 +221,7 @@ void arch_to_user_mode(arch_context_t *context, uint64_t entry, uint64_t stack)
 {
     arch_context_to_user_mode(context, entry, stack);
 
-    asm volatile("movq %0, %%cr3" ::"r"(context->mm->page_table_addr));
+    arch_switch_mm(NULL, context->mm);
 
     asm volatile(
         "movq %0, %%rsp\n\t"
@@ -202,7 +248,7 @@ uint64_t sys_arch_prctl(uint64_t cmd, uint64_t arg)
         return 0;
     case ARCH_SET_GS:
         current_task->arch_context->gsbase = arg;
-        write_gsbase(current_task->arch_context->gsbase);
+        write_kgsbase(current_task->arch_context->gsbase);
         return 0;
     case ARCH_GET_FS:
         return current_task->arch_context->fsbase;
@@ -48,7 +48,8 @@ typedef struct arch_context
     uint64_t gsbase;
     task_mm_info_t *mm;
     struct pt_regs *ctx;
-    fpu_context_t *fpu_ctx;
+    fpu_context_t *fpu_ctx; // 前 512 字节是 legacy 区, 总大小为 fpu_xstate_size
+    int64_t fpu_cpu;        // 寄存器中保存着该状态的 CPU, -1 表示没有
 } arch_context_t;
 
 typedef struct arch_signal_frame
@@ -88,6 +89,7 @@ void arch_context_free(arch_context_t *context);
 task_t *arch_get_current();
 void arch_set_current(task_t *current);
 
+void arch_switch_mm(task_mm_info_t *prev, task_mm_info_t *next);
 void arch_switch_with_context(arch_context_t *prev, arch_context_t *next, uint64_t kernel_stack);
 void arch_task_switch_to(struct pt_regs *ctx, task_t *prev, task_t *next);
 void arch_context_to_user_mode(arch_context_t *context, uint64_t entry, uint64_t stack);
@@ -0,0 +1,189 @@
+#include <arch/arch.h>
+#include <arch/x64/task/fpu.h>
+#include <mm/mm.h>
+#include <task/task.h>
+
+#define CR0_TS (1UL << 3)
+#define CR4_OSXSAVE (1UL << 18)
+
+uint64_t fpu_xstate_size = 512;
+
+static bool fpu_use_xsave = false;
+static bool fpu_use_xsaveopt = false;
+
+// 每个 CPU 的寄存器里是谁的状态, 以及本时间片内 TS 是否已被清除
+static DEFINE_PER_CPU(struct arch_context *, fpu_owner);
+static DEFINE_PER_CPU(bool, fpu_active);
+
+static inline void clts()
+{
+    asm volatile("clts");
+}
+
+static inline void stts()
+{
+    asm volatile("movq %%cr0, %%rax\n\t"
+                 "orq %0, %%rax\n\t"
+                 "movq %%rax, %%cr0" ::"i"(CR0_TS) : "rax");
+}
+
+static inline void xsetbv(uint32_t index, uint64_t value)
+{
+    asm volatile("xsetbv" ::"c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline void fpu_save(void *state)
+{
+    if (fpu_use_xsaveopt)
+        asm volatile("xsaveopt64 (%0)" ::"r"(state), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+    else if (fpu_use_xsave)
+        asm volatile("xsave64 (%0)" ::"r"(state), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+    else
+        asm volatile("fxsave64 (%0)" ::"r"(state) : "memory");
+}
+
+static inline void fpu_restore(void *state)
+{
+    if (fpu_use_xsave)
+        asm volatile("xrstor64 (%0)" ::"r"(state), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+    else
+        asm volatile("fxrstor64 (%0)" ::"r"(state) : "memory");
+}
+
+// 每个 CPU 都要执行, 保存区大小只在第一次时计算
+// 此时 IDT 可能还没有建立, 先保持 TS 清除, 由第一次切换设置
+void fpu_init()
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    per_cpu(fpu_owner, current_cpu_id) = NULL;
+    per_cpu(fpu_active, current_cpu_id) = true;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    if (!(ecx & (1 << 26)))
+        return;
+
+    uint64_t cr4;
+    asm volatile("movq %%cr4, %0" : "=r"(cr4));
+    asm volatile("movq %0, %%cr4" ::"r"(cr4 | CR4_OSXSAVE));
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0xd), "c"(0));
+    uint64_t mask = (((uint64_t)edx << 32) | eax) & XSTATE_SUPPORTED;
+
+    // AVX-512 的三个分量必须同时开启
+    if ((mask & (XSTATE_OPMASK | XSTATE_ZMM_HI256 | XSTATE_HI16_ZMM)) != (XSTATE_OPMASK | XSTATE_ZMM_HI256 | XSTATE_HI16_ZMM))
+        mask &= ~(XSTATE_OPMASK | XSTATE_ZMM_HI256 | XSTATE_HI16_ZMM);
+
+    xsetbv(0, mask);
+
+    // EBX 是当前 XCR0 下需要的大小
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0xd), "c"(0));
+    uint64_t size = ebx;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0xd), "c"(1));
+
+    if (!fpu_use_xsave)
+    {
+        fpu_xstate_size = size;
+        fpu_use_xsaveopt = eax & (1 << 0);
+        fpu_use_xsave = true;
+    }
+}
+
+void *fpu_alloc_state()
+{
+    void *state = alloc_frames_bytes(fpu_xstate_size);
+    memset(state, 0, fpu_xstate_size);
+
+    fpu_context_t *legacy = (fpu_context_t *)state;
+    legacy->mxscr = 0x1f80;
+    legacy->fcw = 0x037f;
+
+    return state;
+}
+
+void fpu_free_state(void *state)
+{
+    free_frames_bytes(state, fpu_xstate_size);
+}
+
+void fpu_switch(struct arch_context *prev)
+{
+    uint32_t cpu = current_cpu_id;
+
+    if (!per_cpu(fpu_active, cpu))
+        return;
+
+    if (prev && prev->fpu_ctx)
+    {
+        fpu_save(prev->fpu_ctx);
+        prev->fpu_cpu = cpu;
+        per_cpu(fpu_owner, cpu) = prev;
+    }
+    else
+    {
+        per_cpu(fpu_owner, cpu) = NULL;
+    }
+
+    per_cpu(fpu_active, cpu) = false;
+    stts();
+}
+
+// 第一次使用 FPU 时才恢复, 寄存器里仍是自己的状态时不需要恢复
+void fpu_handle_nm()
+{
+    clts();
+
+    uint32_t cpu = current_cpu_id;
+    struct arch_context *context = current_task ? current_task->arch_context : NULL;
+
+    if (context && context->fpu_ctx)
+    {
+        if (per_cpu(fpu_owner, cpu) != context || context->fpu_cpu != (int64_t)cpu)
+            fpu_restore(context->fpu_ctx);
+        context->fpu_cpu = cpu;
+    }
+
+    per_cpu(fpu_owner, cpu) = context;
+    per_cpu(fpu_active, cpu) = true;
+}
+
+void fpu_flush(struct arch_context *context)
+{
+    uint32_t cpu = current_cpu_id;
+
+    if (per_cpu(fpu_active, cpu) && per_cpu(fpu_owner, cpu) == context && context->fpu_ctx)
+        fpu_save(context->fpu_ctx);
+}
+
+void fpu_invalidate(struct arch_context *context)
+{
+    uint32_t cpu = current_cpu_id;
+
+    if (fpu_use_xsave && context->fpu_ctx)
+    {
+        // legacy 区被改写, 让 XRSTOR 使用其中的 x87/SSE 值
+        uint64_t *xstate_bv = (uint64_t *)((uint8_t *)context->fpu_ctx + XSAVE_HEADER_OFFSET);
+        *xstate_bv |= XSTATE_X87 | XSTATE_SSE;
+    }
+
+    context->fpu_cpu = -1;
+    if (per_cpu(fpu_owner, cpu) == context)
+    {
+        per_cpu(fpu_owner, cpu) = NULL;
+        if (per_cpu(fpu_active, cpu))
+        {
+            per_cpu(fpu_active, cpu) = false;
+            stts();
+        }
+    }
+}
+
+void fpu_release(struct arch_context *context)
+{
+    for (uint32_t cpu = 0; cpu < MAX_CPU_NUM; cpu++)
+    {
+        struct arch_context *expected = context;
+        __atomic_compare_exchange_n(&per_cpu(fpu_owner, cpu), &expected, NULL, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+}
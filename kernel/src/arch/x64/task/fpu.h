@@ -0,0 +1,35 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+#define XSTATE_X87 (1UL << 0)
+#define XSTATE_SSE (1UL << 1)
+#define XSTATE_AVX (1UL << 2)
+#define XSTATE_OPMASK (1UL << 5)
+#define XSTATE_ZMM_HI256 (1UL << 6)
+#define XSTATE_HI16_ZMM (1UL << 7)
+
+#define XSTATE_SUPPORTED (XSTATE_X87 | XSTATE_SSE | XSTATE_AVX | XSTATE_OPMASK | XSTATE_ZMM_HI256 | XSTATE_HI16_ZMM)
+
+// XSAVE 区域中 legacy 区之后的头部
+#define XSAVE_HEADER_OFFSET 512
+
+struct arch_context;
+
+// 保存区大小, 由 CPUID 0xd 得到, 不支持 XSAVE 时为 512
+extern uint64_t fpu_xstate_size;
+
+void fpu_init();
+
+void *fpu_alloc_state();
+void fpu_free_state(void *state);
+
+// 切换时只保存本时间片用过 FPU 的任务, 恢复推迟到 #NM
+void fpu_switch(struct arch_context *prev);
+void fpu_handle_nm();
+
+// 把寄存器中还未保存的状态写回 fpu_ctx
+void fpu_flush(struct arch_context *context);
+// fpu_ctx 被外部修改后, 丢弃寄存器中的旧状态
+void fpu_invalidate(struct arch_context *context);
+void fpu_release(struct arch_context *context);
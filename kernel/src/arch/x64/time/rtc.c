@@ -199,3 +199,19 @@ void time_read(tm *time)
     time->tm_isdst = -1;
     century = bcd_to_bin(century);
 }
+
+// CLOCK_REALTIME = nanoTime() + realtime_offset
+uint64_t realtime_offset = 0;
+
+void realtime_init()
+{
+    tm time;
+    time_read(&time);
+    startup_time = mktime(&time);
+    realtime_offset = (uint64_t)startup_time * 1000000000ULL - nanoTime();
+}
+
+uint64_t realtime_nano_time()
+{
+    return nanoTime() + realtime_offset;
+}
@@ -17,3 +17,8 @@ typedef struct
 
 void time_read(tm *time);
 int64_t mktime(tm *time);
+
+extern uint64_t realtime_offset;
+
+void realtime_init();
+uint64_t realtime_nano_time();
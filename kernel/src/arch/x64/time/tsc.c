@@ -0,0 +1,95 @@
+#include <arch/x64/time/tsc.h>
+#include <arch/x64/acpi/acpi.h>
+#include <drivers/kernel_logger.h>
+
+bool tsc_clocksource = false;
+uint64_t tsc_hz = 0;
+uint64_t tsc_base = 0;
+uint64_t tsc_ns_base = 0;
+uint64_t tsc_mult = 0;
+uint64_t tsc_inv_mult = 0;
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(subleaf));
+}
+
+static bool tsc_invariant()
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007)
+        return false;
+
+    cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+    return edx & (1 << 8);
+}
+
+bool tsc_deadline_supported()
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0x01, 0, &eax, &ebx, &ecx, &edx);
+    return tsc_clocksource && (ecx & (1 << 24));
+}
+
+// 优先使用 CPUID 报告的频率, 否则对 HPET 校准一次
+static uint64_t tsc_detect_hz()
+{
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t max_leaf;
+
+    cpuid(0x00, 0, &max_leaf, &ebx, &ecx, &edx);
+
+    if (max_leaf >= 0x15)
+    {
+        cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx)
+            return (uint64_t)ecx * ebx / eax;
+    }
+
+    if (max_leaf >= 0x16)
+    {
+        cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0xffff)
+            return (uint64_t)(eax & 0xffff) * 1000000;
+    }
+
+    uint64_t t0 = hpet_nano_time();
+    uint64_t c0 = rdtsc();
+    while (hpet_nano_time() - t0 < 10000000)
+        asm volatile("pause");
+    uint64_t t1 = hpet_nano_time();
+    uint64_t c1 = rdtsc();
+
+    if (t1 == t0)
+        return 0;
+
+    return (c1 - c0) * 1000000000ULL / (t1 - t0);
+}
+
+void tsc_init()
+{
+    if (!tsc_invariant())
+    {
+        printk("TSC is not invariant, keep HPET as clocksource\n");
+        return;
+    }
+
+    uint64_t hz = tsc_detect_hz();
+    if (!hz)
+        return;
+
+    tsc_hz = hz;
+    tsc_mult = (1000000000ULL << 32) / hz;
+    tsc_inv_mult = ((hz / 1000000000ULL) << 32) + ((hz % 1000000000ULL) << 32) / 1000000000ULL;
+
+    // 与 HPET 的时间轴衔接
+    tsc_ns_base = hpet_nano_time();
+    tsc_base = rdtsc();
+
+    tsc_clocksource = true;
+
+    printk("Setup TSC clocksource (%lu kHz)\n", hz / 1000);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+#define IA32_TSC_DEADLINE 0x6e0
+
+extern bool tsc_clocksource;
+extern uint64_t tsc_hz;
+extern uint64_t tsc_base;
+extern uint64_t tsc_ns_base;
+extern uint64_t tsc_mult;     // ns = tsc * tsc_mult >> 32
+extern uint64_t tsc_inv_mult; // tsc = ns * tsc_inv_mult >> 32
+
+static inline uint64_t rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t tsc_nano_time()
+{
+    uint64_t delta = rdtsc() - tsc_base;
+    return tsc_ns_base + (uint64_t)(((unsigned __int128)delta * tsc_mult) >> 32);
+}
+
+static inline uint64_t ns_to_tsc(uint64_t ns)
+{
+    if (ns <= tsc_ns_base)
+        return tsc_base;
+    return tsc_base + (uint64_t)(((unsigned __int128)(ns - tsc_ns_base) * tsc_inv_mult) >> 32);
+}
+
+bool tsc_deadline_supported();
+void tsc_init();
@@ -0,0 +1,119 @@
+#include <arch/x64/vdso/vdso.h>
+#include <arch/arch.h>
+#include <mm/mm.h>
+#include <drivers/kernel_logger.h>
+
+// vdso_image.S 嵌入的 vdso.so
+extern uint8_t vdso_image_start[];
+extern uint8_t vdso_image_end[];
+
+struct vdso_data *vdso_data = NULL;
+
+static uint64_t vdso_data_phys = 0;
+static uint64_t vdso_text_phys = 0;
+static uint64_t vdso_text_size = 0;
+
+static spinlock_t vdso_lock = {0};
+
+static bool cpu_has_rdtscp()
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000000), "c"(0));
+    if (eax < 0x80000001)
+        return false;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000001), "c"(0));
+    return edx & (1 << 27);
+}
+
+// 每个 CPU 都要执行, 供 vDSO 的 getcpu 通过 rdtscp 读取
+void vdso_cpu_init(uint32_t cpu)
+{
+    if (cpu_has_rdtscp())
+        wrmsr(IA32_TSC_AUX, cpu);
+}
+
+void vdso_init()
+{
+    realtime_init();
+
+    uint64_t image_size = vdso_image_end - vdso_image_start;
+    if (image_size > VDSO_MAX_SIZE - DEFAULT_PAGE_SIZE)
+    {
+        printk("vDSO image too large (%lu bytes)\n", image_size);
+        return;
+    }
+
+    vdso_text_size = PADDING_UP(image_size, DEFAULT_PAGE_SIZE);
+    vdso_data_phys = alloc_frames(1);
+    vdso_text_phys = alloc_frames(vdso_text_size / DEFAULT_PAGE_SIZE);
+
+    memset(phys_to_virt((void *)vdso_data_phys), 0, DEFAULT_PAGE_SIZE);
+    memset(phys_to_virt((void *)vdso_text_phys), 0, vdso_text_size);
+    memcpy(phys_to_virt((void *)vdso_text_phys), vdso_image_start, image_size);
+
+    vdso_data = phys_to_virt((struct vdso_data *)vdso_data_phys);
+    vdso_data->rdtscp = cpu_has_rdtscp();
+    vdso_update();
+
+    vdso_cpu_init(current_cpu_id);
+
+    printk("Setup vDSO (%lu bytes)\n", image_size);
+}
+
+// 由 CPU 0 的时钟中断调用, 以及时钟参数改变时
+void vdso_update()
+{
+    if (!vdso_data)
+        return;
+
+    spin_lock_irqsave(&vdso_lock);
+
+    vdso_write_begin(vdso_data);
+
+    vdso_data->clock_mode = tsc_clocksource ? VDSO_CLOCKMODE_TSC : VDSO_CLOCKMODE_NONE;
+    vdso_data->tsc_base = tsc_base;
+    vdso_data->tsc_ns_base = tsc_ns_base;
+    vdso_data->tsc_mult = tsc_mult;
+    vdso_data->realtime_offset = realtime_offset;
+    vdso_data->coarse_ns = nanoTime();
+
+    vdso_write_end(vdso_data);
+
+    spin_unlock_irqrestore(&vdso_lock);
+}
+
+// 所有进程共享同一份物理页
+void vdso_map(uint64_t *pml4)
+{
+    if (!vdso_data)
+        return;
+
+    if (translate_address(pml4, VDSO_DATA_ADDR) == vdso_data_phys)
+        return;
+
+    map_page_range(pml4, VDSO_DATA_ADDR, vdso_data_phys, DEFAULT_PAGE_SIZE, PT_FLAG_R | PT_FLAG_U);
+    map_page_range(pml4, VDSO_TEXT_ADDR, vdso_text_phys, vdso_text_size, PT_FLAG_R | PT_FLAG_U | PT_FLAG_X);
+}
+
+// 只清除页表项, 不释放共享的物理页
+void vdso_unmap(uint64_t *pml4)
+{
+    for (uint64_t vaddr = VDSO_DATA_ADDR; vaddr < VDSO_DATA_ADDR + VDSO_MAX_SIZE; vaddr += DEFAULT_PAGE_SIZE)
+    {
+        uint64_t *table = pml4;
+
+        for (uint64_t level = 1; level < ARCH_MAX_PT_LEVEL && table; level++)
+        {
+            uint64_t entry = table[PAGE_CALC_PAGE_TABLE_INDEX(vaddr, level)];
+            if (!ARCH_PT_IS_TABLE(entry) || ARCH_PT_IS_LARGE(entry))
+                table = NULL;
+            else
+                table = (uint64_t *)phys_to_virt(entry & (~PAGE_CALC_PAGE_TABLE_MASK(ARCH_MAX_PT_LEVEL)));
+        }
+
+        if (table)
+            table[PAGE_CALC_PAGE_TABLE_INDEX(vaddr, ARCH_MAX_PT_LEVEL)] = 0;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <arch/x64/vdso/vdso_data.h>
+
+#define IA32_TSC_AUX 0xc0000103
+
+// 数据页在前, 代码紧随其后 (vdso.lds 中 vdso_data 位于镜像基址 - 0x1000)
+#define VDSO_DATA_ADDR 0x0000600000000000
+#define VDSO_TEXT_ADDR (VDSO_DATA_ADDR + DEFAULT_PAGE_SIZE)
+#define VDSO_MAX_SIZE 0x10000
+
+extern struct vdso_data *vdso_data;
+
+void vdso_init();
+void vdso_cpu_init(uint32_t cpu);
+void vdso_update();
+
+void vdso_map(uint64_t *pml4);
+void vdso_unmap(uint64_t *pml4);
+
+static inline bool is_vdso_region(uint64_t vaddr)
+{
+    return vaddr >= VDSO_DATA_ADDR && vaddr < VDSO_DATA_ADDR + VDSO_MAX_SIZE;
+}
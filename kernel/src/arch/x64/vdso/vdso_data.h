@@ -0,0 +1,52 @@
+#pragma once
+
+// 内核与 vDSO 共用, 只能依赖 stdint
+#include <stdint.h>
+
+#define VDSO_CLOCKMODE_NONE 0 // 用户态无法读时钟, 回退到系统调用
+#define VDSO_CLOCKMODE_TSC 1
+
+// 映射到每个进程的只读时间数据页, 由内核按顺序锁更新
+struct vdso_data
+{
+    volatile uint32_t seq; // 奇数表示内核正在写
+    uint32_t clock_mode;
+    uint64_t tsc_base;
+    uint64_t tsc_ns_base;
+    uint64_t tsc_mult; // ns = (tsc - tsc_base) * tsc_mult >> 32
+    uint64_t realtime_offset;
+    uint64_t coarse_ns; // 最近一次时钟中断时的单调时间
+    uint32_t rdtscp;    // IA32_TSC_AUX 中存放着 CPU 编号
+    uint32_t padding;
+};
+
+#define vdso_barrier() asm volatile("" ::: "memory")
+
+static inline uint32_t vdso_read_begin(const struct vdso_data *vd)
+{
+    uint32_t seq;
+
+    while ((seq = vd->seq) & 1)
+        asm volatile("pause");
+
+    vdso_barrier();
+    return seq;
+}
+
+static inline int vdso_read_retry(const struct vdso_data *vd, uint32_t start)
+{
+    vdso_barrier();
+    return vd->seq != start;
+}
+
+static inline void vdso_write_begin(struct vdso_data *vd)
+{
+    vd->seq++;
+    vdso_barrier();
+}
+
+static inline void vdso_write_end(struct vdso_data *vd)
+{
+    vdso_barrier();
+    vd->seq++;
+}
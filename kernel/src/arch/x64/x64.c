@@ -11,10 +11,15 @@ void arch_early_init()
     generic_interrupt_table_init();
     acpi_init();
     smp_init();
+    fpu_init();
     tss_init();
 
     apic_timer_init();
 
+    tlb_shootdown_init();
+
+    vdso_init();
+
     fsgsbase_init();
 }
 
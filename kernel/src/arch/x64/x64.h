@@ -16,9 +16,12 @@
 #include "drivers/msi_arch.h"
 #include "task/arch_context.h"
 #include "task/fsgsbase.h"
+#include "task/fpu.h"
 #include "syscall/nr.h"
 #include "syscall/syscall.h"
 #include "time/time.h"
+#include "time/tsc.h"
+#include "vdso/vdso.h"
 
 void arch_early_init();
 void arch_init();
@@ -28,3 +31,15 @@ static inline void arch_pause()
 {
     asm volatile("pause");
 }
+
+// 只用于测量本 CPU 上的短时间间隔
+static inline uint64_t arch_cycles()
+{
+    return rdtsc();
+}
+
+// TSC 不是恒定频率时为 0
+static inline uint64_t arch_cycles_hz()
+{
+    return tsc_hz;
+}
@@ -1,10 +1,11 @@
 #include <block/block.h>
 #include <mm/mm.h>
+#include <task/lock_stat.h>
 
 blkdev_t blk_devs[MAX_BLKDEV_NUM];
 uint64_t blk_devnum = 0;
 
-spinlock_t blockdev_op_lock = {0};
+DEFINE_SPINLOCK_STAT(blockdev_op_lock);
 
 void regist_blkdev(char *name, void *ptr, uint64_t block_size, uint64_t size, uint64_t max_op_size, uint64_t (*read)(void *data, uint64_t lba, void *buffer, uint64_t size), uint64_t (*write)(void *data, uint64_t lba, void *buffer, uint64_t size))
 {
@@ -1,4 +1,5 @@
 #include <drivers/bus/pci.h>
+#include <drivers/bus/msi.h>
 #include <drivers/kernel_logger.h>
 #include <block/block.h>
 #include <drivers/block/ahci/ahci.h>
@@ -273,8 +274,34 @@ uint64_t ahci_write(void *data, uint64_t lba, void *buffer, uint64_t size)
 #define HBA_FIS_SIZE 256
 #define HBA_CLB_SIZE 1024
 
-struct ahci_driver *ahci_driver_init(pci_bar_t *bar5)
+#define HBA_PxIE_DEFAULT (HBA_PxINTR_DHR | HBA_PxINTR_PS | HBA_PxINTR_DPS | HBA_FATAL)
+
+static void ahci_irq_handler(uint64_t irq_num, void *data, struct pt_regs *regs)
 {
+    struct ahci_hba *hba = data;
+    hba_reg_t is = hba->base[HBA_RIS];
+
+    for (int i = 0; i < 32; i++)
+    {
+        struct hba_port *port = hba->ports[i];
+        if (!(is & (1U << i)) || !port)
+            continue;
+
+        hba_reg_t pxis = port->regs[HBA_RPxIS];
+        __atomic_fetch_or(&port->irq_status, pxis, __ATOMIC_RELEASE);
+        port->regs[HBA_RPxIS] = pxis;
+
+        irq_waiter_wake(&port->irq);
+    }
+
+    // 先清端口的 PxIS, 再清全局 IS
+    hba->base[HBA_RIS] = is;
+}
+
+struct ahci_driver *ahci_driver_init(pci_device_t *dev)
+{
+    pci_bar_t *bar5 = &dev->bars[5];
+
     struct ahci_driver *ahci_drv = malloc(sizeof(struct ahci_driver));
     memset(ahci_drv, 0, sizeof(struct ahci_driver));
     struct ahci_hba *hba = &ahci_drv->hba;
@@ -294,6 +321,17 @@ struct ahci_driver *ahci_driver_init(pci_bar_t *bar5)
     hba->base[HBA_RGHC] |= HBA_RGHC_ACHI_ENABLE;
     hba->base[HBA_RGHC] &= ~HBA_RGHC_INTR_ENABLE;
 
+    bool use_irq = false;
+    if (pci_alloc_irq_vectors(dev, 1, 1) > 0)
+    {
+        irq_regist_irq(pci_irq_vector(dev, 0), ahci_irq_handler, 0, hba, &msi_controller, "AHCI");
+        use_irq = true;
+    }
+    else
+    {
+        printk("AHCI: no MSI/MSI-X available, polling for completions\n");
+    }
+
     hba_reg_t cap = hba->base[HBA_RCAP];
     hba_reg_t pmap = hba->base[HBA_RPI];
 
@@ -302,6 +340,12 @@ struct ahci_driver *ahci_driver_init(pci_bar_t *bar5)
     hba->version = hba->base[HBA_RVER];
     hba->ports_bmp = pmap;
 
+    if (use_irq)
+    {
+        hba_clear_reg(hba->base[HBA_RIS]);
+        hba->base[HBA_RGHC] |= HBA_RGHC_INTR_ENABLE;
+    }
+
     uint64_t clb_pa = 0, fis_pa = 0;
 
     for (uint64_t i = 0, fisp = 0, clbp = 0; i < 32; i++, pmap >>= 1, fisp = (fisp + 1) % 16, clbp = (clbp + 1) % 4)
@@ -340,6 +384,9 @@ struct ahci_driver *ahci_driver_init(pci_bar_t *bar5)
         port->fis = (void *)(fis_pa + fisp * HBA_FIS_SIZE);
         port->hba = hba;
 
+        irq_waiter_init(&port->irq);
+        port->irq.enabled = use_irq;
+
         port_regs[HBA_RPxCI] = 0;
 
         hba_clear_reg(port_regs[HBA_RPxSERR]);
@@ -356,6 +403,12 @@ struct ahci_driver *ahci_driver_init(pci_bar_t *bar5)
         port_regs[HBA_RPxCMD] |= HBA_PxCMD_FRE;
         port_regs[HBA_RPxCMD] |= HBA_PxCMD_ST;
 
+        if (use_irq)
+        {
+            hba_clear_reg(port_regs[HBA_RPxIS]);
+            port_regs[HBA_RPxIE] = HBA_PxIE_DEFAULT;
+        }
+
         if (!ahci_init_device(port))
         {
             printk("ahci device init failed\n");
@@ -401,7 +454,7 @@ uint64_t ahci_init()
 
     op_buffer = (void *)alloc_frames(0x400000UL / DEFAULT_PAGE_SIZE);
 
-    drv = ahci_driver_init(bar5);
+    drv = ahci_driver_init(devs[0]);
 
     return 0;
 }
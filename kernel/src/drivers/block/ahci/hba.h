@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <interrupt/irq_manager.h>
 
 typedef uint32_t hba_reg_t;
 
@@ -34,6 +35,7 @@ typedef uint32_t hba_reg_t;
 #define HBA_PxCMD_ST (1)
 #define HBA_PxINTR_DMA (1 << 2)
 #define HBA_PxINTR_DHR (1)
+#define HBA_PxINTR_PS (1 << 1)
 #define HBA_PxINTR_DPS (1 << 5)
 #define HBA_PxINTR_TFE (1 << 30)
 #define HBA_PxINTR_HBF (1 << 29)
@@ -182,6 +184,8 @@ struct hba_port
     void *fis;
     struct hba_device *device;
     struct ahci_hba *hba;
+    irq_waiter_t irq;
+    uint32_t irq_status; // 中断处理函数清除 PxIS 前保存的状态
 };
 
 struct ahci_hba
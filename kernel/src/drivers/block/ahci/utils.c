@@ -1,5 +1,6 @@
 #include "drivers/block/ahci/ahci.h"
 #include "drivers/kernel_logger.h"
+#include <arch/arch.h>
 
 int ahci_try_send(struct hba_port *port, int slot)
 {
@@ -51,6 +52,11 @@ int ahci_try_send(struct hba_port *port, int slot)
 #define AHCI_CMD_FR (1 << 14) // FIS Receive Running
 #define AHCI_CMD_CR (1 << 15) // Command Running
 
+static inline uint32_t ahci_port_status(struct hba_port *port)
+{
+    return port->regs[HBA_RPxIS] | __atomic_load_n(&port->irq_status, __ATOMIC_ACQUIRE);
+}
+
 void ahci_post(struct hba_port *port, struct hba_cmd_state *state, int slot)
 {
     int bitmask = 1 << slot;
@@ -64,28 +70,22 @@ void ahci_post(struct hba_port *port, struct hba_cmd_state *state, int slot)
     }
 
     hba_clear_reg(port->regs[HBA_RPxIS]);
+    __atomic_store_n(&port->irq_status, 0, __ATOMIC_RELAXED);
 
     port->cmdctx.issued[slot] = state;
     port->cmdctx.tracked_ci |= bitmask;
     port->regs[HBA_RPxCI] |= bitmask;
 
-    while (1)
-    {
-        if ((port->regs[HBA_RPxCI] & (1 << slot)) == 0)
-            break;
-        if (port->regs[HBA_RPxIS] & HBA_PxINTR_TFE)
-        {
-            goto err;
-        }
-    }
+    // 完成或出错时 HBA 会发中断, 中断处理函数会清除 PxIS, 所以两处都要看
+    irq_wait_event(&port->irq, !(port->regs[HBA_RPxCI] & bitmask) || (ahci_port_status(port) & HBA_PxINTR_TFE));
 
-    if (port->regs[HBA_RPxIS] & HBA_PxINTR_TFE)
+    if (ahci_port_status(port) & HBA_PxINTR_TFE)
     {
-    err:
         printk("AHCI task file error\n");
 
         port->regs[HBA_RPxCI] &= ~bitmask;
 
         hba_clear_reg(port->regs[HBA_RPxIS]);
+        __atomic_store_n(&port->irq_status, 0, __ATOMIC_RELAXED);
     }
 }
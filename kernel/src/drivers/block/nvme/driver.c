@@ -2,6 +2,7 @@
 #include "drivers/kernel_logger.h"
 #include <mm/mm.h>
 #include <block/block.h>
+#include <drivers/bus/msi.h>
 
 #define NVME_CSTS_FATAL (1U << 1)
 #define NVME_CSTS_RDY (1U << 0)
@@ -47,6 +48,7 @@ int NVMEConfigureCQ(NVME_CONTROLLER *ctrl, NVME_COMPLETION_QUEUE *cq, uint32_t i
     cq->COM.HAD = 0;
     cq->COM.TAL = 0;
     cq->COM.PHA = 1;
+    irq_waiter_init(&cq->IRQ);
     return 0;
 }
 int NVMEConfigureSQ(NVME_CONTROLLER *ctrl, NVME_SUBMISSION_QUEUE *sq, uint32_t idx, uint32_t len)
@@ -70,6 +72,36 @@ int NVMEWaitingRDY(NVME_CONTROLLER *ctrl, uint32_t rdy)
     }
     return 0;
 }
+static inline bool NVMECompleted(NVME_COMPLETION_QUEUE *cq)
+{
+    return (__atomic_load_n(&cq->CQE[cq->COM.HAD].STS, __ATOMIC_ACQUIRE) & 0x1) == cq->COM.PHA;
+}
+
+// 两个完成队列可能共用一个向量, 都唤醒一次, 等待者会重新检查相位位
+static void nvme_irq_handler(uint64_t irq_num, void *data, struct pt_regs *regs)
+{
+    NVME_CONTROLLER *ctrl = data;
+
+    irq_waiter_wake(&ctrl->ACQ.IRQ);
+    irq_waiter_wake(&ctrl->ICQ.IRQ);
+}
+
+// 管理队列使用第 0 个向量, I/O 完成队列尽量使用第 1 个, 返回 I/O 队列的中断向量索引
+static int NVMESetupIRQ(NVME_CONTROLLER *ctrl, pci_device_t *dev)
+{
+    int nvec = pci_alloc_irq_vectors(dev, 1, 2);
+    if (nvec < 0)
+    {
+        printk("NVME: no MSI/MSI-X available, polling for completions\n");
+        return -1;
+    }
+
+    for (int i = 0; i < nvec; i++)
+        irq_regist_irq(pci_irq_vector(dev, i), nvme_irq_handler, 0, ctrl, &msi_controller, "NVMe");
+
+    return nvec - 1;
+}
+
 NVME_COMPLETION_QUEUE_ENTRY NVMEWaitingCMD(NVME_SUBMISSION_QUEUE *sq, NVME_SUBMISSION_QUEUE_ENTRY *e)
 {
     NVME_COMPLETION_QUEUE_ENTRY errcqe;
@@ -93,10 +125,7 @@ NVME_COMPLETION_QUEUE_ENTRY NVMEWaitingCMD(NVME_SUBMISSION_QUEUE *sq, NVME_SUBMI
 
     // Check completion
     NVME_COMPLETION_QUEUE *cq = sq->ICQ;
-    while ((cq->CQE[cq->COM.HAD].STS & 0x1) != cq->COM.PHA)
-    {
-        asm volatile("nop");
-    }
+    irq_wait_event(&cq->IRQ, NVMECompleted(cq));
 
     // Consume CQE
     NVME_COMPLETION_QUEUE_ENTRY *cqe = cq->CQE + cq->COM.HAD;
@@ -210,8 +239,11 @@ uint64_t nvme_write(void *data, uint64_t lba, void *buffer, uint64_t bytes)
     return ret;
 }
 
-void nvme_driver_init(uint64_t bar0, uint64_t bar_size)
+void nvme_driver_init(pci_device_t *dev)
 {
+    uint64_t bar0 = dev->bars[0].address;
+    uint64_t bar_size = dev->bars[0].size;
+
     NVME_CAPABILITY *cap = (NVME_CAPABILITY *)phys_to_virt(bar0);
     map_page_range(get_current_page_dir(false), (uint64_t)cap, bar0, bar_size, PT_FLAG_R | PT_FLAG_W);
 
@@ -251,6 +283,10 @@ void nvme_driver_init(uint64_t bar0, uint64_t bar_size)
     }
     ctrl->ASQ.ICQ = &ctrl->ACQ;
 
+    int iv = NVMESetupIRQ(ctrl, dev);
+    if (iv < 0)
+        ctrl->ACQ.IRQ.enabled = false;
+
     ctrl->CAP->AQA = ((uint32_t)ctrl->ACQ.COM.MSK << 16) | ctrl->ASQ.COM.MSK;
     ctrl->CAP->ASQ = virt_to_phys((uint64_t)ctrl->ASQ.SQE);
     ctrl->CAP->ACQ = virt_to_phys((uint64_t)ctrl->ACQ.CQE);
@@ -333,6 +369,10 @@ void nvme_driver_init(uint64_t bar0, uint64_t bar_size)
         ccq.DATA[1] = 0;
         ccq.CDWA = ((uint32_t)ctrl->ICQ.COM.MSK << 16) | (qidx >> 1);
         ccq.CDWB = 1;
+        if (iv >= 0)
+            ccq.CDWB |= ((uint32_t)iv << 16) | (1U << 1); // IV, IEN
+        else
+            ctrl->ICQ.IRQ.enabled = false;
 
         cqe = NVMEWaitingCMD(&ctrl->ASQ, &ccq);
         if ((cqe.STS >> 1) & 0xFF)
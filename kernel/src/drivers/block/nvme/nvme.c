@@ -22,6 +22,6 @@ void nvme_init()
     {
         pci_device_t *dev = devs[i];
 
-        nvme_driver_init(dev->bars[0].address, dev->bars[0].size);
+        nvme_driver_init(dev);
     }
 }
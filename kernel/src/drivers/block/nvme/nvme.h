@@ -1,6 +1,7 @@
 #pragma once
 
 #include "drivers/bus/pci.h"
+#include "interrupt/irq_manager.h"
 
 typedef struct _NVME_CONTROLLER NVME_CONTROLLER;
 typedef struct _NVME_CAPABILITY
@@ -58,6 +59,7 @@ typedef struct _NVME_COMPLETION_QUEUE
 {
     NVME_QUEUE_COMMON COM;
     NVME_COMPLETION_QUEUE_ENTRY *CQE;
+    irq_waiter_t IRQ; // 等待完成的任务, 由 MSI-X 中断唤醒
 } NVME_COMPLETION_QUEUE;
 
 typedef struct _NVME_SUBMISSION_QUEUE
@@ -226,6 +228,6 @@ extern uint64_t nvme_device_num;
 
 uint32_t NVMETransfer(NVME_NAMESPACE *ns, void *buf, uint64_t lba, uint32_t count, uint32_t write);
 
-void nvme_driver_init(uint64_t bar0, uint64_t bar_size);
+void nvme_driver_init(pci_device_t *dev);
 
 void nvme_init();
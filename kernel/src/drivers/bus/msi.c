@@ -11,7 +11,7 @@
 struct msi_msg_t *msi_arch_get_msg(struct msi_desc_t *msi_desc)
 {
     msi_desc->msg.address_hi = 0;
-    msi_desc->msg.address_lo = ia64_pci_get_arch_msi_message_address(msi_desc->processor);
+    msi_desc->msg.address_lo = ia64_pci_get_arch_msi_message_address(msi_arch_dest(msi_desc->processor));
     msi_desc->msg.data = ia64_pci_get_arch_msi_message_data(msi_desc->irq_num, msi_desc->processor, msi_desc->edge_trigger, msi_desc->assert);
     msi_desc->msg.vector_control = 0;
     return &(msi_desc->msg);
@@ -85,16 +85,17 @@ static inline struct pci_msix_cap_t __msi_read_msix_cap_list(struct msi_desc_t *
 static inline int __msix_map_table(pci_device_t *pci_dev,
                                    struct pci_msix_cap_t *msix_cap)
 {
-    // 计算bar寄存器的offset
-    uint32_t bar_off = 0x10 + 4 * (msix_cap->dword1 & 0x7);
+    uint32_t bir = msix_cap->dword1 & 0x7;
 
     // msix table相对于bar寄存器中存储的地址的offset
     pci_dev->msix_offset = msix_cap->dword1 & (~0x7);
     pci_dev->msix_table_size = (msix_cap->msg_ctrl & 0x7ff) + 1;
     pci_dev->msix_mmio_size = pci_dev->msix_table_size * 16 + pci_dev->msix_offset;
 
-    uint64_t physical_address = translate_address(get_kernel_page_dir(), pci_dev->msix_mmio_vaddr);
-    map_page_range(get_kernel_page_dir(), pci_dev->msix_mmio_vaddr, physical_address, pci_dev->msix_mmio_size, PT_FLAG_R | PT_FLAG_W);
+    uint64_t table_phys = pci_dev->bars[bir].address + pci_dev->msix_offset;
+    uint64_t map_start = PADDING_DOWN(table_phys, DEFAULT_PAGE_SIZE);
+    uint64_t map_end = PADDING_UP(table_phys + pci_dev->msix_table_size * 16, DEFAULT_PAGE_SIZE);
+    map_page_range(get_kernel_page_dir(), phys_to_virt(map_start), map_start, map_end - map_start, PT_FLAG_R | PT_FLAG_W);
 
     return 0;
 }
@@ -107,11 +108,14 @@ static inline int __msix_map_table(pci_device_t *pci_dev,
  */
 static inline void __msix_set_entry(struct msi_desc_t *msi_desc)
 {
-    uint64_t *ptr =
-        (uint64_t *)(msi_desc->pci_dev->msix_mmio_vaddr + msi_desc->pci_dev->msix_offset + msi_desc->msi_index * 16);
-    *ptr = ((uint64_t)(msi_desc->msg.address_hi) << 32) | (msi_desc->msg.address_lo);
-    ++ptr;
-    *ptr = ((uint64_t)(msi_desc->msg.data) << 32) | (msi_desc->msg.vector_control);
+    // 表项布局: addr_lo@0, addr_hi@4, data@8, vector_control@12
+    volatile uint32_t *ptr =
+        (volatile uint32_t *)(msi_desc->pci_dev->msix_mmio_vaddr + msi_desc->pci_dev->msix_offset + msi_desc->msi_index * 16);
+    ptr[0] = msi_desc->msg.address_lo;
+    ptr[1] = msi_desc->msg.address_hi;
+    ptr[2] = msi_desc->msg.data;
+    // vector control 单独最后写, 地址和数据都就绪后才可能解除屏蔽
+    ptr[3] = msi_desc->msg.vector_control;
 }
 
 /**
@@ -169,9 +173,9 @@ int pci_enable_msi(struct msi_desc_t *msi_desc)
     // 获取msi消息
     msi_arch_get_msg(msi_desc);
 
-    // disable intx
-    tmp = ptr->op->read(ptr->bus, ptr->slot, ptr->func, ptr->segment, 0x04); // 读取cap+0x0处的值
-    tmp &= ~(1U << 10);
+    // disable intx, command 寄存器的 bit 10 是 Interrupt Disable
+    tmp = ptr->op->read(ptr->bus, ptr->slot, ptr->func, ptr->segment, 0x04);
+    tmp |= (1U << 10);
     ptr->op->write(ptr->bus, ptr->slot, ptr->func, ptr->segment, 0x04, tmp);
 
     if (msi_desc->pci.msi_attribute.is_msix) // MSI-X
@@ -182,12 +186,9 @@ int pci_enable_msi(struct msi_desc_t *msi_desc)
         {
             return -EINVAL;
         }
-        uint32_t table_offset_in_bar = table_offset & 0xFFFFFFF8;
-
-        uint64_t msix_table_physical_address = ptr->bars[bir].address + table_offset_in_bar;
-        uint64_t msix_mmio_vaddr = phys_to_virt(msix_table_physical_address);
 
-        ptr->msix_mmio_vaddr = msix_mmio_vaddr;
+        // 表项地址为 msix_mmio_vaddr + msix_offset
+        ptr->msix_mmio_vaddr = phys_to_virt(ptr->bars[bir].address);
 
         // 读取msix的信息
         struct pci_msix_cap_t cap = __msi_read_msix_cap_list(msi_desc, cap_ptr);
@@ -196,10 +197,11 @@ int pci_enable_msi(struct msi_desc_t *msi_desc)
         // 设置msix的中断
         __msix_set_entry(msi_desc);
 
-        // 使能msi-x
-        tmp = ptr->op->read(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr + 0x2); // 读取cap+0x2处的值
-        tmp |= (1U << 15);
-        ptr->op->write(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr + 0x2, tmp);
+        // 使能msi-x, message control 位于 cap+0x0 的高 16 位, 同时清除 function mask
+        tmp = ptr->op->read(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr);
+        tmp |= (1U << 31);
+        tmp &= ~(1U << 30);
+        ptr->op->write(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr, tmp);
     }
     else
     {
@@ -222,12 +224,194 @@ int pci_enable_msi(struct msi_desc_t *msi_desc)
         else
             ptr->op->write(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr + 0x8, tmp);
 
-        // 使能msi
-        tmp = ptr->op->read(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr + 0x2); // 读取cap+0x2处的值
-        tmp |= 1;
-        tmp &= ~(7 << 4);
-        ptr->op->write(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr + 0x2, tmp);
+        // 使能msi, 只使用一个向量
+        tmp = ptr->op->read(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr);
+        tmp |= (1U << 16);
+        tmp &= ~(7U << 20);
+        ptr->op->write(ptr->bus, ptr->slot, ptr->func, ptr->segment, cap_ptr, tmp);
     }
 
     return 0;
 }
+
+// 按向量号索引, 给 msi_controller 屏蔽表项用
+static struct msi_desc_t msi_descs[ARCH_MAX_IRQ_NUM];
+
+static void pci_disable_msi(pci_device_t *dev)
+{
+    uint32_t cap_ptr = pci_enumerate_capability_list(dev, dev->msix_enabled ? 0x11 : 0x05);
+    if (cap_ptr == 0)
+        return;
+
+    uint32_t tmp = dev->op->read(dev->bus, dev->slot, dev->func, dev->segment, cap_ptr);
+    tmp &= dev->msix_enabled ? ~(1U << 31) : ~(1U << 16);
+    dev->op->write(dev->bus, dev->slot, dev->func, dev->segment, cap_ptr, tmp);
+
+    // 重新允许 intx
+    tmp = dev->op->read(dev->bus, dev->slot, dev->func, dev->segment, 0x04);
+    tmp &= ~(1U << 10);
+    dev->op->write(dev->bus, dev->slot, dev->func, dev->segment, 0x04, tmp);
+}
+
+int pci_alloc_irq_vectors(pci_device_t *dev, uint32_t min, uint32_t max)
+{
+    if (dev->irq_vector_count)
+        return -EBUSY;
+
+    bool msix = false;
+    uint32_t count = 1;
+
+    uint32_t cap_ptr = pci_enumerate_capability_list(dev, 0x11);
+    if (cap_ptr)
+    {
+        uint32_t dw0 = dev->op->read(dev->bus, dev->slot, dev->func, dev->segment, cap_ptr);
+        uint32_t table_size = ((dw0 >> 16) & 0x7ff) + 1;
+        count = MIN(max, table_size);
+        msix = true;
+    }
+    else if (pci_enumerate_capability_list(dev, 0x05) == 0)
+    {
+        return -ENOSYS;
+    }
+
+    // 普通 MSI 只使用一个向量
+    if (count < min)
+        return -ENOSPC;
+
+    int64_t base = irq_alloc_vectors(count);
+    if (base < 0)
+        return base;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct msi_desc_t *desc = &msi_descs[base + i];
+
+        memset(desc, 0, sizeof(struct msi_desc_t));
+        desc->irq_num = base + i;
+        desc->processor = i % cpu_count;
+        desc->edge_trigger = 1;
+        desc->assert = 0;
+        desc->pci_dev = dev;
+        desc->msi_index = i;
+        desc->pci.msi_attribute.is_msix = msix;
+
+        int ret = pci_enable_msi(desc);
+        if (ret < 0)
+        {
+            dev->msix_enabled = msix;
+            pci_disable_msi(dev);
+            irq_free_vectors(base, count);
+            return ret;
+        }
+    }
+
+    dev->irq_vector_base = base;
+    dev->irq_vector_count = count;
+    dev->msix_enabled = msix;
+
+    return count;
+}
+
+int64_t pci_irq_vector(pci_device_t *dev, uint32_t index)
+{
+    if (index >= dev->irq_vector_count)
+        return -EINVAL;
+
+    return dev->irq_vector_base + index;
+}
+
+void pci_free_irq_vectors(pci_device_t *dev)
+{
+    if (!dev->irq_vector_count)
+        return;
+
+    if (dev->msix_enabled)
+    {
+        for (uint32_t i = 0; i < dev->irq_vector_count; i++)
+            __msix_clear_entry(dev, i);
+    }
+
+    pci_disable_msi(dev);
+    irq_free_vectors(dev->irq_vector_base, dev->irq_vector_count);
+
+    dev->irq_vector_base = 0;
+    dev->irq_vector_count = 0;
+    dev->msix_enabled = false;
+}
+
+// MSI-X 表项第 12 字节的 bit 0 是 per-vector mask, 普通 MSI 不支持单独屏蔽
+static int64_t msi_set_mask(uint64_t irq, bool mask)
+{
+    struct msi_desc_t *desc = &msi_descs[irq];
+    if (!desc->pci_dev || !desc->pci.msi_attribute.is_msix)
+        return 0;
+
+    volatile uint32_t *ctrl = (volatile uint32_t *)(desc->pci_dev->msix_mmio_vaddr + desc->pci_dev->msix_offset + desc->msi_index * 16 + 12);
+    if (mask)
+        *ctrl |= 1;
+    else
+        *ctrl &= ~1U;
+
+    return 0;
+}
+
+static int64_t msi_mask(uint64_t irq)
+{
+    return msi_set_mask(irq, true);
+}
+
+static int64_t msi_unmask(uint64_t irq)
+{
+    return msi_set_mask(irq, false);
+}
+
+// 只改 message address 中的目标, 向量号不变
+static int64_t msi_set_affinity(uint64_t irq, uint32_t cpu)
+{
+    struct msi_desc_t *desc = &msi_descs[irq];
+    pci_device_t *dev = desc->pci_dev;
+    if (!dev)
+        return -EINVAL;
+
+    desc->processor = cpu;
+    msi_arch_get_msg(desc);
+
+    if (desc->pci.msi_attribute.is_msix)
+    {
+        // 先屏蔽表项再改地址, __msix_set_entry 写完地址和数据后才单独写 vector control 解除屏蔽
+        msi_set_mask(irq, true);
+        __msix_set_entry(desc);
+        return 0;
+    }
+
+    uint32_t cap_ptr = pci_enumerate_capability_list(dev, 0x05);
+    if (cap_ptr == 0)
+        return -ENOSYS;
+
+    uint32_t message_control = (dev->op->read(dev->bus, dev->slot, dev->func, dev->segment, cap_ptr) >> 16) & 0xffff;
+    dev->op->write(dev->bus, dev->slot, dev->func, dev->segment, cap_ptr + 0x4, desc->msg.address_lo);
+    if (message_control & (1 << 7))
+        dev->op->write(dev->bus, dev->slot, dev->func, dev->segment, cap_ptr + 0x8, desc->msg.address_hi);
+
+    return 0;
+}
+
+static int64_t msi_install(uint64_t irq, uint64_t arg)
+{
+    return 0;
+}
+
+static int64_t msi_ack(uint64_t irq)
+{
+    msi_arch_eoi();
+    return 0;
+}
+
+irq_controller_t msi_controller = {
+    .mask = msi_mask,
+    .unmask = msi_unmask,
+    .install = msi_install,
+    .ack = msi_ack,
+    .set_affinity = msi_set_affinity,
+    .name = "PCI-MSI",
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "drivers/bus/pci.h"
+#include "interrupt/irq_manager.h"
 
 /**
  * @brief msi消息内容结构体
@@ -94,3 +95,19 @@ struct msi_desc_t
  * @return 返回码
  */
 int pci_enable_msi(struct msi_desc_t *msi_desc);
+
+/**
+ * @brief 为设备分配 [min, max] 个中断向量, 优先使用 MSI-X, 否则退回单个 MSI 向量
+ *
+ * @return 分配到的向量数量, 或者负的错误码
+ */
+int pci_alloc_irq_vectors(pci_device_t *dev, uint32_t min, uint32_t max);
+
+/**
+ * @brief 获取第 index 个 MSI/MSI-X 表项对应的向量号
+ */
+int64_t pci_irq_vector(pci_device_t *dev, uint32_t index);
+
+void pci_free_irq_vectors(pci_device_t *dev);
+
+extern irq_controller_t msi_controller;
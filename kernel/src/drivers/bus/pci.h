@@ -65,6 +65,11 @@ typedef struct
     uint32_t msix_offset;
     uint16_t msix_table_size;
 
+    // pci_alloc_irq_vectors 分配的连续向量
+    uint64_t irq_vector_base;
+    uint32_t irq_vector_count;
+    bool msix_enabled;
+
     uint8_t irq_line;
     uint8_t irq_pin;
 
@@ -1,6 +1,7 @@
 #include <drivers/kernel_logger.h>
 #include <arch/arch.h>
 #include <mm/mm.h>
+#include <task/lock_stat.h>
 
 #define PAD_ZERO 1 // 0填充
 #define LEFT 2     // 靠左对齐
@@ -534,7 +535,7 @@ char *write_float_point_num(char *str, double num, int field_width, int precisio
     return str;
 }
 
-spinlock_t printk_lock = {0};
+DEFINE_SPINLOCK_STAT(printk_lock);
 
 int printk(const char *fmt, ...)
 {
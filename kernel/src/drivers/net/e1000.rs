@@ -23,11 +23,11 @@ use smoltcp::{iface::*, socket};
 
 use crate::mm::phys_to_virt;
 use crate::net::{NetworkDevice, SOCKETS, SOCKETS_SET};
-use crate::rust::bindings::bindings::apic_controller;
+use crate::rust::bindings::bindings::{apic_controller, msi_controller};
 use crate::rust::bindings::bindings::{
     DEFAULT_PAGE_SIZE, PT_FLAG_R, PT_FLAG_W, alloc_frames, arch_enable_interrupt, arch_yield,
-    get_current_page_dir, irq_controller_t, irq_regist_irq, map_page_range, mktime, pci_device_t,
-    pci_find_class, pt_regs, task_create, task_exit, time_read, tm,
+    IRQF_ONESHOT, get_current_page_dir, irq_controller_t, map_page_range, mktime,
+    pci_alloc_irq_vectors, pci_device_t, pci_find_class, pci_irq_vector, request_threaded_irq, task_create, task_exit, time_read, tm,
 };
 use crate::{println, ref_to_mut};
 
@@ -431,11 +431,25 @@ pub static E1000_DRIVER: Lazy<Mutex<Vec<Arc<E1000Interface>>>> = Lazy::new(|| {
 
         let iface = Interface::new(config, &mut net_driver, get_current_instant());
 
+        // 优先使用 MSI/MSI-X, 不支持时退回 IOAPIC 上的 INTx
+        // MSI-X 可以按向量屏蔽, 线程处理期间保持屏蔽
+        let (irq, controller, flags) = unsafe {
+            if pci_alloc_irq_vectors(device as *mut pci_device_t, 1, 1) > 0 {
+                (
+                    pci_irq_vector(device as *mut pci_device_t, 0) as u64,
+                    &raw mut msi_controller,
+                    IRQF_ONESHOT,
+                )
+            } else {
+                (device.irq_line as u64 + 32, &raw mut apic_controller, 0)
+            }
+        };
+
         let interface = Arc::new(E1000Interface {
             iface: Arc::new(iface),
             driver: net_driver.clone(),
             name: format!("eth{}", i),
-            irq: Some(device.irq_line as usize),
+            irq: Some(irq as usize),
         });
         drivers.push(interface.clone());
 
@@ -446,12 +460,14 @@ pub static E1000_DRIVER: Lazy<Mutex<Vec<Arc<E1000Interface>>>> = Lazy::new(|| {
         }
 
         unsafe {
-            irq_regist_irq(
-                device.irq_line as u64 + 32,
-                Some(e1000_irq_handler),
+            request_threaded_irq(
+                irq,
+                None,
+                Some(e1000_irq_thread),
                 device.irq_line as u64,
                 core::ptr::null_mut(),
-                &raw mut apic_controller as *mut irq_controller_t,
+                controller as *mut irq_controller_t,
+                flags,
                 "e1000\0".as_ptr() as usize as *mut core::ffi::c_char,
             )
         };
@@ -460,11 +476,8 @@ pub static E1000_DRIVER: Lazy<Mutex<Vec<Arc<E1000Interface>>>> = Lazy::new(|| {
     Mutex::new(drivers)
 });
 
-unsafe extern "C" fn e1000_irq_handler(
-    irq_num: u64,
-    data: *mut ::core::ffi::c_void,
-    regs: *mut pt_regs,
-) {
+// 在中断线程中执行, 主处理函数只负责唤醒线程
+unsafe extern "C" fn e1000_irq_thread(irq_num: u64, data: *mut ::core::ffi::c_void) {
     ref_to_mut(ACTIVATE_DRIVER.clone().unwrap().driver.0.as_ref()).handle_interrupt();
 }
 
@@ -1,6 +1,7 @@
 #include <drivers/usb/hcds/usb-xhci.h>
 #include <drivers/usb/usb.h>
 #include <drivers/bus/pci.h>
+#include <drivers/bus/msi.h>
 #include <mm/mm.h>
 
 // --------------------------------------------------------------
@@ -39,6 +40,11 @@
 #define XHCI_STS_CNR (1 << 11)
 #define XHCI_STS_HCE (1 << 12)
 
+#define XHCI_IMAN_IP (1 << 0)
+#define XHCI_IMAN_IE (1 << 1)
+
+#define XHCI_ERDP_EHB (1 << 3)
+
 #define XHCI_PORTSC_CCS (1 << 0)
 #define XHCI_PORTSC_PED (1 << 1)
 #define XHCI_PORTSC_OCA (1 << 3)
@@ -245,6 +251,8 @@ struct usb_xhci_s
     struct xhci_ring *cmds;
     struct xhci_ring *evts;
     struct xhci_er_seg *eseg;
+
+    irq_waiter_t irq;
 };
 
 struct xhci_pipe
@@ -401,6 +409,17 @@ xhci_free_pipes(struct usb_xhci_s *xhci)
     // XXX - should walk list of pipes and free unused pipes.
 }
 
+static void xhci_irq_handler(uint64_t irq_num, void *data, struct pt_regs *regs)
+{
+    struct usb_xhci_s *xhci = data;
+
+    // EINT 和 IMAN.IP 都是写 1 清除
+    xhci->op->usbsts = XHCI_STS_EINT;
+    xhci->ir->iman = XHCI_IMAN_IP | XHCI_IMAN_IE;
+
+    irq_waiter_wake(&xhci->irq);
+}
+
 static void
 configure_xhci(void *data)
 {
@@ -476,8 +495,23 @@ configure_xhci(void *data)
         xhci->devs[0].ptr_high = (uint32_t)(spba_phys >> 23);
     }
 
+    // 中断只用来唤醒等待者, 事件仍由等待者自己处理
+    irq_waiter_init(&xhci->irq);
+    if (pci_alloc_irq_vectors(xhci->usb.pci, 1, 1) > 0)
+    {
+        irq_regist_irq(pci_irq_vector(xhci->usb.pci, 0), xhci_irq_handler, 0, xhci, &msi_controller, "xHCI");
+        xhci->ir->iman = XHCI_IMAN_IP | XHCI_IMAN_IE;
+    }
+    else
+    {
+        xhci->irq.enabled = false;
+        printk("XHCI: no MSI/MSI-X available, polling for events\n");
+    }
+
     reg = xhci->op->usbcmd;
     reg |= XHCI_CMD_RS;
+    if (xhci->irq.enabled)
+        reg |= XHCI_CMD_INTE;
     xhci->op->usbcmd = reg;
 
     // Find devices
@@ -673,7 +707,8 @@ static void xhci_process_events(struct usb_xhci_s *xhci)
         evts->nidx = nidx;
         struct xhci_ir *ir = xhci->ir;
         uint64_t erdp = translate_address(get_current_page_dir(false), (uint64_t)(evts->ring + nidx));
-        ir->erdp_low = (uint32_t)(erdp & 0xFFFFFFFF);
+        // 同时清除 EHB, 控制器才会为之后的事件再发中断
+        ir->erdp_low = (uint32_t)(erdp & 0xFFFFFFFF) | XHCI_ERDP_EHB;
         ir->erdp_high = (uint32_t)(erdp >> 32);
     }
 }
@@ -686,21 +721,21 @@ static int xhci_ring_busy(struct xhci_ring *ring)
     return (eidx != nidx);
 }
 
+static bool xhci_event_done(struct usb_xhci_s *xhci, struct xhci_ring *ring)
+{
+    xhci_process_events(xhci);
+    return !xhci_ring_busy(ring);
+}
+
 // Wait for a ring to empty (all TRBs processed by hardware)
 static int xhci_event_wait(struct usb_xhci_s *xhci,
                            struct xhci_ring *ring,
                            uint32_t timeout)
 {
-    for (;;)
-    {
-        xhci_process_events(xhci);
-        if (!xhci_ring_busy(ring))
-        {
-            uint32_t status = ring->evt.status;
-            return (status >> 24) & 0xff;
-        }
-        arch_pause();
-    }
+    irq_wait_event(&xhci->irq, xhci_event_done(xhci, ring));
+
+    uint32_t status = ring->evt.status;
+    return (status >> 24) & 0xff;
 }
 
 // Add a TRB to the given ring
@@ -11,6 +11,7 @@
 #include <drivers/usb/usb-hid.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <task/workqueue.h>
 
 struct pipe_node
 {
@@ -84,7 +85,13 @@ struct keyevent
 
 #define MAX_KBD_EVENT 16
 
-static void usb_check_key();
+// 键盘没有中断回调, 由工作队列定期轮询
+#define USB_KBD_POLL_NS 10000000ULL
+
+static delayed_work_t usb_kbd_work;
+static bool usb_kbd_polling = false;
+
+static void usb_check_key(work_struct_t *work);
 
 static int usb_kbd_setup(struct usbdevice_s *usbdev, struct usb_endpoint_descriptor *epdesc)
 {
@@ -106,7 +113,12 @@ static int usb_kbd_setup(struct usbdevice_s *usbdev, struct usb_endpoint_descrip
     if (add_pipe_node(&keyboards, usbdev, epdesc))
         return -1;
 
-    task_create("USB KBD HANDLE", usb_check_key, 0);
+    if (!usb_kbd_polling)
+    {
+        usb_kbd_polling = true;
+        delayed_work_init(&usb_kbd_work, usb_check_key, NULL);
+        queue_delayed_work(&usb_kbd_work, USB_KBD_POLL_NS);
+    }
 
     return 0;
 }
@@ -568,28 +580,25 @@ static void handle_key(struct keyevent *data)
 }
 
 // Check if a USB keyboard event is pending and process it if so.
-static void usb_check_key()
+static void usb_check_key(work_struct_t *work)
 {
-    while (1)
+    for (struct pipe_node *node = keyboards;
+         node;
+         node = node->next)
     {
-        for (struct pipe_node *node = keyboards;
-             node;
-             node = node->next)
-        {
-            struct usb_pipe *pipe = node->pipe;
+        struct usb_pipe *pipe = node->pipe;
 
-            for (;;)
-            {
-                uint8_t data[MAX_KBD_EVENT];
-                int ret = usb_poll_intr(pipe, data);
-                if (ret)
-                    break;
-                handle_key((void *)data);
-            }
+        for (;;)
+        {
+            uint8_t data[MAX_KBD_EVENT];
+            int ret = usb_poll_intr(pipe, data);
+            if (ret)
+                break;
+            handle_key((void *)data);
         }
-
-        arch_pause();
     }
+
+    queue_delayed_work(&usb_kbd_work, USB_KBD_POLL_NS);
 }
 
 // // Handle a ps2 style keyboard command.
@@ -1,10 +1,10 @@
-use core::hint::spin_loop;
-
 use alloc::vec::Vec;
 use spin::{Lazy, Mutex, MutexGuard};
 use virtio_drivers::{Error, device::input::VirtIOInput, transport::pci::PciTransport};
 
-use crate::rust::bindings::bindings::{arch_get_current, kb_char, task_create};
+use crate::rust::bindings::bindings::{
+    arch_get_current, delayed_work_init, delayed_work_t, kb_char, queue_delayed_work, work_struct,
+};
 
 use super::{
     decode::{DecodeType, Decoder},
@@ -25,26 +25,29 @@ impl VirtIOInputDriver {
 
 static INPUT_DRIVERS: Mutex<Vec<VirtIOInputDriver>> = Mutex::new(Vec::new());
 
-unsafe extern "C" fn virtio_input_kthread(arg: u64) {
-    loop {
-        for device in INPUT_DRIVERS.lock().iter() {
-            if let Some(event) = device.lock().pop_pending_event() {
-                let decode = Decoder::decode(
-                    event.event_type as usize,
-                    event.code as usize,
-                    event.value as usize,
-                );
-                if let Ok(code) = decode {
-                    if let DecodeType::Key(key, ty) = code {
-                        push_char(key.to_char().unwrap() as u8);
-                    } else if let DecodeType::Mouse(mouse) = code {
-                    }
+// 设备没有注册中断, 由工作队列定期轮询
+const INPUT_POLL_NS: u64 = 10_000_000;
+
+static mut INPUT_WORK: delayed_work_t = unsafe { core::mem::zeroed() };
+
+unsafe extern "C" fn virtio_input_work(_work: *mut work_struct) {
+    for device in INPUT_DRIVERS.lock().iter() {
+        while let Some(event) = device.lock().pop_pending_event() {
+            let decode = Decoder::decode(
+                event.event_type as usize,
+                event.code as usize,
+                event.value as usize,
+            );
+            if let Ok(code) = decode {
+                if let DecodeType::Key(key, ty) = code {
+                    push_char(key.to_char().unwrap() as u8);
+                } else if let DecodeType::Mouse(mouse) = code {
                 }
             }
         }
-
-        spin_loop();
     }
+
+    unsafe { queue_delayed_work(&raw mut INPUT_WORK, INPUT_POLL_NS) };
 }
 
 fn push_char(c: u8) {
@@ -55,11 +58,8 @@ pub fn init_pci(transport: PciTransport) {
     if let Ok(device) = VirtIOInputDriver::new(transport) {
         if INPUT_DRIVERS.lock().len() == 0 {
             unsafe {
-                task_create(
-                    "Virtio input kthread".as_ptr() as *const core::ffi::c_char,
-                    Some(virtio_input_kthread),
-                    0,
-                );
+                delayed_work_init(&raw mut INPUT_WORK, Some(virtio_input_work), core::ptr::null_mut());
+                queue_delayed_work(&raw mut INPUT_WORK, INPUT_POLL_NS);
             }
         }
         INPUT_DRIVERS.lock().push(device);
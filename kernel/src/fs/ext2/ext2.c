@@ -4,8 +4,9 @@
 #include <arch/arch.h>
 #include <task/task.h>
 #include <fs/fs_syscall.h>
+#include <task/lock_stat.h>
 
-spinlock_t ext2_op_lock = {0};
+DEFINE_SPINLOCK_STAT(ext2_op_lock);
 
 // 辅助函数
 
@@ -17,7 +17,11 @@ char *at_resolve_pathname(int dirfd, char *pathname)
         }
         else
         { // relative to dirfd, resolve accordingly
-            vfs_node_t node = current_task->fds[dirfd]->node;
+            fd_t *file = fd_get(current_task->files, dirfd);
+            if (!file)
+                return (char *)-EBADF;
+            vfs_node_t node = file->node;
+            fd_put(file);
             if (!node)
                 return (char *)-EBADF;
             if (node->type != file_dir)
@@ -77,3 +81,132 @@ void wake_blocked_tasks(task_block_list_t *head)
         current = next;
     }
 }
+
+// 保护所有事件源的 poll 等待队列, 事件源可能在中断中唤醒
+static spinlock_t poll_wait_lock = {0};
+
+void poll_wait(task_block_list_t *head)
+{
+    poll_table_t *table = current_task->poll_table;
+    if (!table)
+        return;
+
+    // 重新扫描时同一个队列只登记一次
+    for (poll_wait_entry_t *entry = table->entries; entry; entry = entry->next)
+    {
+        if (entry->head == head)
+            return;
+    }
+
+    poll_wait_entry_t *entry = malloc(sizeof(poll_wait_entry_t));
+    entry->wait.task = current_task;
+    entry->head = head;
+    entry->table = table;
+
+    spin_lock_irqsave(&poll_wait_lock);
+    entry->wait.next = head->next;
+    head->next = &entry->wait;
+    spin_unlock_irqrestore(&poll_wait_lock);
+
+    entry->next = table->entries;
+    table->entries = entry;
+}
+
+void poll_wake(task_block_list_t *head)
+{
+    spin_lock_irqsave(&poll_wait_lock);
+
+    for (task_block_list_t *wait = head->next; wait; wait = wait->next)
+    {
+        poll_wait_entry_t *entry = (poll_wait_entry_t *)wait;
+
+        entry->table->triggered = true;
+        if (wait->task->state == TASK_BLOCKING)
+            task_unblock(wait->task, EOK);
+    }
+
+    spin_unlock_irqrestore(&poll_wait_lock);
+}
+
+void poll_wait_free(task_block_list_t *head)
+{
+    spin_lock_irqsave(&poll_wait_lock);
+
+    task_block_list_t *wait = head->next;
+    head->next = NULL;
+
+    while (wait)
+    {
+        poll_wait_entry_t *entry = (poll_wait_entry_t *)wait;
+        wait = wait->next;
+
+        entry->head = NULL;
+        entry->table->triggered = true;
+        if (entry->wait.task->state == TASK_BLOCKING)
+            task_unblock(entry->wait.task, EOK);
+    }
+
+    spin_unlock_irqrestore(&poll_wait_lock);
+}
+
+void poll_table_init(poll_table_t *table)
+{
+    table->entries = NULL;
+    table->triggered = false;
+    current_task->poll_table = table;
+}
+
+void poll_table_free(poll_table_t *table)
+{
+    current_task->poll_table = NULL;
+
+    spin_lock_irqsave(&poll_wait_lock);
+
+    for (poll_wait_entry_t *entry = table->entries; entry; entry = entry->next)
+    {
+        if (!entry->head)
+            continue;
+
+        task_block_list_t *prev = entry->head;
+        while (prev->next && prev->next != &entry->wait)
+            prev = prev->next;
+        if (prev->next)
+            prev->next = entry->wait.next;
+    }
+
+    spin_unlock_irqrestore(&poll_wait_lock);
+
+    while (table->entries)
+    {
+        poll_wait_entry_t *entry = table->entries;
+        table->entries = entry->next;
+        free(entry);
+    }
+}
+
+void poll_sleep_until(poll_table_t *table, uint64_t deadline)
+{
+    arch_disable_interrupt();
+
+    // 先进入阻塞状态, 再在 poll_wake 的锁下检查 triggered, 扫描之后的唤醒不会丢失
+    task_block_prepare(current_task, TASK_BLOCKING, deadline);
+
+    spin_lock_irqsave(&poll_wait_lock);
+    bool triggered = table->triggered;
+    table->triggered = false;
+    spin_unlock_irqrestore(&poll_wait_lock);
+
+    if (triggered)
+    {
+        current_task->state = TASK_READY;
+        if (deadline)
+            hrtimer_cancel(&current_task->block_timer);
+        return;
+    }
+
+    task_block_wait(current_task, TASK_BLOCKING, deadline);
+
+    spin_lock_irqsave(&poll_wait_lock);
+    table->triggered = false;
+    spin_unlock_irqrestore(&poll_wait_lock);
+}
@@ -29,6 +29,23 @@ struct timespec
     long tv_nsec;
 };
 
+struct itimerspec
+{
+    struct timespec it_interval;
+    struct timespec it_value;
+};
+
+static inline uint64_t timespec_to_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+static inline void ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
 #define S_IFMT 00170000
 #define S_IFSOCK 0140000
 #define S_IFLNK 0120000
@@ -165,6 +182,7 @@ uint64_t sys_writev(uint64_t fd, struct iovec *iovec, uint64_t count);
 uint64_t sys_getdents(uint64_t fd, uint64_t buf, uint64_t size);
 uint64_t sys_chdir(const char *dirname);
 uint64_t sys_getcwd(char *cwd, uint64_t size);
+uint64_t sys_umask(uint64_t mask);
 
 uint64_t sys_dup(uint64_t fd);
 uint64_t sys_dup2(uint64_t fd, uint64_t newfd);
@@ -182,6 +200,8 @@ uint64_t sys_dup3(uint64_t oldfd, uint64_t newfd, uint64_t flags);
 
 #define F_DUPFD_CLOEXEC 1030
 
+#define FD_CLOEXEC 1
+
 uint64_t sys_fcntl(uint64_t fd, uint64_t command, uint64_t arg);
 int sys_pipe(int fd[2]);
 uint64_t sys_stat(const char *fd, struct stat *buf);
@@ -328,13 +348,15 @@ typedef struct epoll_watch
 
 typedef struct epoll
 {
-    bool lock;
+    rwlock_t lock; // epoll_wait 只读监视列表, epoll_ctl 修改
 
     struct epoll *next;
 
     epoll_watch_t *firstEpollWatch;
 
     uint64_t reference_count;
+
+    task_block_list_t poll_wait; // 监视列表变化时唤醒 epoll_wait 重新扫描
 } epoll_t;
 
 uint32_t poll_to_epoll_comp(uint32_t poll_events);
@@ -424,28 +446,159 @@ uint64_t sys_unlinkat(uint64_t dirfd, const char *name, uint64_t flags);
 #define CLOCK_SGI_CYCLE 10
 #define CLOCK_TAI 11
 
+#define TIMER_ABSTIME 1
+
+// 把 it_value 换成 nanoTime 上的到期时间, 0 表示解除定时器
+// 绝对时间按定时器的时钟解释, CLOCK_REALTIME 要减去实时时钟的偏移
+static inline uint64_t timer_value_to_deadline(int clock_type, const struct timespec *value, bool absolute)
+{
+    uint64_t ns = timespec_to_ns(value);
+    if (!ns)
+        return 0;
+
+    if (!absolute)
+        return nanoTime() + ns;
+
+#if defined(__x86_64__)
+    if (clock_type == CLOCK_REALTIME)
+        ns = ns > realtime_offset ? ns - realtime_offset : 0;
+#endif
+
+    // 已经过去的时间立即到期
+    return ns ? ns : 1;
+}
+
 typedef struct
 {
     kernel_timer_t timer;
     uint64_t count;
     int flags;
+    task_t *waiter;
+    task_block_list_t poll_wait;
 } timerfd_t;
 
+#define TFD_NONBLOCK O_NONBLOCK
+#define TFD_TIMER_ABSTIME (1 << 0)
+
 int sys_timerfd_create(int clockid, int flags);
-int sys_timerfd_settime(int fd, int flags, const struct itimerval *new_value, struct itimerval *old_v);
+int sys_timerfd_settime(int fd, int flags, const struct itimerspec *new_value, struct itimerspec *old_v);
+
+#define FUTEX_HASH_BITS 8
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+struct futex_bucket;
+
+// 私有 futex 以 (mm, 用户地址) 为键, 共享 futex 以物理地址为键, 此时 mm 为 NULL
+typedef struct futex_key
+{
+    void *mm;
+    uint64_t addr;
+} futex_key_t;
+
+// 等待者节点位于等待任务的内核栈上
+struct futex_q
+{
+    struct futex_q *prev;
+    struct futex_q *next;
+    futex_key_t key;
+    uint32_t bitset;
+    task_t *task;
+    struct futex_bucket *volatile bucket; // 被唤醒后置为 NULL
+};
 
-struct futex_wait
+// PI futex 的等待者, 按有效优先级排序
+struct futex_pi_waiter
 {
-    void *uaddr;
     task_t *task;
-    struct futex_wait *next;
+    struct futex_pi_waiter *next;
+    bool granted; // 解锁者已把锁直接交给该等待者
 };
 
+// 每个有等待者的 PI futex 对应一个, 类似 rt_mutex
+struct futex_pi_state
+{
+    futex_key_t key;
+    task_t *owner;
+    struct futex_pi_waiter *waiters;
+    struct futex_pi_state *owner_next; // owner->pi_owned 链表
+    struct futex_pi_state *next;       // 桶内链表
+};
+
+typedef struct futex_bucket
+{
+    spinlock_t lock;
+    struct futex_q *head;
+    struct futex_pi_state *pi_states;
+} futex_bucket_t;
+
 #define FUTEX_CMD_MASK 0x7F
 
 #define FUTEX_WAIT 0
 #define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_CMP_REQUEUE 4
+#define FUTEX_WAKE_OP 5
+#define FUTEX_LOCK_PI 6
+#define FUTEX_UNLOCK_PI 7
+#define FUTEX_TRYLOCK_PI 8
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
+
+#define FUTEX_PRIVATE_FLAG 128
+#define FUTEX_CLOCK_REALTIME 256
+
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+#define FUTEX_WAITERS 0x80000000
+#define FUTEX_OWNER_DIED 0x40000000
+#define FUTEX_TID_MASK 0x3fffffff
+
+// 优先级继承链的最大深度
+#define FUTEX_PI_MAX_DEPTH 64
+
+#define FUTEX_OP_SET 0
+#define FUTEX_OP_ADD 1
+#define FUTEX_OP_OR 2
+#define FUTEX_OP_ANDN 3
+#define FUTEX_OP_XOR 4
+#define FUTEX_OP_OPARG_SHIFT 8
+
+#define FUTEX_OP_CMP_EQ 0
+#define FUTEX_OP_CMP_NE 1
+#define FUTEX_OP_CMP_LT 2
+#define FUTEX_OP_CMP_LE 3
+#define FUTEX_OP_CMP_GT 4
+#define FUTEX_OP_CMP_GE 5
 
 int sys_futex(int *uaddr, int op, int val, const struct timespec *timeout, int *uaddr2, int val3);
+void futex_pi_adjust(task_t *task);
+void futex_exit(task_t *task);
 
 void wake_blocked_tasks(task_block_list_t *head);
+
+// poll/epoll 扫描时在各事件源的等待队列上登记, 事件源状态变化时唤醒
+typedef struct poll_wait_entry
+{
+    task_block_list_t wait; // 挂在事件源的队列上
+    task_block_list_t *head;
+    struct poll_table *table;
+    struct poll_wait_entry *next;
+} poll_wait_entry_t;
+
+typedef struct poll_table
+{
+    poll_wait_entry_t *entries;
+    bool triggered; // 登记之后有事件源调用过 poll_wake
+} poll_table_t;
+
+// 在事件源的 poll 回调中调用, 当前任务不在 poll/epoll 中时什么也不做
+void poll_wait(task_block_list_t *head);
+// 事件源状态变化后调用, 可以在中断中调用
+void poll_wake(task_block_list_t *head);
+// 事件源释放前调用, 唤醒并摘下所有登记项
+void poll_wait_free(task_block_list_t *head);
+
+void poll_table_init(poll_table_t *table);
+void poll_table_free(poll_table_t *table);
+// deadline 为 0 表示无限等待, 没有事件源唤醒时一直睡眠
+void poll_sleep_until(poll_table_t *table, uint64_t deadline);
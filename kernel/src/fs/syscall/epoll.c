@@ -12,37 +12,24 @@ static int dummy()
 // epoll API
 size_t epoll_create1(int flags)
 {
-    int i = -1;
-    for (i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i] == NULL)
-        {
-            break;
-        }
-    }
-
-    if (i == MAX_FD_NUM)
-    {
-        return -EBADF;
-    }
-
     char buf[256];
     sprintf(buf, "epoll%d", epollfd_id++);
     vfs_node_t node = vfs_node_alloc(epollfs_root, buf);
     node->type = file_epoll;
     node->refcount++;
     epoll_t *epoll = malloc(sizeof(epoll_t));
-    epoll->lock = false;
+    memset(&epoll->lock, 0, sizeof(rwlock_t));
     epoll->firstEpollWatch = NULL;
     epoll->reference_count = 1;
+    epoll->poll_wait.next = NULL;
     node->mode = 0700;
     node->handle = epoll;
     node->fsid = epollfs_id;
 
-    current_task->fds[i] = malloc(sizeof(fd_t));
-    current_task->fds[i]->node = node;
-    current_task->fds[i]->offset = 0;
-    current_task->fds[i]->flags = 0;
+    fd_t *file = fd_new(node, 0);
+    int i = fd_install(current_task->files, file, 0, flags & O_CLOEXEC);
+    if (i < 0)
+        fd_put(file);
 
     return i;
 }
@@ -61,15 +48,16 @@ uint64_t epoll_wait(vfs_node_t epollFd, struct epoll_event *events, int maxevent
     bool sigexit = false;
 
     int ready = 0;
-    size_t target = nanoTime() + timeout;
+    uint64_t deadline = timeout > 0 ? nanoTime() + (uint64_t)timeout * 1000000ULL : 0;
+
+    poll_table_t table;
+    poll_table_init(&table);
+
     do
     {
-        while (epoll->lock)
-        {
-            arch_pause();
-        }
+        poll_wait(&epoll->poll_wait);
 
-        epoll->lock = true;
+        read_lock(&epoll->lock);
         epoll_watch_t *browse = epoll->firstEpollWatch;
 
         while (browse && ready < maxevents)
@@ -84,23 +72,19 @@ uint64_t epoll_wait(vfs_node_t epollFd, struct epoll_event *events, int maxevent
             browse = browse->next;
         }
 
-        epoll->lock = false;
+        read_unlock(&epoll->lock);
 
         sigexit = signals_pending_quick(current_task);
 
-        if (ready > 0 || sigexit)
+        if (ready > 0 || sigexit || timeout == 0)
+            break;
+        if (deadline && nanoTime() >= deadline)
             break;
 
-#if defined(__x86_64__)
-        arch_enable_interrupt();
-#endif
-
-        arch_pause();
-    } while (timeout != 0 && (timeout == -1 || nanoTime() < target));
+        poll_sleep_until(&table, deadline);
+    } while (1);
 
-#if defined(__x86_64__)
-    arch_disable_interrupt();
-#endif
+    poll_table_free(&table);
 
     if (!ready && sigexit)
         return (uint64_t)-EINTR;
@@ -124,13 +108,16 @@ size_t epoll_ctl(vfs_node_t epollFd, int op, int fd, struct epoll_event *event)
 
     size_t ret = 0;
 
-    if (!current_task->fds[fd])
+    write_lock(&epoll->lock);
+
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
     {
         ret = (uint64_t)(-EBADF);
         goto cleanup;
     }
 
-    vfs_node_t fdNode = current_task->fds[fd]->node;
+    vfs_node_t fdNode = file->node;
 
     switch (op)
     {
@@ -188,7 +175,10 @@ size_t epoll_ctl(vfs_node_t epollFd, int op, int fd, struct epoll_event *event)
             ret = (uint64_t)(-ENOENT);
             goto cleanup;
         }
-        prev->next = browse->next;
+        if (prev)
+            prev->next = browse->next;
+        else
+            epoll->firstEpollWatch = browse->next;
         free(browse);
         break;
     }
@@ -198,6 +188,14 @@ size_t epoll_ctl(vfs_node_t epollFd, int op, int fd, struct epoll_event *event)
     }
 
 cleanup:
+    write_unlock(&epoll->lock);
+
+    if (file)
+        fd_put(file);
+
+    if (!ret)
+        poll_wake(&epoll->poll_wait);
+
     return ret;
 }
 
@@ -230,10 +228,17 @@ uint64_t sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int
     {
         return (uint64_t)-EFAULT;
     }
-    vfs_node_t node = current_task->fds[epfd]->node;
-    if (!node)
+    fd_t *file = fd_get(current_task->files, epfd);
+    if (!file)
         return (uint64_t)-EBADF;
-    return epoll_wait(node, events, maxevents, timeout);
+
+    uint64_t ret = (uint64_t)-EBADF;
+    vfs_node_t node = file->node;
+    if (node)
+        ret = epoll_wait(node, events, maxevents, timeout);
+
+    fd_put(file);
+    return ret;
 }
 
 uint64_t sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
@@ -242,10 +247,17 @@ uint64_t sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
     {
         return (uint64_t)-EFAULT;
     }
-    vfs_node_t node = current_task->fds[epfd]->node;
-    if (!node)
+    fd_t *file = fd_get(current_task->files, epfd);
+    if (!file)
         return (uint64_t)-EBADF;
-    return epoll_ctl(node, op, fd, event);
+
+    uint64_t ret = (uint64_t)-EBADF;
+    vfs_node_t node = file->node;
+    if (node)
+        ret = epoll_ctl(node, op, fd, event);
+
+    fd_put(file);
+    return ret;
 }
 
 uint64_t sys_epoll_pwait(int epfd, struct epoll_event *events,
@@ -256,10 +268,17 @@ uint64_t sys_epoll_pwait(int epfd, struct epoll_event *events,
     {
         return (uint64_t)-EFAULT;
     }
-    vfs_node_t node = current_task->fds[epfd]->node;
-    if (!node)
+    fd_t *file = fd_get(current_task->files, epfd);
+    if (!file)
         return (uint64_t)-EBADF;
-    return epoll_pwait(node, events, maxevents, timeout, sigmask, sigsetsize);
+
+    uint64_t ret = (uint64_t)-EBADF;
+    vfs_node_t node = file->node;
+    if (node)
+        ret = epoll_pwait(node, events, maxevents, timeout, sigmask, sigsetsize);
+
+    fd_put(file);
+    return ret;
 }
 
 uint64_t sys_epoll_create1(int flags) { return epoll_create1(flags); }
@@ -16,22 +16,6 @@ uint64_t sys_eventfd2(uint64_t initial_val, uint64_t flags)
     if (flags & ~(EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE))
         return (uint64_t)-EINVAL;
 
-    // 分配文件描述符
-    int fd = -1;
-    for (int i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (!current_task->fds[i])
-        {
-            fd = i;
-            break;
-        }
-    }
-
-    if (fd == -1)
-    {
-        return (uint64_t)-EMFILE;
-    }
-
     // 分配eventfd结构体
     eventfd_t *efd = malloc(sizeof(eventfd_t));
     if (!efd)
@@ -50,12 +34,13 @@ uint64_t sys_eventfd2(uint64_t initial_val, uint64_t flags)
     node->fsid = eventfdfs_id;
     node->handle = efd;
 
-    current_task->fds[fd] = malloc(sizeof(fd_t));
-    current_task->fds[fd]->node = node;
-    current_task->fds[fd]->offset = 0;
-    current_task->fds[fd]->flags = 0;
+    // 文件完全建好后再安装, 其他线程拿到 fd 时 node 已经可用
+    fd_t *file = fd_new(node, 0);
+    int fd = fd_install(current_task->files, file, 0, flags & EFD_CLOEXEC);
+    if (fd < 0)
+        fd_put(file);
 
-    return fd;
+    return (uint64_t)fd;
 }
 
 // 实现读写操作
@@ -0,0 +1,800 @@
+#include <fs/fs_syscall.h>
+#include <arch/arch.h>
+#include <mm/mm.h>
+#include <task/lock_stat.h>
+
+// 所有桶的锁算作同一类
+static lock_stat_t futex_bucket_stat = LOCK_STAT_INIT("futex_bucket_lock");
+static futex_bucket_t futex_buckets[FUTEX_HASH_SIZE] = {
+    [0 ... FUTEX_HASH_SIZE - 1] = {.lock = SPINLOCK_STAT_INIT(futex_bucket_stat)},
+};
+
+// 私有 futex 只在同一个 mm 内匹配, 不依赖物理页: 写时复制换页后键保持不变,
+// 映射同一个页缓存页的不相关进程也不会互相唤醒
+// 共享 futex 以 futex 字的物理地址为键
+static int futex_key(int *uaddr, int flags, futex_key_t *key)
+{
+    if (((uint64_t)uaddr & 3) || check_user_overflow((uint64_t)uaddr, sizeof(int)))
+        return -EFAULT;
+
+    uint64_t phys = translate_address(get_current_page_dir(true), (uint64_t)uaddr);
+    if (phys < DEFAULT_PAGE_SIZE)
+        return -EFAULT;
+
+    if (flags & FUTEX_PRIVATE_FLAG)
+    {
+        key->mm = current_task->arch_context->mm;
+        key->addr = (uint64_t)uaddr;
+    }
+    else
+    {
+        key->mm = NULL;
+        key->addr = phys;
+    }
+
+    return 0;
+}
+
+static inline bool futex_key_equal(const futex_key_t *a, const futex_key_t *b)
+{
+    return a->mm == b->mm && a->addr == b->addr;
+}
+
+static futex_bucket_t *futex_hash(const futex_key_t *key)
+{
+    uint64_t h = (key->addr >> 2) ^ ((uint64_t)key->mm >> 4);
+
+    return &futex_buckets[(h * 0x9E3779B97F4A7C15ULL) >> (64 - FUTEX_HASH_BITS)];
+}
+
+static void futex_bucket_lock2(futex_bucket_t *b1, futex_bucket_t *b2)
+{
+    if (b1 > b2)
+    {
+        futex_bucket_t *tmp = b1;
+        b1 = b2;
+        b2 = tmp;
+    }
+
+    spin_lock_irqsave(&b1->lock);
+    if (b1 != b2)
+        spin_lock(&b2->lock);
+}
+
+static void futex_bucket_unlock2(futex_bucket_t *b1, futex_bucket_t *b2)
+{
+    if (b1 > b2)
+    {
+        futex_bucket_t *tmp = b1;
+        b1 = b2;
+        b2 = tmp;
+    }
+
+    if (b1 != b2)
+        spin_unlock(&b2->lock);
+    spin_unlock_irqrestore(&b1->lock);
+}
+
+// 需持有 bucket->lock
+static void futex_enqueue(futex_bucket_t *bucket, struct futex_q *q)
+{
+    q->prev = NULL;
+    q->next = bucket->head;
+    if (bucket->head)
+        bucket->head->prev = q;
+    bucket->head = q;
+    q->bucket = bucket;
+}
+
+// 需持有 q->bucket->lock
+static void futex_dequeue(struct futex_q *q)
+{
+    futex_bucket_t *bucket = q->bucket;
+
+    if (q->prev)
+        q->prev->next = q->next;
+    else
+        bucket->head = q->next;
+    if (q->next)
+        q->next->prev = q->prev;
+
+    q->prev = NULL;
+    q->next = NULL;
+}
+
+// 需持有 q->bucket->lock, 之后等待者可能立刻返回, 不能再访问 q
+static void futex_wake_one(struct futex_q *q)
+{
+    task_t *task = q->task;
+
+    futex_dequeue(q);
+    task_unblock(task, EOK);
+    q->bucket = NULL;
+}
+
+// 超时或被信号打断时自行出队, 返回 false 表示已经被唤醒
+static bool futex_unqueue(struct futex_q *q)
+{
+    for (;;)
+    {
+        futex_bucket_t *bucket = q->bucket;
+        if (!bucket)
+            return false;
+
+        spin_lock_irqsave(&bucket->lock);
+
+        // 可能已被 requeue 到其他桶
+        if (bucket != q->bucket)
+        {
+            spin_unlock_irqrestore(&bucket->lock);
+            continue;
+        }
+
+        futex_dequeue(q);
+        q->bucket = NULL;
+
+        spin_unlock_irqrestore(&bucket->lock);
+        return true;
+    }
+}
+
+static int futex_wait(int *uaddr, int flags, int val, uint64_t deadline, uint32_t bitset)
+{
+    if (!bitset)
+        return -EINVAL;
+
+    futex_key_t key;
+    int ret = futex_key(uaddr, flags, &key);
+    if (ret < 0)
+        return ret;
+
+    futex_bucket_t *bucket = futex_hash(&key);
+    struct futex_q q = {
+        .key = key,
+        .bitset = bitset,
+        .task = current_task,
+    };
+
+    spin_lock_irqsave(&bucket->lock);
+
+    if (*(volatile int *)uaddr != val)
+    {
+        spin_unlock_irqrestore(&bucket->lock);
+        return -EWOULDBLOCK;
+    }
+
+    futex_enqueue(bucket, &q);
+    task_block_prepare(current_task, TASK_BLOCKING, deadline);
+
+    spin_unlock_irqrestore(&bucket->lock);
+
+    int status = task_block_wait(current_task, TASK_BLOCKING, deadline);
+
+    if (!futex_unqueue(&q))
+        return 0;
+
+    return status == -ETIMEDOUT ? -ETIMEDOUT : -EINTR;
+}
+
+static int futex_wake(int *uaddr, int flags, int nr_wake, uint32_t bitset)
+{
+    if (!bitset)
+        return -EINVAL;
+
+    futex_key_t key;
+    int ret = futex_key(uaddr, flags, &key);
+    if (ret < 0)
+        return ret;
+
+    futex_bucket_t *bucket = futex_hash(&key);
+    int woken = 0;
+
+    spin_lock_irqsave(&bucket->lock);
+
+    struct futex_q *q = bucket->head;
+    while (q && woken < nr_wake)
+    {
+        struct futex_q *next = q->next;
+        if (futex_key_equal(&q->key, &key) && (q->bitset & bitset))
+        {
+            futex_wake_one(q);
+            woken++;
+        }
+        q = next;
+    }
+
+    spin_unlock_irqrestore(&bucket->lock);
+
+    return woken;
+}
+
+static int futex_requeue(int *uaddr, int *uaddr2, int flags, int nr_wake, int nr_requeue, bool cmp, int cmpval)
+{
+    if (nr_wake < 0 || nr_requeue < 0)
+        return -EINVAL;
+
+    futex_key_t key1, key2;
+    if (futex_key(uaddr, flags, &key1) < 0 || futex_key(uaddr2, flags, &key2) < 0)
+        return -EFAULT;
+
+    futex_bucket_t *b1 = futex_hash(&key1);
+    futex_bucket_t *b2 = futex_hash(&key2);
+    int woken = 0;
+    int requeued = 0;
+
+    futex_bucket_lock2(b1, b2);
+
+    if (cmp && *(volatile int *)uaddr != cmpval)
+    {
+        futex_bucket_unlock2(b1, b2);
+        return -EAGAIN;
+    }
+
+    struct futex_q *q = b1->head;
+    while (q)
+    {
+        struct futex_q *next = q->next;
+
+        if (futex_key_equal(&q->key, &key1))
+        {
+            if (woken < nr_wake)
+            {
+                futex_wake_one(q);
+                woken++;
+            }
+            else if (requeued < nr_requeue)
+            {
+                futex_dequeue(q);
+                q->key = key2;
+                futex_enqueue(b2, q);
+                requeued++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        q = next;
+    }
+
+    futex_bucket_unlock2(b1, b2);
+
+    return woken + requeued;
+}
+
+// 在加锁和访问用户内存之前检查整个编码, 非法的操作不能产生任何副作用
+static int futex_op_check(int encoded_op)
+{
+    int op = (encoded_op >> 28) & 7;
+    int cmp = (encoded_op >> 24) & 15;
+    int oparg = (int)((uint32_t)encoded_op << 8) >> 20;
+
+    if (op > FUTEX_OP_XOR || cmp > FUTEX_OP_CMP_GE)
+        return -ENOSYS;
+
+    if ((encoded_op & (FUTEX_OP_OPARG_SHIFT << 28)) && (oparg < 0 || oparg > 31))
+        return -EINVAL;
+
+    return 0;
+}
+
+// 编码已经过 futex_op_check 检查
+static void futex_atomic_op(int *uaddr, int encoded_op, int *oldval)
+{
+    int op = (encoded_op >> 28) & 7;
+    int oparg = (int)((uint32_t)encoded_op << 8) >> 20;
+
+    if (encoded_op & (FUTEX_OP_OPARG_SHIFT << 28))
+        oparg = 1 << oparg;
+
+    switch (op)
+    {
+    case FUTEX_OP_SET:
+        *oldval = __atomic_exchange_n(uaddr, oparg, __ATOMIC_SEQ_CST);
+        break;
+    case FUTEX_OP_ADD:
+        *oldval = __atomic_fetch_add(uaddr, oparg, __ATOMIC_SEQ_CST);
+        break;
+    case FUTEX_OP_OR:
+        *oldval = __atomic_fetch_or(uaddr, oparg, __ATOMIC_SEQ_CST);
+        break;
+    case FUTEX_OP_ANDN:
+        *oldval = __atomic_fetch_and(uaddr, ~oparg, __ATOMIC_SEQ_CST);
+        break;
+    case FUTEX_OP_XOR:
+    default:
+        *oldval = __atomic_fetch_xor(uaddr, oparg, __ATOMIC_SEQ_CST);
+        break;
+    }
+}
+
+static bool futex_op_cmp(int encoded_op, int oldval)
+{
+    int cmp = (encoded_op >> 24) & 15;
+    int cmparg = (int)((uint32_t)encoded_op << 20) >> 20;
+
+    switch (cmp)
+    {
+    case FUTEX_OP_CMP_EQ:
+        return oldval == cmparg;
+    case FUTEX_OP_CMP_NE:
+        return oldval != cmparg;
+    case FUTEX_OP_CMP_LT:
+        return oldval < cmparg;
+    case FUTEX_OP_CMP_LE:
+        return oldval <= cmparg;
+    case FUTEX_OP_CMP_GT:
+        return oldval > cmparg;
+    case FUTEX_OP_CMP_GE:
+    default:
+        return oldval >= cmparg;
+    }
+}
+
+static int futex_wake_op(int *uaddr, int *uaddr2, int flags, int nr_wake, int nr_wake2, int encoded_op)
+{
+    int ret = futex_op_check(encoded_op);
+    if (ret < 0)
+        return ret;
+
+    futex_key_t key1, key2;
+    if (futex_key(uaddr, flags, &key1) < 0 || futex_key(uaddr2, flags, &key2) < 0)
+        return -EFAULT;
+
+    futex_bucket_t *b1 = futex_hash(&key1);
+    futex_bucket_t *b2 = futex_hash(&key2);
+    int woken = 0;
+    int oldval;
+
+    futex_bucket_lock2(b1, b2);
+
+    futex_atomic_op(uaddr2, encoded_op, &oldval);
+
+    struct futex_q *q = b1->head;
+    while (q && woken < nr_wake)
+    {
+        struct futex_q *next = q->next;
+        if (futex_key_equal(&q->key, &key1))
+        {
+            futex_wake_one(q);
+            woken++;
+        }
+        q = next;
+    }
+
+    if (futex_op_cmp(encoded_op, oldval))
+    {
+        int woken2 = 0;
+
+        q = b2->head;
+        while (q && woken2 < nr_wake2)
+        {
+            struct futex_q *next = q->next;
+            if (futex_key_equal(&q->key, &key2))
+            {
+                futex_wake_one(q);
+                woken2++;
+            }
+            q = next;
+        }
+
+        woken += woken2;
+    }
+
+    futex_bucket_unlock2(b1, b2);
+
+    return woken;
+}
+
+// 保护所有任务的 prio / pi_blocked_on / pi_owned 以及 PI 等待者链表
+// 锁顺序: 桶锁 -> futex_pi_lock
+DEFINE_STATIC_SPINLOCK_STAT(futex_pi_lock);
+
+// 需持有 futex_pi_lock
+static void pi_waiter_insert(struct futex_pi_state *ps, struct futex_pi_waiter *w)
+{
+    struct futex_pi_waiter **pp = &ps->waiters;
+
+    // 同优先级按 FIFO
+    while (*pp && (*pp)->task->prio <= w->task->prio)
+        pp = &(*pp)->next;
+
+    w->next = *pp;
+    *pp = w;
+}
+
+// 需持有 futex_pi_lock
+static void pi_waiter_remove(struct futex_pi_state *ps, struct futex_pi_waiter *w)
+{
+    for (struct futex_pi_waiter **pp = &ps->waiters; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == w)
+        {
+            *pp = w->next;
+            w->next = NULL;
+            return;
+        }
+    }
+}
+
+// 需持有 futex_pi_lock
+static void pi_state_set_owner(struct futex_pi_state *ps, task_t *owner)
+{
+    if (ps->owner)
+    {
+        for (struct futex_pi_state **pp = &ps->owner->pi_owned; *pp; pp = &(*pp)->owner_next)
+        {
+            if (*pp == ps)
+            {
+                *pp = ps->owner_next;
+                break;
+            }
+        }
+    }
+
+    ps->owner = owner;
+    ps->owner_next = NULL;
+
+    if (owner)
+    {
+        ps->owner_next = owner->pi_owned;
+        owner->pi_owned = ps;
+    }
+}
+
+// 沿着 owner -> pi_blocked_on -> owner 链重新计算有效优先级, 需持有 futex_pi_lock
+static void pi_adjust_chain(task_t *task)
+{
+    for (int depth = 0; task && depth < FUTEX_PI_MAX_DEPTH; depth++)
+    {
+        int prio = task->static_prio;
+
+        for (struct futex_pi_state *ps = task->pi_owned; ps; ps = ps->owner_next)
+        {
+            if (ps->waiters && ps->waiters->task->prio < prio)
+                prio = ps->waiters->task->prio;
+        }
+
+        if (prio == task->prio)
+            break;
+
+        task->prio = prio;
+
+        struct futex_pi_state *blocked = task->pi_blocked_on;
+        if (!blocked)
+            break;
+
+        // 优先级变了, 在所等待的锁上重新排队
+        for (struct futex_pi_waiter *w = blocked->waiters; w; w = w->next)
+        {
+            if (w->task == task)
+            {
+                pi_waiter_remove(blocked, w);
+                pi_waiter_insert(blocked, w);
+                break;
+            }
+        }
+
+        task = blocked->owner;
+    }
+}
+
+// static_prio 或持有的锁变化后强制重新计算, 需持有 futex_pi_lock
+static void futex_pi_recompute(task_t *task)
+{
+    task->prio = -1;
+    pi_adjust_chain(task);
+}
+
+void futex_pi_adjust(task_t *task)
+{
+    spin_lock_irqsave(&futex_pi_lock);
+    futex_pi_recompute(task);
+    spin_unlock_irqrestore(&futex_pi_lock);
+}
+
+// 任务退出时放弃持有的 PI futex, 等待者保持阻塞直到超时或被信号打断
+void futex_exit(task_t *task)
+{
+    spin_lock_irqsave(&futex_pi_lock);
+
+    while (task->pi_owned)
+        pi_state_set_owner(task->pi_owned, NULL);
+
+    spin_unlock_irqrestore(&futex_pi_lock);
+}
+
+// 需持有 bucket->lock
+static struct futex_pi_state *pi_state_lookup(futex_bucket_t *bucket, const futex_key_t *key)
+{
+    for (struct futex_pi_state *ps = bucket->pi_states; ps; ps = ps->next)
+    {
+        if (futex_key_equal(&ps->key, key))
+            return ps;
+    }
+
+    return NULL;
+}
+
+// 需持有 bucket->lock 和 futex_pi_lock
+static void pi_state_free(futex_bucket_t *bucket, struct futex_pi_state *ps)
+{
+    for (struct futex_pi_state **pp = &bucket->pi_states; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == ps)
+        {
+            *pp = ps->next;
+            break;
+        }
+    }
+
+    pi_state_set_owner(ps, NULL);
+    free(ps);
+}
+
+static int futex_lock_pi(int *uaddr, int flags, uint64_t deadline, bool trylock)
+{
+    futex_key_t key;
+    int ret = futex_key(uaddr, flags, &key);
+    if (ret < 0)
+        return ret;
+
+    futex_bucket_t *bucket = futex_hash(&key);
+    uint32_t tid = current_task->pid;
+
+    spin_lock_irqsave(&bucket->lock);
+
+    struct futex_pi_state *ps = pi_state_lookup(bucket, &key);
+    uint32_t val;
+
+    for (;;)
+    {
+        val = __atomic_load_n((uint32_t *)uaddr, __ATOMIC_SEQ_CST);
+
+        if ((val & FUTEX_TID_MASK) == tid)
+        {
+            spin_unlock_irqrestore(&bucket->lock);
+            return -EDEADLK;
+        }
+
+        // 没有持有者 (或持有者已退出), 直接获取
+        if (!(val & FUTEX_TID_MASK))
+        {
+            uint32_t newval = tid | (ps && ps->waiters ? FUTEX_WAITERS : 0);
+            if (!__atomic_compare_exchange_n((uint32_t *)uaddr, &val, newval, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                continue;
+
+            if (ps)
+            {
+                spin_lock(&futex_pi_lock);
+                pi_state_set_owner(ps, current_task);
+                pi_adjust_chain(current_task);
+                spin_unlock(&futex_pi_lock);
+            }
+
+            spin_unlock_irqrestore(&bucket->lock);
+            return 0;
+        }
+
+        if (trylock)
+        {
+            spin_unlock_irqrestore(&bucket->lock);
+            return -EWOULDBLOCK;
+        }
+
+        // 让持有者解锁时进入内核
+        if (!(val & FUTEX_WAITERS) && !__atomic_compare_exchange_n((uint32_t *)uaddr, &val, val | FUTEX_WAITERS, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            continue;
+
+        break;
+    }
+
+    uint32_t owner_tid = val & FUTEX_TID_MASK;
+
+    // 持有者挂到 pi_state 上之前可能退出并被回收
+    rcu_read_lock();
+
+    task_t *owner = task_find_by_pid(owner_tid);
+    if (!owner)
+    {
+        rcu_read_unlock();
+        spin_unlock_irqrestore(&bucket->lock);
+        return -ESRCH;
+    }
+
+    if (!ps)
+    {
+        ps = malloc(sizeof(struct futex_pi_state));
+        if (!ps)
+        {
+            rcu_read_unlock();
+            spin_unlock_irqrestore(&bucket->lock);
+            return -ENOMEM;
+        }
+        memset(ps, 0, sizeof(struct futex_pi_state));
+        ps->key = key;
+        ps->next = bucket->pi_states;
+        bucket->pi_states = ps;
+    }
+
+    struct futex_pi_waiter w = {
+        .task = current_task,
+        .next = NULL,
+        .granted = false,
+    };
+
+    spin_lock(&futex_pi_lock);
+
+    if (ps->owner != owner)
+        pi_state_set_owner(ps, owner);
+
+    pi_waiter_insert(ps, &w);
+    current_task->pi_blocked_on = ps;
+    pi_adjust_chain(owner);
+
+    spin_unlock(&futex_pi_lock);
+
+    rcu_read_unlock();
+
+    task_block_prepare(current_task, TASK_BLOCKING, deadline);
+
+    spin_unlock_irqrestore(&bucket->lock);
+
+    int status = task_block_wait(current_task, TASK_BLOCKING, deadline);
+
+    spin_lock_irqsave(&bucket->lock);
+
+    if (w.granted)
+    {
+        spin_unlock_irqrestore(&bucket->lock);
+        return 0;
+    }
+
+    // 超时或被信号打断, 撤销对持有者的提升
+    spin_lock(&futex_pi_lock);
+
+    pi_waiter_remove(ps, &w);
+    current_task->pi_blocked_on = NULL;
+
+    owner = ps->owner;
+    if (!ps->waiters)
+        pi_state_free(bucket, ps);
+    if (owner)
+        pi_adjust_chain(owner);
+
+    spin_unlock(&futex_pi_lock);
+
+    spin_unlock_irqrestore(&bucket->lock);
+
+    return status == -ETIMEDOUT ? -ETIMEDOUT : -EINTR;
+}
+
+static int futex_unlock_pi(int *uaddr, int flags)
+{
+    futex_key_t key;
+    int ret = futex_key(uaddr, flags, &key);
+    if (ret < 0)
+        return ret;
+
+    futex_bucket_t *bucket = futex_hash(&key);
+    uint32_t tid = current_task->pid;
+
+    spin_lock_irqsave(&bucket->lock);
+
+    uint32_t val = __atomic_load_n((uint32_t *)uaddr, __ATOMIC_SEQ_CST);
+    if ((val & FUTEX_TID_MASK) != tid)
+    {
+        spin_unlock_irqrestore(&bucket->lock);
+        return -EPERM;
+    }
+
+    struct futex_pi_state *ps = pi_state_lookup(bucket, &key);
+
+    spin_lock(&futex_pi_lock);
+
+    if (ps && ps->waiters)
+    {
+        // 直接把锁交给优先级最高的等待者
+        struct futex_pi_waiter *w = ps->waiters;
+        task_t *new_owner = w->task;
+
+        ps->waiters = w->next;
+        w->next = NULL;
+        new_owner->pi_blocked_on = NULL;
+
+        uint32_t newval = new_owner->pid | (ps->waiters ? FUTEX_WAITERS : 0);
+
+        if (ps->waiters)
+            pi_state_set_owner(ps, new_owner);
+        else
+            pi_state_free(bucket, ps);
+
+        __atomic_store_n((uint32_t *)uaddr, newval, __ATOMIC_SEQ_CST);
+
+        futex_pi_recompute(current_task);
+        futex_pi_recompute(new_owner);
+
+        w->granted = true;
+        task_unblock(new_owner, EOK);
+    }
+    else
+    {
+        if (ps)
+            pi_state_free(bucket, ps);
+
+        __atomic_store_n((uint32_t *)uaddr, 0, __ATOMIC_SEQ_CST);
+
+        futex_pi_recompute(current_task);
+    }
+
+    spin_unlock(&futex_pi_lock);
+
+    spin_unlock_irqrestore(&bucket->lock);
+
+    return 0;
+}
+
+// FUTEX_WAIT 的超时是相对时间, FUTEX_WAIT_BITSET 是绝对时间
+static uint64_t futex_deadline(const struct timespec *timeout, int op, bool absolute)
+{
+    if (!timeout)
+        return 0;
+
+    uint64_t ns = timespec_to_ns(timeout);
+
+    if (!absolute)
+        return nanoTime() + ns;
+
+#if defined(__x86_64__)
+    if (op & FUTEX_CLOCK_REALTIME)
+        ns = ns > realtime_offset ? ns - realtime_offset : 0;
+#endif
+
+    // 0 表示不超时, 已经过去的时间也要立即超时
+    return ns ? ns : 1;
+}
+
+int sys_futex(int *uaddr, int op, int val, const struct timespec *timeout, int *uaddr2, int val3)
+{
+    if (check_user_overflow((uint64_t)uaddr, sizeof(int)))
+    {
+        return -EFAULT;
+    }
+
+    int cmd = op & FUTEX_CMD_MASK;
+    int flags = op & FUTEX_PRIVATE_FLAG;
+
+    switch (cmd)
+    {
+    case FUTEX_WAIT:
+    case FUTEX_WAIT_BITSET:
+        if (timeout && check_user_overflow((uint64_t)timeout, sizeof(struct timespec)))
+            return -EFAULT;
+
+        return futex_wait(uaddr, flags, val, futex_deadline(timeout, op, cmd == FUTEX_WAIT_BITSET), cmd == FUTEX_WAIT ? FUTEX_BITSET_MATCH_ANY : (uint32_t)val3);
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, flags, val, FUTEX_BITSET_MATCH_ANY);
+    case FUTEX_WAKE_BITSET:
+        return futex_wake(uaddr, flags, val, (uint32_t)val3);
+    case FUTEX_REQUEUE:
+        // val2 通过 timeout 参数传入
+        return futex_requeue(uaddr, uaddr2, flags, val, (int)(uint64_t)timeout, false, 0);
+    case FUTEX_CMP_REQUEUE:
+        return futex_requeue(uaddr, uaddr2, flags, val, (int)(uint64_t)timeout, true, val3);
+    case FUTEX_WAKE_OP:
+        return futex_wake_op(uaddr, uaddr2, flags, val, (int)(uint64_t)timeout, val3);
+    case FUTEX_LOCK_PI:
+        if (timeout && check_user_overflow((uint64_t)timeout, sizeof(struct timespec)))
+            return -EFAULT;
+
+        // FUTEX_LOCK_PI 的超时总是 CLOCK_REALTIME 绝对时间
+        return futex_lock_pi(uaddr, flags, futex_deadline(timeout, op | FUTEX_CLOCK_REALTIME, true), false);
+    case FUTEX_TRYLOCK_PI:
+        return futex_lock_pi(uaddr, flags, 0, true);
+    case FUTEX_UNLOCK_PI:
+        return futex_unlock_pi(uaddr, flags);
+    default:
+        return -ENOSYS;
+    }
+}
@@ -19,20 +19,6 @@ uint64_t sys_mount(char *dev_name, char *dir_name, char *type, uint64_t flags, v
 
 uint64_t sys_open(const char *name, uint64_t flags, uint64_t mode)
 {
-    uint64_t i = 0;
-    for (i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i] == NULL)
-        {
-            break;
-        }
-    }
-
-    if (i == MAX_FD_NUM)
-    {
-        return (uint64_t)-EBADF;
-    }
-
     int create_mode = (flags & O_CREAT);
 
     // printk("Opening file %s\n", name);
@@ -62,13 +48,16 @@ uint64_t sys_open(const char *name, uint64_t flags, uint64_t mode)
             return (uint64_t)-ENOENT;
     }
 
-    current_task->fds[i] = malloc(sizeof(fd_t));
-    current_task->fds[i]->node = node;
-    current_task->fds[i]->offset = 0;
-    current_task->fds[i]->flags = flags;
+    fd_t *file = fd_new(node, flags);
+    int fd = fd_install(current_task->files, file, 0, flags & O_CLOEXEC);
+    if (fd < 0)
+    {
+        fd_put(file);
+        return (uint64_t)fd;
+    }
     node->refcount++;
 
-    return i;
+    return fd;
 }
 
 uint64_t sys_openat(uint64_t dirfd, const char *name, uint64_t flags, uint64_t mode)
@@ -90,22 +79,20 @@ uint64_t sys_openat(uint64_t dirfd, const char *name, uint64_t flags, uint64_t m
 
 uint64_t sys_close(uint64_t fd)
 {
-    if (fd >= MAX_FD_NUM || current_task->fds[fd] == NULL)
+    fd_t *file = fd_remove(current_task->files, fd);
+    if (file == NULL)
     {
         return (uint64_t)-EBADF;
     }
 
-    current_task->fds[fd]->offset = 0;
-    if (current_task->fds[fd]->node->lock.l_pid == current_task->pid)
+    if (file->node->lock.l_pid == current_task->pid)
     {
-        current_task->fds[fd]->node->lock.l_type = F_UNLCK;
-        current_task->fds[fd]->node->lock.l_pid = 0;
+        file->node->lock.l_type = F_UNLCK;
+        file->node->lock.l_pid = 0;
     }
 
-    vfs_close(current_task->fds[fd]->node);
-    free(current_task->fds[fd]);
-
-    current_task->fds[fd] = NULL;
+    // 其他线程可能还在使用该文件, 由最后一个引用负责关闭
+    fd_put(file);
 
     return 0;
 }
@@ -116,28 +103,27 @@ uint64_t sys_read(uint64_t fd, void *buf, uint64_t len)
     {
         return (uint64_t)-EFAULT;
     }
-    if (fd >= MAX_FD_NUM || current_task->fds[fd] == NULL)
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
     {
         return (uint64_t)-EBADF;
     }
 
-    if (current_task->fds[fd]->node->type & file_dir)
+    if (file->node->type & file_dir)
     {
+        fd_put(file);
         return (uint64_t)-EISDIR; // 读取目录时返回正确错误码
     }
 
-    if (!buf)
-    {
-        return (uint64_t)-EFAULT;
-    }
-
-    ssize_t ret = vfs_read(current_task->fds[fd]->node, buf, current_task->fds[fd]->offset, len);
+    ssize_t ret = vfs_read(file->node, buf, file->offset, len);
 
     if (ret > 0)
     {
-        current_task->fds[fd]->offset += ret;
+        file->offset += ret;
     }
 
+    fd_put(file);
+
     if (ret == -EAGAIN)
     {
         return (uint64_t)-EAGAIN; // 保持非阻塞I/O语义
@@ -152,28 +138,27 @@ uint64_t sys_write(uint64_t fd, const void *buf, uint64_t len)
     {
         return (uint64_t)-EFAULT;
     }
-    if (fd >= MAX_FD_NUM || current_task->fds[fd] == NULL)
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
     {
         return (uint64_t)-EBADF;
     }
 
-    if (current_task->fds[fd]->node->type & file_dir)
+    if (file->node->type & file_dir)
     {
+        fd_put(file);
         return (uint64_t)-EISDIR; // 读取目录时返回正确错误码
     }
 
-    if (!buf)
-    {
-        return (uint64_t)-EFAULT;
-    }
-
-    ssize_t ret = vfs_write(current_task->fds[fd]->node, buf, current_task->fds[fd]->offset, len);
+    ssize_t ret = vfs_write(file->node, buf, file->offset, len);
 
     if (ret > 0)
     {
-        current_task->fds[fd]->offset += ret;
+        file->offset += ret;
     }
 
+    fd_put(file);
+
     if (ret == -EAGAIN)
     {
         return (uint64_t)-EAGAIN; // 保持非阻塞I/O语义
@@ -184,52 +169,63 @@ uint64_t sys_write(uint64_t fd, const void *buf, uint64_t len)
 
 uint64_t sys_lseek(uint64_t fd, uint64_t offset, uint64_t whence)
 {
-    if (fd >= MAX_FD_NUM || current_task->fds[fd] == NULL)
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
     {
         return (uint64_t)-EBADF;
     }
 
+    uint64_t ret;
     int64_t real_offset = offset;
-    if (real_offset < 0 && current_task->fds[fd]->node->type & file_none && whence != SEEK_CUR)
-        return (uint64_t)-EBADF;
+    if (real_offset < 0 && file->node->type & file_none && whence != SEEK_CUR)
+    {
+        ret = (uint64_t)-EBADF;
+        goto out;
+    }
 
     switch (whence)
     {
     case SEEK_SET:
-        current_task->fds[fd]->offset = real_offset;
+        file->offset = real_offset;
         break;
     case SEEK_CUR:
-        current_task->fds[fd]->offset += real_offset;
-        if ((int64_t)current_task->fds[fd]->offset < 0)
+        file->offset += real_offset;
+        if ((int64_t)file->offset < 0)
         {
-            current_task->fds[fd]->offset = 0;
+            file->offset = 0;
         }
-        else if (current_task->fds[fd]->offset > current_task->fds[fd]->node->size)
+        else if (file->offset > file->node->size)
         {
-            current_task->fds[fd]->offset = current_task->fds[fd]->node->size;
+            file->offset = file->node->size;
         }
 
         break;
     case SEEK_END:
-        current_task->fds[fd]->offset = current_task->fds[fd]->node->size - real_offset;
+        file->offset = file->node->size - real_offset;
         break;
 
     default:
-        return (uint64_t)-ENOSYS;
-        break;
+        ret = (uint64_t)-ENOSYS;
+        goto out;
     }
 
-    return current_task->fds[fd]->offset;
+    ret = file->offset;
+out:
+    fd_put(file);
+    return ret;
 }
 
 uint64_t sys_ioctl(uint64_t fd, uint64_t cmd, uint64_t arg)
 {
-    if (fd >= MAX_FD_NUM || current_task->fds[fd] == NULL)
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
     {
         return (uint64_t)-EBADF;
     }
 
-    return vfs_ioctl(current_task->fds[fd]->node, cmd, arg);
+    uint64_t ret = vfs_ioctl(file->node, cmd, arg);
+    fd_put(file);
+    return ret;
 }
 
 uint64_t sys_readv(uint64_t fd, struct iovec *iovec, uint64_t count)
@@ -296,16 +292,17 @@ uint64_t sys_getdents(uint64_t fd, uint64_t buf, uint64_t size)
     {
         return (uint64_t)-EFAULT;
     }
-    if (fd >= MAX_FD_NUM)
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
         return (uint64_t)-EBADF;
-    if (!current_task->fds[fd])
-        return (uint64_t)-EBADF;
-    if (!(current_task->fds[fd]->node->type & file_dir))
+    if (!(file->node->type & file_dir))
+    {
+        fd_put(file);
         return (uint64_t)-ENOTDIR;
+    }
 
     struct dirent *dents = (struct dirent *)buf;
-    fd_t *filedescriptor = current_task->fds[fd];
-    vfs_node_t node = filedescriptor->node;
+    vfs_node_t node = file->node;
 
     uint64_t child_count = (uint64_t)list_length(node->child);
 
@@ -316,15 +313,15 @@ uint64_t sys_getdents(uint64_t fd, uint64_t buf, uint64_t size)
     uint64_t offset = 0;
     list_foreach(node->child, i)
     {
-        if (offset < filedescriptor->offset)
+        if (offset < file->offset)
             goto next;
-        if (filedescriptor->offset >= (child_count * sizeof(struct dirent)))
+        if (file->offset >= (child_count * sizeof(struct dirent)))
             break;
         if (read_count >= max_dents_num)
             break;
         vfs_node_t child_node = (vfs_node_t)i->data;
         dents[read_count].d_ino = child_node->inode;
-        dents[read_count].d_off = filedescriptor->offset;
+        dents[read_count].d_off = file->offset;
         dents[read_count].d_reclen = sizeof(struct dirent);
         if (child_node->type & file_symlink)
             dents[read_count].d_type = DT_LNK;
@@ -335,12 +332,14 @@ uint64_t sys_getdents(uint64_t fd, uint64_t buf, uint64_t size)
         else
             dents[read_count].d_type = DT_UNKNOWN;
         strncpy(dents[read_count].d_name, child_node->name, 1024);
-        filedescriptor->offset += sizeof(struct dirent);
+        file->offset += sizeof(struct dirent);
         read_count++;
     next:
         offset += sizeof(struct dirent);
     }
 
+    fd_put(file);
+
     return read_count * sizeof(struct dirent);
 }
 
@@ -356,7 +355,7 @@ uint64_t sys_chdir(const char *dirname)
     if (new_cwd->type != file_dir)
         return (uint64_t)-ENOTDIR;
 
-    current_task->cwd = new_cwd;
+    current_task->fs->cwd = new_cwd;
 
     return 0;
 }
@@ -367,7 +366,7 @@ uint64_t sys_getcwd(char *cwd, uint64_t size)
     {
         return (uint64_t)-EFAULT;
     }
-    char *str = vfs_get_fullpath(current_task->cwd);
+    char *str = vfs_get_fullpath(current_task->fs->cwd);
     if (size < (uint64_t)strlen(str))
     {
         return (uint64_t)-ERANGE;
@@ -377,18 +376,18 @@ uint64_t sys_getcwd(char *cwd, uint64_t size)
     return (uint64_t)strlen(str);
 }
 
+uint64_t sys_umask(uint64_t mask)
+{
+    return __atomic_exchange_n(&current_task->fs->umask, (uint32_t)(mask & 0777), __ATOMIC_SEQ_CST);
+}
+
 extern int unix_socket_fsid;
 extern int unix_accept_fsid;
 
 // Implement the sys_dup3 function
 uint64_t sys_dup3(uint64_t oldfd, uint64_t newfd, uint64_t flags)
 {
-    if (oldfd >= MAX_FD_NUM || current_task->fds[oldfd] == NULL)
-    {
-        return -EBADF;
-    }
-
-    if (newfd >= MAX_FD_NUM)
+    if (newfd >= current_task->rlim[RLIMIT_NOFILE].rlim_cur)
     {
         return -EBADF;
     }
@@ -403,43 +402,57 @@ uint64_t sys_dup3(uint64_t oldfd, uint64_t newfd, uint64_t flags)
         return -EBADF;
     }
 
-    if (current_task->fds[newfd] != NULL)
+    fd_t *file = fd_get(current_task->files, oldfd);
+    if (!file)
     {
-        sys_close(newfd);
+        return -EBADF;
     }
 
-    fd_t *new_node = vfs_dup(current_task->fds[oldfd]);
+    // newfd 未打开时返回 -EBADF, 忽略即可
+    sys_close(newfd);
+
+    fd_t *new_node = vfs_dup(file);
+    fd_put(file);
     if (new_node == NULL)
     {
         return -EMFILE;
     }
 
-    current_task->fds[newfd] = new_node;
-    new_node->node->refcount++;
-
-    if (flags & O_CLOEXEC)
+    int ret = fd_install_at(current_task->files, new_node, newfd, flags & O_CLOEXEC);
+    if (ret < 0)
     {
-        current_task->fds[newfd]->flags |= O_CLOEXEC;
+        fd_put(new_node);
+        return ret;
     }
+    new_node->node->refcount++;
 
     return newfd;
 }
 
 uint64_t sys_dup2(uint64_t fd, uint64_t newfd)
 {
-    if (!current_task->fds[fd])
+    if (newfd >= current_task->rlim[RLIMIT_NOFILE].rlim_cur)
         return (uint64_t)-EBADF;
 
-    fd_t *new = vfs_dup(current_task->fds[fd]);
-    if (!new)
-        return (uint64_t)-ENOSPC;
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
+        return (uint64_t)-EBADF;
 
-    if (current_task->fds[newfd])
+    if (fd == newfd)
     {
-        vfs_close(current_task->fds[newfd]->node);
-        free(current_task->fds[newfd]);
+        fd_put(file);
+        return newfd;
     }
 
+    fd_t *new = vfs_dup(file);
+    fd_put(file);
+    if (!new)
+        return (uint64_t)-ENOSPC;
+
+    fd_t *old = fd_remove(current_task->files, newfd);
+    if (old)
+        fd_put(old);
+
     switch (new->node->type)
     {
     case file_socket:
@@ -450,62 +463,89 @@ uint64_t sys_dup2(uint64_t fd, uint64_t newfd)
         break;
     }
 
-    current_task->fds[newfd] = new;
+    int ret = fd_install_at(current_task->files, new, newfd, false);
+    if (ret < 0)
+    {
+        fd_put(new);
+        return (uint64_t)ret;
+    }
     new->node->refcount++;
 
     return newfd;
 }
 
-uint64_t sys_dup(uint64_t fd)
+// 复制到不小于 start 的最小空闲描述符
+static uint64_t fd_dup_from(uint64_t fd, uint64_t start, bool cloexec)
 {
-    vfs_node_t node = current_task->fds[fd]->node;
-    if (!node)
+    if (start >= current_task->rlim[RLIMIT_NOFILE].rlim_cur)
+        return (uint64_t)-EINVAL;
+
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
         return (uint64_t)-EBADF;
 
-    uint64_t i;
-    for (i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i] == NULL)
-        {
-            break;
-        }
-    }
+    fd_t *new = vfs_dup(file);
+    fd_put(file);
+    if (!new)
+        return (uint64_t)-ENOSPC;
 
-    if (i == MAX_FD_NUM)
+    int newfd = fd_install(current_task->files, new, start, cloexec);
+    if (newfd < 0)
     {
-        return (uint64_t)-EBADF;
+        fd_put(new);
+        return (uint64_t)newfd;
     }
+    new->node->refcount++;
 
-    return sys_dup2(fd, i);
+    if (new->node->type == file_socket)
+        socket_on_dup_file(fd, newfd);
+
+    return newfd;
+}
+
+uint64_t sys_dup(uint64_t fd)
+{
+    return fd_dup_from(fd, 0, false);
 }
 
 uint64_t sys_fcntl(uint64_t fd, uint64_t command, uint64_t arg)
 {
-    if (fd > MAX_FD_NUM || !current_task->fds[fd])
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
         return (uint64_t)-EBADF;
 
+    uint64_t ret = 0;
+
     switch (command)
     {
     case F_GETFD:
-        return !!(current_task->fds[fd]->flags & O_CLOEXEC);
+        ret = fd_get_cloexec(current_task->files, fd) ? FD_CLOEXEC : 0;
+        break;
     case F_SETFD:
-        return current_task->fds[fd]->flags |= O_CLOEXEC;
+        fd_set_cloexec(current_task->files, fd, arg & FD_CLOEXEC);
+        break;
     case F_DUPFD_CLOEXEC:
-        uint64_t newfd = sys_dup(fd);
-        current_task->fds[newfd]->flags |= O_CLOEXEC;
-        return newfd;
+        ret = fd_dup_from(fd, arg, true);
+        break;
     case F_DUPFD:
-        return sys_dup(fd);
+        ret = fd_dup_from(fd, arg, false);
+        break;
     case F_GETFL:
-        return current_task->fds[fd]->flags;
+        ret = file->flags;
+        break;
     case F_SETFL:
         uint32_t valid_flags = O_APPEND | O_DIRECT | O_NOATIME | O_NONBLOCK;
-        current_task->fds[fd]->flags &= ~valid_flags;
-        current_task->fds[fd]->flags |= arg & valid_flags;
-        return 0;
+        file->flags &= ~valid_flags;
+        file->flags |= arg & valid_flags;
+        break;
+    default:
+        ret = (uint64_t)-ENOSYS;
+        break;
     }
 
-    return (uint64_t)-ENOSYS;
+    fd_put(file);
+
+    return ret;
 }
 
 uint64_t sys_stat(const char *fn, struct stat *buf)
@@ -557,30 +597,31 @@ uint64_t sys_fstat(uint64_t fd, struct stat *buf)
     {
         return (uint64_t)-EFAULT;
     }
-    if (fd >= MAX_FD_NUM || current_task->fds[fd] == NULL)
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
     {
         return (uint64_t)-EBADF;
     }
 
     buf->st_dev = 0;
-    buf->st_ino = current_task->fds[fd]->node->inode;
+    buf->st_ino = file->node->inode;
     buf->st_nlink = 1;
-    buf->st_mode = current_task->fds[fd]->node->mode | ((current_task->fds[fd]->node->type & file_symlink) ? S_IFLNK : (current_task->fds[fd]->node->type & file_dir ? S_IFDIR : S_IFREG));
+    buf->st_mode = file->node->mode | ((file->node->type & file_symlink) ? S_IFLNK : (file->node->type & file_dir ? S_IFDIR : S_IFREG));
     buf->st_uid = 0;
     buf->st_gid = 0;
-    if (current_task->fds[fd]->node->type & file_stream)
+    if (file->node->type & file_stream)
     {
         buf->st_rdev = (4 << 8) | 1;
     }
-    else if (current_task->fds[fd]->node->type & file_fbdev)
+    else if (file->node->type & file_fbdev)
     {
         buf->st_rdev = (29 << 8) | 0;
     }
-    else if (current_task->fds[fd]->node->type & file_keyboard)
+    else if (file->node->type & file_keyboard)
     {
         buf->st_rdev = (13 << 8) | 0;
     }
-    else if (current_task->fds[fd]->node->type & file_mouse)
+    else if (file->node->type & file_mouse)
     {
         buf->st_rdev = (13 << 8) | 1;
     }
@@ -588,10 +629,12 @@ uint64_t sys_fstat(uint64_t fd, struct stat *buf)
     {
         buf->st_rdev = 0;
     }
-    buf->st_blksize = current_task->fds[fd]->node->blksz;
-    buf->st_size = current_task->fds[fd]->node->size;
+    buf->st_blksize = file->node->blksz;
+    buf->st_size = file->node->size;
     buf->st_blocks = (buf->st_size + buf->st_blksize - 1) / buf->st_blksize;
 
+    fd_put(file);
+
     return 0;
 }
 
@@ -754,7 +797,7 @@ uint64_t sys_readlink(char *path, char *buf, uint64_t size)
         return (uint64_t)-EFAULT;
     }
 
-    vfs_node_t node = vfs_open_at(current_task->cwd, path, true);
+    vfs_node_t node = vfs_open_at(current_task->fs->cwd, path, true);
     if (node == NULL)
     {
         return (uint64_t)-ENOENT;
@@ -794,7 +837,7 @@ uint64_t sys_readlinkat(int dfd, char *path, char *buf, uint64_t size)
 
     char *resolved = at_resolve_pathname(dfd, path);
 
-    vfs_node_t node = vfs_open_at(current_task->cwd, resolved, true);
+    vfs_node_t node = vfs_open_at(current_task->fs->cwd, resolved, true);
     if (node == NULL)
     {
         return (uint64_t)-ENOENT;
@@ -880,14 +923,16 @@ uint64_t sys_rename(const char *old, const char *new)
 
 uint64_t sys_fchdir(uint64_t fd)
 {
-    if (fd >= MAX_FD_NUM || !current_task->fds[fd])
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
         return -EBADF;
 
-    vfs_node_t node = current_task->fds[fd]->node;
+    vfs_node_t node = file->node;
+    fd_put(file);
     if (node->type != file_dir)
         return -ENOTDIR;
 
-    current_task->cwd = node;
+    current_task->fs->cwd = node;
 
     return 0;
 }
@@ -908,12 +953,14 @@ uint64_t sys_mkdir(const char *name, uint64_t mode)
 
 uint64_t sys_flock(int fd, uint64_t operation)
 {
-    if (fd < 0 || fd >= MAX_FD_NUM || !current_task->fds[fd])
+    fd_t *file = fd < 0 ? NULL : fd_get(current_task->files, fd);
+    if (!file)
         return -EBADF;
 
-    vfs_node_t node = current_task->fds[fd]->node;
+    vfs_node_t node = file->node;
     struct flock *lock = &node->lock;
     uint64_t pid = current_task->pid;
+    uint64_t ret = 0;
 
     // 提前检查参数有效性
     switch (operation & ~LOCK_NB)
@@ -923,16 +970,19 @@ uint64_t sys_flock(int fd, uint64_t operation)
     case LOCK_UN:
         break;
     default:
-        return -EINVAL;
+        ret = -EINVAL;
+        goto out;
     }
 
     // 非阻塞模式下立即检查冲突
     if (operation & LOCK_NB)
     {
-        if ((operation & LOCK_SH) && lock->l_type == F_WRLCK)
-            return -EWOULDBLOCK;
-        if ((operation & LOCK_EX) && lock->l_type != F_UNLCK)
-            return -EWOULDBLOCK;
+        if (((operation & LOCK_SH) && lock->l_type == F_WRLCK) ||
+            ((operation & LOCK_EX) && lock->l_type != F_UNLCK))
+        {
+            ret = -EWOULDBLOCK;
+            goto out;
+        }
     }
 
     // 实际加锁逻辑
@@ -943,7 +993,10 @@ uint64_t sys_flock(int fd, uint64_t operation)
         while (lock->l_type != F_UNLCK && lock->l_pid != pid)
         {
             if (operation & LOCK_NB)
-                return -EWOULDBLOCK;
+            {
+                ret = -EWOULDBLOCK;
+                goto out;
+            }
 
             while (lock->lock)
             {
@@ -964,86 +1017,17 @@ uint64_t sys_flock(int fd, uint64_t operation)
 
     case LOCK_UN:
         if (lock->l_pid != pid)
-            return -EACCES;
+        {
+            ret = -EACCES;
+            goto out;
+        }
         lock->l_type = F_UNLCK;
         lock->l_pid = 0;
         lock->lock = 1;
         break;
     }
 
-    return 0;
-}
-
-spinlock_t futex_lock = {0};
-struct futex_wait futex_wait_list = {NULL, 0, NULL};
-
-int sys_futex(int *uaddr, int op, int val, const struct timespec *timeout, int *uaddr2, int val3)
-{
-    if (check_user_overflow((uint64_t)uaddr, sizeof(int)) || (timeout && !check_user_overflow((uint64_t)timeout, sizeof(struct timespec))))
-    {
-        return -EFAULT;
-    }
-
-    switch (op & FUTEX_CMD_MASK)
-    {
-    case FUTEX_WAIT:
-    {
-        spin_lock(&futex_lock);
-
-        int current = *(int *)uaddr;
-        if (current != val)
-        {
-            spin_unlock(&futex_lock);
-            return -EWOULDBLOCK;
-        }
-
-        struct futex_wait *wait = malloc(sizeof(struct futex_wait));
-        wait->uaddr = uaddr;
-        wait->task = current_task;
-        struct futex_wait *curr = &futex_wait_list;
-        while (curr && curr->next)
-            curr = curr->next;
-
-        curr->next = wait;
-
-        spin_unlock(&futex_lock);
-
-        task_block(current_task, TASK_BLOCKING, -1);
-
-        while (current_task->state == TASK_BLOCKING)
-        {
-            arch_enable_interrupt();
-            arch_pause();
-        }
-
-        return 0;
-    }
-    case FUTEX_WAKE:
-    {
-        spin_lock(&futex_lock);
-
-        struct futex_wait *curr = &futex_wait_list;
-        struct futex_wait *prev = NULL;
-        int count = 0;
-        while (curr)
-        {
-            if (curr->uaddr == uaddr && ++count <= val)
-            {
-                task_unblock(curr->task, EOK);
-                if (prev)
-                {
-                    prev->next = curr->next;
-                }
-                free(curr);
-            }
-            prev = curr;
-            curr = curr->next;
-        }
-
-        spin_unlock(&futex_lock);
-        return count;
-    }
-    default:
-        return -ENOSYS;
-    }
+out:
+    fd_put(file);
+    return ret;
 }
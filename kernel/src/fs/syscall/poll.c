@@ -39,10 +39,32 @@ uint32_t poll_to_epoll_comp(uint32_t poll_events)
 size_t sys_poll(struct pollfd *fds, int nfds, uint64_t timeout)
 {
     int ready = 0;
-    uint64_t start_time = nanoTime();
+    int timeout_ms = (int)timeout;
+    uint64_t deadline = timeout_ms > 0 ? nanoTime() + (uint64_t)timeout_ms * 1000000ULL : 0;
 
     bool sigexit = false;
 
+    // 等待队列属于文件节点, 睡眠期间其他线程可能关闭描述符, 整个调用期间都持有引用
+    fd_t **files = calloc(nfds ? nfds : 1, sizeof(fd_t *));
+    if (!files)
+        return (size_t)-ENOMEM;
+
+    for (int i = 0; i < nfds; i++)
+    {
+        files[i] = fds[i].fd < 0 ? NULL : fd_get(current_task->files, fds[i].fd);
+        if (!files[i])
+        {
+            while (i--)
+                fd_put(files[i]);
+            free(files);
+            return (size_t)-EBADF;
+        }
+    }
+
+    // 扫描时在各事件源上登记, 没有就绪的描述符时睡眠到被唤醒或超时
+    poll_table_t table;
+    poll_table_init(&table);
+
     do
     {
         // 检查每个文件描述符
@@ -50,11 +72,7 @@ size_t sys_poll(struct pollfd *fds, int nfds, uint64_t timeout)
         {
             fds[i].revents = 0;
 
-            if (fds[i].fd > MAX_FD_NUM || !current_task->fds[fds[i].fd])
-            {
-                return (size_t)-EBADF;
-            }
-            vfs_node_t node = current_task->fds[fds[i].fd]->node;
+            vfs_node_t node = files[i]->node;
             if (!node)
                 continue;
             if (!fs_callbacks[node->fsid]->poll)
@@ -76,19 +94,19 @@ size_t sys_poll(struct pollfd *fds, int nfds, uint64_t timeout)
 
         // sigexit = signals_pending_quick(current_task);
 
-        if (ready > 0 || sigexit)
+        if (ready > 0 || sigexit || timeout_ms == 0)
+            break;
+        if (deadline && nanoTime() >= deadline)
             break;
 
-#if defined(__x86_64__)
-        arch_enable_interrupt();
-#endif
+        poll_sleep_until(&table, deadline);
+    } while (1);
 
-        arch_pause();
-    } while (timeout != 0 && ((int)timeout == -1 || (nanoTime() - start_time) < timeout));
+    poll_table_free(&table);
 
-#if defined(__x86_64__)
-    arch_disable_interrupt();
-#endif
+    for (int i = 0; i < nfds; i++)
+        fd_put(files[i]);
+    free(files);
 
     if (!ready && sigexit)
         return (size_t)-EINTR;
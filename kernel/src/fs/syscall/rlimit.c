@@ -25,6 +25,10 @@ uint64_t sys_prlimit64(uint64_t pid, int resource, const struct rlimit *new_rlim
 
     if (new_rlim)
     {
+        if (new_rlim->rlim_cur > new_rlim->rlim_max)
+            return (uint64_t)-EINVAL;
+        if (resource == RLIMIT_NOFILE && new_rlim->rlim_max > NR_OPEN_MAX)
+            return (uint64_t)-EPERM;
         current_task->rlim[resource] = *new_rlim;
     }
 
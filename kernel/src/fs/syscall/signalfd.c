@@ -67,17 +67,6 @@ uint64_t sys_signalfd4(int ufd, const sigset_t *mask, size_t sizemask, int flags
     ctx->queue = malloc(ctx->queue_size * sizeof(struct sigevent));
     ctx->queue_head = ctx->queue_tail = 0;
 
-    // 分配文件描述符
-    int fd = -1;
-    for (int i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (!current_task->fds[i])
-        {
-            fd = i;
-            break;
-        }
-    }
-
     // 创建VFS节点
     char buf[256];
     sprintf(buf, "signalfd%d", signalfd_id++);
@@ -87,10 +76,11 @@ uint64_t sys_signalfd4(int ufd, const sigset_t *mask, size_t sizemask, int flags
     node->type = file_stream;
     node->fsid = signalfdfs_id;
     node->handle = ctx;
-    current_task->fds[fd] = malloc(sizeof(fd_t));
-    current_task->fds[fd]->node = node;
-    current_task->fds[fd]->offset = 0;
-    current_task->fds[fd]->flags = 0;
+
+    fd_t *file = fd_new(node, 0);
+    int fd = fd_install(current_task->files, file, 0, flags & O_CLOEXEC);
+    if (fd < 0)
+        fd_put(file);
 
     return fd;
 }
@@ -5,29 +5,38 @@ static vfs_node_t timerfdfs_root = NULL;
 
 static int timerfd_id = 0;
 
+static hrtimer_restart_t timerfd_expire(hrtimer_t *timer)
+{
+    timerfd_t *tfd = timer->data;
+
+    tfd->count++;
+
+    if (tfd->waiter && tfd->waiter->state == TASK_BLOCKING)
+        task_unblock(tfd->waiter, EOK);
+    poll_wake(&tfd->poll_wait);
+
+    if (tfd->timer.interval)
+    {
+        tfd->count += hrtimer_forward(timer, nanoTime(), tfd->timer.interval) - 1;
+        tfd->timer.expires = timer->expires;
+        return HRTIMER_RESTART;
+    }
+
+    tfd->timer.expires = 0;
+    return HRTIMER_NORESTART;
+}
+
 int sys_timerfd_create(int clockid, int flags)
 {
     // 参数检查
     if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
         return -EINVAL;
 
-    // 分配文件描述符
-    int fd = -1;
-    for (int i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (!current_task->fds[i])
-        {
-            fd = i;
-            break;
-        }
-    }
-    if (fd == -1)
-        return -EMFILE;
-
     timerfd_t *tfd = malloc(sizeof(timerfd_t));
     memset(tfd, 0, sizeof(timerfd_t));
     tfd->timer.clock_type = clockid;
     tfd->flags = flags;
+    hrtimer_init(&tfd->timer.timer, timerfd_expire, tfd);
 
     char buf[32];
     sprintf(buf, "timerfd%d", timerfd_id++);
@@ -37,47 +46,99 @@ int sys_timerfd_create(int clockid, int flags)
     node->fsid = timerfdfs_id;
     node->handle = tfd;
 
-    current_task->fds[fd] = malloc(sizeof(fd_t));
-    current_task->fds[fd]->node = node;
-    current_task->fds[fd]->offset = 0;
-    current_task->fds[fd]->flags = 0;
+    fd_t *file = fd_new(node, 0);
+    int fd = fd_install(current_task->files, file, 0, flags & O_CLOEXEC);
+    if (fd < 0)
+        fd_put(file);
 
     return fd;
 }
 
-int sys_timerfd_settime(int fd, int flags, const struct itimerval *new_value, struct itimerval *old_value)
+int sys_timerfd_settime(int fd, int flags, const struct itimerspec *new_value, struct itimerspec *old_value)
 {
-    if (fd >= MAX_FD_NUM || !current_task->fds[fd])
+    if (!new_value || check_user_overflow((uint64_t)new_value, sizeof(struct itimerspec)))
+        return -EFAULT;
+
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
         return -EBADF;
 
-    vfs_node_t node = current_task->fds[fd]->node;
+    vfs_node_t node = file->node;
+    if (node->fsid != timerfdfs_id)
+    {
+        fd_put(file);
+        return -EINVAL;
+    }
+
     timerfd_t *tfd = node->handle;
 
     if (old_value)
     {
-        uint64_t remaining = tfd->timer.expires > jiffies ? tfd->timer.expires - jiffies : 0;
+        ns_to_timespec(tfd->timer.interval, &old_value->it_interval);
+        ns_to_timespec(hrtimer_remaining(&tfd->timer.timer), &old_value->it_value);
+    }
 
-        old_value->it_interval.tv_sec = tfd->timer.interval / 1000;
-        old_value->it_interval.tv_usec = (tfd->timer.interval % 1000) * 1000;
+    hrtimer_cancel(&tfd->timer.timer);
 
-        old_value->it_value.tv_sec = remaining / 1000;
-        old_value->it_value.tv_usec = (remaining % 1000) * 1000;
-    }
+    tfd->count = 0;
+    tfd->timer.interval = timespec_to_ns(&new_value->it_interval);
 
-    uint64_t interval = new_value->it_interval.tv_sec * 1000 +
-                        new_value->it_interval.tv_usec / 1000000;
-    uint64_t expires = new_value->it_value.tv_sec * 1000 +
-                       new_value->it_value.tv_usec / 1000000;
+    tfd->timer.expires = timer_value_to_deadline(tfd->timer.clock_type, &new_value->it_value, flags & TFD_TIMER_ABSTIME);
+    if (tfd->timer.expires)
+        hrtimer_start_range(&tfd->timer.timer, tfd->timer.expires, current_task->timer_slack_ns);
 
-    tfd->timer.interval = interval;
-    tfd->timer.expires = jiffies + expires;
+    fd_put(file);
 
     return 0;
 }
 
+ssize_t timerfd_read(void *file, void *addr, size_t offset, size_t size)
+{
+    timerfd_t *tfd = file;
+
+    if (size < sizeof(uint64_t))
+        return -EINVAL;
+
+    while (!tfd->count)
+    {
+        if (tfd->flags & TFD_NONBLOCK)
+            return -EAGAIN;
+        if (!tfd->timer.expires)
+            return -EAGAIN;
+        if (signals_pending_quick(current_task))
+            return -EINTR;
+
+        tfd->waiter = current_task;
+        task_block_until(current_task, TASK_BLOCKING, tfd->timer.expires);
+        tfd->waiter = NULL;
+    }
+
+    uint64_t count = tfd->count;
+    tfd->count = 0;
+    memcpy(addr, &count, sizeof(uint64_t));
+
+    return sizeof(uint64_t);
+}
+
+int timerfd_poll(void *file, size_t events)
+{
+    timerfd_t *tfd = file;
+
+    poll_wait(&tfd->poll_wait);
+
+    int revents = 0;
+    if ((events & EPOLLIN) && tfd->count)
+        revents |= EPOLLIN;
+
+    return revents;
+}
+
 bool sys_timerfd_close(void *current)
 {
-    free(current);
+    timerfd_t *tfd = current;
+    hrtimer_cancel(&tfd->timer.timer);
+    poll_wait_free(&tfd->poll_wait);
+    free(tfd);
     return true;
 }
 
@@ -91,7 +152,7 @@ static struct vfs_callback timerfd_callbacks = {
     .unmount = (vfs_unmount_t)dummy,
     .open = (vfs_open_t)dummy,
     .close = (vfs_close_t)sys_timerfd_close,
-    .read = (vfs_read_t)dummy,
+    .read = (vfs_read_t)timerfd_read,
     .write = (vfs_write_t)dummy,
     .mkdir = (vfs_mk_t)dummy,
     .mkfile = (vfs_mk_t)dummy,
@@ -100,7 +161,7 @@ static struct vfs_callback timerfd_callbacks = {
     .map = (vfs_mapfile_t)dummy,
     .stat = (vfs_stat_t)dummy,
     .ioctl = (vfs_ioctl_t)dummy,
-    .poll = (vfs_poll_t)dummy,
+    .poll = (vfs_poll_t)timerfd_poll,
 };
 
 void timerfd_init()
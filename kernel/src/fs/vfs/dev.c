@@ -246,6 +246,7 @@ ssize_t inputdev_ioctl(void *data, ssize_t request, ssize_t arg)
 ssize_t inputdev_poll(void *data, size_t event)
 {
     dev_input_event_t *e = data;
+    poll_wait(&e->poll_wait);
     size_t cnt = circular_int_read_poll(&e->device_events);
     if (cnt > 0 && event & EPOLLIN)
         return EPOLLIN;
@@ -424,19 +425,17 @@ ssize_t stdio_ioctl(void *data, ssize_t cmd, ssize_t arg)
     return -ENOTTY;
 }
 
-bool ioSwitch = false;
-
+// 键盘输入直接交给正在读的任务, 没有缓冲可以检查, 总是报告可读, 由 read 阻塞
 ssize_t stdio_poll(void *data, size_t events)
 {
     ssize_t revents = 0;
     if (events & EPOLLERR || events & EPOLLPRI)
         return 0;
 
-    if (events & EPOLLIN && ioSwitch)
+    if (events & EPOLLIN)
         revents |= EPOLLIN;
     if (events & EPOLLOUT)
         revents |= EPOLLOUT;
-    ioSwitch = !ioSwitch;
     return revents;
 }
 
@@ -530,6 +529,7 @@ void dev_init()
     kb_input_event->event_bit = kb_event_bit;
     kb_input_event->device_events.read_ptr = 0;
     kb_input_event->device_events.write_ptr = 0;
+    kb_input_event->poll_wait.next = NULL;
     circular_int_init(&kb_input_event->device_events, 16384);
     vfs_node_t kb_node = regist_dev("input/event0", inputdev_event_read, inputdev_event_write, inputdev_ioctl, inputdev_poll, NULL, kb_input_event);
     dev_input_event_t *mouse_input_event = malloc(sizeof(dev_input_event_t));
@@ -540,6 +540,7 @@ void dev_init()
     mouse_input_event->event_bit = mouse_event_bit;
     mouse_input_event->device_events.read_ptr = 0;
     mouse_input_event->device_events.write_ptr = 0;
+    mouse_input_event->poll_wait.next = NULL;
     circular_int_init(&mouse_input_event->device_events, 16384);
     vfs_node_t mouse_node = regist_dev("input/event1", inputdev_event_read, inputdev_event_write, inputdev_ioctl, inputdev_poll, NULL, mouse_input_event);
 
@@ -554,23 +555,18 @@ void circular_int_init(circular_int_t *circ, size_t size)
     circ->write_ptr = 0;
     circ->buff_size = size;
     circ->buff = malloc(size);
-    circ->lock_read = false;
+    memset(&circ->lock_read, 0, sizeof(spinlock_t));
     memset(circ->buff, 0, size);
 }
 
 size_t circular_int_read(circular_int_t *circ, uint8_t *buff, size_t length)
 {
-    while (circ->lock_read)
-    {
-        arch_pause();
-    }
-
-    circ->lock_read = true;
+    spin_lock(&circ->lock_read);
     size_t write = circ->write_ptr;
     size_t read = circ->read_ptr;
     if (write == read)
     {
-        circ->lock_read = false;
+        spin_unlock(&circ->lock_read);
         return 0;
     }
 
@@ -583,7 +579,7 @@ size_t circular_int_read(circular_int_t *circ, uint8_t *buff, size_t length)
     }
 
     circ->read_ptr = read;
-    circ->lock_read = false;
+    spin_unlock(&circ->lock_read);
 
     return toCopy;
 }
@@ -612,16 +608,11 @@ size_t circular_int_write(circular_int_t *circ, const uint8_t *buff, size_t leng
 size_t circular_int_read_poll(circular_int_t *circ)
 {
     size_t ret = 0;
-    while (circ->lock_read)
-    {
-        arch_pause();
-    }
-
-    circ->lock_read = true;
+    spin_lock(&circ->lock_read);
     size_t write = circ->write_ptr;
     size_t read = circ->read_ptr;
     ret = CIRC_READABLE(write, read, circ->buff_size);
-    circ->lock_read = false;
+    spin_unlock(&circ->lock_read);
     return ret;
 }
 
@@ -639,6 +630,7 @@ void input_generate_event(dev_input_event_t *item, uint16_t type, uint16_t code,
     event->value = value;
 
     circular_int_write(&item->device_events, (const void *)event, sizeof(struct input_event));
+    poll_wake(&item->poll_wait);
 
     free(event);
 }
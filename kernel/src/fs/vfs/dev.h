@@ -2,6 +2,7 @@
 
 #include "../partition.h"
 #include "vfs.h"
+#include "pipe.h"
 
 #define MAX_DEV_NUM 64
 #define MAX_DEV_NAME_LEN 32
@@ -165,7 +166,7 @@ typedef struct circular_int
     size_t read_ptr;
     size_t write_ptr;
 
-    volatile bool lock_read;
+    spinlock_t lock_read; // 读者之间互斥, 写者只在中断中移动 write_ptr
 } circular_int_t;
 
 void circular_int_init(circular_int_t *circ, size_t size);
@@ -180,6 +181,7 @@ typedef struct dev_input_event
 
     size_t timesOpened;
     circular_int_t device_events;
+    task_block_list_t poll_wait;
 
     struct input_id inputid;
 
@@ -60,8 +60,10 @@ ssize_t pipefs_read(void *file, void *addr, size_t offset, size_t size)
             arch_pause();
         }
         arch_disable_interrupt();
+
+        spin_lock(&pipe->lock);
+        available = (pipe->write_ptr - pipe->read_ptr) % PIPE_BUFF;
     }
-    spin_unlock(&pipe->lock);
 
     // 实际读取量
     uint32_t to_read = MIN(size, available);
@@ -82,6 +84,7 @@ ssize_t pipefs_read(void *file, void *addr, size_t offset, size_t size)
     pipe->read_ptr = (pipe->read_ptr + to_read) % PIPE_BUFF;
 
     wake_blocked_tasks(&pipe->blocking_write);
+    poll_wake(&pipe->poll_wait);
 
     spin_unlock(&pipe->lock);
 
@@ -126,9 +129,9 @@ ssize_t pipe_write_inner(void *file, const void *addr, size_t size)
             arch_pause();
         }
         arch_disable_interrupt();
-    }
 
-    spin_unlock(&pipe->lock);
+        spin_lock(&pipe->lock);
+    }
 
     if (pipe->write_ptr + size <= PIPE_BUFF)
     {
@@ -144,6 +147,7 @@ ssize_t pipe_write_inner(void *file, const void *addr, size_t size)
     pipe->write_ptr = (pipe->write_ptr + size) % PIPE_BUFF;
 
     wake_blocked_tasks(&pipe->blocking_read);
+    poll_wake(&pipe->poll_wait);
 
     spin_unlock(&pipe->lock);
 
@@ -210,12 +214,16 @@ bool pipefs_close(void *current)
         wake_blocked_tasks(&pipe->blocking_read);
     if (!pipe->read_fds)
         wake_blocked_tasks(&pipe->blocking_write);
+    poll_wake(&pipe->poll_wait);
 
-    if (pipe->write_fds == 0 && pipe->read_fds == 0)
+    bool last = pipe->write_fds == 0 && pipe->read_fds == 0;
+    spin_unlock(&pipe->lock);
+
+    if (last)
     {
+        poll_wait_free(&pipe->poll_wait);
         free(pipe);
     }
-    spin_unlock(&pipe->lock);
 
     free(spec);
 
@@ -230,6 +238,7 @@ int pipefs_poll(void *file, size_t events)
     int out = 0;
 
     spin_lock(&pipe->lock);
+    poll_wait(&pipe->poll_wait);
     if (events & EPOLLIN)
     {
         if (!pipe->write_fds)
@@ -278,20 +287,6 @@ void pipefs_init()
 // 创建一个新管道
 int sys_pipe(int pipefd[2])
 {
-    int i1 = -1;
-    for (i1 = 3; i1 < MAX_FD_NUM; i1++)
-    {
-        if (current_task->fds[i1] == NULL)
-        {
-            break;
-        }
-    }
-
-    if (i1 == MAX_FD_NUM)
-    {
-        return -EBADF;
-    }
-
     char buf[16];
     sprintf(buf, "pipe%d", pipefd_id++);
 
@@ -314,6 +309,7 @@ int sys_pipe(int pipefd[2])
     info->write_fds = 1;
     info->blocking_read.next = NULL;
     info->blocking_write.next = NULL;
+    info->poll_wait.next = NULL;
     info->lock.lock = 0;
     info->read_ptr = 0;
     info->write_ptr = 0;
@@ -330,30 +326,27 @@ int sys_pipe(int pipefd[2])
     node_input->handle = read_spec;
     node_output->handle = write_spec;
 
-    current_task->fds[i1] = malloc(sizeof(fd_t));
-    current_task->fds[i1]->node = node_input;
-    current_task->fds[i1]->offset = 0;
-    current_task->fds[i1]->flags = 0;
+    // 两端都建好后再安装, 安装失败时 fd_put 经 pipefs_close 释放管道
+    fd_t *file1 = fd_new(node_input, 0);
+    fd_t *file2 = fd_new(node_output, 0);
 
-    int i2 = -1;
-    for (i2 = 3; i2 < MAX_FD_NUM; i2++)
+    int i1 = fd_install(current_task->files, file1, 0, false);
+    if (i1 < 0)
     {
-        if (current_task->fds[i2] == NULL)
-        {
-            break;
-        }
+        fd_put(file1);
+        fd_put(file2);
+        return i1;
     }
 
-    if (i2 == MAX_FD_NUM)
+    int i2 = fd_install(current_task->files, file2, 0, false);
+    if (i2 < 0)
     {
-        return -EBADF;
+        if ((file1 = fd_remove(current_task->files, i1)))
+            fd_put(file1);
+        fd_put(file2);
+        return i2;
     }
 
-    current_task->fds[i2] = malloc(sizeof(fd_t));
-    current_task->fds[i2]->node = node_output;
-    current_task->fds[i2]->offset = 0;
-    current_task->fds[i2]->flags = 0;
-
     pipefd[0] = i1;
     pipefd[1] = i2;
 
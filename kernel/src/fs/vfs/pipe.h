@@ -29,6 +29,7 @@ typedef struct pipe_info
 
     task_block_list_t blocking_read;
     task_block_list_t blocking_write;
+    task_block_list_t poll_wait;
 } pipe_info_t;
 
 typedef struct pipe_specific pipe_specific_t;
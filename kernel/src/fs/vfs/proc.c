@@ -1,6 +1,82 @@
 #include <fs/vfs/proc.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <task/hrtimer.h>
+#include <mm/page_cache.h>
+#include <interrupt/irq_manager.h>
+#include <interrupt/softirq.h>
+#include <task/lock_stat.h>
+
+static ssize_t procfs_read_string(const char *content, size_t len, void *addr, size_t offset, size_t size)
+{
+    if (offset >= len)
+        return 0;
+
+    size_t to_copy = MIN(size, len - offset);
+    memcpy(addr, content + offset, to_copy);
+
+    return to_copy;
+}
+
+// 解析 "irq/N/file" 中的 N 和 file
+static int64_t procfs_irq_number(const char *name, const char **file)
+{
+    if (strncmp(name, "irq/", 4))
+        return -1;
+
+    int64_t irq = 0;
+    const char *p = name + 4;
+    if (*p < '0' || *p > '9')
+        return -1;
+
+    while (*p >= '0' && *p <= '9')
+        irq = irq * 10 + (*p++ - '0');
+
+    if (*p != '/')
+        return -1;
+
+    *file = p + 1;
+    return irq;
+}
+
+static int procfs_parse_hex(const char *buf, size_t size, uint64_t *value)
+{
+    size_t i = 0;
+    uint64_t result = 0;
+    int digits = 0;
+
+    if (size >= 2 && buf[0] == '0' && (buf[1] == 'x' || buf[1] == 'X'))
+        i = 2;
+
+    for (; i < size; i++)
+    {
+        char c = buf[i];
+        int d;
+
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            d = c - 'A' + 10;
+        else if (c == ',') // 兼容按 32 位分组的写法
+            continue;
+        else if (c == '\n' || c == ' ' || c == '\0')
+            break;
+        else
+            return -EINVAL;
+
+        if (++digits > 16)
+            return -EINVAL;
+        result = (result << 4) | d;
+    }
+
+    if (!digits)
+        return -EINVAL;
+
+    *value = result;
+    return 0;
+}
 
 ssize_t procfs_read(void *file, void *addr, size_t offset, size_t size)
 {
@@ -24,12 +100,174 @@ ssize_t procfs_read(void *file, void *addr, size_t offset, size_t size)
         return len + 1;
     }
 
+    if (!strcmp(handle->name, "page_cache"))
+    {
+        char *buf = malloc(DEFAULT_PAGE_SIZE);
+        int len = page_cache_stats_print(buf, DEFAULT_PAGE_SIZE);
+        ssize_t ret = procfs_read_string(buf, len, addr, offset, size);
+        free(buf);
+        return ret;
+    }
+
+    if (!strcmp(handle->name, "stat") || !strcmp(handle->name, "vmstat"))
+    {
+        char buf[256];
+        int len = !strcmp(handle->name, "stat") ? cpu_stat_print(buf, sizeof(buf)) : vm_stat_print(buf, sizeof(buf));
+        return procfs_read_string(buf, len, addr, offset, size);
+    }
+
+    if (!strcmp(handle->name, "irq/balance"))
+    {
+        const char *content = irq_balance_enabled() ? "1\n" : "0\n";
+        return procfs_read_string(content, 2, addr, offset, size);
+    }
+
+    if (!strcmp(handle->name, "interrupts") || !strcmp(handle->name, "softirqs") || !strcmp(handle->name, "irq/softirq_latency"))
+    {
+        bool interrupts = !strcmp(handle->name, "interrupts");
+        size_t buf_size = interrupts ? irq_stat_print_size() : softirq_stat_print_size();
+        char *buf = malloc(buf_size);
+        int len;
+        if (interrupts)
+            len = irq_stat_print(buf, buf_size);
+        else if (!strcmp(handle->name, "softirqs"))
+            len = softirq_stat_print(buf, buf_size);
+        else
+            len = softirq_latency_print(buf, buf_size);
+        ssize_t ret = procfs_read_string(buf, len, addr, offset, size);
+        free(buf);
+        return ret;
+    }
+
+    if (!strcmp(handle->name, "lock_stat"))
+    {
+        size_t buf_size = lock_stat_print_size();
+        char *buf = malloc(buf_size);
+        int len = lock_stat_print(buf, buf_size);
+        ssize_t ret = procfs_read_string(buf, len, addr, offset, size);
+        free(buf);
+        return ret;
+    }
+
+    const char *irq_file;
+    int64_t irq = procfs_irq_number(handle->name, &irq_file);
+    if (irq >= 0 && !strcmp(irq_file, "latency"))
+    {
+        char buf[1024];
+        int len = irq_latency_print(irq, buf, sizeof(buf));
+        return procfs_read_string(buf, len, addr, offset, size);
+    }
+    if (irq >= 0)
+    {
+        char buf[32];
+        int len = sprintf(buf, "%lx\n", irq_get_affinity(irq));
+        return procfs_read_string(buf, len, addr, offset, size);
+    }
+
+    if (!strcmp(handle->name, "timer_list"))
+    {
+        char *buf = malloc(64 * (cpu_count + 1));
+        int len = hrtimer_stats_print(buf);
+        ssize_t ret = procfs_read_string(buf, len, addr, offset, size);
+        free(buf);
+        return ret;
+    }
+
     return 0;
 }
 
+ssize_t procfs_write(void *file, const void *addr, size_t offset, size_t size)
+{
+    proc_handle_t *handle = (proc_handle_t *)file;
+    const char *buf = addr;
+
+    if (offset != 0 || size == 0)
+        return -EINVAL;
+
+    if (!strcmp(handle->name, "irq/balance"))
+    {
+        if (buf[0] != '0' && buf[0] != '1')
+            return -EINVAL;
+        irq_balance_set(buf[0] == '1');
+        return size;
+    }
+
+    // 与 Linux 相同, 写入 0 清空统计
+    if (!strcmp(handle->name, "lock_stat"))
+    {
+        if (buf[0] != '0')
+            return -EINVAL;
+        lock_stat_reset();
+        return size;
+    }
+
+    // 写入任何内容都清零最大耗时
+    if (!strcmp(handle->name, "irq/softirq_latency"))
+    {
+        softirq_latency_reset();
+        return size;
+    }
+
+    const char *irq_file;
+    int64_t irq = procfs_irq_number(handle->name, &irq_file);
+    if (irq >= 0 && !strcmp(irq_file, "latency"))
+    {
+        irq_latency_reset(irq);
+        return size;
+    }
+    if (irq >= 0)
+    {
+        uint64_t mask;
+        int ret = procfs_parse_hex(buf, size, &mask);
+        if (ret < 0)
+            return ret;
+
+        int64_t err = irq_set_affinity(irq, mask);
+        return err < 0 ? err : (ssize_t)size;
+    }
+
+    return -ENOSYS;
+}
+
 vfs_node_t procfs_root = NULL;
 int procfs_id = 0;
 
+static vfs_node_t procfs_irq = NULL;
+static vfs_node_t procfs_irq_nodes[ARCH_MAX_IRQ_NUM];
+
+static vfs_node_t procfs_add_file(vfs_node_t parent, const char *name, uint32_t mode, const char *handle_name)
+{
+    vfs_node_t node = vfs_node_alloc(parent, name);
+    node->type = file_none;
+    node->mode = mode;
+    proc_handle_t *handle = malloc(sizeof(proc_handle_t));
+    node->handle = handle;
+    handle->task = NULL;
+    sprintf(handle->name, "%s", handle_name);
+
+    return node;
+}
+
+void proc_irq_register(uint64_t irq)
+{
+    if (!procfs_irq || procfs_irq_nodes[irq])
+        return;
+
+    char name[64];
+    sprintf(name, "%lu", irq);
+
+    vfs_node_t dir = vfs_node_alloc(procfs_irq, name);
+    dir->type = file_dir;
+    dir->mode = 0555;
+    procfs_irq_nodes[irq] = dir;
+
+    sprintf(name, "irq/%lu/smp_affinity", irq);
+    procfs_add_file(dir, "smp_affinity", 0644, name);
+
+    sprintf(name, "irq/%lu/latency", irq);
+    procfs_add_file(dir, "latency", 0644, name);
+}
+
 static int dummy()
 {
     return -ENOSYS;
@@ -40,7 +278,7 @@ static struct vfs_callback callbacks =
         .open = (vfs_open_t)dummy,
         .close = (vfs_close_t)dummy,
         .read = procfs_read,
-        .write = (vfs_write_t)dummy,
+        .write = procfs_write,
         .mkdir = (vfs_mk_t)dummy,
         .mkfile = (vfs_mk_t)dummy,
         .delete = (vfs_del_t)dummy,
@@ -72,4 +310,54 @@ void proc_init()
     self_exe->handle = handle;
     handle->task = NULL;
     sprintf(handle->name, "self/exe");
+
+    vfs_node_t timer_list = vfs_node_alloc(procfs_root, "timer_list");
+    timer_list->type = file_none;
+    timer_list->mode = 0444;
+    handle = malloc(sizeof(proc_handle_t));
+    timer_list->handle = handle;
+    handle->task = NULL;
+    sprintf(handle->name, "timer_list");
+
+    vfs_node_t page_cache = vfs_node_alloc(procfs_root, "page_cache");
+    page_cache->type = file_none;
+    page_cache->mode = 0444;
+    handle = malloc(sizeof(proc_handle_t));
+    page_cache->handle = handle;
+    handle->task = NULL;
+    sprintf(handle->name, "page_cache");
+
+    vfs_node_t stat = vfs_node_alloc(procfs_root, "stat");
+    stat->type = file_none;
+    stat->mode = 0444;
+    handle = malloc(sizeof(proc_handle_t));
+    stat->handle = handle;
+    handle->task = NULL;
+    sprintf(handle->name, "stat");
+
+    vfs_node_t vmstat = vfs_node_alloc(procfs_root, "vmstat");
+    vmstat->type = file_none;
+    vmstat->mode = 0444;
+    handle = malloc(sizeof(proc_handle_t));
+    vmstat->handle = handle;
+    handle->task = NULL;
+    sprintf(handle->name, "vmstat");
+
+    procfs_irq = vfs_node_alloc(procfs_root, "irq");
+    procfs_irq->type = file_dir;
+    procfs_irq->mode = 0555;
+
+    procfs_add_file(procfs_irq, "balance", 0644, "irq/balance");
+    procfs_add_file(procfs_irq, "softirq_latency", 0644, "irq/softirq_latency");
+
+    procfs_add_file(procfs_root, "interrupts", 0444, "interrupts");
+    procfs_add_file(procfs_root, "softirqs", 0444, "softirqs");
+    procfs_add_file(procfs_root, "lock_stat", 0644, "lock_stat");
+
+    // 在这之前注册的中断
+    for (uint64_t irq = 0; irq < ARCH_MAX_IRQ_NUM; irq++)
+    {
+        if (irq_get_affinity(irq))
+            proc_irq_register(irq);
+    }
 }
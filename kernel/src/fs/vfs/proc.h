@@ -11,5 +11,9 @@ typedef struct proc_handle
 } proc_handle_t;
 
 ssize_t procfs_read(void *file, void *addr, size_t offset, size_t size);
+ssize_t procfs_write(void *file, const void *addr, size_t offset, size_t size);
+
+// 注册中断时创建 /proc/irq/N
+void proc_irq_register(uint64_t irq);
 
 void proc_init();
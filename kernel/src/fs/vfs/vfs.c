@@ -2,6 +2,7 @@
 #include "fs/fs_syscall.h"
 #include "arch/arch.h"
 #include "mm/mm.h"
+#include "mm/page_cache.h"
 #include "task/task.h"
 
 vfs_node_t rootdir = NULL;
@@ -49,6 +50,7 @@ void vfs_free(vfs_node_t vfs)
         return;
     list_free_with(vfs->child, (free_t)vfs_free);
     vfs_close(vfs);
+    page_cache_invalidate(vfs);
     free(vfs->name);
     if (vfs->linkname)
         free(vfs->linkname);
@@ -153,7 +155,7 @@ int vfs_mkfile(const char *name)
     char *path;
     if (name[0] != '/')
     {
-        current = current_task->cwd;
+        current = current_task->fs->cwd;
         path = strdup(name);
     }
     else
@@ -313,8 +315,8 @@ err:
 
 vfs_node_t vfs_open(const char *_path)
 {
-    if (current_task && current_task->cwd)
-        return vfs_open_at(current_task->cwd, _path, false);
+    if (current_task && current_task->fs->cwd)
+        return vfs_open_at(current_task->fs->cwd, _path, false);
     else
         return vfs_open_at(rootdir, _path, false);
 }
@@ -422,6 +424,7 @@ ssize_t vfs_write(vfs_node_t file, const void *addr, size_t offset, size_t size)
     if (write_bytes > 0)
     {
         file->size = max(file->size, offset + write_bytes);
+        page_cache_invalidate(file);
     }
     return write_bytes;
 }
@@ -530,6 +533,7 @@ fd_t *vfs_dup(fd_t *fd)
     new_fd->node = node;
     new_fd->offset = 0;
     new_fd->flags = fd->flags;
+    new_fd->ref_count = 1;
     return new_fd;
 }
 
@@ -225,6 +225,7 @@ struct vfs_node
     vfs_node_t root;     // 根目录
     uint32_t refcount;   // 引用计数
     uint16_t mode;       // 模式
+    uint32_t page_cache_pages; // 页缓存中属于该文件的页数
 };
 
 typedef struct fd
@@ -232,6 +233,7 @@ typedef struct fd
     vfs_node_t node;
     uint64_t offset;
     uint64_t flags;
+    int ref_count; // 描述符表和正在使用它的系统调用各持有一个
 } fd_t;
 
 extern vfs_node_t rootdir; // vfs 根目录
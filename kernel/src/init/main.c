@@ -31,6 +31,9 @@ void kmain(void)
         }
     }
 
+    // percpu_init 之前 arch_this_cpu 也要能安全地返回 NULL
+    arch_set_this_cpu(NULL);
+
     frame_init();
     printk("Next Aether-OS starting...\n");
 
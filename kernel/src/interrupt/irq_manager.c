@@ -2,21 +2,63 @@
 #include <drivers/kernel_logger.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <interrupt/softirq.h>
+#include <task/workqueue.h>
+#include <task/rcu.h>
+#include <fs/vfs/proc.h>
 
 irq_action_t actions[ARCH_MAX_IRQ_NUM];
 
+typedef struct irq_cpu_stat
+{
+    uint32_t count[ARCH_MAX_IRQ_NUM];
+} irq_cpu_stat_t;
+
+static DEFINE_PER_CPU(irq_cpu_stat_t, irq_stats);
+
+typedef struct irq_latency
+{
+    uint32_t hist[IRQ_HIST_BUCKETS];
+    uint64_t max_cycles;
+} irq_latency_t;
+
+// 所有 CPU 共用一份, 每个向量一次只投递到一个 CPU, 原子操作很少竞争
+static irq_latency_t irq_latencies[ARCH_MAX_IRQ_NUM];
+
+static uint64_t irq_errors = 0;
+
+// 保护 affinity/target_cpu, 以及对控制器 set_affinity 的调用
+static spinlock_t irq_affinity_lock = {0};
+
 extern bool can_schedule;
 
+static void irq_latency_record(uint64_t irq, uint64_t cycles)
+{
+    irq_latency_t *latency = &irq_latencies[irq];
+
+    __atomic_fetch_add(&latency->hist[irq_hist_bucket(cycles)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&latency->max_cycles, __ATOMIC_RELAXED);
+    while (cycles > max && !__atomic_compare_exchange_n(&latency->max_cycles, &max, cycles, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
 void do_irq(struct pt_regs *regs, uint64_t irq_num)
 {
     irq_action_t *action = &actions[irq_num];
 
+    cpu_stat_inc(CPU_STAT_INTR);
+    this_cpu_var(irq_stats).count[irq_num]++;
+
     if (action->handler)
     {
+        uint64_t start = arch_cycles();
         action->handler(irq_num, action->data, regs);
+        irq_latency_record(irq_num, arch_cycles() - start);
     }
     else
     {
+        __atomic_fetch_add(&irq_errors, 1, __ATOMIC_RELAXED);
         printk("Intr vector [%d] does not have a handler\n", irq_num);
     }
 
@@ -29,12 +71,328 @@ void do_irq(struct pt_regs *regs, uint64_t irq_num)
         printk("Intr vector [%d] does not have an ack\n", irq_num);
     }
 
-    if ((irq_num == ARCH_TIMER_IRQ) && can_schedule)
+    // 被打断的代码不在读侧临界区内时, 本 CPU 经过了一次静止状态
+    rcu_note_qs();
+
+    // 中断已经应答, 推迟的处理在这里开中断执行
+    do_softirq();
+
+    // 被打断的软中断不能切换出去, 否则本 CPU 的软中断会一直停在 active
+    // 读侧临界区中也不能切换, 推迟到退出临界区后的下一次中断
+    if ((irq_num == ARCH_TIMER_IRQ || arch_this_cpu()->need_resched) && can_schedule && !in_softirq() && !rcu_read_lock_held())
     {
+        arch_this_cpu()->need_resched = false;
         arch_task_switch_to(regs, current_task, task_search(TASK_READY, current_task->cpu_id));
     }
 }
 
+static uint64_t irq_online_mask()
+{
+    return cpu_count >= 64 ? ~0UL : (1UL << cpu_count) - 1;
+}
+
+// 本地 APIC 定时器等每个 CPU 各有一份的中断不能迁移
+static bool irq_can_set_affinity(uint64_t irq)
+{
+    irq_action_t *action = &actions[irq];
+
+    return irq != ARCH_TIMER_IRQ && action->irq_controller && action->irq_controller->set_affinity;
+}
+
+// 调用者持有 irq_affinity_lock
+static uint32_t irq_pick_cpu(uint64_t mask)
+{
+    uint32_t assigned[MAX_CPU_NUM] = {0};
+
+    for (uint64_t irq = 0; irq < ARCH_MAX_IRQ_NUM; irq++)
+    {
+        if (actions[irq].handler && irq_can_set_affinity(irq))
+            assigned[actions[irq].target_cpu]++;
+    }
+
+    uint32_t best = MAX_CPU_NUM;
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        if (!(mask & (1UL << cpu)))
+            continue;
+        if (best == MAX_CPU_NUM || assigned[cpu] < assigned[best])
+            best = cpu;
+    }
+
+    return best;
+}
+
+// 调用者持有 irq_affinity_lock
+static int64_t irq_move(uint64_t irq, uint32_t cpu)
+{
+    irq_action_t *action = &actions[irq];
+
+    int64_t ret = action->irq_controller->set_affinity(irq, cpu);
+    if (ret == 0)
+        action->target_cpu = cpu;
+
+    return ret;
+}
+
+static void irq_affinity_setup(uint64_t irq)
+{
+    irq_action_t *action = &actions[irq];
+
+    spin_lock_irqsave(&irq_affinity_lock);
+
+    action->affinity = irq_online_mask();
+    action->target_cpu = current_cpu_id;
+
+    uint32_t cpu = irq_pick_cpu(action->affinity);
+    if (irq_can_set_affinity(irq) && cpu < MAX_CPU_NUM)
+        irq_move(irq, cpu);
+
+    spin_unlock_irqrestore(&irq_affinity_lock);
+}
+
+int64_t irq_set_affinity(uint64_t irq, uint64_t mask)
+{
+    if (irq >= ARCH_MAX_IRQ_NUM || !actions[irq].handler)
+        return -EINVAL;
+
+    mask &= irq_online_mask();
+    if (!mask)
+        return -EINVAL;
+
+    if (!irq_can_set_affinity(irq))
+        return -EIO;
+
+    irq_action_t *action = &actions[irq];
+    int64_t ret = 0;
+
+    spin_lock_irqsave(&irq_affinity_lock);
+
+    action->affinity = mask;
+    if (!(mask & (1UL << action->target_cpu)))
+        ret = irq_move(irq, irq_pick_cpu(mask));
+
+    spin_unlock_irqrestore(&irq_affinity_lock);
+
+    return ret;
+}
+
+uint64_t irq_get_affinity(uint64_t irq)
+{
+    return irq < ARCH_MAX_IRQ_NUM ? actions[irq].affinity : 0;
+}
+
+uint32_t irq_get_target(uint64_t irq)
+{
+    return actions[irq].target_cpu;
+}
+
+uint64_t irq_stat_read(uint32_t cpu, uint64_t irq)
+{
+    return __atomic_load_n(&per_cpu(irq_stats, cpu).count[irq], __ATOMIC_RELAXED);
+}
+
+uint64_t irq_err_count()
+{
+    return __atomic_load_n(&irq_errors, __ATOMIC_RELAXED);
+}
+
+// 每行最长的长度, 名字超出部分截断
+#define IRQ_STAT_NAME_MAX 32
+#define IRQ_STAT_LINE_MAX(cpus) (16 + (cpus) * 11 + 2 * (IRQ_STAT_NAME_MAX + 2) + 1)
+
+size_t irq_stat_print_size()
+{
+    size_t lines = 2; // 表头和 ERR
+
+    for (uint64_t irq = 0; irq < ARCH_MAX_IRQ_NUM; irq++)
+    {
+        if (actions[irq].handler)
+            lines++;
+    }
+
+    return lines * IRQ_STAT_LINE_MAX(cpu_count) + 1;
+}
+
+int irq_stat_print(char *buf, size_t size)
+{
+    size_t line_max = IRQ_STAT_LINE_MAX(cpu_count);
+    size_t len = 0;
+
+    if (size < line_max)
+        return 0;
+
+    len += sprintf(buf + len, "%*s", 3 + 8, "");
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        len += sprintf(buf + len, "CPU%-8u", cpu);
+    len += sprintf(buf + len, "\n");
+
+    for (uint64_t irq = 0; irq < ARCH_MAX_IRQ_NUM; irq++)
+    {
+        irq_action_t *action = &actions[irq];
+        if (!action->handler)
+            continue;
+
+        // 留出 ERR 一行
+        if (len + 2 * line_max >= size)
+            break;
+
+        len += sprintf(buf + len, "%3lu: ", irq);
+        for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+            len += sprintf(buf + len, "%10lu ", irq_stat_read(cpu, irq));
+
+        const char *chip = action->irq_controller && action->irq_controller->name ? action->irq_controller->name : "none";
+        len += sprintf(buf + len, " %8.32s  %.32s\n", chip, action->name ? action->name : "");
+    }
+
+    len += sprintf(buf + len, "%3s: %10lu\n", "ERR", irq_err_count());
+
+    return len;
+}
+
+static size_t irq_print_line(char *buf, size_t len, size_t size, const char *line, int n)
+{
+    if (len + n >= size)
+        return len;
+
+    memcpy(buf + len, line, n);
+    return len + n;
+}
+
+int irq_latency_print(uint64_t irq, char *buf, size_t size)
+{
+    irq_latency_t *latency = &irq_latencies[irq];
+    char line[64];
+    size_t len = 0;
+
+    len = irq_print_line(buf, len, size, line, sprintf(line, "%-24s %10s\n", "cycles", "count"));
+
+    for (int i = 0; i < IRQ_HIST_BUCKETS; i++)
+    {
+        uint64_t low = i ? 1UL << (IRQ_HIST_SHIFT + i - 1) : 0;
+        uint64_t high = (1UL << (IRQ_HIST_SHIFT + i)) - 1;
+        uint32_t count = __atomic_load_n(&latency->hist[i], __ATOMIC_RELAXED);
+
+        int n = i == IRQ_HIST_BUCKETS - 1 ? sprintf(line, "%12lu - %-9s %10u\n", low, "", count)
+                                          : sprintf(line, "%12lu - %-9lu %10u\n", low, high, count);
+        len = irq_print_line(buf, len, size, line, n);
+    }
+
+    // 周期频率未知时只给出周期数
+    uint64_t max = __atomic_load_n(&latency->max_cycles, __ATOMIC_RELAXED);
+    uint64_t hz = arch_cycles_hz();
+    int n = hz ? sprintf(line, "max %lu cycles (%lu ns)\n", max, (uint64_t)((unsigned __int128)max * 1000000000ULL / hz))
+               : sprintf(line, "max %lu cycles\n", max);
+
+    return irq_print_line(buf, len, size, line, n);
+}
+
+void irq_latency_reset(uint64_t irq)
+{
+    irq_latency_t *latency = &irq_latencies[irq];
+
+    for (int i = 0; i < IRQ_HIST_BUCKETS; i++)
+        __atomic_store_n(&latency->hist[i], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&latency->max_cycles, 0, __ATOMIC_RELAXED);
+}
+
+static bool irq_balance_on = false;
+static delayed_work_t irq_balance_work;
+
+// 只有工作线程访问
+static uint64_t irq_balance_last[ARCH_MAX_IRQ_NUM];
+static uint64_t irq_balance_delta[ARCH_MAX_IRQ_NUM];
+static uint16_t irq_balance_order[ARCH_MAX_IRQ_NUM];
+
+static void irq_balance_func(work_struct_t *work)
+{
+    uint64_t load[MAX_CPU_NUM] = {0};
+    uint32_t count = 0;
+
+    spin_lock_irqsave(&irq_affinity_lock);
+
+    for (uint64_t irq = 0; irq < ARCH_MAX_IRQ_NUM; irq++)
+    {
+        if (!actions[irq].handler || !irq_can_set_affinity(irq))
+            continue;
+
+        uint64_t total = 0;
+        for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+            total += irq_stat_read(cpu, irq);
+
+        irq_balance_delta[irq] = total - irq_balance_last[irq];
+        irq_balance_last[irq] = total;
+
+        if (!irq_balance_delta[irq])
+            continue;
+
+        // 按这段时间内的次数从大到小插入
+        uint32_t i = count++;
+        while (i > 0 && irq_balance_delta[irq_balance_order[i - 1]] < irq_balance_delta[irq])
+        {
+            irq_balance_order[i] = irq_balance_order[i - 1];
+            i--;
+        }
+        irq_balance_order[i] = irq;
+    }
+
+    // 先分配负载大的中断, 每个都放到当前负载最小的 CPU 上
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint64_t irq = irq_balance_order[i];
+        irq_action_t *action = &actions[irq];
+        uint64_t delta = irq_balance_delta[irq];
+
+        uint32_t best = action->target_cpu;
+        for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        {
+            if ((action->affinity & (1UL << cpu)) && load[cpu] < load[best])
+                best = cpu;
+        }
+
+        // 差距不大时留在原来的 CPU 上, 避免来回迁移
+        if (best != action->target_cpu && load[action->target_cpu] > load[best] + delta / 2)
+        {
+            if (irq_move(irq, best) != 0)
+                best = action->target_cpu;
+        }
+        else
+        {
+            best = action->target_cpu;
+        }
+
+        load[best] += delta;
+    }
+
+    spin_unlock_irqrestore(&irq_affinity_lock);
+
+    if (__atomic_load_n(&irq_balance_on, __ATOMIC_ACQUIRE))
+        queue_delayed_work(&irq_balance_work, IRQ_BALANCE_INTERVAL_NS);
+}
+
+void irq_balance_set(bool enable)
+{
+    static bool initialized = false;
+
+    if (!initialized)
+    {
+        delayed_work_init(&irq_balance_work, irq_balance_func, NULL);
+        initialized = true;
+    }
+
+    if (__atomic_exchange_n(&irq_balance_on, enable, __ATOMIC_ACQ_REL) == enable)
+        return;
+
+    if (enable)
+        queue_delayed_work(&irq_balance_work, IRQ_BALANCE_INTERVAL_NS);
+    else
+        cancel_delayed_work(&irq_balance_work);
+}
+
+bool irq_balance_enabled()
+{
+    return __atomic_load_n(&irq_balance_on, __ATOMIC_ACQUIRE);
+}
+
 void irq_regist_irq(uint64_t irq_num, void (*handler)(uint64_t irq_num, void *data, struct pt_regs *regs), uint64_t arg, void *data, irq_controller_t *controller, char *name)
 {
     irq_action_t *action = &actions[irq_num];
@@ -49,8 +407,225 @@ void irq_regist_irq(uint64_t irq_num, void (*handler)(uint64_t irq_num, void *da
         action->irq_controller->install(irq_num, arg);
     }
 
+    irq_affinity_setup(irq_num);
+    proc_irq_register(irq_num);
+
     if (action->irq_controller && action->irq_controller->unmask)
     {
         action->irq_controller->unmask(irq_num);
     }
 }
+
+static void irq_thread_wake(uint64_t irq)
+{
+    irq_action_t *action = &actions[irq];
+
+    if ((action->flags & IRQF_ONESHOT) && action->irq_controller && action->irq_controller->mask)
+        action->irq_controller->mask(irq);
+
+    // 与线程中先设置阻塞状态再检查 pending 的顺序配对
+    __atomic_store_n(&action->thread_pending, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    task_t *thread = action->thread;
+    if (thread && thread->state == TASK_BLOCKING)
+    {
+        task_unblock(thread, EOK);
+        task_wake_preempt(thread);
+    }
+}
+
+static void irq_thread_primary(uint64_t irq_num, void *data, struct pt_regs *regs)
+{
+    irq_action_t *action = &actions[irq_num];
+
+    irq_return_t ret = action->primary ? action->primary(irq_num, data, regs) : IRQ_WAKE_THREAD;
+    if (ret == IRQ_WAKE_THREAD)
+        irq_thread_wake(irq_num);
+}
+
+static void irq_thread_entry(uint64_t irq)
+{
+    irq_action_t *action = &actions[irq];
+
+    while (1)
+    {
+        arch_disable_interrupt();
+
+        if (!__atomic_exchange_n(&action->thread_pending, 0, __ATOMIC_ACQ_REL))
+        {
+            task_block_prepare(current_task, TASK_BLOCKING, 0);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&action->thread_pending, __ATOMIC_RELAXED))
+                current_task->state = TASK_READY;
+            else
+                task_block_wait(current_task, TASK_BLOCKING, 0);
+            continue;
+        }
+
+        arch_enable_interrupt();
+
+        if (action->thread_fn)
+            action->thread_fn(irq, action->data);
+
+        if ((action->flags & IRQF_ONESHOT) && action->irq_controller && action->irq_controller->unmask)
+            action->irq_controller->unmask(irq);
+    }
+}
+
+int64_t request_threaded_irq(uint64_t irq_num, irq_primary_t primary, irq_thread_fn_t thread_fn, uint64_t arg, void *data, irq_controller_t *controller, uint32_t flags, char *name)
+{
+    if (irq_num >= ARCH_MAX_IRQ_NUM || !thread_fn)
+        return -EINVAL;
+
+    irq_action_t *action = &actions[irq_num];
+    if (action->handler)
+        return -EBUSY;
+
+    action->flags = flags;
+    action->primary = primary;
+    action->thread_fn = thread_fn;
+    action->thread = NULL;
+    action->thread_pending = 0;
+
+    irq_regist_irq(irq_num, irq_thread_primary, arg, data, controller, name);
+
+    // 注册后到线程创建前的中断只留下 pending, 线程启动后会先处理
+    bool enabled = arch_interrupt_enabled();
+
+    char thread_name[TASK_NAME_MAX];
+    sprintf(thread_name, "irq/%lu-%s", irq_num, name);
+    task_t *thread = task_create(thread_name, irq_thread_entry, irq_num);
+    thread->cpu_id = action->target_cpu;
+    task_setscheduler(thread, SCHED_FIFO, IRQ_THREAD_DEFAULT_RT_PRIO);
+    action->thread = thread;
+
+    if (enabled)
+        arch_enable_interrupt();
+
+    return 0;
+}
+
+int irq_set_thread_priority(uint64_t irq, int policy, int rt_priority)
+{
+    if (irq >= ARCH_MAX_IRQ_NUM || !actions[irq].thread)
+        return -EINVAL;
+
+    return task_setscheduler(actions[irq].thread, policy, rt_priority);
+}
+
+static uint64_t irq_vector_used[(ARCH_MAX_IRQ_NUM + 63) / 64];
+static spinlock_t irq_vector_lock = {0};
+
+static bool irq_vector_test(uint64_t irq)
+{
+    return irq_vector_used[irq / 64] & (1UL << (irq % 64));
+}
+
+int64_t irq_alloc_vectors(uint32_t count)
+{
+    if (count == 0)
+        return -EINVAL;
+
+    spin_lock_irqsave(&irq_vector_lock);
+
+    for (uint64_t start = ARCH_IRQ_DYNAMIC_START; start + count <= ARCH_IRQ_DYNAMIC_END; start++)
+    {
+        uint32_t i = 0;
+        while (i < count && !irq_vector_test(start + i) && !actions[start + i].handler)
+            i++;
+
+        if (i < count)
+        {
+            start += i;
+            continue;
+        }
+
+        for (i = 0; i < count; i++)
+            irq_vector_used[(start + i) / 64] |= 1UL << ((start + i) % 64);
+
+        spin_unlock_irqrestore(&irq_vector_lock);
+        return start;
+    }
+
+    spin_unlock_irqrestore(&irq_vector_lock);
+
+    return -ENOSPC;
+}
+
+void irq_free_vectors(uint64_t irq, uint32_t count)
+{
+    spin_lock_irqsave(&irq_vector_lock);
+    spin_lock_irqsave(&irq_affinity_lock);
+
+    for (uint64_t i = irq; i < irq + count; i++)
+    {
+        irq_vector_used[i / 64] &= ~(1UL << (i % 64));
+        memset(&actions[i], 0, sizeof(irq_action_t));
+        irq_latency_reset(i);
+    }
+
+    spin_unlock_irqrestore(&irq_affinity_lock);
+    spin_unlock_irqrestore(&irq_vector_lock);
+}
+
+void irq_waiter_init(irq_waiter_t *waiter)
+{
+    waiter->task = NULL;
+    waiter->missed = 0;
+    waiter->enabled = true;
+}
+
+void irq_waiter_wake(irq_waiter_t *waiter)
+{
+    task_t *task = __atomic_exchange_n(&waiter->task, NULL, __ATOMIC_ACQ_REL);
+    if (task && task->state == TASK_BLOCKING)
+        task_unblock(task, EOK);
+}
+
+// 返回 true 时已经进入阻塞状态并关中断, 调用者再检查一次条件, 然后 cancel 或 sleep
+bool irq_waiter_prepare(irq_waiter_t *waiter)
+{
+    if (!waiter->enabled || !can_schedule || !current_task || !arch_interrupt_enabled())
+        return false;
+
+    arch_disable_interrupt();
+
+    waiter->deadline = nanoTime() + IRQ_WAIT_TIMEOUT_NS;
+    task_block_prepare(current_task, TASK_BLOCKING, waiter->deadline);
+    __atomic_store_n(&waiter->task, current_task, __ATOMIC_SEQ_CST);
+
+    return true;
+}
+
+void irq_waiter_cancel(irq_waiter_t *waiter)
+{
+    __atomic_store_n(&waiter->task, NULL, __ATOMIC_SEQ_CST);
+    hrtimer_cancel(&current_task->block_timer);
+    current_task->state = TASK_READY;
+
+    arch_enable_interrupt();
+}
+
+int irq_waiter_sleep(irq_waiter_t *waiter)
+{
+    int ret = task_block_wait(current_task, TASK_BLOCKING, waiter->deadline);
+
+    __atomic_store_n(&waiter->task, NULL, __ATOMIC_SEQ_CST);
+    arch_enable_interrupt();
+
+    if (ret != -ETIMEDOUT)
+        waiter->missed = 0;
+
+    return ret;
+}
+
+void irq_waiter_missed(irq_waiter_t *waiter)
+{
+    if (++waiter->missed < IRQ_WAIT_MAX_MISSED)
+        return;
+
+    waiter->enabled = false;
+    printk("irq waiter: interrupts are not arriving, falling back to polling\n");
+}
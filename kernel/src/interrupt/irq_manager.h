@@ -3,6 +3,7 @@
 #include <libs/klibc.h>
 
 struct pt_regs;
+struct task;
 
 typedef struct irq_controller
 {
@@ -10,14 +11,123 @@ typedef struct irq_controller
     int64_t (*mask)(uint64_t irq);
     int64_t (*install)(uint64_t irq, uint64_t arg);
     int64_t (*ack)(uint64_t irq);
+    int64_t (*set_affinity)(uint64_t irq, uint32_t cpu); // 改为投递到指定 CPU
+    const char *name;                                    // 显示在 /proc/interrupts 中
 } irq_controller_t;
 
+typedef enum irq_return
+{
+    IRQ_NONE,
+    IRQ_HANDLED,
+    IRQ_WAKE_THREAD, // 交给中断线程继续处理
+} irq_return_t;
+
+typedef irq_return_t (*irq_primary_t)(uint64_t irq_num, void *data, struct pt_regs *regs);
+typedef void (*irq_thread_fn_t)(uint64_t irq_num, void *data);
+
+#define IRQF_ONESHOT (1 << 0) // 线程处理完之前保持屏蔽, 控制器需要能屏蔽单个向量
+
+// 中断线程默认使用 SCHED_FIFO, 与 Linux 一致
+#define IRQ_THREAD_DEFAULT_RT_PRIO 50
+
 typedef struct irq_action
 {
     char *name;
     void *data;
     irq_controller_t *irq_controller;
     void (*handler)(uint64_t irq_num, void *data, struct pt_regs *regs);
+    uint64_t affinity;   // 允许处理这个中断的 CPU 位图, 未注册时为 0
+    uint32_t target_cpu; // 硬件实际投递到的 CPU
+    uint32_t flags;
+    irq_primary_t primary;     // 线程化中断在关中断时执行的部分, 可以为空
+    irq_thread_fn_t thread_fn; // 在中断线程中开中断执行
+    struct task *thread;
+    uint32_t thread_pending;
 } irq_action_t;
 
 void irq_regist_irq(uint64_t irq_num, void (*handler)(uint64_t irq_num, void *data, struct pt_regs *regs), uint64_t arg, void *data, irq_controller_t *controller, char *name);
+
+// primary 为空时只屏蔽 (IRQF_ONESHOT) 并唤醒线程, 应答仍由 do_irq 完成
+int64_t request_threaded_irq(uint64_t irq_num, irq_primary_t primary, irq_thread_fn_t thread_fn, uint64_t arg, void *data, irq_controller_t *controller, uint32_t flags, char *name);
+int irq_set_thread_priority(uint64_t irq, int policy, int rt_priority);
+
+// 硬件一次只投递到一个 CPU, 从允许的 CPU 中选已分配中断最少的
+int64_t irq_set_affinity(uint64_t irq, uint64_t mask);
+uint64_t irq_get_affinity(uint64_t irq);
+uint32_t irq_get_target(uint64_t irq);
+
+// 每个 CPU 上处理过的次数
+uint64_t irq_stat_read(uint32_t cpu, uint64_t irq);
+// 没有处理函数的中断次数
+uint64_t irq_err_count();
+
+// 处理函数的耗时按周期数以 2 的幂分桶, 第一个桶是 [0, 1 << IRQ_HIST_SHIFT)
+#define IRQ_HIST_BUCKETS 16
+#define IRQ_HIST_SHIFT 10
+
+static inline int irq_hist_bucket(uint64_t cycles)
+{
+    uint64_t scaled = cycles >> IRQ_HIST_SHIFT;
+    int bucket = scaled ? 64 - __builtin_clzll(scaled) : 0;
+
+    return MIN(bucket, IRQ_HIST_BUCKETS - 1);
+}
+
+// 与 Linux 的 /proc/interrupts 格式相同
+size_t irq_stat_print_size();
+int irq_stat_print(char *buf, size_t size);
+
+// 耗时分布和最大值, 最大值在 reset 之前一直保留
+int irq_latency_print(uint64_t irq, char *buf, size_t size);
+void irq_latency_reset(uint64_t irq);
+
+// 周期性地按各 CPU 的中断负载重新分配可以迁移的中断
+#define IRQ_BALANCE_INTERVAL_NS 1000000000ULL
+
+void irq_balance_set(bool enable);
+bool irq_balance_enabled();
+
+// 在 [ARCH_IRQ_DYNAMIC_START, ARCH_IRQ_DYNAMIC_END) 中分配 count 个连续向量, 返回第一个
+int64_t irq_alloc_vectors(uint32_t count);
+void irq_free_vectors(uint64_t irq, uint32_t count);
+
+// 驱动在等待设备完成时睡眠, 由中断处理函数唤醒, 同一时刻只有一个等待者
+typedef struct irq_waiter
+{
+    struct task *task;
+    uint64_t deadline;
+    uint32_t missed; // 连续超时后发现条件已满足的次数
+    bool enabled;    // 中断没有送达时关闭, 退回轮询
+} irq_waiter_t;
+
+// 超过这个时间没有被唤醒就重新检查一次条件
+#define IRQ_WAIT_TIMEOUT_NS 100000000ULL
+#define IRQ_WAIT_MAX_MISSED 8
+
+void irq_waiter_init(irq_waiter_t *waiter);
+void irq_waiter_wake(irq_waiter_t *waiter);
+
+bool irq_waiter_prepare(irq_waiter_t *waiter);
+void irq_waiter_cancel(irq_waiter_t *waiter);
+int irq_waiter_sleep(irq_waiter_t *waiter);
+void irq_waiter_missed(irq_waiter_t *waiter);
+
+// 关中断或没有启用中断时自旋等待
+#define irq_wait_event(waiter, cond)                                        \
+    ({                                                                      \
+        while (!(cond))                                                     \
+        {                                                                   \
+            if (!irq_waiter_prepare(waiter))                                \
+            {                                                               \
+                arch_pause();                                               \
+                continue;                                                   \
+            }                                                               \
+            if (cond)                                                       \
+            {                                                               \
+                irq_waiter_cancel(waiter);                                  \
+                break;                                                      \
+            }                                                               \
+            if (irq_waiter_sleep(waiter) == -ETIMEDOUT && (cond))           \
+                irq_waiter_missed(waiter);                                  \
+        }                                                                   \
+    })
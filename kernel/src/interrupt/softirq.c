@@ -0,0 +1,210 @@
+#include <interrupt/softirq.h>
+#include <arch/arch.h>
+#include <task/percpu.h>
+#include <task/workqueue.h>
+
+static softirq_action_t softirq_vec[NR_SOFTIRQS];
+
+static const char *softirq_names[NR_SOFTIRQS] = {"NET_RX", "BLOCK", "TASKLET", "RCU"};
+
+DEFINE_PER_CPU(softirq_cpu_t, softirq_cpus);
+
+// 退出中断时没处理完的软中断, 在本 CPU 的工作线程中继续
+static DEFINE_PER_CPU(work_struct_t, softirq_works);
+
+void open_softirq(softirq_nr_t nr, softirq_action_t action)
+{
+    softirq_vec[nr] = action;
+}
+
+void raise_softirq(softirq_nr_t nr)
+{
+    __atomic_fetch_or(&this_cpu_var(softirq_cpus).pending, 1 << nr, __ATOMIC_RELAXED);
+}
+
+bool in_softirq()
+{
+    return this_cpu_var(softirq_cpus).active;
+}
+
+void do_softirq()
+{
+    uint32_t cpu = current_cpu_id;
+    softirq_cpu_t *sc = &per_cpu(softirq_cpus, cpu);
+
+    if (sc->active || !__atomic_load_n(&sc->pending, __ATOMIC_RELAXED))
+        return;
+
+    sc->active = true;
+
+    for (int restart = 0; restart < SOFTIRQ_MAX_RESTART; restart++)
+    {
+        uint32_t pending = __atomic_exchange_n(&sc->pending, 0, __ATOMIC_RELAXED);
+        if (!pending)
+            break;
+
+        // 执行期间允许硬件中断嵌套, 嵌套的中断只会设置 pending
+        arch_enable_interrupt();
+
+        for (int nr = 0; nr < NR_SOFTIRQS; nr++)
+        {
+            if (!(pending & (1 << nr)) || !softirq_vec[nr])
+                continue;
+
+            uint64_t start = arch_cycles();
+            softirq_vec[nr]();
+            uint64_t cycles = arch_cycles() - start;
+
+            sc->count[nr]++;
+            if (cycles > sc->max_cycles[nr])
+                sc->max_cycles[nr] = cycles;
+        }
+
+        arch_disable_interrupt();
+    }
+
+    sc->active = false;
+
+    if (__atomic_load_n(&sc->pending, __ATOMIC_RELAXED))
+        queue_work_on(cpu, &per_cpu(softirq_works, cpu));
+}
+
+#define SOFTIRQ_STAT_LINE_MAX(cpus) (20 + (cpus) * 11 + 2)
+
+size_t softirq_stat_print_size()
+{
+    return (NR_SOFTIRQS + 1) * SOFTIRQ_STAT_LINE_MAX(cpu_count) + 1;
+}
+
+static int softirq_print_table(char *buf, size_t size, bool latency)
+{
+    uint64_t hz = arch_cycles_hz();
+    size_t len = 0;
+
+    if (size < softirq_stat_print_size())
+        return 0;
+
+    len += sprintf(buf + len, "%*s", 20, "");
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        len += sprintf(buf + len, "CPU%-8u", cpu);
+    len += sprintf(buf + len, "\n");
+
+    for (int nr = 0; nr < NR_SOFTIRQS; nr++)
+    {
+        len += sprintf(buf + len, "%12s:", softirq_names[nr]);
+
+        for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        {
+            softirq_cpu_t *sc = &per_cpu(softirq_cpus, cpu);
+            uint64_t value = __atomic_load_n(latency ? &sc->max_cycles[nr] : &sc->count[nr], __ATOMIC_RELAXED);
+
+            // 周期频率已知时以纳秒为单位
+            if (latency && hz)
+                value = (unsigned __int128)value * 1000000000ULL / hz;
+
+            len += sprintf(buf + len, " %10lu", value);
+        }
+
+        len += sprintf(buf + len, "\n");
+    }
+
+    return len;
+}
+
+int softirq_stat_print(char *buf, size_t size)
+{
+    return softirq_print_table(buf, size, false);
+}
+
+int softirq_latency_print(char *buf, size_t size)
+{
+    return softirq_print_table(buf, size, true);
+}
+
+void softirq_latency_reset()
+{
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        for (int nr = 0; nr < NR_SOFTIRQS; nr++)
+            __atomic_store_n(&per_cpu(softirq_cpus, cpu).max_cycles[nr], 0, __ATOMIC_RELAXED);
+    }
+}
+
+static void softirq_work_func(work_struct_t *work)
+{
+    arch_disable_interrupt();
+    do_softirq();
+    arch_enable_interrupt();
+}
+
+void tasklet_init(tasklet_t *tasklet, void (*func)(uint64_t data), uint64_t data)
+{
+    tasklet->next = NULL;
+    tasklet->func = func;
+    tasklet->data = data;
+    tasklet->state = 0;
+}
+
+// 调用者持有 tasklet_lock
+static void tasklet_enqueue(softirq_cpu_t *sc, tasklet_t *tasklet)
+{
+    tasklet->next = NULL;
+    if (sc->tasklet_tail)
+        sc->tasklet_tail->next = tasklet;
+    else
+        sc->tasklet_head = tasklet;
+    sc->tasklet_tail = tasklet;
+}
+
+void tasklet_schedule(tasklet_t *tasklet)
+{
+    if (__atomic_fetch_or(&tasklet->state, TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL) & TASKLET_STATE_SCHED)
+        return;
+
+    softirq_cpu_t *sc = &this_cpu_var(softirq_cpus);
+
+    spin_lock_irqsave(&sc->tasklet_lock);
+    tasklet_enqueue(sc, tasklet);
+    raise_softirq(TASKLET_SOFTIRQ);
+    spin_unlock_irqrestore(&sc->tasklet_lock);
+}
+
+static void tasklet_action()
+{
+    softirq_cpu_t *sc = &this_cpu_var(softirq_cpus);
+
+    spin_lock_irqsave(&sc->tasklet_lock);
+    tasklet_t *list = sc->tasklet_head;
+    sc->tasklet_head = NULL;
+    sc->tasklet_tail = NULL;
+    spin_unlock_irqrestore(&sc->tasklet_lock);
+
+    while (list)
+    {
+        tasklet_t *tasklet = list;
+        list = list->next;
+
+        // 正在其他 CPU 上执行, 放回队列稍后再试
+        if (__atomic_fetch_or(&tasklet->state, TASKLET_STATE_RUN, __ATOMIC_ACQUIRE) & TASKLET_STATE_RUN)
+        {
+            spin_lock_irqsave(&sc->tasklet_lock);
+            tasklet_enqueue(sc, tasklet);
+            raise_softirq(TASKLET_SOFTIRQ);
+            spin_unlock_irqrestore(&sc->tasklet_lock);
+            continue;
+        }
+
+        // 先清除 SCHED, 执行期间可以再次调度自己
+        __atomic_fetch_and(&tasklet->state, ~TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL);
+        tasklet->func(tasklet->data);
+        __atomic_fetch_and(&tasklet->state, ~TASKLET_STATE_RUN, __ATOMIC_RELEASE);
+    }
+}
+
+void softirq_init()
+{
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        work_init(&per_cpu(softirq_works, cpu), softirq_work_func, NULL);
+
+    open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+// 软中断在硬件中断处理完并应答之后执行, 此时中断已重新打开
+typedef enum softirq_nr
+{
+    NET_RX_SOFTIRQ,
+    BLOCK_SOFTIRQ,
+    TASKLET_SOFTIRQ,
+    RCU_SOFTIRQ,
+    NR_SOFTIRQS,
+} softirq_nr_t;
+
+// 一次退出中断时最多重新扫描的次数, 剩余的交给工作队列
+#define SOFTIRQ_MAX_RESTART 10
+
+typedef void (*softirq_action_t)();
+
+typedef struct softirq_cpu
+{
+    uint32_t pending;
+    bool active;
+    uint64_t count[NR_SOFTIRQS];
+    uint64_t max_cycles[NR_SOFTIRQS]; // 单次执行的最长耗时
+    spinlock_t tasklet_lock; // 只防止本 CPU 上的中断嵌套
+    struct tasklet *tasklet_head;
+    struct tasklet *tasklet_tail;
+} softirq_cpu_t;
+
+void open_softirq(softirq_nr_t nr, softirq_action_t action);
+void raise_softirq(softirq_nr_t nr);
+
+// 在关中断时调用, 正在执行软中断时直接返回
+void do_softirq();
+bool in_softirq();
+
+// 与 Linux 的 /proc/softirqs 格式相同
+size_t softirq_stat_print_size();
+int softirq_stat_print(char *buf, size_t size);
+// 各 CPU 上的最长耗时, 写入时清零
+int softirq_latency_print(char *buf, size_t size);
+void softirq_latency_reset();
+
+#define TASKLET_STATE_SCHED (1 << 0) // 已排队, 尚未执行
+#define TASKLET_STATE_RUN (1 << 1)   // 正在某个 CPU 上执行
+
+// 同一个 tasklet 不会在多个 CPU 上并发执行
+typedef struct tasklet
+{
+    struct tasklet *next;
+    void (*func)(uint64_t data);
+    uint64_t data;
+    uint32_t state;
+} tasklet_t;
+
+void tasklet_init(tasklet_t *tasklet, void (*func)(uint64_t data), uint64_t data);
+void tasklet_schedule(tasklet_t *tasklet);
+
+void softirq_init();
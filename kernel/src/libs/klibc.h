@@ -30,6 +30,7 @@ typedef void *timer_t;
 #define MIN(x, y) ((x < y) ? (x) : (y))
 
 #define PADDING_UP(a, align) (typeof(a))((((uint64_t)(a)) + ((uint64_t)(align)) - 1) & ~(((uint64_t)(align)) - 1))
+#define PADDING_DOWN(a, align) (typeof(a))(((uint64_t)(a)) & ~(((uint64_t)(align)) - 1))
 
 // 四舍五入成整数
 static inline uint64_t round(double x)
@@ -575,32 +576,13 @@ static inline char *strdup(const char *s)
 
 #if defined(__x86_64__)
 
-typedef struct
-{
-    volatile uint32_t lock;
-    uint64_t rflags;
-} spinlock_t;
-
-static inline void spin_lock(spinlock_t *lock)
-{
-    asm volatile(
-        "1: lock btsl $0, %0\n" // 测试并设置
-        "   jc 1b\n"            // 如果已锁定则重试s
-        : "+m"(lock->lock)
-        :
-        : "memory", "cc");
-}
-
-static inline void spin_unlock(spinlock_t *lock)
+static inline void spin_relax()
 {
-    asm volatile(
-        "lock btrl $0, %0\n" // 清除锁标志
-        : "+m"(lock->lock)
-        :
-        : "memory", "cc");
+    asm volatile("pause" ::: "memory");
 }
 
-static inline void spin_lock_irqsave(spinlock_t *lock)
+// 保存中断状态并关中断
+static inline uint64_t spin_irq_save()
 {
     uint64_t flags;
     asm volatile(
@@ -610,111 +592,299 @@ static inline void spin_lock_irqsave(spinlock_t *lock)
         : "=r"(flags)
         :
         : "memory");
+    return flags;
+}
 
+static inline void spin_irq_restore(uint64_t flags)
+{
     asm volatile(
-        "1: lock btsl $0, %0\n\t" // 测试并设置
-        "   jc 1b\n\t"            // 如果已锁定则重试
-        : "+m"(lock->lock)
+        "push %0\n\t" // 恢复原始RFLAGS
+        "popfq"
         :
+        : "r"(flags)
         : "memory", "cc");
+}
 
-    lock->rflags = flags; // 保存原始中断状态
+#elif defined(__aarch64__)
+
+static inline void spin_relax()
+{
+    asm volatile("yield" ::: "memory");
 }
 
-static inline void spin_unlock_irqrestore(spinlock_t *lock)
+static inline uint64_t spin_irq_save()
 {
+    uint64_t daif;
     asm volatile(
-        "lock btrl $0, %0\n\t" // 清除锁标志
-        : "+m"(lock->lock)
+        "mrs %0, daif\n\t"
+        "msr daifset, #2\n\t"
+        : "=r"(daif)
         :
-        : "memory", "cc");
+        : "memory");
+    return daif;
+}
 
-    uint64_t flags = lock->rflags;
+static inline void spin_irq_restore(uint64_t daif)
+{
     asm volatile(
-        "push %0\n\t" // 恢复原始RFLAGS
-        "popfq"
+        "msr daif, %0\n\t"
         :
-        : "r"(flags)
+        : "r"(daif)
         : "memory");
 }
 
-#elif defined(__aarch64__)
+#endif
 
+// 排队自旋锁: 按取号顺序获得锁, 等待者只读 owner, 释放时只有一次写
+// 全零表示未加锁, 可以用 {0} 静态初始化
 typedef struct
 {
-    volatile uint32_t lock;
-    uint64_t daif;
+    union
+    {
+        volatile uint32_t lock;
+        struct
+        {
+            volatile uint16_t owner; // 当前持有者的号
+            volatile uint16_t next;  // 下一个要发的号
+        };
+    };
+    uint64_t flags; // spin_lock_irqsave 保存的中断状态
+#if CONFIG_LOCK_STAT
+    struct lock_stat *stat; // 为空时不统计
+    uint64_t hold_start;
+#endif
 } spinlock_t;
 
+#if CONFIG_LOCK_STAT
+#define SPINLOCK_STAT_INIT(lock_stat) {.stat = &(lock_stat)}
+
+// 带统计的加锁和解锁, 实现在 task/lock_stat.c
+void lock_stat_lock(spinlock_t *lock);
+void lock_stat_acquired(spinlock_t *lock);
+void lock_stat_release(spinlock_t *lock);
+#else
+// 用指定成员初始化, 联合体在前时 {0} 会触发 -Wmissing-braces
+#define SPINLOCK_STAT_INIT(lock_stat) {.flags = 0}
+#endif
+
+static inline void ticket_lock(spinlock_t *lock)
+{
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+        spin_relax();
+}
+
+static inline bool ticket_trylock(spinlock_t *lock)
+{
+    uint32_t old = __atomic_load_n(&lock->lock, __ATOMIC_RELAXED);
+    uint16_t owner = old & 0xffff;
+
+    if (owner != (old >> 16))
+        return false;
+
+    // 号码与持有者相同时才取号, 相当于在空闲时直接拿到锁
+    uint32_t new = old + (1U << 16);
+    return __atomic_compare_exchange_n(&lock->lock, &old, new, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void ticket_unlock(spinlock_t *lock)
+{
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
 static inline void spin_lock(spinlock_t *lock)
 {
-    uint32_t tmp;
-    asm volatile(
-        "1: ldaxr %w0, [%1]\n"     // 加载独占
-        "   cbnz %w0, 1b\n"        // 检查是否已锁定
-        "   mov %w0, #1\n"         // 准备锁定值
-        "   stxr %w0, %w0, [%1]\n" // 尝试存储
-        "   cbnz %w0, 1b\n"        // 检查是否成功
-        : "=&r"(tmp)
-        : "r"(&lock->lock)
-        : "memory");
+#if CONFIG_LOCK_STAT
+    if (lock->stat)
+    {
+        lock_stat_lock(lock);
+        return;
+    }
+#endif
+    ticket_lock(lock);
+}
+
+static inline bool spin_trylock(spinlock_t *lock)
+{
+    if (!ticket_trylock(lock))
+        return false;
+#if CONFIG_LOCK_STAT
+    if (lock->stat)
+        lock_stat_acquired(lock);
+#endif
+    return true;
 }
 
 static inline void spin_unlock(spinlock_t *lock)
 {
-    asm volatile(
-        "stlr wzr, [%0]\n" // 释放锁
-        :
-        : "r"(&lock->lock)
-        : "memory");
+#if CONFIG_LOCK_STAT
+    if (lock->stat)
+        lock_stat_release(lock);
+#endif
+    ticket_unlock(lock);
+}
+
+static inline bool spin_is_locked(spinlock_t *lock)
+{
+    uint32_t val = __atomic_load_n(&lock->lock, __ATOMIC_RELAXED);
+    return (val & 0xffff) != (val >> 16);
 }
 
 static inline void spin_lock_irqsave(spinlock_t *lock)
 {
-    uint32_t tmp, daif;
+    uint64_t flags = spin_irq_save();
+    spin_lock(lock);
+    lock->flags = flags; // 保存原始中断状态
+}
 
-    // 保存并禁用中断
-    asm volatile(
-        "mrs %0, daif\n\t"
-        "msr daifset, #2\n\t"
-        : "=r"(daif)
-        :
-        : "memory");
+static inline void spin_unlock_irqrestore(spinlock_t *lock)
+{
+    // 释放之后 flags 可能被下一个持有者覆盖, 先取出来
+    uint64_t flags = lock->flags;
+    spin_unlock(lock);
+    spin_irq_restore(flags);
+}
 
-    // 获取锁
-    asm volatile(
-        "1: ldaxr %w0, [%1]\n\t"
-        "   cbnz %w0, 1b\n\t"
-        "   mov %w0, #1\n\t"
-        "   stxr %w0, %w0, [%1]\n\t"
-        "   cbnz %w0, 1b\n\t"
-        : "=&r"(tmp)
-        : "r"(&lock->lock)
-        : "memory");
+// 读写锁: 读者之间不互斥; 有写者在等待时新来的读者排到后面, 写者不会饿死
+#define RW_LOCKED 0x0ff       // 写者持有
+#define RW_WAITING 0x100      // 有写者在排队
+#define RW_WMASK 0x1ff
+#define RW_READER_BIAS 0x200  // 读者计数从第 9 位开始
 
-    lock->daif = daif; // 保存原始DAIF状态
+typedef struct
+{
+    volatile uint32_t cnts;
+    spinlock_t wait; // 慢路径上的读者和写者在这里排队
+    uint64_t flags;  // write_lock_irqsave 保存的中断状态
+} rwlock_t;
+
+static inline void read_lock(rwlock_t *lock)
+{
+    uint32_t cnts = __atomic_add_fetch(&lock->cnts, RW_READER_BIAS, __ATOMIC_ACQUIRE);
+    if (!(cnts & RW_WMASK))
+        return;
+
+    __atomic_sub_fetch(&lock->cnts, RW_READER_BIAS, __ATOMIC_RELAXED);
+
+    spin_lock(&lock->wait);
+
+    // 排在队首时只需要等当前的写者退出
+    __atomic_add_fetch(&lock->cnts, RW_READER_BIAS, __ATOMIC_RELAXED);
+    while ((__atomic_load_n(&lock->cnts, __ATOMIC_ACQUIRE) & RW_WMASK) == RW_LOCKED)
+        spin_relax();
+
+    spin_unlock(&lock->wait);
 }
 
-static inline void spin_unlock_irqrestore(spinlock_t *lock)
+static inline void read_unlock(rwlock_t *lock)
 {
-    uint32_t daif = lock->daif;
+    __atomic_sub_fetch(&lock->cnts, RW_READER_BIAS, __ATOMIC_RELEASE);
+}
 
-    // 释放锁
-    asm volatile(
-        "stlr wzr, [%0]\n\t"
-        :
-        : "r"(&lock->lock)
-        : "memory");
+static inline void write_lock(rwlock_t *lock)
+{
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&lock->cnts, &expected, RW_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
 
-    // 恢复中断状态
-    asm volatile(
-        "msr daif, %0\n\t"
-        :
-        : "r"(daif)
-        : "memory");
+    spin_lock(&lock->wait);
+
+    __atomic_fetch_or(&lock->cnts, RW_WAITING, __ATOMIC_RELAXED);
+
+    // 等已经进入的读者全部退出
+    while (true)
+    {
+        expected = RW_WAITING;
+        if (__atomic_compare_exchange_n(&lock->cnts, &expected, RW_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+        spin_relax();
+    }
+
+    spin_unlock(&lock->wait);
 }
 
-#endif
+static inline void write_unlock(rwlock_t *lock)
+{
+    __atomic_fetch_and(&lock->cnts, ~(uint32_t)RW_LOCKED, __ATOMIC_RELEASE);
+}
+
+static inline void write_lock_irqsave(rwlock_t *lock)
+{
+    uint64_t flags = spin_irq_save();
+    write_lock(lock);
+    lock->flags = flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t *lock)
+{
+    uint64_t flags = lock->flags;
+    write_unlock(lock);
+    spin_irq_restore(flags);
+}
+
+// 顺序锁: 写者之间用自旋锁互斥, 读者不加锁, 读到一半被写入时重试
+// 读者不能解引用可能被写者释放的指针
+typedef struct
+{
+    volatile uint32_t seq; // 奇数表示正在写
+    spinlock_t lock;
+} seqlock_t;
+
+static inline uint32_t read_seqbegin(const seqlock_t *sl)
+{
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+        spin_relax();
+
+    return seq;
+}
+
+// 与 write_seqcount_begin 中的释放屏障配对: 数据读取完成后再重读 seq
+static inline bool read_seqretry(const seqlock_t *sl, uint32_t start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != start;
+}
+
+// 调用者已持有 sl->lock
+// seq 变为奇数后才能写数据, 读者看到任何新数据时也一定能看到奇数 seq
+static inline void write_seqcount_begin(seqlock_t *sl)
+{
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// 数据写完后才能让 seq 变回偶数, 与 read_seqbegin 的获取读配对
+static inline void write_seqcount_end(seqlock_t *sl)
+{
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline void write_seqlock(seqlock_t *sl)
+{
+    spin_lock(&sl->lock);
+    write_seqcount_begin(sl);
+}
+
+static inline void write_sequnlock(seqlock_t *sl)
+{
+    write_seqcount_end(sl);
+    spin_unlock(&sl->lock);
+}
+
+static inline void write_seqlock_irqsave(seqlock_t *sl)
+{
+    spin_lock_irqsave(&sl->lock);
+    write_seqcount_begin(sl);
+}
+
+static inline void write_sequnlock_irqrestore(seqlock_t *sl)
+{
+    write_seqcount_end(sl);
+    spin_unlock_irqrestore(&sl->lock);
+}
 
 typedef struct semaphore
 {
@@ -728,24 +898,23 @@ extern uint64_t nanoTime();
 static inline bool semaphore_wait(semaphore_t *sem, uint32_t timeout)
 {
     uint64_t timerStart = nanoTime();
-    bool ret = false;
 
     while (true)
     {
         if (timeout > 0 && nanoTime() > (timerStart + timeout * 1000))
-            goto just_return;
+            return false;
+
+        spin_lock(&sem->lock);
         if (sem->cnt > 0)
         {
             sem->cnt--;
-            ret = true;
-            goto cleanup;
+            spin_unlock(&sem->lock);
+            return true;
         }
-    }
+        spin_unlock(&sem->lock);
 
-cleanup:
-    spin_unlock(&sem->lock);
-just_return:
-    return ret;
+        spin_relax();
+    }
 }
 
 static inline void semaphore_post(semaphore_t *sem)
@@ -1,5 +1,7 @@
 #include <arch/arch.h>
 #include <mm/mm.h>
+#include <task/percpu.h>
+#include <task/lock_stat.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,7 +11,7 @@ __attribute__((used, section(".limine_requests"))) static volatile struct limine
     .revision = 0,
 };
 
-spinlock_t frame_op_lock = {0};
+DEFINE_SPINLOCK_STAT(frame_op_lock);
 
 FrameAllocator frame_allocator;
 uint64_t memory_size = 0;
@@ -95,6 +97,7 @@ retry:
         bitmap_set_range(bitmap, frame_index, frame_index + count, false);
         frame_allocator.usable_frames -= count;
         spin_unlock_irqrestore(&frame_op_lock);
+        cpu_stat_add(CPU_STAT_PGALLOC, count);
         return frame_index * DEFAULT_PAGE_SIZE;
     }
 
@@ -127,19 +130,30 @@ void free_frames(uint64_t addr, uint64_t size)
     frame_allocator.usable_frames++;
 
     spin_unlock_irqrestore(&frame_op_lock);
+
+    cpu_stat_add(CPU_STAT_PGFREE, size);
 }
 
 // 内存映射相关函数保持不变
-bool mem_map_op_lock = false;
+spinlock_t mem_map_op_lock = {0};
 
-void map_page_range(uint64_t *pml4, uint64_t vaddr, uint64_t paddr, uint64_t size, uint64_t flags)
+// 持锁者可能正在等待本 CPU 响应 TLB shootdown, 关中断自旋时要处理发给自己的请求
+static void mem_map_lock()
 {
-    while (mem_map_op_lock)
+    uint64_t flags = spin_irq_save();
+
+    while (!spin_trylock(&mem_map_op_lock))
     {
+        arch_flush_tlb_pending();
         arch_pause();
     }
 
-    mem_map_op_lock = true;
+    mem_map_op_lock.flags = flags;
+}
+
+void map_page_range(uint64_t *pml4, uint64_t vaddr, uint64_t paddr, uint64_t size, uint64_t flags)
+{
+    mem_map_lock();
 
     for (uint64_t va = vaddr; va < vaddr + size; va += DEFAULT_PAGE_SIZE)
     {
@@ -159,22 +173,17 @@ void map_page_range(uint64_t *pml4, uint64_t vaddr, uint64_t paddr, uint64_t siz
         }
     }
 
-    mem_map_op_lock = false;
+    spin_unlock_irqrestore(&mem_map_op_lock);
 }
 
 void unmap_page_range(uint64_t *pml4, uint64_t vaddr, uint64_t size)
 {
-    while (mem_map_op_lock)
-    {
-        arch_pause();
-    }
-
-    mem_map_op_lock = true;
+    mem_map_lock();
 
     for (uint64_t va = vaddr; va < vaddr + size; va += DEFAULT_PAGE_SIZE)
     {
         unmap_page(pml4, va);
     }
 
-    mem_map_op_lock = false;
+    spin_unlock_irqrestore(&mem_map_op_lock);
 }
@@ -25,7 +25,12 @@ extern FrameAllocator frame_allocator;
 typedef struct task_mm_info
 {
     uint64_t page_table_addr;
-    uint8_t ref_count;
+    int ref_count;     // CLONE_VM 的线程共享同一个 mm, 原子增减
+    uint64_t cpu_mask; // CR3 当前指向该页表的 CPU, 修改页表项后要向它们发送 TLB shootdown
+    // 地址分配游标跟着地址空间走, 共享 mm 的线程原子地推进
+    uint64_t mmap_start;
+    uint64_t brk_start;
+    uint64_t brk_end;
 } task_mm_info_t;
 
 void frame_init();
@@ -3,24 +3,42 @@
 #include <fs/vfs/vfs.h>
 #include <task/task.h>
 
+// CLONE_VM 的线程共享同一个 mm, 游标用 CAS 推进, 地址空间耗尽返回 0
+static uint64_t mmap_reserve(task_mm_info_t *mm, uint64_t len)
+{
+    uint64_t size = PADDING_UP(len, DEFAULT_PAGE_SIZE);
+    uint64_t start = __atomic_load_n(&mm->mmap_start, __ATOMIC_RELAXED);
+
+    do
+    {
+        if (start + size > USER_MMAP_END)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&mm->mmap_start, &start, start + size, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return start;
+}
+
 uint64_t sys_brk(uint64_t addr)
 {
+    task_mm_info_t *mm = current_task->arch_context->mm;
     uint64_t new_brk = (addr + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
 
     if (new_brk == 0)
-        return current_task->brk_start;
-    if (new_brk < current_task->brk_end)
-        return 0;
+        return mm->brk_start;
 
-    uint64_t start = current_task->brk_end;
-    uint64_t size = new_brk - current_task->brk_end;
+    uint64_t start = __atomic_load_n(&mm->brk_end, __ATOMIC_RELAXED);
+    do
+    {
+        if (new_brk < start)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&mm->brk_end, &start, new_brk, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    uint64_t size = new_brk - start;
 
     map_page_range(get_current_page_dir(true), start, 0, size, PT_FLAG_R | PT_FLAG_W | PT_FLAG_U);
 
     memset((void *)start, 0, size);
 
-    current_task->brk_end = new_brk;
-
     return new_brk;
 }
 
@@ -30,31 +48,28 @@ uint64_t sys_mmap(uint64_t addr, uint64_t len, uint64_t prot, uint64_t flags, ui
 
     uint64_t aligned_len = (len + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
 
-    if (addr == 0)
+    if (aligned_len == 0)
     {
-        addr = current_task->mmap_start;
-        flags &= (~MAP_FIXED);
+        return (uint64_t)-EINVAL;
     }
 
-    if (aligned_len == 0)
+    if (addr == 0)
     {
-        return (uint64_t)-EINVAL;
+        addr = mmap_reserve(current_task->arch_context->mm, aligned_len);
+        if (addr == 0)
+            return (uint64_t)-ENOMEM;
+        flags &= (~MAP_FIXED);
     }
 
-    if (fd < MAX_FD_NUM && current_task->fds[fd])
+    fd_t *file = fd_get(current_task->files, fd);
+    if (file)
     {
-        vfs_node_t node = current_task->fds[fd]->node;
-        return (uint64_t)vfs_map(node, addr, len, prot, flags, offset);
+        uint64_t ret = (uint64_t)vfs_map(file->node, addr, len, prot, flags, offset);
+        fd_put(file);
+        return ret;
     }
     else
     {
-        current_task->mmap_start += (aligned_len + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
-        if (current_task->mmap_start > USER_MMAP_END)
-        {
-            current_task->mmap_start -= (aligned_len + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
-            return (uint64_t)-ENOMEM;
-        }
-
         uint64_t pt_flags = PT_FLAG_U | PT_FLAG_W;
 
         if (prot & PROT_READ)
@@ -81,13 +96,6 @@ uint64_t sys_munmap(uint64_t addr, uint64_t size)
 
 void *general_map(vfs_read_t read_callback, void *file, uint64_t addr, uint64_t len, uint64_t prot, uint64_t flags, uint64_t offset)
 {
-    current_task->mmap_start += (len + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
-    if (current_task->mmap_start > USER_MMAP_END)
-    {
-        current_task->mmap_start -= (len + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
-        return (void *)-ENOMEM;
-    }
-
     uint64_t pt_flags = PT_FLAG_U | PT_FLAG_W;
 
     if (prot & PROT_READ)
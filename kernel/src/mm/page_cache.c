@@ -0,0 +1,249 @@
+#include <mm/page_cache.h>
+#include <mm/mm.h>
+#include <arch/arch.h>
+
+#define PAGE_CACHE_HASH_BITS 10
+#define PAGE_CACHE_HASH_SIZE (1 << PAGE_CACHE_HASH_BITS)
+
+#define PAGE_CACHE_STATS_MAX 64
+
+typedef struct page_cache_entry
+{
+    struct page_cache_entry *key_next;  // (node, offset) 哈希链
+    struct page_cache_entry *phys_next; // 物理地址哈希链
+    vfs_node_t node;                    // 失效后为 NULL, 只能通过物理地址找到
+    uint64_t offset;
+    uint64_t phys;
+    int ref_count;
+} page_cache_entry_t;
+
+static page_cache_entry_t *key_hash[PAGE_CACHE_HASH_SIZE];
+static page_cache_entry_t *phys_hash[PAGE_CACHE_HASH_SIZE];
+static spinlock_t page_cache_lock = {0};
+
+static inline uint64_t key_hashfn(vfs_node_t node, uint64_t offset)
+{
+    return ((((uint64_t)node >> 4) + offset / DEFAULT_PAGE_SIZE) * 0x9E3779B97F4A7C15ULL) >> (64 - PAGE_CACHE_HASH_BITS);
+}
+
+static inline uint64_t phys_hashfn(uint64_t phys)
+{
+    return ((phys / DEFAULT_PAGE_SIZE) * 0x9E3779B97F4A7C15ULL) >> (64 - PAGE_CACHE_HASH_BITS);
+}
+
+static page_cache_entry_t *key_lookup(vfs_node_t node, uint64_t offset)
+{
+    for (page_cache_entry_t *entry = key_hash[key_hashfn(node, offset)]; entry; entry = entry->key_next)
+        if (entry->node == node && entry->offset == offset)
+            return entry;
+    return NULL;
+}
+
+static page_cache_entry_t *phys_lookup(uint64_t phys)
+{
+    for (page_cache_entry_t *entry = phys_hash[phys_hashfn(phys)]; entry; entry = entry->phys_next)
+        if (entry->phys == phys)
+            return entry;
+    return NULL;
+}
+
+static void key_unlink(page_cache_entry_t *entry)
+{
+    page_cache_entry_t **pprev = &key_hash[key_hashfn(entry->node, entry->offset)];
+    while (*pprev && *pprev != entry)
+        pprev = &(*pprev)->key_next;
+    if (*pprev)
+        *pprev = entry->key_next;
+
+    entry->node->page_cache_pages--;
+    entry->node = NULL;
+    entry->key_next = NULL;
+}
+
+static void phys_unlink(page_cache_entry_t *entry)
+{
+    page_cache_entry_t **pprev = &phys_hash[phys_hashfn(entry->phys)];
+    while (*pprev && *pprev != entry)
+        pprev = &(*pprev)->phys_next;
+    if (*pprev)
+        *pprev = entry->phys_next;
+}
+
+uint64_t page_cache_get(vfs_node_t node, uint64_t offset)
+{
+    spin_lock_irqsave(&page_cache_lock);
+    page_cache_entry_t *entry = key_lookup(node, offset);
+    if (entry)
+    {
+        entry->ref_count++;
+        spin_unlock_irqrestore(&page_cache_lock);
+        return entry->phys;
+    }
+    spin_unlock_irqrestore(&page_cache_lock);
+
+    // 读文件时不持锁, 插入前再查一次
+    uint64_t phys = alloc_frames(1);
+    if (phys == 0 || phys == (uint64_t)-1)
+        return 0;
+
+    uint8_t *page = phys_to_virt((uint8_t *)phys);
+    memset(page, 0, DEFAULT_PAGE_SIZE);
+    if (offset < node->size && vfs_read(node, page, offset, MIN(DEFAULT_PAGE_SIZE, node->size - offset)) < 0)
+    {
+        free_frames(phys, 1);
+        return 0;
+    }
+
+    page_cache_entry_t *new = malloc(sizeof(page_cache_entry_t));
+    new->node = node;
+    new->offset = offset;
+    new->phys = phys;
+    new->ref_count = 1;
+
+    spin_lock_irqsave(&page_cache_lock);
+
+    entry = key_lookup(node, offset);
+    if (entry)
+    {
+        entry->ref_count++;
+        spin_unlock_irqrestore(&page_cache_lock);
+        free_frames(phys, 1);
+        free(new);
+        return entry->phys;
+    }
+
+    uint64_t key = key_hashfn(node, offset);
+    new->key_next = key_hash[key];
+    key_hash[key] = new;
+
+    uint64_t hash = phys_hashfn(phys);
+    new->phys_next = phys_hash[hash];
+    phys_hash[hash] = new;
+
+    node->page_cache_pages++;
+
+    spin_unlock_irqrestore(&page_cache_lock);
+
+    return phys;
+}
+
+void page_cache_ref(uint64_t phys)
+{
+    spin_lock_irqsave(&page_cache_lock);
+    page_cache_entry_t *entry = phys_lookup(phys);
+    if (entry)
+        entry->ref_count++;
+    spin_unlock_irqrestore(&page_cache_lock);
+}
+
+// 最后一个映射解除时释放, 不保留未映射的页
+void page_cache_put(uint64_t phys)
+{
+    spin_lock_irqsave(&page_cache_lock);
+
+    page_cache_entry_t *entry = phys_lookup(phys);
+    if (!entry || --entry->ref_count > 0)
+    {
+        spin_unlock_irqrestore(&page_cache_lock);
+        return;
+    }
+
+    phys_unlink(entry);
+    if (entry->node)
+        key_unlink(entry);
+
+    spin_unlock_irqrestore(&page_cache_lock);
+
+    free_frames(phys, 1);
+    free(entry);
+}
+
+void page_cache_invalidate(vfs_node_t node)
+{
+    if (!node || !node->page_cache_pages)
+        return;
+
+    spin_lock_irqsave(&page_cache_lock);
+
+    for (uint64_t i = 0; i < PAGE_CACHE_HASH_SIZE && node->page_cache_pages; i++)
+    {
+        page_cache_entry_t *entry = key_hash[i];
+        while (entry)
+        {
+            page_cache_entry_t *next = entry->key_next;
+            if (entry->node == node)
+                key_unlink(entry);
+            entry = next;
+        }
+    }
+
+    spin_unlock_irqrestore(&page_cache_lock);
+}
+
+typedef struct page_cache_stat
+{
+    vfs_node_t node;
+    char name[64];
+    uint64_t pages;
+    uint64_t mappings;
+} page_cache_stat_t;
+
+// 每个文件的缓存页数以及这些页被映射的总次数
+int page_cache_stats_print(char *buf, size_t size)
+{
+    page_cache_stat_t *stats = malloc(PAGE_CACHE_STATS_MAX * sizeof(page_cache_stat_t));
+    int count = 0;
+
+    spin_lock_irqsave(&page_cache_lock);
+
+    for (uint64_t i = 0; i < PAGE_CACHE_HASH_SIZE; i++)
+    {
+        for (page_cache_entry_t *entry = key_hash[i]; entry; entry = entry->key_next)
+        {
+            int j;
+            for (j = 0; j < count; j++)
+                if (stats[j].node == entry->node)
+                    break;
+
+            if (j == count)
+            {
+                if (count == PAGE_CACHE_STATS_MAX)
+                    continue;
+                stats[j].node = entry->node;
+                strncpy(stats[j].name, entry->node->name ? entry->node->name : "?", sizeof(stats[j].name) - 1);
+                stats[j].name[sizeof(stats[j].name) - 1] = '\0';
+                stats[j].pages = 0;
+                stats[j].mappings = 0;
+                count++;
+            }
+
+            stats[j].pages++;
+            stats[j].mappings += entry->ref_count;
+        }
+    }
+
+    spin_unlock_irqrestore(&page_cache_lock);
+
+    char line[128];
+    size_t len = 0;
+
+    int n = sprintf(line, "%-32s %8s %8s %8s\n", "file", "pages", "mapped", "saved");
+    if (len + n < size)
+    {
+        memcpy(buf + len, line, n);
+        len += n;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        n = sprintf(line, "%-32s %8lu %8lu %8lu\n", stats[i].name, stats[i].pages, stats[i].mappings, stats[i].mappings - stats[i].pages);
+        if (len + n >= size)
+            break;
+        memcpy(buf + len, line, n);
+        len += n;
+    }
+
+    free(stats);
+
+    return len;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <fs/vfs/vfs.h>
+
+// 可执行文件的共享页, 以 (文件, 页对齐偏移) 为键, 每次映射持有一个引用
+uint64_t page_cache_get(vfs_node_t node, uint64_t offset);
+void page_cache_ref(uint64_t phys);
+void page_cache_put(uint64_t phys);
+
+// 文件被写入或释放后, 已映射的页保持不变, 之后的 get 重新读取
+void page_cache_invalidate(vfs_node_t node);
+
+int page_cache_stats_print(char *buf, size_t size);
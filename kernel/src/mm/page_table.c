@@ -1,5 +1,6 @@
 #include <arch/arch.h>
 #include <mm/mm.h>
+#include <mm/page_cache.h>
 
 uint64_t translate_address(uint64_t *pgdir, uint64_t vaddr)
 {
@@ -64,11 +65,26 @@ uint64_t map_page(uint64_t *pgdir, uint64_t vaddr, uint64_t paddr, uint64_t flag
     }
 
     uint64_t index = indexs[ARCH_MAX_PT_LEVEL - 1];
-    if (pgdir[index] != 0)
-        free_frames((paddr & (~PAGE_CALC_PAGE_TABLE_MASK(ARCH_MAX_PT_LEVEL))), 1);
-    pgdir[index] = (paddr & (~PAGE_CALC_PAGE_TABLE_MASK(ARCH_MAX_PT_LEVEL))) | flags;
+    uint64_t old = pgdir[index];
+    uint64_t new_paddr = paddr & (~PAGE_CALC_PAGE_TABLE_MASK(ARCH_MAX_PT_LEVEL));
+    pgdir[index] = new_paddr | flags;
 
-    arch_flush_tlb(vaddr);
+    // 不存在的页表项不会被缓存, 新建映射不需要刷新
+    if (old != 0)
+    {
+        // arch_flush_tlb 返回时所有 CPU 都已刷新, 此后才能释放被替换的旧页
+        // 只有用户页归页表所有, 内核里重新映射 MMIO 之类的地址不释放
+        arch_flush_tlb(vaddr);
+
+        uint64_t old_paddr = old & ARCH_ADDR_MASK;
+        if ((old & ARCH_PT_FLAG_VALID) && (old & ARCH_PT_FLAG_USER) && old_paddr != new_paddr)
+        {
+            if (old & ARCH_PT_FLAG_SHARED)
+                page_cache_put(old_paddr);
+            else
+                free_frames(old_paddr, 1);
+        }
+    }
 
     return 0;
 }
@@ -102,7 +118,7 @@ uint64_t unmap_page(uint64_t *pgdir, uint64_t vaddr)
 
     if (pte & ARCH_PT_FLAG_VALID)
     {
-        uint64_t paddr = pte & (~PAGE_CALC_PAGE_TABLE_MASK(ARCH_MAX_PT_LEVEL));
+        uint64_t paddr = pte & ARCH_ADDR_MASK;
         size_t frame_count = 1;
 
         if (ARCH_PT_IS_LARGE(pte))
@@ -111,9 +127,13 @@ uint64_t unmap_page(uint64_t *pgdir, uint64_t vaddr)
             frame_count = page_size / DEFAULT_PAGE_SIZE;
         }
 
-        free_frames(paddr, frame_count);
         pgdir[index] = 0;
         arch_flush_tlb(vaddr);
+
+        if (pte & ARCH_PT_FLAG_SHARED)
+            page_cache_put(paddr);
+        else
+            free_frames(paddr, frame_count);
     }
 
     return 0;
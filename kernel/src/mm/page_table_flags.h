@@ -5,3 +5,4 @@
 #define PT_FLAG_X (1UL << 2)
 #define PT_FLAG_U (1UL << 3)
 #define PT_FLAG_COW (1UL << 4)
+#define PT_FLAG_SHARED (1UL << 5) // 页缓存中的共享页, 释放时减引用
@@ -94,6 +94,11 @@ unsafe extern "C" fn net_socket(domain: i32, ty: i32, protocol: i32) -> i32 {
                 SOCKETS_TYPE_MAP.lock().insert(handle, SocketType::Raw);
 
                 let fd = socket_alloc_fd_net();
+                if fd < 0 {
+                    SOCKETS_TYPE_MAP.lock().remove(&handle);
+                    SOCKETS_SET.lock().remove(handle);
+                    return fd;
+                }
 
                 SOCKETS.lock().get_mut(&pid).unwrap().insert(fd, handle);
 
@@ -112,6 +117,11 @@ unsafe extern "C" fn net_socket(domain: i32, ty: i32, protocol: i32) -> i32 {
                 SOCKETS_TYPE_MAP.lock().insert(handle, SocketType::Raw);
 
                 let fd = socket_alloc_fd_net();
+                if fd < 0 {
+                    SOCKETS_TYPE_MAP.lock().remove(&handle);
+                    SOCKETS_SET.lock().remove(handle);
+                    return fd;
+                }
 
                 SOCKETS.lock().get_mut(&pid).unwrap().insert(fd, handle);
 
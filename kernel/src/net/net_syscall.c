@@ -12,12 +12,15 @@ uint64_t sys_shutdown(uint64_t fd, uint64_t how)
 
 int sys_getpeername(int fd, struct sockaddr_un *addr, socklen_t *addrlen)
 {
-    if (fd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, fd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[fd];
 
     socket_handle_t *handle = node->node->handle;
-    return unix_socket_getpeername(fd, addr, addrlen);
+    int ret = unix_socket_getpeername(fd, addr, addrlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int sys_getsockname(int sockfd, struct sockaddr_un *addr, socklen_t *addrlen)
@@ -27,30 +30,32 @@ int sys_getsockname(int sockfd, struct sockaddr_un *addr, socklen_t *addrlen)
 
 int sys_setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen)
 {
-    if (fd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, fd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[fd];
 
     socket_handle_t *handle = node->node->handle;
+    int ret = -ENOSYS;
     if (handle->op->setsockopt)
-    {
-        return handle->op->setsockopt(fd, level, optname, optval, optlen);
-    }
-    return -ENOSYS;
+        ret = handle->op->setsockopt(fd, level, optname, optval, optlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int sys_getsockopt(int fd, int level, int optname, void *optval, socklen_t *optlen)
 {
-    if (fd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, fd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[fd];
 
     socket_handle_t *handle = node->node->handle;
+    int ret = -ENOSYS;
     if (handle->op->getsockopt)
-    {
-        return handle->op->getsockopt(fd, level, optname, optval, optlen);
-    }
-    return -ENOSYS;
+        ret = handle->op->getsockopt(fd, level, optname, optval, optlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int sys_socket(int domain, int type, int protocol)
@@ -68,103 +73,131 @@ int sys_socketpair(int family, int type, int protocol, int *sv)
 
 int sys_bind(int sockfd, const struct sockaddr_un *addr, socklen_t addrlen)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int ret = 0;
     if (handle->op->bind)
-        return handle->op->bind(sockfd, addr, addrlen);
-    return 0;
+        ret = handle->op->bind(sockfd, addr, addrlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int sys_listen(int sockfd, int backlog)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int ret = 0;
     if (handle->op->listen)
-        return handle->op->listen(sockfd, backlog);
-    return 0;
+        ret = handle->op->listen(sockfd, backlog);
+
+    fd_put(node);
+    return ret;
 }
 
 int sys_accept(int sockfd, struct sockaddr_un *addr, socklen_t *addrlen)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int ret = 0;
     if (handle->op->accept)
-        return handle->op->accept(sockfd, addr, addrlen);
-    return 0;
+        ret = handle->op->accept(sockfd, addr, addrlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int sys_connect(int sockfd, const struct sockaddr_un *addr, socklen_t addrlen)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int ret = 0;
     if (handle->op->connect)
-        return handle->op->connect(sockfd, addr, addrlen);
-    return 0;
+        ret = handle->op->connect(sockfd, addr, addrlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int64_t sys_send(int sockfd, void *buff, size_t len, int flags, struct sockaddr_un *dest_addr, socklen_t addrlen)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int64_t ret = 0;
     if (handle->op->sendto)
-        return handle->op->sendto(sockfd, buff, len, flags, dest_addr, addrlen);
-    return 0;
+        ret = handle->op->sendto(sockfd, buff, len, flags, dest_addr, addrlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int64_t sys_recv(int sockfd, void *buf, size_t len, int flags, struct sockaddr_un *dest_addr, socklen_t *addrlen)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int64_t ret = 0;
     if (handle->op->recvfrom)
-        return handle->op->recvfrom(sockfd, buf, len, flags, dest_addr, addrlen);
-    return 0;
+        ret = handle->op->recvfrom(sockfd, buf, len, flags, dest_addr, addrlen);
+
+    fd_put(node);
+    return ret;
 }
 
 int64_t sys_sendmsg(int sockfd, const struct msghdr *msg, int flags)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int64_t ret = 0;
     if (handle->op->sendmsg)
-        return handle->op->sendmsg(sockfd, msg, flags);
-    return 0;
+        ret = handle->op->sendmsg(sockfd, msg, flags);
+
+    fd_put(node);
+    return ret;
 }
 
 int64_t sys_recvmsg(int sockfd, struct msghdr *msg, int flags)
 {
-    if (sockfd >= MAX_FD_NUM)
+    fd_t *node = fd_get(current_task->files, sockfd);
+    if (!node)
         return -EBADF;
-    fd_t *node = current_task->fds[sockfd];
 
     socket_handle_t *handle = node->node->handle;
+    int64_t ret = 0;
     if (handle->op->recvmsg)
-        return handle->op->recvmsg(sockfd, msg, flags);
-    return 0;
+        ret = handle->op->recvmsg(sockfd, msg, flags);
+
+    fd_put(node);
+    return ret;
 }
 
 size_t net_recvmsg(uint64_t fd, struct msghdr *msg, int flags)
 {
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
+        return (size_t)-EBADF;
+
+    socket_handle_t *handle = file->node->handle;
 
     msg->msg_controllen = 0;
     msg->msg_flags = 0;
@@ -174,26 +207,34 @@ size_t net_recvmsg(uint64_t fd, struct msghdr *msg, int flags)
     {
         struct iovec *curr =
             (struct iovec *)((size_t)msg->msg_iov + i * sizeof(struct iovec));
-        if (cnt > 0 && fs_callbacks[current_task->fds[fd]->node->fsid]->poll)
+        if (cnt > 0 && fs_callbacks[file->node->fsid]->poll)
         {
             // check syscalls_fs.c for why this is necessary
-            if (!(fs_callbacks[current_task->fds[fd]->node->fsid]->poll(current_task->fds[fd]->node, EPOLLIN) & EPOLLIN))
-                return cnt;
+            if (!(fs_callbacks[file->node->fsid]->poll(file->node, EPOLLIN) & EPOLLIN))
+                break;
         }
         size_t singleCnt = handle->op->recvfrom(
             fd, curr->iov_base, curr->len, noblock ? MSG_DONTWAIT : 0, 0, 0);
         if ((int64_t)(singleCnt) < 0)
-            return singleCnt;
+        {
+            cnt = singleCnt;
+            break;
+        }
 
         cnt += singleCnt;
     }
 
+    fd_put(file);
     return cnt;
 }
 
 size_t net_sendmsg(uint64_t fd, const struct msghdr *msg, int flags)
 {
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    fd_t *file = fd_get(current_task->files, fd);
+    if (!file)
+        return (size_t)-EBADF;
+
+    socket_handle_t *handle = file->node->handle;
 
     size_t cnt = 0;
     bool noblock = flags & MSG_DONTWAIT;
@@ -207,10 +248,15 @@ size_t net_sendmsg(uint64_t fd, const struct msghdr *msg, int flags)
             noblock ? MSG_DONTWAIT : 0, NULL, 0);
 
         if ((int64_t)singleCnt < 0)
-            return singleCnt;
+        {
+            cnt = singleCnt;
+            break;
+        }
 
         cnt += singleCnt;
     }
+
+    fd_put(file);
     return cnt;
 }
 
@@ -234,26 +280,26 @@ socket_op_t net_ops = {
 
 int socket_alloc_fd_net()
 {
-    int fd = 0;
-    for (uint64_t i = 0; i < MAX_FD_NUM; i++)
-        if (current_task->fds[i] == NULL)
-        {
-            fd = i;
-            break;
-        }
-
-    if (fd == 0)
-        return 0;
-
-    current_task->fds[fd] = malloc(sizeof(fd_t));
     char buf[256];
     sprintf(buf, "sock%d", sockfsfd_id++);
-    current_task->fds[fd]->node = vfs_node_alloc(sockfs_root, buf);
+    vfs_node_t node = vfs_node_alloc(sockfs_root, buf);
     socket_handle_t *sock = malloc(sizeof(socket_handle_t));
     sock->op = &net_ops;
     sock->sock = NULL;
-    current_task->fds[fd]->node->handle = sock;
-    current_task->fds[fd]->node->type = file_socket;
+    node->handle = sock;
+    node->type = file_socket;
+
+    fd_t *file = fd_new(node, 0);
+    int fd = fd_install(current_task->files, file, 0, false);
+    if (fd < 0)
+    {
+        // 节点还没有对外可见, 和 vfs_delete 一样直接拆掉
+        list_delete(sockfs_root->child, node);
+        node->handle = NULL;
+        vfs_free(node);
+        free(sock);
+        free(file);
+    }
 
     return fd;
 }
@@ -6,7 +6,8 @@
 #include <fs/vfs/vfs.h>
 #include <task/task.h>
 
-bool socket_op_lock = false;
+// 保护所有 unix socket 对的收发缓冲区, 等待对端时必须先释放
+spinlock_t socket_op_lock = {0};
 
 extern socket_op_t socket_ops;
 extern socket_op_t accept_ops;
@@ -15,7 +16,9 @@ vfs_node_t sockfs_root = NULL;
 
 int sockfsfd_id = 0;
 
+// 链表的读者在 rcu_read_lock 中遍历, 插入和摘除由 unix_socket_list_lock 串行化
 socket_t first_unix_socket;
+static spinlock_t unix_socket_list_lock = {0};
 
 socket_t sockets[MAX_SOCKETS];
 
@@ -80,6 +83,7 @@ unix_socket_pair_t *unix_socket_allocate_pair()
 
 void unix_socket_free_pair(unix_socket_pair_t *pair)
 {
+    poll_wait_free(&pair->poll_wait);
     free(pair->clientBuff);
     free(pair->serverBuff);
     free(pair->filename);
@@ -93,10 +97,17 @@ bool socket_accept_close(socket_handle_t *handle)
 
     if (pair->serverFds == 0 && pair->clientFds == 0)
         unix_socket_free_pair(pair);
+    else
+        poll_wake(&pair->poll_wait);
 
     return false;
 }
 
+static void socket_free_rcu(rcu_head_t *head)
+{
+    free((socket_t *)((char *)head - offsetof(socket_t, rcu)));
+}
+
 bool socket_socket_close(socket_handle_t *socket_handle)
 {
     socket_t *unixSocket = socket_handle->sock;
@@ -109,9 +120,13 @@ bool socket_socket_close(socket_handle_t *socket_handle)
         unixSocket->pair->clientFds--;
         if (!unixSocket->pair->clientFds && !unixSocket->pair->serverFds)
             unix_socket_free_pair(unixSocket->pair);
+        else
+            poll_wake(&unixSocket->pair->poll_wait);
     }
     if (unixSocket->timesOpened == 0)
     {
+        spin_lock_irqsave(&unix_socket_list_lock);
+
         socket_t *browse = &first_unix_socket;
 
         while (browse && browse->next != unixSocket)
@@ -119,8 +134,12 @@ bool socket_socket_close(socket_handle_t *socket_handle)
             browse = browse->next;
         }
 
-        browse->next = unixSocket->next;
-        free(unixSocket);
+        rcu_assign_pointer(browse->next, unixSocket->next);
+
+        spin_unlock_irqrestore(&unix_socket_list_lock);
+
+        poll_wait_free(&unixSocket->poll_wait);
+        call_rcu(&unixSocket->rcu, socket_free_rcu);
         free(socket_handle);
 
         return true;
@@ -133,52 +152,72 @@ size_t unix_socket_accept_recv_from(uint64_t fd, uint8_t *out, size_t limit,
                                     int flags, struct sockaddr_un *addr,
                                     uint32_t *len)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
     (void)addr;
     (void)len;
 
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     unix_socket_pair_t *pair = handle->sock;
     if (!pair->clientFds && pair->serverBuffPos == 0)
-        return 0;
+    {
+        ret = 0;
+        goto out;
+    }
     while (true)
     {
         if (!pair->clientFds && pair->serverBuffPos == 0)
         {
-            return 0;
+            ret = 0;
+            goto out;
         }
-        else if ((current_task->fds[fd]->flags & O_NONBLOCK || flags & MSG_DONTWAIT) &&
+        else if ((sock_file->flags & O_NONBLOCK || flags & MSG_DONTWAIT) &&
                  pair->serverBuffPos == 0)
         {
-            return -(EWOULDBLOCK);
+            ret = -(EWOULDBLOCK);
+            goto out;
         }
         else if (pair->serverBuffPos > 0)
             break;
     }
 
-    // spinlock already acquired
+    spin_lock(&socket_op_lock);
+
     size_t toCopy = MIN(limit, pair->serverBuffPos);
     memcpy(out, pair->serverBuff, toCopy);
     memmove(pair->serverBuff, &pair->serverBuff[toCopy],
             pair->serverBuffPos - toCopy);
     pair->serverBuffPos -= toCopy;
 
-    return toCopy;
+    spin_unlock(&socket_op_lock);
+
+    poll_wake(&pair->poll_wait);
+
+    ret = toCopy;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_accept_sendto(uint64_t fd, uint8_t *in, size_t limit,
                                  int flags, struct sockaddr_un *addr, uint32_t len)
 {
-    while (socket_op_lock)
-    {
-        arch_pause();
-    }
-    socket_op_lock = true;
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
 
     // useless unless SOCK_DGRAM
     (void)addr;
     (void)len;
 
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     unix_socket_pair_t *pair = handle->sock;
 
     if (limit > pair->clientBuffSize)
@@ -186,6 +225,8 @@ size_t unix_socket_accept_sendto(uint64_t fd, uint8_t *in, size_t limit,
         limit = pair->clientBuffSize;
     }
 
+    spin_lock(&socket_op_lock);
+
     while (true)
     {
         if (!pair->clientFds)
@@ -196,26 +237,36 @@ size_t unix_socket_accept_sendto(uint64_t fd, uint8_t *in, size_t limit,
         if ((pair->clientBuffPos + limit) <= pair->clientBuffSize)
             break;
 
-        if (current_task->fds[fd]->flags & O_NONBLOCK || flags & MSG_DONTWAIT)
+        if (sock_file->flags & O_NONBLOCK || flags & MSG_DONTWAIT)
         {
-            socket_op_lock = false;
-            return -(EWOULDBLOCK);
+            spin_unlock(&socket_op_lock);
+            ret = -(EWOULDBLOCK);
+            goto out;
         }
 
+        spin_unlock(&socket_op_lock);
+
         arch_enable_interrupt();
 
         arch_pause();
+
+        spin_lock(&socket_op_lock);
     }
 
     arch_disable_interrupt();
 
-    // spinlock already acquired
     memcpy(&pair->clientBuff[pair->clientBuffPos], in, limit);
     pair->clientBuffPos += limit;
 
-    socket_op_lock = false;
+    spin_unlock(&socket_op_lock);
 
-    return limit;
+    poll_wake(&pair->poll_wait);
+
+    ret = limit;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 int socket_accept_poll(void *file, int events)
@@ -224,6 +275,8 @@ int socket_accept_poll(void *file, int events)
     unix_socket_pair_t *pair = handle->sock;
     int revents = 0;
 
+    poll_wait(&pair->poll_wait);
+
     if (!pair->clientFds)
         revents |= EPOLLHUP;
 
@@ -255,6 +308,9 @@ int socket_socket(int domain, int type, int protocol)
     memset(handle, 0, sizeof(socket_handle_t));
     socket_t *unix_socket = malloc(sizeof(socket_t));
     memset(unix_socket, 0, sizeof(socket_t));
+    unix_socket->timesOpened = 1;
+
+    spin_lock_irqsave(&unix_socket_list_lock);
 
     socket_t *head = &first_unix_socket;
     while (head->next)
@@ -262,32 +318,18 @@ int socket_socket(int domain, int type, int protocol)
         head = head->next;
     }
 
-    head->next = unix_socket;
+    rcu_assign_pointer(head->next, unix_socket);
+
+    spin_unlock_irqrestore(&unix_socket_list_lock);
 
     handle->sock = unix_socket;
     handle->op = &socket_ops;
     socknode->handle = handle;
 
-    unix_socket->timesOpened = 1;
-
-    uint64_t i = 0;
-    for (i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i] == NULL)
-        {
-            break;
-        }
-    }
-
-    if (i == MAX_FD_NUM)
-    {
-        return -EBADF;
-    }
-
-    current_task->fds[i] = malloc(sizeof(fd_t));
-    current_task->fds[i]->node = socknode;
-    current_task->fds[i]->offset = 0;
-    current_task->fds[i]->flags = 0;
+    fd_t *file = fd_new(socknode, 0);
+    int i = fd_install(current_task->files, file, 0, false);
+    if (i < 0)
+        fd_put(file);
 
     // if (type | SOCK_CLOEXEC)
     //     sockNode->closeOnExec = true;
@@ -299,15 +341,27 @@ int socket_socket(int domain, int type, int protocol)
 
 int socket_bind(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrlen)
 {
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    int ret;
+
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *sock = handle->sock;
 
     if (sock->bindAddr)
-        return -(EINVAL);
+    {
+        ret = -(EINVAL);
+        goto out;
+    }
 
     char *safe = unix_socket_addr_safe(addr, addrlen);
     if (((uint64_t)safe & ERRNO_MASK) == ERRNO_MASK)
-        return (uint64_t)safe;
+    {
+        ret = (uint64_t)safe;
+        goto out;
+    }
 
     bool is_abstract = (addr->sun_path[0] == '\0');
 
@@ -318,11 +372,15 @@ int socket_bind(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrlen)
         {
             vfs_close(new_node);
             free(safe);
-            return -(EADDRINUSE);
+            ret = -(EADDRINUSE);
+            goto out;
         }
     }
 
     size_t safeLen = strlen(safe);
+
+    rcu_read_lock();
+
     socket_t *browse = &first_unix_socket;
     while (browse)
     {
@@ -330,42 +388,61 @@ int socket_bind(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrlen)
             strlen(browse->bindAddr) == safeLen &&
             memcmp(safe, browse->bindAddr, safeLen) == 0)
             break;
-        browse = browse->next;
+        browse = rcu_dereference(browse->next);
     }
 
+    rcu_read_unlock();
+
     if (browse)
     {
         free(safe);
-        return -(EADDRINUSE);
+        ret = -(EADDRINUSE);
+        goto out;
     }
 
     sock->bindAddr = safe;
-    return 0;
+    ret = 0;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 int socket_listen(uint64_t fd, int backlog)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
     if (backlog == 0) // newer kernel behavior
         backlog = 1;
     if (backlog < 0)
         backlog = 128;
 
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *sock = handle->sock;
 
     // maybe do a typical array here
     sock->connMax = backlog;
     sock->backlog = calloc(sock->connMax * sizeof(unix_socket_pair_t *), 1);
+
+    fd_put(sock_file);
     return 0;
 }
 
 int socket_accept(uint64_t fd, struct sockaddr_un *addr, socklen_t *addrlen)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    int ret;
+
     if (addr && addrlen && *addrlen > 0)
     {
     }
 
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *sock = handle->sock;
 
     while (true)
@@ -398,19 +475,8 @@ int socket_accept(uint64_t fd, struct sockaddr_un *addr, socklen_t *addrlen)
             (sock->connMax - 1) * sizeof(unix_socket_pair_t *));
     sock->connCurr--;
 
-    uint64_t i = 0;
-    for (i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i] == NULL)
-        {
-            break;
-        }
-    }
-
-    if (i == MAX_FD_NUM)
-    {
-        return -EBADF;
-    }
+    poll_wake(&sock->poll_wait);
+    poll_wake(&pair->poll_wait);
 
     socket_handle_t *new_handle = acceptFd->handle;
     socket_t *new_sock = new_handle->sock;
@@ -418,36 +484,55 @@ int socket_accept(uint64_t fd, struct sockaddr_un *addr, socklen_t *addrlen)
     new_sock->options.peercred = sock->options.peercred;
     new_sock->options.has_peercred = true;
 
-    current_task->fds[i] = malloc(sizeof(fd_t));
-    current_task->fds[i]->node = acceptFd;
-    current_task->fds[i]->offset = 0;
-    current_task->fds[i]->flags = 0;
+    fd_t *file = fd_new(acceptFd, 0);
+    ret = fd_install(current_task->files, file, 0, false);
+    if (ret < 0)
+        fd_put(file);
 
-    return i;
+    fd_put(sock_file);
+    return ret;
 }
 
 int socket_connect(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrlen)
 {
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    int ret;
+
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *sock = handle->sock;
 
     if (sock->connMax != 0) // already ran listen()
-        return -(ECONNREFUSED);
+    {
+        ret = -(ECONNREFUSED);
+        goto out;
+    }
 
     if (sock->pair) // already ran connect()
-        return -(EISCONN);
+    {
+        ret = -(EISCONN);
+        goto out;
+    }
 
     char *safe = unix_socket_addr_safe(addr, addrlen);
     if (((uint64_t)safe & ERRNO_MASK) == ERRNO_MASK)
-        return (uint64_t)safe;
+    {
+        ret = (uint64_t)safe;
+        goto out;
+    }
     size_t safeLen = strlen(safe);
 
+    // 等待 accept 之前不再访问 parent, 在那里离开读侧临界区
+    rcu_read_lock();
+
     socket_t *parent = &first_unix_socket;
     while (parent)
     {
         if (parent == sock)
         {
-            parent = parent->next;
+            parent = rcu_dereference(parent->next);
             continue;
         }
 
@@ -455,20 +540,27 @@ int socket_connect(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrle
             memcmp(safe, parent->bindAddr, safeLen) == 0)
             break;
 
-        parent = parent->next;
+        parent = rcu_dereference(parent->next);
     }
     free(safe);
 
     if (!parent)
-        return -(ENOENT);
+    {
+        rcu_read_unlock();
+        ret = -(ENOENT);
+        goto out;
+    }
 
     if (!parent->connMax)
     {
-        return -(ECONNREFUSED);
+        rcu_read_unlock();
+        ret = -(ECONNREFUSED);
+        goto out;
     }
 
     if (parent->connCurr >= parent->connMax)
     {
+        rcu_read_unlock();
         return -(ECONNREFUSED); // no slot
     }
 
@@ -476,6 +568,9 @@ int socket_connect(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrle
     sock->pair = pair;
     pair->clientFds = 1;
     parent->backlog[parent->connCurr++] = pair;
+    poll_wake(&parent->poll_wait);
+
+    rcu_read_unlock();
 
     // todo!
     while (true)
@@ -497,118 +592,151 @@ int socket_connect(uint64_t fd, const struct sockaddr_un *addr, socklen_t addrle
 
     arch_disable_interrupt();
 
-    return 0;
+    ret = 0;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_recv_from(uint64_t fd, uint8_t *out, size_t limit, int flags,
                              struct sockaddr_un *addr, uint32_t *len)
 {
-    while (socket_op_lock)
-    {
-        arch_pause();
-    }
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
 
-    socket_op_lock = true;
+    size_t ret;
 
     // useless unless SOCK_DGRAM
     (void)addr;
     (void)len;
 
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *socket = handle->sock;
     unix_socket_pair_t *pair = socket->pair;
     if (!pair)
     {
-        socket_op_lock = false;
-        return -(ENOTCONN);
+        ret = -(ENOTCONN);
+        goto out;
     }
-    if (!pair->serverFds && pair->clientBuffPos == 0)
-        return 0;
+
+    spin_lock(&socket_op_lock);
+
     while (true)
     {
         if (!pair->serverFds && pair->clientBuffPos == 0)
         {
-            socket_op_lock = false;
-            return 0;
+            spin_unlock(&socket_op_lock);
+            ret = 0;
+            goto out;
         }
-        else if ((current_task->fds[fd]->flags & O_NONBLOCK || flags & MSG_DONTWAIT) &&
+        else if ((sock_file->flags & O_NONBLOCK || flags & MSG_DONTWAIT) &&
                  pair->clientBuffPos == 0)
         {
-            socket_op_lock = false;
-            return -(EWOULDBLOCK);
+            spin_unlock(&socket_op_lock);
+            ret = -(EWOULDBLOCK);
+            goto out;
         }
         else if (pair->clientBuffPos > 0)
             break;
+
+        spin_unlock(&socket_op_lock);
+        arch_pause();
+        spin_lock(&socket_op_lock);
     }
 
-    // spinlock already acquired
     size_t toCopy = MIN(limit, pair->clientBuffPos);
     memcpy(out, pair->clientBuff, toCopy);
     memmove(pair->clientBuff, &pair->clientBuff[toCopy],
             pair->clientBuffPos - toCopy);
     pair->clientBuffPos -= toCopy;
 
-    socket_op_lock = false;
+    spin_unlock(&socket_op_lock);
+
+    poll_wake(&pair->poll_wait);
 
-    return toCopy;
+    ret = toCopy;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_send_to(uint64_t fd, uint8_t *in, size_t limit, int flags,
                            struct sockaddr_un *addr, uint32_t len)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
     // useless unless SOCK_DGRAM
     (void)addr;
     (void)len;
 
-    while (socket_op_lock)
-    {
-        arch_pause();
-    }
-
-    socket_op_lock = true;
-
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *socket = handle->sock;
     unix_socket_pair_t *pair = socket->pair;
     if (!pair)
     {
-        socket_op_lock = false;
-        return -(ENOTCONN);
+        ret = -(ENOTCONN);
+        goto out;
     }
     if (limit > pair->serverBuffSize)
     {
         limit = pair->serverBuffSize;
     }
 
+    spin_lock(&socket_op_lock);
+
     while (true)
     {
         if (!pair->serverFds)
         {
             current_task->signal |= SIGMASK(SIGPIPE);
-            socket_op_lock = false;
-            return -(EPIPE);
+            spin_unlock(&socket_op_lock);
+            ret = -(EPIPE);
+            goto out;
         }
-        else if ((current_task->fds[fd]->flags & O_NONBLOCK || flags & MSG_DONTWAIT) &&
+        else if ((sock_file->flags & O_NONBLOCK || flags & MSG_DONTWAIT) &&
                  (pair->serverBuffPos + limit) > pair->serverBuffSize)
         {
-            socket_op_lock = false;
-            return -(EWOULDBLOCK);
+            spin_unlock(&socket_op_lock);
+            ret = -(EWOULDBLOCK);
+            goto out;
         }
         else if ((pair->serverBuffPos + limit) <= pair->serverBuffSize)
             break;
+
+        spin_unlock(&socket_op_lock);
+        arch_pause();
+        spin_lock(&socket_op_lock);
     }
 
-    // spinlock already acquired
     memcpy(&pair->serverBuff[pair->serverBuffPos], in, limit);
     pair->serverBuffPos += limit;
 
-    socket_op_lock = false;
+    spin_unlock(&socket_op_lock);
+
+    poll_wake(&pair->poll_wait);
 
-    return limit;
+    ret = limit;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_recv_msg(uint64_t fd, struct msghdr *msg, int flags)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
     msg->msg_controllen = 0;
     msg->msg_flags = 0;
     size_t cnt = 0;
@@ -617,20 +745,30 @@ size_t unix_socket_recv_msg(uint64_t fd, struct msghdr *msg, int flags)
     {
         struct iovec *curr =
             (struct iovec *)((size_t)msg->msg_iov + i * sizeof(struct iovec));
-        if (cnt > 0 && fs_callbacks[current_task->fds[fd]->node->fsid]->poll)
+        if (cnt > 0 && fs_callbacks[sock_file->node->fsid]->poll)
         {
-            if (!(fs_callbacks[current_task->fds[fd]->node->fsid]->poll(current_task->fds[fd]->node, EPOLLIN) & EPOLLIN))
-                return cnt;
+            if (!(fs_callbacks[sock_file->node->fsid]->poll(sock_file->node, EPOLLIN) & EPOLLIN))
+            {
+                ret = cnt;
+                goto out;
+            }
         }
         size_t singleCnt = unix_socket_recv_from(fd, curr->iov_base, curr->len,
                                                  noblock ? MSG_DONTWAIT : 0, 0, 0);
         if (((int64_t)singleCnt) < 0)
-            return singleCnt;
+        {
+            ret = singleCnt;
+            goto out;
+        }
 
         cnt += singleCnt;
     }
 
-    return cnt;
+    ret = cnt;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_send_msg(uint64_t fd, const struct msghdr *msg, int flags)
@@ -657,6 +795,12 @@ size_t unix_socket_send_msg(uint64_t fd, const struct msghdr *msg, int flags)
 size_t unix_socket_accept_recv_msg(uint64_t fd, struct msghdr *msg,
                                    int flags)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
     msg->msg_controllen = 0;
     msg->msg_flags = 0;
     size_t cnt = 0;
@@ -665,21 +809,31 @@ size_t unix_socket_accept_recv_msg(uint64_t fd, struct msghdr *msg,
     {
         struct iovec *curr =
             (struct iovec *)((size_t)msg->msg_iov + i * sizeof(struct iovec));
-        if (cnt > 0 && fs_callbacks[current_task->fds[fd]->node->fsid]->poll)
+        if (cnt > 0 && fs_callbacks[sock_file->node->fsid]->poll)
         {
             // check syscalls_fs.c for why this is necessary
-            if (!(fs_callbacks[current_task->fds[fd]->node->fsid]->poll(current_task->fds[fd]->node, EPOLLIN) & EPOLLIN))
-                return cnt;
+            if (!(fs_callbacks[sock_file->node->fsid]->poll(sock_file->node, EPOLLIN) & EPOLLIN))
+            {
+                ret = cnt;
+                goto out;
+            }
         }
         size_t singleCnt = unix_socket_accept_recv_from(
             fd, curr->iov_base, curr->len, noblock ? MSG_DONTWAIT : 0, 0, 0);
         if ((int64_t)(singleCnt) < 0)
-            return singleCnt;
+        {
+            ret = singleCnt;
+            goto out;
+        }
 
         cnt += singleCnt;
     }
 
-    return cnt;
+    ret = cnt;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_accept_send_msg(uint64_t fd, const struct msghdr *msg, int flags)
@@ -712,7 +866,12 @@ int unix_socket_pair(int type, int protocol, int *sv)
     if ((int64_t)(sock1) < 0)
         return sock1;
 
-    vfs_node_t sock1Fd = current_task->fds[sock1]->node;
+    fd_t *sock1_file = fd_get(current_task->files, sock1);
+    if (!sock1_file)
+        return -EBADF;
+
+    vfs_node_t sock1Fd = sock1_file->node;
+    fd_put(sock1_file);
 
     unix_socket_pair_t *pair = unix_socket_allocate_pair();
     pair->clientFds = 1;
@@ -725,20 +884,6 @@ int unix_socket_pair(int type, int protocol, int *sv)
 
     vfs_node_t sock2Fd = unix_socket_accept_create(pair);
 
-    uint64_t i = 0;
-    for (i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i] == NULL)
-        {
-            break;
-        }
-    }
-
-    if (i == MAX_FD_NUM)
-    {
-        return -EBADF;
-    }
-
     sock->options.peercred.pid = current_task->pid;
     sock->options.peercred.uid = current_task->uid;
     sock->options.peercred.gid = current_task->gid;
@@ -749,10 +894,13 @@ int unix_socket_pair(int type, int protocol, int *sv)
     new_sock->options.peercred = sock->options.peercred;
     new_sock->options.has_peercred = true;
 
-    current_task->fds[i] = malloc(sizeof(fd_t));
-    current_task->fds[i]->node = sock2Fd;
-    current_task->fds[i]->offset = 0;
-    current_task->fds[i]->flags = 0;
+    fd_t *file = fd_new(sock2Fd, 0);
+    int i = fd_install(current_task->files, file, 0, false);
+    if (i < 0)
+    {
+        fd_put(file);
+        return i;
+    }
 
     // finish it off
     sv[0] = sock1;
@@ -767,6 +915,10 @@ int socket_socket_poll(void *file, int events)
     socket_t *socket = handler->sock;
     int revents = 0;
 
+    poll_wait(&socket->poll_wait);
+    if (socket->pair)
+        poll_wait(&socket->pair->poll_wait);
+
     if (socket->connMax > 0)
     {
         // listen()
@@ -797,11 +949,18 @@ int socket_socket_poll(void *file, int events)
 
 size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *optval, socklen_t optlen)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
     if (level != SOL_SOCKET)
     {
-        return -ENOPROTOOPT;
+        ret = -ENOPROTOOPT;
+        goto out;
     }
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *sock = handle->sock;
 
     switch (optname)
@@ -809,14 +968,16 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_REUSEADDR:
         if (optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         sock->options.reuseaddr = *(int *)optval;
         break;
     case SO_KEEPALIVE:
         if (optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         sock->options.keepalive = *(int *)optval;
         break;
@@ -824,7 +985,8 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_SNDTIMEO_NEW:
         if (optlen < sizeof(struct timeval))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(&sock->options.sndtimeo, optval, sizeof(struct timeval));
         break;
@@ -832,14 +994,16 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_RCVTIMEO_NEW:
         if (optlen < sizeof(struct timeval))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(&sock->options.rcvtimeo, optval, sizeof(struct timeval));
         break;
     case SO_BINDTODEVICE:
         if (optlen > IFNAMSIZ)
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         strncpy(sock->options.bind_to_dev, optval, optlen);
         sock->options.bind_to_dev[IFNAMSIZ - 1] = '\0';
@@ -847,14 +1011,16 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_LINGER:
         if (optlen < sizeof(struct linger))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(&sock->options.linger_opt, optval, sizeof(struct linger));
         break;
     case SO_SNDBUF:
         if (optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         sock->pair->serverBuffSize = *(int *)optval;
         if (sock->pair->serverBuffSize < BUFFER_SIZE)
@@ -865,7 +1031,8 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_RCVBUF:
         if (optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         sock->pair->clientBuffSize = *(int *)optval;
         if (sock->pair->clientBuffSize < BUFFER_SIZE)
@@ -876,7 +1043,8 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_PASSCRED:
         if (optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         sock->options.passcred = *(int *)optval;
         break;
@@ -885,12 +1053,14 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
         struct sock_fprog fprog;
         if (optlen < sizeof(fprog))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(&fprog, optval, sizeof(fprog));
         if (fprog.len > 64 || fprog.len == 0)
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
 
         // 分配内存保存过滤器
@@ -900,19 +1070,31 @@ size_t unix_socket_setsockopt(uint64_t fd, int level, int optname, const void *o
         break;
     }
     default:
-        return -ENOPROTOOPT;
+        ret = -ENOPROTOOPT;
+        goto out;
     }
 
-    return 0;
+    ret = 0;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *optval, socklen_t *optlen)
 {
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
     if (level != SOL_SOCKET)
     {
-        return -ENOPROTOOPT;
+        ret = -ENOPROTOOPT;
+        goto out;
     }
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *sock = handle->sock;
 
     // 获取选项值
@@ -921,7 +1103,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_REUSEADDR:
         if (*optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         *(int *)optval = sock->options.reuseaddr;
         *optlen = sizeof(int);
@@ -929,7 +1112,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_KEEPALIVE:
         if (*optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         *(int *)optval = sock->options.keepalive;
         *optlen = sizeof(int);
@@ -938,7 +1122,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_SNDTIMEO_NEW:
         if (*optlen < sizeof(struct timeval))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(optval, &sock->options.sndtimeo, sizeof(struct timeval));
         *optlen = sizeof(struct timeval);
@@ -947,7 +1132,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_RCVTIMEO_NEW:
         if (*optlen < sizeof(struct timeval))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(optval, &sock->options.rcvtimeo, sizeof(struct timeval));
         *optlen = sizeof(struct timeval);
@@ -955,7 +1141,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_BINDTODEVICE:
         if (*optlen < IFNAMSIZ)
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         strncpy(optval, sock->options.bind_to_dev, IFNAMSIZ);
         *optlen = strlen(sock->options.bind_to_dev);
@@ -963,7 +1150,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_PROTOCOL:
         if (*optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         *(int *)optval = sock->protocol;
         *optlen = sizeof(int);
@@ -971,7 +1159,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_LINGER:
         if (*optlen < sizeof(struct linger))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(optval, &sock->options.linger_opt, sizeof(struct linger));
         *optlen = sizeof(struct linger);
@@ -979,7 +1168,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_SNDBUF:
         if (*optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         *(int *)optval = sock->pair->serverBuffSize;
         *optlen = sizeof(int);
@@ -987,7 +1177,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_RCVBUF:
         if (*optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         *(int *)optval = sock->pair->clientBuffSize;
         *optlen = sizeof(int);
@@ -995,7 +1186,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_PASSCRED:
         if (*optlen < sizeof(int))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         *(int *)optval = sock->options.passcred;
         *optlen = sizeof(int);
@@ -1003,11 +1195,13 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_PEERCRED:
         if (!sock->options.has_peercred)
         {
-            return -ENODATA;
+            ret = -ENODATA;
+            goto out;
         }
         if (*optlen < sizeof(struct ucred))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         memcpy(optval, &sock->options.peercred, sizeof(struct ucred));
         *optlen = sizeof(struct ucred);
@@ -1015,7 +1209,8 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
     case SO_ATTACH_FILTER:
         if (*optlen < sizeof(struct sock_fprog))
         {
-            return -EINVAL;
+            ret = -EINVAL;
+            goto out;
         }
         struct sock_fprog fprog = {
             .len = sock->options.filter_len,
@@ -1024,10 +1219,15 @@ size_t unix_socket_getsockopt(uint64_t fd, int level, int optname, const void *o
         *optlen = sizeof(fprog);
         break;
     default:
-        return -ENOPROTOOPT;
+        ret = -ENOPROTOOPT;
+        goto out;
     }
 
-    return 0;
+    ret = 0;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 static int dummy()
@@ -1037,20 +1237,36 @@ static int dummy()
 
 size_t unix_socket_getpeername(uint64_t fd, struct sockaddr_un *addr, socklen_t *len)
 {
-    socket_handle_t *handle = current_task->fds[fd]->node->handle;
+    fd_t *sock_file = fd_get(current_task->files, fd);
+    if (!sock_file)
+        return -EBADF;
+
+    size_t ret;
+
+    socket_handle_t *handle = sock_file->node->handle;
     socket_t *socket = handle->sock;
     unix_socket_pair_t *pair = socket->pair;
     if (!pair)
-        return -(ENOTCONN);
+    {
+        ret = -(ENOTCONN);
+        goto out;
+    }
 
     size_t actualLen = sizeof(addr->sun_family) + strlen(pair->filename);
     int toCopy = MIN(*len, actualLen);
     if (toCopy < sizeof(addr->sun_family))
-        return -(EINVAL);
+    {
+        ret = -(EINVAL);
+        goto out;
+    }
     addr->sun_family = 1;
     memcpy(addr->sun_path, pair->filename, toCopy - sizeof(addr->sun_family));
     *len = toCopy;
-    return 0;
+    ret = 0;
+
+out:
+    fd_put(sock_file);
+    return ret;
 }
 
 void socket_open(void *parent, const char *name, vfs_node_t node)
@@ -2,6 +2,7 @@
 
 #include <libs/klibc.h>
 #include <fs/fs_syscall.h>
+#include <task/rcu.h>
 
 typedef uint32_t socklen_t;
 
@@ -79,6 +80,8 @@ typedef struct unix_socket_pair
     uint8_t *clientBuff;
     int clientBuffPos;
     int clientBuffSize;
+
+    task_block_list_t poll_wait; // 两端的缓冲区和连接状态变化时唤醒
 } unix_socket_pair_t;
 
 #define MAX_CONNECTIONS 16
@@ -108,6 +111,8 @@ typedef struct socket
     // connect()
     unix_socket_pair_t *pair;
 
+    task_block_list_t poll_wait; // listen 后 backlog 变化时唤醒
+
     // socket选项
     struct
     {
@@ -123,6 +128,8 @@ typedef struct socket
         struct ucred peercred;
         bool has_peercred;
     } options;
+
+    rcu_head_t rcu;
 } socket_t;
 
 bool sys_socket_close(void *current);
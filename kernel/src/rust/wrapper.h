@@ -9,6 +9,8 @@
 #include <fs/termios.h>
 #include <task/task.h>
 #include <task/signal.h>
+#include <task/workqueue.h>
+#include <interrupt/softirq.h>
 #include <net/socket.h>
 
 #if defined(__x86_64__)
@@ -7,4 +7,10 @@
 #define MAX_CPU_NUM 64
 #define STACK_SIZE 65536UL
 
+// 统计标注过的锁的等待和持有时间, 见 /proc/lock_stat
+// 每次加解锁都要读时钟, 默认关闭, 调试时通过 -DCONFIG_LOCK_STAT=1 打开
+#ifndef CONFIG_LOCK_STAT
+#define CONFIG_LOCK_STAT 0
+#endif
+
 #define BUILD_VERSION "0.0.2"
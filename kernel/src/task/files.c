@@ -0,0 +1,429 @@
+#include <task/files.h>
+#include <task/task.h>
+#include <fs/fs_syscall.h>
+#include <mm/mm.h>
+
+#define BITS_PER_WORD 64
+#define BITMAP_WORDS(bits) (((bits) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+
+fd_t *fd_new(vfs_node_t node, uint64_t flags)
+{
+    fd_t *fd = malloc(sizeof(fd_t));
+    fd->node = node;
+    fd->offset = 0;
+    fd->flags = flags;
+    fd->ref_count = 1;
+    return fd;
+}
+
+// 最后一个引用释放时才关闭节点, 其他线程 close 不会让正在进行的调用访问已释放的文件
+void fd_put(fd_t *file)
+{
+    if (__atomic_sub_fetch(&file->ref_count, 1, __ATOMIC_SEQ_CST) != 0)
+        return;
+
+    vfs_close(file->node);
+    free(file);
+}
+
+static void fd_table_alloc(fd_table_t *table, uint32_t max_fds)
+{
+    uint32_t words = BITMAP_WORDS(max_fds);
+    uint32_t full_words = BITMAP_WORDS(words);
+
+    table->max_fds = max_fds;
+    table->fds = calloc(max_fds, sizeof(fd_t *));
+    table->open_fds = calloc(words, sizeof(uint64_t));
+    table->close_on_exec = calloc(words, sizeof(uint64_t));
+    table->full_fds_bits = calloc(full_words, sizeof(uint64_t));
+}
+
+static void fd_table_free(fd_table_t *table)
+{
+    free(table->fds);
+    free(table->open_fds);
+    free(table->close_on_exec);
+    free(table->full_fds_bits);
+}
+
+// 调用者持有 table->lock
+static bool fd_table_expand(fd_table_t *table, uint32_t fd)
+{
+    if (fd >= NR_OPEN_MAX)
+        return false;
+
+    uint32_t max_fds = table->max_fds;
+    while (max_fds <= fd)
+        max_fds *= 2;
+    if (max_fds > NR_OPEN_MAX)
+        max_fds = NR_OPEN_MAX;
+
+    fd_table_t new_table;
+    fd_table_alloc(&new_table, max_fds);
+    if (!new_table.fds || !new_table.open_fds || !new_table.close_on_exec || !new_table.full_fds_bits)
+    {
+        fd_table_free(&new_table);
+        return false;
+    }
+
+    uint32_t words = BITMAP_WORDS(table->max_fds);
+    memcpy(new_table.fds, table->fds, table->max_fds * sizeof(fd_t *));
+    memcpy(new_table.open_fds, table->open_fds, words * sizeof(uint64_t));
+    memcpy(new_table.close_on_exec, table->close_on_exec, words * sizeof(uint64_t));
+    memcpy(new_table.full_fds_bits, table->full_fds_bits, BITMAP_WORDS(words) * sizeof(uint64_t));
+
+    fd_table_free(table);
+
+    table->max_fds = new_table.max_fds;
+    table->fds = new_table.fds;
+    table->open_fds = new_table.open_fds;
+    table->close_on_exec = new_table.close_on_exec;
+    table->full_fds_bits = new_table.full_fds_bits;
+
+    return true;
+}
+
+static inline void fd_mark_open(fd_table_t *table, uint32_t fd, bool cloexec)
+{
+    uint32_t word = fd / BITS_PER_WORD;
+    uint64_t bit = 1UL << (fd % BITS_PER_WORD);
+
+    table->open_fds[word] |= bit;
+    if (table->open_fds[word] == ~0UL)
+        table->full_fds_bits[word / BITS_PER_WORD] |= 1UL << (word % BITS_PER_WORD);
+
+    if (cloexec)
+        table->close_on_exec[word] |= bit;
+    else
+        table->close_on_exec[word] &= ~bit;
+}
+
+static inline void fd_mark_closed(fd_table_t *table, uint32_t fd)
+{
+    uint32_t word = fd / BITS_PER_WORD;
+    uint64_t bit = 1UL << (fd % BITS_PER_WORD);
+
+    table->open_fds[word] &= ~bit;
+    table->close_on_exec[word] &= ~bit;
+    table->full_fds_bits[word / BITS_PER_WORD] &= ~(1UL << (word % BITS_PER_WORD));
+}
+
+// 先在 start 所在的字里找, 再借助 full_fds_bits 跳过已满的字
+static uint32_t fd_find_free(fd_table_t *table, uint32_t start)
+{
+    uint32_t words = BITMAP_WORDS(table->max_fds);
+    uint32_t word = start / BITS_PER_WORD;
+
+    if (word >= words)
+        return table->max_fds;
+
+    uint64_t bits = table->open_fds[word] | ((1UL << (start % BITS_PER_WORD)) - 1);
+    if (bits != ~0UL)
+        return word * BITS_PER_WORD + __builtin_ctzl(~bits);
+
+    for (word++; word < words; word++)
+    {
+        uint64_t full = table->full_fds_bits[word / BITS_PER_WORD] | ((1UL << (word % BITS_PER_WORD)) - 1);
+        if (full == ~0UL)
+        {
+            // 这一组 64 个字全满
+            word = (word / BITS_PER_WORD + 1) * BITS_PER_WORD - 1;
+            continue;
+        }
+
+        word = (word / BITS_PER_WORD) * BITS_PER_WORD + __builtin_ctzl(~full);
+        if (word >= words)
+            break;
+
+        return word * BITS_PER_WORD + __builtin_ctzl(~table->open_fds[word]);
+    }
+
+    return table->max_fds;
+}
+
+uint32_t fd_next_open(fd_table_t *table, uint32_t start)
+{
+    uint32_t words = BITMAP_WORDS(table->max_fds);
+    uint32_t word = start / BITS_PER_WORD;
+
+    if (word >= words)
+        return table->max_fds;
+
+    uint64_t bits = table->open_fds[word] & ~((1UL << (start % BITS_PER_WORD)) - 1);
+    while (!bits)
+    {
+        if (++word >= words)
+            return table->max_fds;
+        bits = table->open_fds[word];
+    }
+
+    return word * BITS_PER_WORD + __builtin_ctzl(bits);
+}
+
+// 安装到不小于 start 的最小空闲描述符, 受 RLIMIT_NOFILE 限制
+int fd_install(fd_table_t *table, fd_t *file, uint32_t start, bool cloexec)
+{
+    uint64_t limit = current_task->rlim[RLIMIT_NOFILE].rlim_cur;
+
+    spin_lock_irqsave(&table->lock);
+
+    uint32_t fd = fd_find_free(table, start);
+    if (fd >= limit || (fd >= table->max_fds && !fd_table_expand(table, fd)))
+    {
+        spin_unlock_irqrestore(&table->lock);
+        return -EMFILE;
+    }
+
+    table->fds[fd] = file;
+    fd_mark_open(table, fd, cloexec);
+
+    spin_unlock_irqrestore(&table->lock);
+
+    return fd;
+}
+
+// dup2/dup3 使用, 调用者需要先关闭 fd 上原有的文件
+int fd_install_at(fd_table_t *table, fd_t *file, uint64_t fd, bool cloexec)
+{
+    if (fd >= current_task->rlim[RLIMIT_NOFILE].rlim_cur)
+        return -EBADF;
+
+    spin_lock_irqsave(&table->lock);
+
+    if (fd >= table->max_fds && !fd_table_expand(table, fd))
+    {
+        spin_unlock_irqrestore(&table->lock);
+        return -EMFILE;
+    }
+
+    table->fds[fd] = file;
+    fd_mark_open(table, fd, cloexec);
+
+    spin_unlock_irqrestore(&table->lock);
+
+    return fd;
+}
+
+fd_t *fd_remove(fd_table_t *table, uint64_t fd)
+{
+    fd_t *file = NULL;
+
+    spin_lock_irqsave(&table->lock);
+
+    if (fd < table->max_fds && table->fds[fd])
+    {
+        file = table->fds[fd];
+        table->fds[fd] = NULL;
+        fd_mark_closed(table, fd);
+    }
+
+    spin_unlock_irqrestore(&table->lock);
+
+    return file;
+}
+
+// 共享描述符表的线程可能同时扩容并释放旧数组, 读取也要持锁
+fd_t *fd_get(fd_table_t *table, uint64_t fd)
+{
+    fd_t *file = NULL;
+
+    spin_lock_irqsave(&table->lock);
+
+    if (fd < table->max_fds && table->fds[fd])
+    {
+        file = table->fds[fd];
+        __atomic_add_fetch(&file->ref_count, 1, __ATOMIC_SEQ_CST);
+    }
+
+    spin_unlock_irqrestore(&table->lock);
+
+    return file;
+}
+
+// 调用者持有 table->lock
+static inline bool fd_test_cloexec(fd_table_t *table, uint32_t fd)
+{
+    return !!(table->close_on_exec[fd / BITS_PER_WORD] & (1UL << (fd % BITS_PER_WORD)));
+}
+
+bool fd_get_cloexec(fd_table_t *table, uint64_t fd)
+{
+    bool cloexec = false;
+
+    spin_lock_irqsave(&table->lock);
+
+    if (fd < table->max_fds)
+        cloexec = fd_test_cloexec(table, fd);
+
+    spin_unlock_irqrestore(&table->lock);
+
+    return cloexec;
+}
+
+void fd_set_cloexec(fd_table_t *table, uint64_t fd, bool cloexec)
+{
+    spin_lock_irqsave(&table->lock);
+
+    if (fd < table->max_fds && table->fds[fd])
+    {
+        if (cloexec)
+            table->close_on_exec[fd / BITS_PER_WORD] |= 1UL << (fd % BITS_PER_WORD);
+        else
+            table->close_on_exec[fd / BITS_PER_WORD] &= ~(1UL << (fd % BITS_PER_WORD));
+    }
+
+    spin_unlock_irqrestore(&table->lock);
+}
+
+// 只遍历 close_on_exec 中置位的字
+void fd_close_on_exec(fd_table_t *table)
+{
+    uint32_t words = BITMAP_WORDS(table->max_fds);
+
+    for (uint32_t word = 0; word < words; word++)
+    {
+        uint64_t bits = table->close_on_exec[word];
+        while (bits)
+        {
+            uint32_t fd = word * BITS_PER_WORD + __builtin_ctzl(bits);
+            bits &= bits - 1;
+
+            fd_t *file = fd_remove(table, fd);
+            if (file)
+                fd_put(file);
+        }
+    }
+}
+
+static fd_table_t *fd_table_alloc_empty(uint32_t max_fds)
+{
+    fd_table_t *table = malloc(sizeof(fd_table_t));
+    memset(table, 0, sizeof(fd_table_t));
+    table->ref_count = 1;
+    fd_table_alloc(table, max_fds);
+    return table;
+}
+
+fd_table_t *fd_table_create()
+{
+    fd_table_t *table = fd_table_alloc_empty(NR_OPEN_DEFAULT);
+
+    // 创建内核任务时 current_task 可能还不存在, 不走 RLIMIT 检查
+    table->fds[0] = fd_new(vfs_open("/dev/stdin"), 0);
+    table->fds[1] = fd_new(vfs_open("/dev/stdout"), 0);
+    table->fds[2] = fd_new(vfs_open("/dev/stderr"), 0);
+    for (uint32_t fd = 0; fd < 3; fd++)
+        fd_mark_open(table, fd, false);
+
+    return table;
+}
+
+// 0-2 重新打开终端, 其余描述符逐个 dup, 只访问已打开的位
+fd_table_t *fd_table_copy(fd_table_t *old)
+{
+    fd_table_t *table = fd_table_create();
+
+    spin_lock_irqsave(&old->lock);
+
+    if (old->max_fds > table->max_fds)
+        fd_table_expand(table, old->max_fds - 1);
+
+    fd_for_each(old, fd)
+    {
+        if (fd < 3)
+            continue;
+
+        table->fds[fd] = vfs_dup(old->fds[fd]);
+        fd_mark_open(table, fd, fd_test_cloexec(old, fd));
+    }
+
+    spin_unlock_irqrestore(&old->lock);
+
+    return table;
+}
+
+fd_table_t *fd_table_get(fd_table_t *table)
+{
+    __atomic_add_fetch(&table->ref_count, 1, __ATOMIC_SEQ_CST);
+    return table;
+}
+
+void fd_table_put(fd_table_t *table)
+{
+    if (__atomic_sub_fetch(&table->ref_count, 1, __ATOMIC_SEQ_CST) != 0)
+        return;
+
+    fd_for_each(table, fd)
+    {
+        fd_put(table->fds[fd]);
+        table->fds[fd] = NULL;
+    }
+
+    fd_table_free(table);
+    free(table);
+}
+
+fs_info_t *fs_info_create(vfs_node_t cwd)
+{
+    fs_info_t *fs = malloc(sizeof(fs_info_t));
+    memset(fs, 0, sizeof(fs_info_t));
+    fs->ref_count = 1;
+    fs->cwd = cwd;
+    fs->umask = 0022;
+    return fs;
+}
+
+fs_info_t *fs_info_copy(fs_info_t *old)
+{
+    spin_lock(&old->lock);
+    fs_info_t *fs = fs_info_create(old->cwd);
+    fs->umask = old->umask;
+    spin_unlock(&old->lock);
+    return fs;
+}
+
+fs_info_t *fs_info_get(fs_info_t *fs)
+{
+    __atomic_add_fetch(&fs->ref_count, 1, __ATOMIC_SEQ_CST);
+    return fs;
+}
+
+void fs_info_put(fs_info_t *fs)
+{
+    if (__atomic_sub_fetch(&fs->ref_count, 1, __ATOMIC_SEQ_CST) == 0)
+        free(fs);
+}
+
+// execve 前调用, 之后对描述符表的修改不再影响其他线程
+void task_unshare_files(task_t *task)
+{
+    fd_table_t *old = task->files;
+    if (__atomic_load_n(&old->ref_count, __ATOMIC_SEQ_CST) == 1)
+        return;
+
+    spin_lock_irqsave(&old->lock);
+
+    fd_table_t *table = fd_table_alloc_empty(old->max_fds);
+
+    fd_for_each(old, fd)
+    {
+        table->fds[fd] = vfs_dup(old->fds[fd]);
+        table->fds[fd]->offset = old->fds[fd]->offset;
+        fd_mark_open(table, fd, fd_test_cloexec(old, fd));
+    }
+
+    spin_unlock_irqrestore(&old->lock);
+
+    task->files = table;
+    fd_table_put(old);
+}
+
+void task_unshare_fs(task_t *task)
+{
+    fs_info_t *old = task->fs;
+    if (__atomic_load_n(&old->ref_count, __ATOMIC_SEQ_CST) == 1)
+        return;
+
+    task->fs = fs_info_copy(old);
+    fs_info_put(old);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <fs/vfs/vfs.h>
+
+#define NR_OPEN_DEFAULT 64    // 描述符表的初始大小
+#define NR_OPEN_MAX 1048576   // RLIMIT_NOFILE 的上限
+#define NR_OPEN_SOFT 1024     // RLIMIT_NOFILE 的默认软限制
+
+// 文件描述符表, CLONE_FILES 时多个任务共享
+// open_fds 每位对应一个描述符, full_fds_bits 每位对应 open_fds 的一个字 (已满时置位)
+typedef struct fd_table
+{
+    int ref_count;
+    spinlock_t lock;
+    uint32_t max_fds; // 当前容量, 总是 64 的倍数
+    fd_t **fds;
+    uint64_t *open_fds;
+    uint64_t *full_fds_bits;
+    uint64_t *close_on_exec;
+} fd_table_t;
+
+// 文件系统相关状态, CLONE_FS 时多个任务共享
+typedef struct fs_info
+{
+    int ref_count;
+    spinlock_t lock;
+    vfs_node_t cwd;
+    uint32_t umask;
+} fs_info_t;
+
+fd_table_t *fd_table_create();
+fd_table_t *fd_table_copy(fd_table_t *old);
+fd_table_t *fd_table_get(fd_table_t *table);
+void fd_table_put(fd_table_t *table);
+
+fd_t *fd_new(vfs_node_t node, uint64_t flags);
+void fd_put(fd_t *file);
+int fd_install(fd_table_t *table, fd_t *file, uint32_t start, bool cloexec);
+int fd_install_at(fd_table_t *table, fd_t *file, uint64_t fd, bool cloexec);
+fd_t *fd_remove(fd_table_t *table, uint64_t fd);
+uint32_t fd_next_open(fd_table_t *table, uint32_t start);
+bool fd_get_cloexec(fd_table_t *table, uint64_t fd);
+void fd_set_cloexec(fd_table_t *table, uint64_t fd, bool cloexec);
+void fd_close_on_exec(fd_table_t *table);
+
+// 越界或未打开时返回 NULL, 否则增加引用计数, 用完后调用 fd_put
+fd_t *fd_get(fd_table_t *table, uint64_t fd);
+
+// 调用者持有 table->lock, 或者该表只有自己在用
+#define fd_for_each(table, fd) \
+    for (uint32_t fd = fd_next_open(table, 0); fd < (table)->max_fds; fd = fd_next_open(table, fd + 1))
+
+fs_info_t *fs_info_create(vfs_node_t cwd);
+fs_info_t *fs_info_copy(fs_info_t *old);
+fs_info_t *fs_info_get(fs_info_t *fs);
+void fs_info_put(fs_info_t *fs);
+
+struct task;
+void task_unshare_files(struct task *task);
+void task_unshare_fs(struct task *task);
@@ -0,0 +1,313 @@
+#include <task/hrtimer.h>
+#include <task/percpu.h>
+#include <arch/arch.h>
+#include <mm/mm.h>
+#include <drivers/kernel_logger.h>
+
+#define HRTIMER_HEAP_INITIAL 64
+
+static DEFINE_PER_CPU(hrtimer_cpu_base_t, hrtimer_bases);
+
+static inline uint64_t heap_key(hrtimer_heap_t *heap, hrtimer_t *timer)
+{
+    return heap->soft ? timer->expires : timer->deadline;
+}
+
+static inline uint32_t *heap_index(hrtimer_heap_t *heap, hrtimer_t *timer)
+{
+    return heap->soft ? &timer->soft_index : &timer->index;
+}
+
+static inline bool hrtimer_before(hrtimer_heap_t *heap, hrtimer_t *a, hrtimer_t *b)
+{
+    return heap_key(heap, a) < heap_key(heap, b);
+}
+
+static inline void heap_place(hrtimer_heap_t *heap, uint32_t index, hrtimer_t *timer)
+{
+    heap->nodes[index] = timer;
+    *heap_index(heap, timer) = index;
+}
+
+static void heap_sift_up(hrtimer_heap_t *heap, uint32_t index)
+{
+    hrtimer_t *timer = heap->nodes[index];
+
+    while (index > 1)
+    {
+        uint32_t parent = index / 2;
+        if (!hrtimer_before(heap, timer, heap->nodes[parent]))
+            break;
+        heap_place(heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+
+    heap_place(heap, index, timer);
+}
+
+static void heap_sift_down(hrtimer_heap_t *heap, uint32_t index)
+{
+    hrtimer_t *timer = heap->nodes[index];
+
+    for (;;)
+    {
+        uint32_t child = index * 2;
+        if (child > heap->count)
+            break;
+        if (child + 1 <= heap->count && hrtimer_before(heap, heap->nodes[child + 1], heap->nodes[child]))
+            child++;
+        if (!hrtimer_before(heap, heap->nodes[child], timer))
+            break;
+        heap_place(heap, index, heap->nodes[child]);
+        index = child;
+    }
+
+    heap_place(heap, index, timer);
+}
+
+static void heap_remove(hrtimer_heap_t *heap, hrtimer_t *timer)
+{
+    uint32_t index = *heap_index(heap, timer);
+    hrtimer_t *last = heap->nodes[heap->count--];
+
+    *heap_index(heap, timer) = 0;
+
+    if (last == timer)
+        return;
+
+    heap_place(heap, index, last);
+    if (index > 1 && hrtimer_before(heap, last, heap->nodes[index / 2]))
+        heap_sift_up(heap, index);
+    else
+        heap_sift_down(heap, index);
+}
+
+static bool heap_reserve(hrtimer_heap_t *heap)
+{
+    if (heap->count + 1 < heap->capacity)
+        return true;
+
+    uint32_t capacity = heap->capacity * 2;
+    hrtimer_t **nodes = realloc(heap->nodes, capacity * sizeof(hrtimer_t *));
+    if (!nodes)
+        return false;
+    heap->nodes = nodes;
+    heap->capacity = capacity;
+
+    return true;
+}
+
+static void heap_insert(hrtimer_heap_t *heap, hrtimer_t *timer)
+{
+    heap->count++;
+    heap_place(heap, heap->count, timer);
+    heap_sift_up(heap, heap->count);
+}
+
+static bool hrtimer_enqueue(hrtimer_cpu_base_t *base, hrtimer_t *timer)
+{
+    if (!heap_reserve(&base->hard) || !heap_reserve(&base->soft))
+        return false;
+
+    heap_insert(&base->hard, timer);
+    heap_insert(&base->soft, timer);
+
+    return true;
+}
+
+static void hrtimer_dequeue(hrtimer_cpu_base_t *base, hrtimer_t *timer)
+{
+    heap_remove(&base->hard, timer);
+    heap_remove(&base->soft, timer);
+}
+
+// 需持有 base->lock, 且 base 为当前 CPU 的队列
+// 按最早的 deadline 编程, 其余 expires 已到的定时器在这次中断里一起处理
+static void hrtimer_reprogram(hrtimer_cpu_base_t *base)
+{
+    uint64_t next = base->hard.count ? base->hard.nodes[1]->deadline : (uint64_t)-1;
+
+    if (next == base->next_event)
+        return;
+
+    base->next_event = next;
+    if (next != (uint64_t)-1)
+        arch_timer_program(next);
+}
+
+static void hrtimer_heap_init(hrtimer_heap_t *heap, bool soft)
+{
+    heap->capacity = HRTIMER_HEAP_INITIAL;
+    heap->nodes = malloc(heap->capacity * sizeof(hrtimer_t *));
+    heap->count = 0;
+    heap->soft = soft;
+}
+
+void hrtimer_cpu_init(uint32_t cpu)
+{
+    hrtimer_cpu_base_t *base = &per_cpu(hrtimer_bases, cpu);
+
+    if (base->hard.nodes)
+        return;
+
+    memset(base, 0, sizeof(hrtimer_cpu_base_t));
+    hrtimer_heap_init(&base->hard, false);
+    hrtimer_heap_init(&base->soft, true);
+    base->next_event = (uint64_t)-1;
+}
+
+void hrtimer_init(hrtimer_t *timer, hrtimer_func_t func, void *data)
+{
+    timer->expires = 0;
+    timer->deadline = 0;
+    timer->slack = 0;
+    timer->func = func;
+    timer->data = data;
+    timer->cpu = 0;
+    timer->index = 0;
+    timer->soft_index = 0;
+}
+
+void hrtimer_start(hrtimer_t *timer, uint64_t expires)
+{
+    hrtimer_start_range(timer, expires, 0);
+}
+
+// 允许定时器在 [expires, expires + slack] 内的任意时刻触发
+void hrtimer_start_range(hrtimer_t *timer, uint64_t expires, uint64_t slack)
+{
+    hrtimer_cancel(timer);
+
+    uint32_t cpu = current_cpu_id;
+    hrtimer_cpu_base_t *base = &per_cpu(hrtimer_bases, cpu);
+
+    if (!base->hard.nodes)
+        hrtimer_cpu_init(cpu);
+
+    spin_lock_irqsave(&base->lock);
+
+    timer->expires = expires;
+    timer->slack = slack;
+    timer->deadline = expires + slack;
+    __atomic_store_n(&timer->cpu, cpu, __ATOMIC_RELAXED);
+    if (hrtimer_enqueue(base, timer) && timer->index == 1)
+        hrtimer_reprogram(base);
+
+    spin_unlock_irqrestore(&base->lock);
+}
+
+bool hrtimer_cancel(hrtimer_t *timer)
+{
+    for (;;)
+    {
+        uint32_t cpu = __atomic_load_n(&timer->cpu, __ATOMIC_RELAXED);
+        hrtimer_cpu_base_t *base = &per_cpu(hrtimer_bases, cpu);
+
+        spin_lock_irqsave(&base->lock);
+
+        // 拿锁前定时器可能已被迁移到其他 CPU 的队列, 锁住的不是它所在的 base 就重试
+        if (timer->cpu != cpu)
+        {
+            spin_unlock_irqrestore(&base->lock);
+            continue;
+        }
+
+        bool queued = hrtimer_active(timer);
+        if (queued)
+            hrtimer_dequeue(base, timer);
+
+        // 回调正在其他 CPU 上执行时, 等它结束 (它可能会重新入队)
+        bool running = base->running == timer && timer->cpu != current_cpu_id;
+
+        spin_unlock_irqrestore(&base->lock);
+
+        if (!running)
+            return queued;
+
+        arch_pause();
+    }
+}
+
+uint64_t hrtimer_forward(hrtimer_t *timer, uint64_t now, uint64_t interval)
+{
+    if (!interval || timer->expires > now)
+        return 0;
+
+    uint64_t overruns = (now - timer->expires) / interval + 1;
+    timer->expires += overruns * interval;
+
+    return overruns;
+}
+
+uint64_t hrtimer_remaining(hrtimer_t *timer)
+{
+    uint64_t now = nanoTime();
+
+    if (!hrtimer_active(timer) || timer->expires <= now)
+        return 0;
+
+    return timer->expires - now;
+}
+
+void hrtimer_interrupt()
+{
+    uint32_t cpu = current_cpu_id;
+    hrtimer_cpu_base_t *base = &per_cpu(hrtimer_bases, cpu);
+
+    if (!base->hard.nodes)
+        return;
+
+    spin_lock(&base->lock);
+
+    // 当前的一次性事件已经触发
+    base->next_event = (uint64_t)-1;
+
+    uint64_t now = nanoTime();
+
+    // 按 expires 取出所有已经可以触发的定时器, 不只是 deadline 最早的那个
+    while (base->soft.count && base->soft.nodes[1]->expires <= now)
+    {
+        hrtimer_t *timer = base->soft.nodes[1];
+        hrtimer_dequeue(base, timer);
+
+        base->expired++;
+        if (timer->deadline > now)
+            base->coalesced++;
+
+        base->running = timer;
+        spin_unlock(&base->lock);
+
+        hrtimer_restart_t restart = timer->func(timer);
+
+        spin_lock(&base->lock);
+        base->running = NULL;
+
+        if (restart == HRTIMER_RESTART && !hrtimer_active(timer))
+        {
+            timer->deadline = timer->expires + timer->slack;
+            __atomic_store_n(&timer->cpu, cpu, __ATOMIC_RELAXED);
+            hrtimer_enqueue(base, timer);
+        }
+
+        now = nanoTime();
+    }
+
+    hrtimer_reprogram(base);
+
+    spin_unlock(&base->lock);
+}
+
+int hrtimer_stats_print(char *buf)
+{
+    char *p = buf;
+
+    p += sprintf(p, "cpu   queued    expired  coalesced\n");
+
+    for (uint64_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        hrtimer_cpu_base_t *base = &per_cpu(hrtimer_bases, cpu);
+        p += sprintf(p, "%3lu %8u %10lu %10lu\n", cpu, base->hard.count, base->expired, base->coalesced);
+    }
+
+    return p - buf;
+}
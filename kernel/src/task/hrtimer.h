@@ -0,0 +1,69 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+struct hrtimer;
+
+typedef enum hrtimer_restart
+{
+    HRTIMER_NORESTART,
+    HRTIMER_RESTART,
+} hrtimer_restart_t;
+
+// 回调在中断上下文中执行 (关中断, 未持有队列锁)
+// 返回 HRTIMER_RESTART 时按 timer->expires 重新入队
+typedef hrtimer_restart_t (*hrtimer_func_t)(struct hrtimer *timer);
+
+typedef struct hrtimer
+{
+    uint64_t expires;  // 最早到期时间 (nanoTime)
+    uint64_t deadline; // 最晚到期时间, expires + slack
+    uint64_t slack;
+    hrtimer_func_t func;
+    void *data;
+    uint32_t cpu;        // 所在的 per-CPU 队列
+    uint32_t index;      // 在按 deadline 排序的堆中的下标 (从 1 开始), 0 表示未入队
+    uint32_t soft_index; // 在按 expires 排序的堆中的下标
+} hrtimer_t;
+
+typedef struct hrtimer_heap
+{
+    hrtimer_t **nodes; // nodes[1..count]
+    uint32_t count;
+    uint32_t capacity;
+    bool soft; // 按 expires 排序, 否则按 deadline
+} hrtimer_heap_t;
+
+// 每个定时器同时在两个堆中: 按 deadline 决定下一次中断的时刻,
+// 中断到来时按 expires 取出所有已经可以触发的定时器
+typedef struct hrtimer_cpu_base
+{
+    spinlock_t lock;
+    hrtimer_heap_t hard;
+    hrtimer_heap_t soft;
+    hrtimer_t *running;
+    uint64_t next_event;
+    uint64_t expired;   // 已触发的定时器数
+    uint64_t coalesced; // 借用其他定时器的中断提前触发的定时器数
+} hrtimer_cpu_base_t;
+
+void hrtimer_cpu_init(uint32_t cpu);
+
+void hrtimer_init(hrtimer_t *timer, hrtimer_func_t func, void *data);
+void hrtimer_start(hrtimer_t *timer, uint64_t expires);
+void hrtimer_start_range(hrtimer_t *timer, uint64_t expires, uint64_t slack);
+bool hrtimer_cancel(hrtimer_t *timer);
+uint64_t hrtimer_forward(hrtimer_t *timer, uint64_t now, uint64_t interval);
+uint64_t hrtimer_remaining(hrtimer_t *timer);
+
+static inline bool hrtimer_active(hrtimer_t *timer)
+{
+    return timer->index != 0;
+}
+
+void hrtimer_interrupt();
+
+int hrtimer_stats_print(char *buf);
+
+// 由架构实现: 在 expires (nanoTime) 时刻触发一次本 CPU 的定时器中断
+void arch_timer_program(uint64_t expires);
@@ -0,0 +1,129 @@
+#include <task/lock_stat.h>
+#include <arch/arch.h>
+
+// 只增不减的链表, 第一次加锁时挂上
+static lock_stat_t *lock_stat_head = NULL;
+static uint32_t lock_stat_count = 0;
+
+#if CONFIG_LOCK_STAT
+
+static void lock_stat_register(lock_stat_t *stat, spinlock_t *lock)
+{
+    if (__atomic_exchange_n(&stat->registered, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    stat->key = lock;
+
+    lock_stat_t *head = __atomic_load_n(&lock_stat_head, __ATOMIC_RELAXED);
+    do
+    {
+        stat->next = head;
+    } while (!__atomic_compare_exchange_n(&lock_stat_head, &head, stat, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    __atomic_fetch_add(&lock_stat_count, 1, __ATOMIC_RELAXED);
+}
+
+static void lock_stat_update_max(uint64_t *max, uint64_t value)
+{
+    uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old && !__atomic_compare_exchange_n(max, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void lock_stat_acquired(spinlock_t *lock)
+{
+    lock_stat_t *stat = lock->stat;
+
+    lock_stat_register(stat, lock);
+    __atomic_fetch_add(&stat->acquisitions, 1, __ATOMIC_RELAXED);
+
+    lock->hold_start = arch_cycles();
+}
+
+void lock_stat_lock(spinlock_t *lock)
+{
+    if (ticket_trylock(lock))
+    {
+        lock_stat_acquired(lock);
+        return;
+    }
+
+    // 只在确实需要等待时计时, 无竞争的路径只多一次 trylock
+    uint64_t start = arch_cycles();
+    ticket_lock(lock);
+    uint64_t wait = arch_cycles() - start;
+
+    lock_stat_t *stat = lock->stat;
+    __atomic_fetch_add(&stat->contentions, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->wait_total, wait, __ATOMIC_RELAXED);
+    lock_stat_update_max(&stat->wait_max, wait);
+
+    lock_stat_acquired(lock);
+}
+
+// 在真正释放之前调用, 此时 hold_start 还属于当前持有者
+void lock_stat_release(spinlock_t *lock)
+{
+    lock_stat_t *stat = lock->stat;
+    uint64_t hold = arch_cycles() - lock->hold_start;
+
+    __atomic_fetch_add(&stat->hold_total, hold, __ATOMIC_RELAXED);
+    lock_stat_update_max(&stat->hold_max, hold);
+}
+
+#endif
+
+void lock_stat_reset()
+{
+    for (lock_stat_t *stat = __atomic_load_n(&lock_stat_head, __ATOMIC_ACQUIRE); stat; stat = stat->next)
+    {
+        __atomic_store_n(&stat->acquisitions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stat->contentions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stat->wait_total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stat->wait_max, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stat->hold_total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stat->hold_max, 0, __ATOMIC_RELAXED);
+    }
+}
+
+#define LOCK_STAT_LINE_MAX 192
+
+size_t lock_stat_print_size()
+{
+    return (__atomic_load_n(&lock_stat_count, __ATOMIC_RELAXED) + 2) * LOCK_STAT_LINE_MAX + 1;
+}
+
+// 周期频率已知时换算成纳秒
+static uint64_t lock_stat_time(uint64_t cycles, uint64_t hz)
+{
+    return hz ? (uint64_t)((unsigned __int128)cycles * 1000000000ULL / hz) : cycles;
+}
+
+int lock_stat_print(char *buf, size_t size)
+{
+    uint64_t hz = arch_cycles_hz();
+    size_t len = 0;
+
+    if (size < 2 * LOCK_STAT_LINE_MAX)
+        return 0;
+
+    len += sprintf(buf + len, "lock_stat version 0.1, time in %s\n", hz ? "ns" : "cycles");
+    len += sprintf(buf + len, "%32s %18s %12s %12s %14s %16s %14s %16s\n", "class name", "key", "contentions", "acquisitions",
+                   "waittime-max", "waittime-total", "holdtime-max", "holdtime-total");
+
+    for (lock_stat_t *stat = __atomic_load_n(&lock_stat_head, __ATOMIC_ACQUIRE); stat; stat = stat->next)
+    {
+        if (len + LOCK_STAT_LINE_MAX >= size)
+            break;
+
+        len += sprintf(buf + len, "%32.32s 0x%016lx %12lu %12lu %14lu %16lu %14lu %16lu\n", stat->name, (uint64_t)stat->key,
+                       __atomic_load_n(&stat->contentions, __ATOMIC_RELAXED),
+                       __atomic_load_n(&stat->acquisitions, __ATOMIC_RELAXED),
+                       lock_stat_time(__atomic_load_n(&stat->wait_max, __ATOMIC_RELAXED), hz),
+                       lock_stat_time(__atomic_load_n(&stat->wait_total, __ATOMIC_RELAXED), hz),
+                       lock_stat_time(__atomic_load_n(&stat->hold_max, __ATOMIC_RELAXED), hz),
+                       lock_stat_time(__atomic_load_n(&stat->hold_total, __ATOMIC_RELAXED), hz));
+    }
+
+    return len;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+// 同一类锁共用一份统计, 时间以周期数记录
+typedef struct lock_stat
+{
+    const char *name;
+    const void *key; // 第一次加锁时的锁地址
+    struct lock_stat *next;
+    uint32_t registered;
+    uint64_t acquisitions;
+    uint64_t contentions; // 需要等待的次数
+    uint64_t wait_total;
+    uint64_t wait_max;
+    uint64_t hold_total;
+    uint64_t hold_max;
+} lock_stat_t;
+
+#define LOCK_STAT_INIT(lock_name) {.name = (lock_name)}
+
+// 声明一把带统计的全局锁, CONFIG_LOCK_STAT 关闭时就是普通的锁
+#define DEFINE_SPINLOCK_STAT(lock) \
+    lock_stat_t lock##_stat = LOCK_STAT_INIT(#lock); \
+    spinlock_t lock = SPINLOCK_STAT_INIT(lock##_stat)
+
+#define DEFINE_STATIC_SPINLOCK_STAT(lock) \
+    static lock_stat_t lock##_stat = LOCK_STAT_INIT(#lock); \
+    static spinlock_t lock = SPINLOCK_STAT_INIT(lock##_stat)
+
+size_t lock_stat_print_size();
+int lock_stat_print(char *buf, size_t size);
+void lock_stat_reset();
@@ -0,0 +1,63 @@
+#include <task/percpu.h>
+#include <arch/arch.h>
+
+cpu_local_t cpu_locals[MAX_CPU_NUM];
+
+void percpu_init(uint32_t cpu_id)
+{
+    cpu_local_t *cpu = &cpu_locals[cpu_id];
+
+    cpu->self = cpu;
+    cpu->cpu_id = cpu_id;
+
+    arch_set_this_cpu(cpu);
+}
+
+uint64_t cpu_stat_read(uint32_t cpu_id, cpu_stat_item_t item)
+{
+    return __atomic_load_n(&cpu_locals[cpu_id].stats[item], __ATOMIC_RELAXED);
+}
+
+// 各 CPU 的计数独立递增, 汇总结果不是某一时刻的精确快照
+uint64_t cpu_stat_sum(cpu_stat_item_t item)
+{
+    uint64_t sum = 0;
+
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        sum += cpu_stat_read(cpu, item);
+
+    return sum;
+}
+
+static int stat_print_items(char *buf, size_t size, const char **names, const cpu_stat_item_t *items, int count)
+{
+    char line[64];
+    size_t len = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        int n = sprintf(line, "%s %lu\n", names[i], cpu_stat_sum(items[i]));
+        if (len + n >= size)
+            break;
+        memcpy(buf + len, line, n);
+        len += n;
+    }
+
+    return len;
+}
+
+int cpu_stat_print(char *buf, size_t size)
+{
+    static const char *names[] = {"intr", "ctxt", "processes"};
+    static const cpu_stat_item_t items[] = {CPU_STAT_INTR, CPU_STAT_CTXT, CPU_STAT_FORKS};
+
+    return stat_print_items(buf, size, names, items, sizeof(items) / sizeof(items[0]));
+}
+
+int vm_stat_print(char *buf, size_t size)
+{
+    static const char *names[] = {"pgalloc_normal", "pgfree", "pgfault"};
+    static const cpu_stat_item_t items[] = {CPU_STAT_PGALLOC, CPU_STAT_PGFREE, CPU_STAT_PGFAULT};
+
+    return stat_print_items(buf, size, names, items, sizeof(items) / sizeof(items[0]));
+}
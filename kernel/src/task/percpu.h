@@ -0,0 +1,83 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+struct task;
+
+// 每个 CPU 独立的统计计数, 只在本 CPU 上累加, 读取时汇总
+typedef enum cpu_stat_item
+{
+    CPU_STAT_CTXT,    // 上下文切换次数
+    CPU_STAT_INTR,    // 处理的中断数
+    CPU_STAT_FORKS,   // 创建的任务数
+    CPU_STAT_PGALLOC, // 分配的物理页数
+    CPU_STAT_PGFREE,  // 释放的物理页数
+    CPU_STAT_PGFAULT, // 缺页异常次数
+    CPU_STAT_NR,
+} cpu_stat_item_t;
+
+typedef struct cpu_local
+{
+    // x86_64 syscall 入口通过 %gs 访问以下两个字段, 不要移动
+    uint64_t syscall_stack;
+    uint64_t syscall_user_rsp;
+    struct cpu_local *self;
+    uint32_t cpu_id;
+    struct task *current;
+    struct task *idle;
+    bool need_resched; // 中断中唤醒了更高优先级的任务, 退出中断时切换
+    uint32_t rcu_read_depth; // 读侧临界区嵌套层数, 不为 0 时不能切换任务
+    uint64_t stats[CPU_STAT_NR];
+} __attribute__((aligned(64))) cpu_local_t;
+
+extern cpu_local_t cpu_locals[MAX_CPU_NUM];
+
+// 每个 CPU 一份的变量, 按 CPU 编号索引
+// 每一份单独占满缓存行, 相邻 CPU 频繁写各自的那份时不会互相使缓存行失效
+// 同一个文件里不能同时 DECLARE 和 DEFINE 同一个变量
+#define PER_CPU_SLOT(type, name)               \
+    struct percpu_##name                       \
+    {                                          \
+        type var __attribute__((aligned(64))); \
+    }
+#define DEFINE_PER_CPU(type, name) PER_CPU_SLOT(type, name) name[MAX_CPU_NUM]
+#define DECLARE_PER_CPU(type, name) extern PER_CPU_SLOT(type, name) name[MAX_CPU_NUM]
+#define per_cpu(name, cpu) ((name)[(cpu)].var)
+#define this_cpu_var(name) per_cpu(name, current_cpu_id)
+
+#if defined(__x86_64__)
+// 内核态 GS_BASE 指向本 CPU 的 cpu_local_t, 一条 %gs 相对的读即可取到
+// percpu_init 之前指向 self 为空的占位结构, 返回 NULL
+static inline cpu_local_t *arch_this_cpu()
+{
+    cpu_local_t *cpu;
+    asm volatile("movq %%gs:%c1, %0" : "=r"(cpu) : "i"(__builtin_offsetof(cpu_local_t, self)));
+    return cpu;
+}
+#else
+// 由体系结构实现, 在 percpu_init 之前返回 NULL
+cpu_local_t *arch_this_cpu();
+#endif
+void arch_set_this_cpu(cpu_local_t *cpu);
+
+void percpu_init(uint32_t cpu_id);
+
+static inline void cpu_stat_add(cpu_stat_item_t item, uint64_t value)
+{
+#if defined(__x86_64__)
+    // 单条指令累加本 CPU 的计数, 中断打断不了, 也不需要总线锁
+    asm volatile("addq %1, %%gs:(%0)" ::"r"(__builtin_offsetof(cpu_local_t, stats) + item * sizeof(uint64_t)), "er"(value) : "memory");
+#else
+    cpu_local_t *cpu = arch_this_cpu();
+    if (cpu)
+        __atomic_fetch_add(&cpu->stats[item], value, __ATOMIC_RELAXED);
+#endif
+}
+
+#define cpu_stat_inc(item) cpu_stat_add(item, 1)
+
+uint64_t cpu_stat_read(uint32_t cpu_id, cpu_stat_item_t item);
+uint64_t cpu_stat_sum(cpu_stat_item_t item);
+
+int cpu_stat_print(char *buf, size_t size);
+int vm_stat_print(char *buf, size_t size);
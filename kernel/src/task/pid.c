@@ -0,0 +1,119 @@
+#include <task/pid.h>
+#include <task/task.h>
+
+// pid 0 留给空闲任务, MAX_TASK_NUM 不是 64 的倍数时向上取整, 多出的位由 pid_find_free 截断
+static uint64_t pid_bitmap[(MAX_TASK_NUM + 63) / 64] = {1};
+static uint64_t last_pid = 0;
+
+static task_t *pid_hash[PID_HASH_SIZE];
+
+task_t *task_list = NULL;
+spinlock_t task_list_lock = {0};
+
+static inline uint64_t pid_hashfn(uint64_t pid)
+{
+    return (pid * 0x9E3779B97F4A7C15ULL) >> (64 - PID_HASH_BITS);
+}
+
+static uint64_t pid_find_free(uint64_t start, uint64_t end)
+{
+    for (uint64_t pid = start; pid < end;)
+    {
+        uint64_t word = pid_bitmap[pid / 64] | ((1UL << (pid % 64)) - 1);
+        if (word != ~0UL)
+        {
+            uint64_t found = (pid & ~63UL) + __builtin_ctzl(~word);
+            return found < end ? found : end;
+        }
+        pid = (pid & ~63UL) + 64;
+    }
+
+    return end;
+}
+
+// 从上次分配的位置往后循环查找, 避免刚释放的 pid 立即被复用
+int64_t pid_alloc()
+{
+    spin_lock_irqsave(&task_list_lock);
+
+    uint64_t pid = pid_find_free(last_pid + 1, MAX_TASK_NUM);
+    if (pid == MAX_TASK_NUM)
+    {
+        pid = pid_find_free(1, last_pid + 1);
+        if (pid == last_pid + 1)
+        {
+            spin_unlock_irqrestore(&task_list_lock);
+            return -EAGAIN;
+        }
+    }
+
+    pid_bitmap[pid / 64] |= 1UL << (pid % 64);
+    last_pid = pid;
+
+    spin_unlock_irqrestore(&task_list_lock);
+
+    return pid;
+}
+
+void pid_free(uint64_t pid)
+{
+    if (pid == 0 || pid >= MAX_TASK_NUM)
+        return;
+
+    spin_lock_irqsave(&task_list_lock);
+    pid_bitmap[pid / 64] &= ~(1UL << (pid % 64));
+    spin_unlock_irqrestore(&task_list_lock);
+}
+
+void task_register(task_t *task)
+{
+    spin_lock_irqsave(&task_list_lock);
+
+    uint64_t hash = pid_hashfn(task->pid);
+    task->pid_hash_next = pid_hash[hash];
+    pid_hash[hash] = task;
+
+    // 插入到表头, 先准备好自身的指针再发布给无锁的读者
+    task->task_next = task_list;
+    task->task_prev = NULL;
+    if (task_list)
+        task_list->task_prev = task;
+    __atomic_store_n(&task_list, task, __ATOMIC_RELEASE);
+
+    spin_unlock_irqrestore(&task_list_lock);
+}
+
+// 被移除任务的 task_next 保持不变, 正在遍历的读者可以继续走下去
+void task_unregister(task_t *task)
+{
+    spin_lock_irqsave(&task_list_lock);
+
+    task_t **pp = &pid_hash[pid_hashfn(task->pid)];
+    while (*pp && *pp != task)
+        pp = &(*pp)->pid_hash_next;
+    if (*pp)
+        *pp = task->pid_hash_next;
+
+    if (task->task_prev)
+        task->task_prev->task_next = task->task_next;
+    else
+        task_list = task->task_next;
+    if (task->task_next)
+        task->task_next->task_prev = task->task_prev;
+
+    if (task->pid < MAX_TASK_NUM)
+        pid_bitmap[task->pid / 64] &= ~(1UL << (task->pid % 64));
+
+    spin_unlock_irqrestore(&task_list_lock);
+}
+
+task_t *task_find_by_pid(uint64_t pid)
+{
+    for (task_t *task = pid_hash[pid_hashfn(pid)]; task; task = task->pid_hash_next)
+    {
+        if (task->pid == pid)
+            return task;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+// 可以在编译时通过 -DMAX_TASK_NUM=... 调整
+#ifndef MAX_TASK_NUM
+#define MAX_TASK_NUM 32768
+#endif
+
+#define PID_HASH_BITS 10
+#define PID_HASH_SIZE (1 << PID_HASH_BITS)
+
+struct task;
+
+int64_t pid_alloc();
+void pid_free(uint64_t pid);
+
+void task_register(struct task *task);
+void task_unregister(struct task *task);
+// 调用者持有 rcu_read_lock 或 task_list_lock, 返回的任务只在此期间有效
+struct task *task_find_by_pid(uint64_t pid);
+
+// 所有已注册的任务 (不含空闲任务), 读者不加锁
+// 在 rcu_read_lock 中遍历, 回收的任务要等宽限期结束才释放
+extern struct task *task_list;
+extern spinlock_t task_list_lock;
+
+#define for_each_task(task) \
+    for (task_t *task = task_list; task; task = task->task_next)
@@ -0,0 +1,183 @@
+#include <task/rcu.h>
+#include <task/task.h>
+#include <arch/arch.h>
+#include <interrupt/softirq.h>
+
+// 低位为 1 表示宽限期正在进行, 每开始或结束一次加 1
+static uint64_t rcu_gp_seq = 0;
+// 当前宽限期中还没有经过静止状态的 CPU
+static uint64_t rcu_qs_pending = 0;
+static spinlock_t rcu_gp_lock = {0};
+
+static DEFINE_PER_CPU(rcu_cpu_data_t, rcu_datas);
+
+// 启动早期就可能有 call_rcu, 链表尾指针在第一次使用时初始化
+static rcu_cpu_data_t *rcu_this_cpu_data()
+{
+    rcu_cpu_data_t *rd = &this_cpu_var(rcu_datas);
+
+    if (!rd->next_tail)
+    {
+        rd->next_tail = &rd->next_head;
+        rd->wait_tail = &rd->wait_head;
+    }
+
+    return rd;
+}
+
+// 现在加入的回调要等到哪个序号才能执行: 正在进行的宽限期可能开始得太早, 要再等一个
+static uint64_t rcu_seq_snap(uint64_t seq)
+{
+    return (seq + 3) & ~1UL;
+}
+
+static bool rcu_seq_done(uint64_t target)
+{
+    return __atomic_load_n(&rcu_gp_seq, __ATOMIC_ACQUIRE) >= target;
+}
+
+static void rcu_start_gp()
+{
+    spin_lock_irqsave(&rcu_gp_lock);
+
+    if (!(rcu_gp_seq & 1))
+    {
+        uint64_t mask = cpu_count >= 64 ? ~0UL : (1UL << cpu_count) - 1;
+
+        __atomic_store_n(&rcu_qs_pending, mask, __ATOMIC_RELAXED);
+        __atomic_store_n(&rcu_gp_seq, rcu_gp_seq + 1, __ATOMIC_RELEASE);
+    }
+
+    spin_unlock_irqrestore(&rcu_gp_lock);
+}
+
+void rcu_note_qs()
+{
+    cpu_local_t *cpu = arch_this_cpu();
+    if (!cpu || cpu->rcu_read_depth)
+        return;
+
+    uint64_t bit = 1UL << cpu->cpu_id;
+    uint64_t seq = __atomic_load_n(&rcu_gp_seq, __ATOMIC_ACQUIRE);
+
+    // 最后一个经过静止状态的 CPU 结束宽限期
+    if ((seq & 1) && (__atomic_load_n(&rcu_qs_pending, __ATOMIC_RELAXED) & bit))
+    {
+        if (__atomic_fetch_and(&rcu_qs_pending, ~bit, __ATOMIC_ACQ_REL) == bit)
+            __atomic_store_n(&rcu_gp_seq, seq + 1, __ATOMIC_RELEASE);
+    }
+
+    rcu_cpu_data_t *rd = &per_cpu(rcu_datas, cpu->cpu_id);
+    if (rd->wait_head || rd->next_head)
+        raise_softirq(RCU_SOFTIRQ);
+}
+
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head))
+{
+    head->next = NULL;
+    head->func = func;
+
+    bool enabled = arch_interrupt_enabled();
+    arch_disable_interrupt();
+
+    rcu_cpu_data_t *rd = rcu_this_cpu_data();
+    *rd->next_tail = head;
+    rd->next_tail = &head->next;
+
+    raise_softirq(RCU_SOFTIRQ);
+
+    if (enabled)
+        arch_enable_interrupt();
+}
+
+static void rcu_process_callbacks()
+{
+    rcu_head_t *done = NULL;
+    bool need_gp = false;
+
+    // 软中断开中断执行, 与本 CPU 上中断里的 call_rcu 互斥
+    arch_disable_interrupt();
+
+    rcu_cpu_data_t *rd = rcu_this_cpu_data();
+
+    if (rd->wait_head && rcu_seq_done(rd->wait_seq))
+    {
+        done = rd->wait_head;
+        rd->wait_head = NULL;
+        rd->wait_tail = &rd->wait_head;
+    }
+
+    if (!rd->wait_head && rd->next_head)
+    {
+        rd->wait_head = rd->next_head;
+        rd->wait_tail = rd->next_tail;
+        rd->wait_seq = rcu_seq_snap(__atomic_load_n(&rcu_gp_seq, __ATOMIC_ACQUIRE));
+        rd->next_head = NULL;
+        rd->next_tail = &rd->next_head;
+    }
+
+    need_gp = rd->wait_head && !(__atomic_load_n(&rcu_gp_seq, __ATOMIC_RELAXED) & 1);
+
+    arch_enable_interrupt();
+
+    if (need_gp)
+        rcu_start_gp();
+
+    while (done)
+    {
+        rcu_head_t *head = done;
+        done = done->next;
+        head->func(head);
+        rd->invoked++;
+    }
+}
+
+typedef struct rcu_synchronize
+{
+    rcu_head_t head;
+    task_t *task;
+    bool done;
+} rcu_synchronize_t;
+
+static void rcu_wakeme(rcu_head_t *head)
+{
+    rcu_synchronize_t *rs = (rcu_synchronize_t *)head;
+
+    __atomic_store_n(&rs->done, true, __ATOMIC_SEQ_CST);
+    if (rs->task->state == TASK_BLOCKING)
+        task_unblock(rs->task, EOK);
+}
+
+void synchronize_rcu()
+{
+    rcu_synchronize_t rs = {.task = current_task, .done = false};
+    bool enabled = arch_interrupt_enabled();
+
+    call_rcu(&rs.head, rcu_wakeme);
+
+    while (1)
+    {
+        arch_disable_interrupt();
+
+        if (__atomic_load_n(&rs.done, __ATOMIC_SEQ_CST))
+            break;
+
+        // 先进入阻塞状态再检查, 回调中的唤醒不会丢失
+        task_block_prepare(current_task, TASK_BLOCKING, 0);
+        if (__atomic_load_n(&rs.done, __ATOMIC_SEQ_CST))
+        {
+            current_task->state = TASK_READY;
+            break;
+        }
+        task_block_wait(current_task, TASK_BLOCKING, 0);
+    }
+
+    if (enabled)
+        arch_enable_interrupt();
+}
+
+// 在这之前加入的回调由之后的静止状态重新触发软中断
+void rcu_init()
+{
+    open_softirq(RCU_SOFTIRQ, rcu_process_callbacks);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <task/percpu.h>
+
+// 基于静止状态的 RCU: 任务切换, 空闲循环和不在读侧临界区内的时钟中断都是静止状态,
+// 所有 CPU 都经过一次静止状态后, 之前摘下的对象不会再有读者
+//
+// 读侧临界区内不能睡眠, 也不会被抢占
+// 关中断不能代替 rcu_read_lock: 系统调用中阻塞的路径会开中断, 期间的中断会报告静止状态
+
+typedef struct rcu_head
+{
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+} rcu_head_t;
+
+typedef struct rcu_cpu_data
+{
+    rcu_head_t *next_head; // 还没有分配宽限期的回调
+    rcu_head_t **next_tail;
+    rcu_head_t *wait_head; // 等待 wait_seq 对应的宽限期结束
+    rcu_head_t **wait_tail;
+    uint64_t wait_seq;
+    uint64_t invoked;
+} rcu_cpu_data_t;
+
+static inline void rcu_read_lock()
+{
+    cpu_local_t *cpu = arch_this_cpu();
+    if (cpu)
+        cpu->rcu_read_depth++;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void rcu_read_unlock()
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    cpu_local_t *cpu = arch_this_cpu();
+    if (cpu)
+        cpu->rcu_read_depth--;
+}
+
+static inline bool rcu_read_lock_held()
+{
+    cpu_local_t *cpu = arch_this_cpu();
+    return cpu && cpu->rcu_read_depth;
+}
+
+// 发布时先初始化好对象再写指针, 读者按依赖顺序读取
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+// 回调在软中断中执行, 不能睡眠
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head));
+// 等待之前开始的所有读侧临界区结束, 会睡眠
+void synchronize_rcu();
+
+// 在静止状态下调用, 调用者不能持有 RCU 保护的指针
+void rcu_note_qs();
+
+void rcu_init();
@@ -250,6 +250,7 @@ void sys_sigreturn()
         memcpy(current_task->arch_context->fpu_ctx,
                ucontext->arch.fpstate,
                sizeof(struct fpstate));
+        fpu_invalidate(current_task->arch_context);
     }
 
     arch_switch_with_context(NULL, current_task->arch_context, current_task->kernel_stack);
@@ -335,21 +336,26 @@ int sys_kill(int pid, int sig)
 
     if (pid < 0)
     {
-        for (uint64_t i = cpu_count; i < MAX_TASK_NUM; i++)
+        rcu_read_lock();
+        for_each_task(ptr)
         {
-            if (tasks[i] && tasks[i]->ppid == current_task->pid)
+            if (ptr->ppid == current_task->pid)
             {
-                sys_kill(tasks[i]->pid, sig);
+                sys_kill(ptr->pid, sig);
             }
         }
+        rcu_read_unlock();
 
         return 0;
     }
 
-    task_t *task = tasks[pid];
+    rcu_read_lock();
+
+    task_t *task = task_find_by_pid(pid);
 
     if (!task)
     {
+        rcu_read_unlock();
         return 0;
     }
 
@@ -376,6 +382,8 @@ int sys_kill(int pid, int sig)
         task_unblock(task, -sig);
     }
 
+    rcu_read_unlock();
+
     return 0;
 }
 
@@ -424,6 +432,7 @@ void task_signal()
 
     sigrsp -= sizeof(struct fpstate);
     struct fpstate *fpu = (struct fpstate *)sigrsp;
+    fpu_flush(current_task->arch_context);
     memcpy(fpu, current_task->arch_context->fpu_ctx, sizeof(struct fpstate));
 
     sigrsp -= sizeof(struct sigcontext);
@@ -535,29 +544,32 @@ void task_signal()
         ptr->sa_handler = SIG_DFL;
     }
 
-    for (int i = 0; i < MAX_FD_NUM; i++)
+    fd_table_t *files = current_task->files;
+
+    spin_lock_irqsave(&files->lock);
+
+    fd_for_each(files, i)
     {
-        if (current_task->fds[i])
+        vfs_node_t node = files->fds[i]->node;
+        if (node && node->fsid == signalfdfs_id)
         {
-            vfs_node_t node = current_task->fds[i]->node;
-            if (node && node->fsid == signalfdfs_id)
+            struct signalfd_ctx *ctx = node->handle;
+
+            struct sigevent info;
+            memset(&info, 0, sizeof(struct sigevent));
+            info.sigev_signo = sig;
+
+            memcpy(&ctx->queue[ctx->queue_head], &info, sizeof(struct sigevent));
+            ctx->queue_head = (ctx->queue_head + 1) % ctx->queue_size;
+            if (ctx->queue_head == ctx->queue_tail)
             {
-                struct signalfd_ctx *ctx = node->handle;
-
-                struct sigevent info;
-                memset(&info, 0, sizeof(struct sigevent));
-                info.sigev_signo = sig;
-
-                memcpy(&ctx->queue[ctx->queue_head], &info, sizeof(struct sigevent));
-                ctx->queue_head = (ctx->queue_head + 1) % ctx->queue_size;
-                if (ctx->queue_head == ctx->queue_tail)
-                {
-                    ctx->queue_tail = (ctx->queue_tail + 1) % ctx->queue_size;
-                }
+                ctx->queue_tail = (ctx->queue_tail + 1) % ctx->queue_size;
             }
         }
     }
 
+    spin_unlock_irqrestore(&files->lock);
+
     current_task->blocked |= ptr->sa_mask;
 
     arch_switch_with_context(NULL, current_task->arch_context, current_task->kernel_stack);
@@ -6,9 +6,8 @@
 #include <mm/mm.h>
 #include <fs/fs_syscall.h>
 #include <net/socket.h>
-
-task_t *tasks[MAX_TASK_NUM];
-task_t *idle_tasks[MAX_CPU_NUM];
+#include <mm/page_cache.h>
+#include <task/workqueue.h>
 
 bool task_initialized = false;
 bool can_schedule = false;
@@ -22,27 +21,29 @@ task_t *get_free_task()
 {
     for (uint64_t i = 0; i < cpu_count; i++)
     {
-        if (idle_tasks[i] == NULL)
+        if (cpu_locals[i].idle == NULL)
         {
-            idle_tasks[i] = (task_t *)malloc(sizeof(task_t));
-            memset(idle_tasks[i], 0, sizeof(task_t));
-            idle_tasks[i]->pid = 0;
-            return idle_tasks[i];
+            cpu_locals[i].idle = (task_t *)malloc(sizeof(task_t));
+            memset(cpu_locals[i].idle, 0, sizeof(task_t));
+            cpu_locals[i].idle->pid = 0;
+            return cpu_locals[i].idle;
         }
     }
 
-    for (uint64_t i = 1; i < MAX_TASK_NUM; i++)
+    int64_t pid = pid_alloc();
+    if (pid < 0)
+        return NULL;
+
+    task_t *task = (task_t *)malloc(sizeof(task_t));
+    if (!task)
     {
-        if (tasks[i] == NULL)
-        {
-            tasks[i] = (task_t *)malloc(sizeof(task_t));
-            memset(tasks[i], 0, sizeof(task_t));
-            tasks[i]->pid = i;
-            return tasks[i];
-        }
+        pid_free(pid);
+        return NULL;
     }
-
-    return NULL;
+    memset(task, 0, sizeof(task_t));
+    task->pid = pid;
+    cpu_stat_inc(CPU_STAT_FORKS);
+    return task;
 }
 
 uint32_t cpu_idx = 0;
@@ -54,13 +55,13 @@ uint32_t alloc_cpu_id()
     return idx;
 }
 
-task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg)
+// 创建内核任务但不加入任务表, 调用者关中断并持有 can_schedule
+static task_t *task_alloc(const char *name, void (*entry)(uint64_t), uint64_t arg)
 {
-    arch_disable_interrupt();
-
-    can_schedule = false;
-
     task_t *task = get_free_task();
+    if (!task)
+        return NULL;
+
     task->cpu_id = alloc_cpu_id();
     task->ppid = task->pid;
     task->uid = 0;
@@ -68,7 +69,6 @@ task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg)
     task->euid = 0;
     task->egid = 0;
     task->pgid = 0;
-    task->waitpid = 0;
     task->state = TASK_READY;
     task->current_state = TASK_READY;
     task->jiffies = 0;
@@ -81,24 +81,12 @@ task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg)
     arch_context_init(task->arch_context, virt_to_phys((uint64_t)get_kernel_page_dir()), (uint64_t)entry, task->kernel_stack, false, arg);
     task->signal = 0;
     task->status = 0;
-    task->cwd = rootdir;
-    task->mmap_start = USER_MMAP_START;
-    task->brk_start = USER_BRK_START;
-    task->brk_end = USER_BRK_START;
+    task->fs = fs_info_create(rootdir);
+    task->arch_context->mm->mmap_start = USER_MMAP_START;
+    task->arch_context->mm->brk_start = USER_BRK_START;
+    task->arch_context->mm->brk_end = USER_BRK_START;
     memset(task->actions, 0, sizeof(task->actions));
-    memset(task->fds, 0, sizeof(task->fds));
-    task->fds[0] = malloc(sizeof(fd_t));
-    task->fds[0]->node = vfs_open("/dev/stdin");
-    task->fds[0]->offset = 0;
-    task->fds[0]->flags = 0;
-    task->fds[1] = malloc(sizeof(fd_t));
-    task->fds[1]->node = vfs_open("/dev/stdout");
-    task->fds[1]->offset = 0;
-    task->fds[1]->flags = 0;
-    task->fds[2] = malloc(sizeof(fd_t));
-    task->fds[2]->node = vfs_open("/dev/stderr");
-    task->fds[2]->offset = 0;
-    task->fds[2]->flags = 0;
+    task->files = fd_table_create();
     strncpy(task->name, name, TASK_NAME_MAX);
 
     memset(&task->term, 0, sizeof(termios));
@@ -128,16 +116,39 @@ task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg)
 
     task->tmp_rec_v = 0;
     task->cmdline = NULL;
+    task->timer_slack_ns = TIMER_SLACK_DEFAULT_NS;
+    task->static_prio = DEFAULT_PRIO;
+    task->prio = DEFAULT_PRIO;
+    task->policy = SCHED_NORMAL;
+    task->rt_priority = 0;
+    task->nice = 0;
+    task->pi_blocked_on = NULL;
+    task->pi_owned = NULL;
 
     memset(task->actions, 0, sizeof(task->actions));
 
     memset(task->rlim, 0, sizeof(task->rlim));
     task->rlim[RLIMIT_NPROC] = (struct rlimit){0, MAX_TASK_NUM};
-    task->rlim[RLIMIT_NOFILE] = (struct rlimit){MAX_FD_NUM, MAX_FD_NUM};
+    task->rlim[RLIMIT_NOFILE] = (struct rlimit){NR_OPEN_SOFT, NR_OPEN_MAX};
     task->rlim[RLIMIT_CORE] = (struct rlimit){0, 0};
 
     socket_on_new_task(task->pid);
 
+    return task;
+}
+
+task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg)
+{
+    arch_disable_interrupt();
+
+    can_schedule = false;
+
+    task_t *task = task_alloc(name, entry, arg);
+
+    // 空闲任务不进入任务表
+    if (task && task->pid != 0)
+        task_register(task);
+
     can_schedule = true;
 
     return task;
@@ -147,11 +158,12 @@ task_t *task_search(task_state_t state, uint32_t cpu_id)
 {
     task_t *task = NULL;
 
-    for (size_t i = 1; i < MAX_TASK_NUM; i++)
+    // 中断返回路径在这之前已经报告过静止状态, 遍历时要自己进入读侧临界区
+    // 找到的任务处于 state 状态, 不会被回收
+    rcu_read_lock();
+
+    for_each_task(ptr)
     {
-        task_t *ptr = tasks[i];
-        if (ptr == NULL)
-            break;
         if (ptr->state != state)
             continue;
         if (current_task == ptr)
@@ -159,13 +171,23 @@ task_t *task_search(task_state_t state, uint32_t cpu_id)
         if (ptr->cpu_id != cpu_id)
             continue;
 
-        if (task == NULL || ptr->jiffies < task->jiffies)
+        // 先比较有效优先级, 相同时选运行时间最少的
+        if (task == NULL || ptr->prio < task->prio || (ptr->prio == task->prio && ptr->jiffies < task->jiffies))
             task = ptr;
     }
 
+    rcu_read_unlock();
+
+    // 当前任务的优先级更高时继续运行它 (空闲任务除外), SCHED_FIFO 在同优先级下也不让出
+    if (task && state == TASK_READY && current_task && current_task->pid != 0 && current_task->state == TASK_READY && current_task->cpu_id == cpu_id &&
+        (current_task->prio < task->prio || (current_task->policy == SCHED_FIFO && current_task->prio == task->prio)))
+    {
+        task = current_task;
+    }
+
     if (task == NULL && state == TASK_READY)
     {
-        task = idle_tasks[cpu_id];
+        task = cpu_locals[cpu_id].idle;
     }
 
     return task;
@@ -175,6 +197,7 @@ void idle_entry(uint64_t arg)
 {
     while (1)
     {
+        rcu_note_qs();
         arch_enable_interrupt();
         arch_pause();
     }
@@ -253,16 +276,18 @@ void init_thread(uint64_t arg)
 
 void task_init()
 {
-    memset(tasks, 0, sizeof(tasks));
-    memset(idle_tasks, 0, sizeof(idle_tasks));
+    for (uint64_t cpu = 0; cpu < cpu_count; cpu++)
+        cpu_locals[cpu].idle = NULL;
 
     for (uint64_t cpu = 0; cpu < cpu_count; cpu++)
     {
-        idle_tasks[cpu] = task_create("idle", idle_entry, 0);
-        idle_tasks[cpu]->cpu_id = cpu;
-        idle_tasks[cpu]->state = TASK_RUNNING;
+        task_t *idle = task_create("idle", idle_entry, 0);
+        idle->cpu_id = cpu;
+        idle->state = TASK_RUNNING;
     }
-    arch_set_current(idle_tasks[0]);
+    arch_set_current(cpu_locals[0].idle);
+    workqueue_init();
+    rcu_init();
     task_create("init", init_thread, 0);
 
     task_initialized = true;
@@ -316,7 +341,13 @@ uint64_t push_infos(task_t *task, uint64_t current_stack, char *argv[], char *en
         }
     }
 
-    uint64_t total_length = 2 * sizeof(uint64_t) + 7 * 2 * sizeof(uint64_t) + (env_i + 0) * sizeof(uint64_t) + sizeof(uint64_t) + (argv_i + 0) * sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t);
+#if defined(__x86_64__)
+    uint64_t auxv_count = 8;
+#else
+    uint64_t auxv_count = 7;
+#endif
+
+    uint64_t total_length = 2 * sizeof(uint64_t) + auxv_count * 2 * sizeof(uint64_t) + (env_i + 0) * sizeof(uint64_t) + sizeof(uint64_t) + (argv_i + 0) * sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t);
     tmp_stack -= (tmp_stack - total_length) % 0x10;
 
     // push auxv
@@ -352,6 +383,12 @@ uint64_t push_infos(task_t *task, uint64_t current_stack, char *argv[], char *en
     ((uint64_t *)tmp)[1] = DEFAULT_PAGE_SIZE;
     tmp_stack = push_slice(tmp_stack, tmp, 2 * sizeof(uint64_t));
 
+#if defined(__x86_64__)
+    ((uint64_t *)tmp)[0] = AT_SYSINFO_EHDR;
+    ((uint64_t *)tmp)[1] = VDSO_TEXT_ADDR;
+    tmp_stack = push_slice(tmp_stack, tmp, 2 * sizeof(uint64_t));
+#endif
+
     memset(tmp, 0, 2 * sizeof(uint64_t));
 
     // push envp
@@ -371,6 +408,51 @@ uint64_t push_infos(task_t *task, uint64_t current_stack, char *argv[], char *en
     return tmp_stack;
 }
 
+#if defined(__x86_64__)
+// 只包含内核映射的新地址空间, 与 init 第一次 execve 时的做法相同
+static task_mm_info_t *task_new_user_mm()
+{
+    task_mm_info_t kernel_mm = {
+        .page_table_addr = (uint64_t)virt_to_phys(get_kernel_page_dir()),
+        .ref_count = 1,
+        .mmap_start = USER_MMAP_START,
+        .brk_start = USER_BRK_START,
+        .brk_end = USER_BRK_START,
+    };
+
+    task_mm_info_t *mm = clone_page_table(&kernel_mm, CLONE_VM);
+    if (mm == &kernel_mm)
+        return NULL;
+
+    return mm;
+}
+#endif
+
+// vfork 的子进程 execve 或退出时唤醒父进程
+void task_vfork_done(task_t *task)
+{
+    task_t *parent = __atomic_exchange_n(&task->vfork_parent, NULL, __ATOMIC_SEQ_CST);
+    if (parent)
+        task_unblock(parent, EOK);
+}
+
+// 父进程睡眠直到子进程不再借用它的地址空间
+static void task_vfork_wait(task_t *child)
+{
+    while (__atomic_load_n(&child->vfork_parent, __ATOMIC_SEQ_CST) == current_task)
+    {
+        task_block_prepare(current_task, TASK_BLOCKING, 0);
+
+        if (__atomic_load_n(&child->vfork_parent, __ATOMIC_SEQ_CST) != current_task)
+        {
+            current_task->state = TASK_READY;
+            break;
+        }
+
+        task_block_wait(current_task, TASK_BLOCKING, 0);
+    }
+}
+
 uint64_t task_fork(struct pt_regs *regs, bool vfork)
 {
     arch_disable_interrupt();
@@ -399,6 +481,7 @@ uint64_t task_fork(struct pt_regs *regs, bool vfork)
     child->arch_context = malloc(sizeof(arch_context_t));
     memset(child->arch_context, 0, sizeof(arch_context_t));
     current_task->arch_context->ctx = regs;
+    // vfork 的子进程直接借用父进程的地址空间, 不复制页表
     arch_context_copy(child->arch_context, current_task->arch_context, child->kernel_stack, vfork ? CLONE_VM : 0);
     child->ppid = current_task->pid;
     child->uid = current_task->uid;
@@ -408,46 +491,15 @@ uint64_t task_fork(struct pt_regs *regs, bool vfork)
     child->pgid = current_task->pgid;
 
     child->jiffies = current_task->jiffies;
+    child->jiffies_base = current_task->jiffies;
 
-    child->cwd = current_task->cwd;
+    child->fs = fs_info_copy(current_task->fs);
     child->cmdline = current_task->cmdline;
 
-    child->mmap_start = USER_MMAP_START;
-    child->brk_start = USER_BRK_START;
-    child->brk_end = USER_BRK_START;
     child->load_start = current_task->load_start;
     child->load_end = current_task->load_end;
 
-    memset(child->fds, 0, sizeof(child->fds));
-    child->fds[0] = malloc(sizeof(fd_t));
-    child->fds[0]->node = vfs_open("/dev/stdin");
-    child->fds[0]->offset = 0;
-    child->fds[0]->flags = 0;
-    child->fds[1] = malloc(sizeof(fd_t));
-    child->fds[1]->node = vfs_open("/dev/stdout");
-    child->fds[1]->offset = 0;
-    child->fds[1]->flags = 0;
-    child->fds[2] = malloc(sizeof(fd_t));
-    child->fds[2]->node = vfs_open("/dev/stderr");
-    child->fds[2]->offset = 0;
-    child->fds[2]->flags = 0;
-
-    if (!vfork)
-    {
-        for (uint64_t i = 3; i < MAX_FD_NUM; i++)
-        {
-            fd_t *fd = current_task->fds[i];
-
-            if (fd)
-            {
-                child->fds[i] = vfs_dup(fd);
-            }
-            else
-            {
-                child->fds[i] = NULL;
-            }
-        }
-    }
+    child->files = fd_table_copy(current_task->files);
 
     memcpy(child->actions, current_task->actions, sizeof(child->actions));
     child->signal = current_task->signal;
@@ -456,42 +508,232 @@ uint64_t task_fork(struct pt_regs *regs, bool vfork)
     memcpy(&child->term, &current_task->term, sizeof(termios));
 
     child->tmp_rec_v = current_task->tmp_rec_v;
+    child->timer_slack_ns = current_task->timer_slack_ns;
+    child->static_prio = current_task->static_prio;
+    child->prio = current_task->static_prio;
+    child->policy = current_task->policy;
+    child->rt_priority = current_task->rt_priority;
+    child->nice = current_task->nice;
+    child->pi_blocked_on = NULL;
+    child->pi_owned = NULL;
 
     memcpy(child->rlim, current_task->rlim, sizeof(child->rlim));
 
     socket_on_new_task(child->pid);
 
+    child->vfork_parent = vfork ? current_task : NULL;
+
+    task_register(child);
+    task_link_child(current_task, child);
+
     can_schedule = true;
 
-    return child->pid;
+    uint64_t pid = child->pid;
+
+    if (vfork)
+        task_vfork_wait(child);
+
+    return pid;
 }
 
-bool execve_lock = false;
+#define ELF_MAX_PHNUM 256
 
-uint64_t task_execve(const char *path, const char **argv, const char **envp)
+static void execve_free_args(char **new_argv, int argv_count, char **new_envp, int envp_count)
+{
+    for (int i = 0; i < argv_count; i++)
+        if (new_argv[i])
+            free(new_argv[i]);
+    free(new_argv);
+    for (int i = 0; i < envp_count; i++)
+        if (new_envp[i])
+            free(new_envp[i]);
+    free(new_envp);
+}
+
+// 只读取 ELF 头和程序头, 程序头由调用者释放
+static Elf64_Phdr *elf_read_headers(vfs_node_t node, Elf64_Ehdr *ehdr)
 {
-    while (execve_lock)
+    memset(ehdr, 0, sizeof(Elf64_Ehdr));
+    if (vfs_read(node, ehdr, 0, MIN(node->size, sizeof(Elf64_Ehdr))) < (ssize_t)sizeof(Elf64_Ehdr))
+        return NULL;
+
+    if (!arch_check_elf(ehdr) || ehdr->e_phentsize != sizeof(Elf64_Phdr) || ehdr->e_phnum == 0 || ehdr->e_phnum > ELF_MAX_PHNUM)
+        return NULL;
+
+    uint64_t size = ehdr->e_phnum * sizeof(Elf64_Phdr);
+    Elf64_Phdr *phdrs = malloc(size);
+    if (vfs_read(node, phdrs, ehdr->e_phoff, size) < (ssize_t)size)
     {
-        arch_enable_interrupt();
+        free(phdrs);
+        return NULL;
+    }
 
-        arch_pause();
+    return phdrs;
+}
+
+// 覆盖该页的所有 PT_LOAD 段的权限之和, 段的首尾可能落在同一页中
+static uint64_t elf_page_flags(const Elf64_Phdr *phdrs, int phnum, uint64_t base, uint64_t page)
+{
+    uint64_t flags = PT_FLAG_U;
+
+    for (int i = 0; i < phnum; i++)
+    {
+        if (phdrs[i].p_type != PT_LOAD)
+            continue;
+
+        uint64_t start = PADDING_DOWN(base + phdrs[i].p_vaddr, DEFAULT_PAGE_SIZE);
+        uint64_t end = base + phdrs[i].p_vaddr + phdrs[i].p_memsz;
+        if (page < start || page >= end)
+            continue;
+
+        if (phdrs[i].p_flags & PF_R)
+            flags |= PT_FLAG_R;
+        if (phdrs[i].p_flags & PF_W)
+            flags |= PT_FLAG_W;
+        if (phdrs[i].p_flags & PF_X)
+            flags |= PT_FLAG_X;
     }
 
-    arch_disable_interrupt();
+    return flags;
+}
 
-    can_schedule = false;
+#if defined(__x86_64__)
+static int elf_page_segments(const Elf64_Phdr *phdrs, int phnum, uint64_t base, uint64_t page)
+{
+    int count = 0;
+
+    for (int i = 0; i < phnum; i++)
+    {
+        if (phdrs[i].p_type != PT_LOAD)
+            continue;
 
-    execve_lock = true;
+        uint64_t start = PADDING_DOWN(base + phdrs[i].p_vaddr, DEFAULT_PAGE_SIZE);
+        uint64_t end = base + phdrs[i].p_vaddr + phdrs[i].p_memsz;
+        if (page >= start && page < end)
+            count++;
+    }
 
-    vfs_node_t node = vfs_open(path);
+    return count;
+}
+
+// 只属于一个段且整页内容来自文件的页直接映射页缓存, 可写段的页写时复制
+static bool elf_map_cached_page(vfs_node_t node, const Elf64_Phdr *phdrs, int phnum, uint64_t base, const Elf64_Phdr *phdr, uint64_t page)
+{
+    uint64_t seg_start = base + phdr->p_vaddr;
+    uint64_t file_end = seg_start + phdr->p_filesz;
+    uint64_t seg_end = seg_start + phdr->p_memsz;
+
+    if ((seg_start - phdr->p_offset) % DEFAULT_PAGE_SIZE != 0)
+        return false;
+
+    // 含有 bss 的页需要清零, 不能与文件共享
+    if (page + DEFAULT_PAGE_SIZE > file_end && seg_end > file_end)
+        return false;
+
+    if (elf_page_segments(phdrs, phnum, base, page) != 1)
+        return false;
+
+    uint64_t phys = page_cache_get(node, phdr->p_offset + page - seg_start);
+    if (!phys)
+        return false;
+
+    uint64_t flags = elf_page_flags(phdrs, phnum, base, page) | PT_FLAG_SHARED;
+    if (flags & PT_FLAG_W)
+        flags = (flags & ~PT_FLAG_W) | PT_FLAG_COW;
+
+    map_page_range(get_current_page_dir(true), page, phys, DEFAULT_PAGE_SIZE, flags);
+
+    return true;
+}
+#endif
+
+// 文件内容直接读入最终的物理页, 新分配的页已清零, 不需要再单独处理 bss
+static int elf_load_segments(vfs_node_t node, const Elf64_Phdr *phdrs, int phnum, uint64_t base, uint64_t *load_start, uint64_t *load_end)
+{
+    uint64_t *pgdir = get_current_page_dir(true);
+
+    for (int i = 0; i < phnum; i++)
+    {
+        const Elf64_Phdr *phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
+            continue;
+
+        if (phdr->p_filesz > phdr->p_memsz)
+            return -EINVAL;
+
+        uint64_t seg_start = base + phdr->p_vaddr;
+        uint64_t file_end = seg_start + phdr->p_filesz;
+        uint64_t seg_end = seg_start + phdr->p_memsz;
+
+        if (load_start && PADDING_DOWN(seg_start, DEFAULT_PAGE_SIZE) < *load_start)
+            *load_start = PADDING_DOWN(seg_start, DEFAULT_PAGE_SIZE);
+        if (load_end && PADDING_UP(seg_end, DEFAULT_PAGE_SIZE) > *load_end)
+            *load_end = PADDING_UP(seg_end, DEFAULT_PAGE_SIZE);
+
+        for (uint64_t page = PADDING_DOWN(seg_start, DEFAULT_PAGE_SIZE); page < seg_end; page += DEFAULT_PAGE_SIZE)
+        {
+            uint64_t phys = translate_address(pgdir, page);
+            if (phys == 0)
+            {
+#if defined(__x86_64__)
+                if (elf_map_cached_page(node, phdrs, phnum, base, phdr, page))
+                    continue;
+#endif
+
+                phys = alloc_frames(1);
+                if (phys == (uint64_t)-1 || phys == 0)
+                    return -ENOMEM;
+                memset(phys_to_virt((void *)phys), 0, DEFAULT_PAGE_SIZE);
+                map_page_range(pgdir, page, phys, DEFAULT_PAGE_SIZE, elf_page_flags(phdrs, phnum, base, page));
+            }
+
+            uint64_t copy_start = MAX(page, seg_start);
+            uint64_t copy_end = MIN(page + DEFAULT_PAGE_SIZE, file_end);
+            if (copy_start >= copy_end)
+                continue;
+
+            uint64_t offset = phdr->p_offset + (copy_start - seg_start);
+            if (vfs_read(node, (uint8_t *)phys_to_virt((void *)phys) + (copy_start - page), offset, copy_end - copy_start) < (ssize_t)(copy_end - copy_start))
+                return -EIO;
+        }
+    }
+
+    return 0;
+}
+
+static int elf_load_interpreter(const char *name, uint64_t *entry)
+{
+    vfs_node_t node = vfs_open(name);
     if (!node)
+        return -ENOENT;
+
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr *phdrs = elf_read_headers(node, &ehdr);
+    if (!phdrs)
     {
-        can_schedule = true;
-        execve_lock = false;
-        return (uint64_t)-ENOENT;
+        vfs_close(node);
+        return -ELIBBAD;
     }
 
-    uint64_t buf_len = (node->size + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1));
+    int ret = elf_load_segments(node, phdrs, ehdr.e_phnum, INTERPRETER_BASE_ADDR, NULL, NULL);
+
+    free(phdrs);
+    vfs_close(node);
+
+    if (ret < 0)
+        return ret;
+
+    *entry = INTERPRETER_BASE_ADDR + ehdr.e_entry;
+    return 0;
+}
+
+uint64_t task_execve(const char *path, const char **argv, const char **envp)
+{
+    arch_disable_interrupt();
+
+    vfs_node_t node = vfs_open(path);
+    if (!node)
+        return (uint64_t)-ENOENT;
 
     char **new_argv = (char **)malloc(1024);
     memset(new_argv, 0, 1024);
@@ -519,35 +761,16 @@ uint64_t task_execve(const char *path, const char **argv, const char **envp)
     }
     new_envp[envp_count] = NULL;
 
-#if defined(__x86_64__)
-    if (current_task->arch_context->mm->page_table_addr == (uint64_t)virt_to_phys(get_kernel_page_dir()))
-    {
-        current_task->arch_context->mm = clone_page_table(current_task->arch_context->mm, CLONE_VM);
-        asm volatile("movq %0, %%cr3" ::"r"(current_task->arch_context->mm->page_table_addr));
-    }
-#endif
-
-    uint8_t *buffer = (uint8_t *)EHDR_START_ADDR;
-    map_page_range(get_current_page_dir(true), EHDR_START_ADDR, 0, buf_len, PT_FLAG_R | PT_FLAG_W | PT_FLAG_U);
-
-    vfs_read(node, buffer, 0, node->size);
-
-    char *fullpath = vfs_get_fullpath(node);
-
-    vfs_close(node);
+    // 在替换地址空间之前完成检查, 出错时调用者的地址空间仍然完好
+    uint8_t magic[2] = {0};
+    vfs_read(node, magic, 0, MIN(node->size, sizeof(magic)));
 
-    if (buffer[0] == '#' && buffer[1] == '!')
+    if (magic[0] == '#' && magic[1] == '!')
     {
-        for (int i = 0; i < argv_count; i++)
-            if (new_argv[i])
-                free(new_argv[i]);
-        free(new_argv);
-        for (int i = 0; i < envp_count; i++)
-            if (new_envp[i])
-                free(new_envp[i]);
-        free(new_envp);
+        vfs_close(node);
+
+        execve_free_args(new_argv, argv_count, new_envp, envp_count);
 
-        execve_lock = false;
         const char *argvs[64];
         memset(argvs, 0, 64 * sizeof(const char *));
         argvs[0] = "/bin/sh";
@@ -559,150 +782,74 @@ uint64_t task_execve(const char *path, const char **argv, const char **envp)
         return task_execve("/bin/sh", argvs, envp);
     }
 
-    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)EHDR_START_ADDR;
-
-    uint64_t e_entry = ehdr->e_entry;
-
-    uint64_t interpreter_entry = 0;
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr *phdrs = elf_read_headers(node, &ehdr);
+    if (!phdrs || ehdr.e_entry == 0)
+    {
+        if (phdrs)
+            free(phdrs);
+        vfs_close(node);
+        execve_free_args(new_argv, argv_count, new_envp, envp_count);
+        return (uint64_t)-ENOEXEC;
+    }
 
-    if (e_entry == 0)
+    char *interpreter_name = NULL;
+    for (int i = 0; i < ehdr.e_phnum; i++)
     {
-        free(fullpath);
-        for (int i = 0; i < argv_count; i++)
-            if (new_argv[i])
-                free(new_argv[i]);
-        free(new_argv);
-        for (int i = 0; i < envp_count; i++)
-            if (new_envp[i])
-                free(new_envp[i]);
-        free(new_envp);
-        can_schedule = true;
-        execve_lock = false;
-        return (uint64_t)-EINVAL;
+        if (phdrs[i].p_type != PT_INTERP || phdrs[i].p_filesz == 0 || phdrs[i].p_filesz > DEFAULT_PAGE_SIZE)
+            continue;
+
+        interpreter_name = malloc(phdrs[i].p_filesz + 1);
+        vfs_read(node, interpreter_name, phdrs[i].p_offset, phdrs[i].p_filesz);
+        interpreter_name[phdrs[i].p_filesz] = '\0';
+        break;
     }
 
-    if (!arch_check_elf(ehdr))
+#if defined(__x86_64__)
+    // 新映像总是装入一个空的地址空间, 原来的由最后一个使用者释放
+    task_mm_info_t *new_mm = task_new_user_mm();
+    if (!new_mm)
     {
-        free(fullpath);
-        for (int i = 0; i < argv_count; i++)
-            if (new_argv[i])
-                free(new_argv[i]);
-        free(new_argv);
-        for (int i = 0; i < envp_count; i++)
-            if (new_envp[i])
-                free(new_envp[i]);
-        free(new_envp);
-        can_schedule = true;
-        execve_lock = false;
-        return (uint64_t)-EINVAL;
+        if (interpreter_name)
+            free(interpreter_name);
+        free(phdrs);
+        vfs_close(node);
+        execve_free_args(new_argv, argv_count, new_envp, envp_count);
+        return (uint64_t)-ENOMEM;
     }
 
-    // 处理程序头
-    Elf64_Phdr *phdr = (Elf64_Phdr *)(EHDR_START_ADDR + ehdr->e_phoff);
+    task_mm_info_t *old_mm = current_task->arch_context->mm;
+    current_task->arch_context->mm = new_mm;
+    arch_switch_mm(old_mm, new_mm);
+    if (old_mm->page_table_addr != (uint64_t)virt_to_phys(get_kernel_page_dir()))
+        free_page_table(old_mm);
+    else
+        free(old_mm);
+#endif
 
     uint64_t load_start = UINT64_MAX;
     uint64_t load_end = 0;
+    uint64_t interpreter_entry = 0;
 
-    for (int i = 0; i < ehdr->e_phnum; ++i)
-    {
-        if (phdr[i].p_type == PT_INTERP)
-        {
-            const char *interpreter_name = ((const char *)ehdr + phdr[i].p_offset);
-
-            vfs_node_t interpreter_node = vfs_open(interpreter_name);
-            if (!interpreter_node)
-            {
-                can_schedule = true;
-                execve_lock = false;
-                return (uint64_t)-ENOENT;
-            }
-
-            uint8_t *interpreter_buffer = (uint8_t *)INTERPRETER_EHDR_ADDR;
-            map_page_range(get_current_page_dir(true), INTERPRETER_EHDR_ADDR, 0, (interpreter_node->size + DEFAULT_PAGE_SIZE - 1) & (~(DEFAULT_PAGE_SIZE - 1)), PT_FLAG_R | PT_FLAG_W | PT_FLAG_U);
-
-            vfs_read(interpreter_node, interpreter_buffer, 0, interpreter_node->size);
-
-            vfs_close(interpreter_node);
-
-            Elf64_Ehdr *interpreter_ehdr = (Elf64_Ehdr *)interpreter_buffer;
-            Elf64_Phdr *interpreter_phdr = (Elf64_Phdr *)(interpreter_buffer + interpreter_ehdr->e_phoff);
-
-            for (int j = 0; j < interpreter_ehdr->e_phnum; j++)
-            {
-                if (interpreter_phdr[j].p_type != PT_LOAD)
-                    continue;
-
-                uint64_t seg_addr = INTERPRETER_BASE_ADDR + interpreter_phdr[j].p_vaddr;
-                uint64_t seg_size = interpreter_phdr[j].p_memsz;
-                uint64_t file_size = interpreter_phdr[j].p_filesz;
-                uint64_t page_size = DEFAULT_PAGE_SIZE;
-                uint64_t page_mask = page_size - 1;
-
-                // 计算对齐后的地址和大小
-                uint64_t aligned_addr = seg_addr & ~page_mask;
-                uint64_t size_diff = seg_addr - aligned_addr;
-                uint64_t alloc_size = (seg_size + size_diff + page_mask) & ~page_mask;
-
-                uint64_t flags = PT_FLAG_R | PT_FLAG_U | PT_FLAG_W | PT_FLAG_X;
-                map_page_range(get_current_page_dir(true), aligned_addr, 0, alloc_size, flags);
-                fast_memcpy((void *)seg_addr, (void *)(INTERPRETER_EHDR_ADDR + interpreter_phdr[j].p_offset), file_size);
-
-                if (seg_size > file_size)
-                {
-                    uint64_t bss_start = seg_addr + file_size;
-                    uint64_t bss_size = seg_size - file_size;
-                    memset((void *)bss_start, 0, bss_size);
-
-                    uint64_t page_remain = (bss_size % DEFAULT_PAGE_SIZE);
-                    if (page_remain)
-                    {
-                        uint64_t align_start = bss_start + bss_size - page_remain;
-                        memset((void *)align_start, 0, page_remain);
-                    }
-                }
-            }
-
-            interpreter_entry = INTERPRETER_BASE_ADDR + interpreter_ehdr->e_entry;
-        }
-        else
-        {
-            if (phdr[i].p_type != PT_LOAD)
-                continue;
-
-            uint64_t seg_addr = phdr[i].p_vaddr;
-            uint64_t seg_size = phdr[i].p_memsz;
-            uint64_t file_size = phdr[i].p_filesz;
-            uint64_t page_size = DEFAULT_PAGE_SIZE;
-            uint64_t page_mask = page_size - 1;
-
-            // 计算对齐后的地址和大小
-            uint64_t aligned_addr = seg_addr & ~page_mask;
-            uint64_t size_diff = seg_addr - aligned_addr;
-            uint64_t alloc_size = (seg_size + size_diff + page_mask) & ~page_mask;
+    int ret = elf_load_segments(node, phdrs, ehdr.e_phnum, 0, &load_start, &load_end);
+    if (ret == 0 && interpreter_name)
+        ret = elf_load_interpreter(interpreter_name, &interpreter_entry);
 
-            if (aligned_addr < load_start)
-                load_start = aligned_addr;
-            else if (aligned_addr + alloc_size > load_end)
-                load_end = aligned_addr + alloc_size;
+    if (interpreter_name)
+        free(interpreter_name);
+    free(phdrs);
 
-            uint64_t flags = PT_FLAG_R | PT_FLAG_U | PT_FLAG_W | PT_FLAG_X;
-            map_page_range(get_current_page_dir(true), aligned_addr, 0, alloc_size, flags);
-            fast_memcpy((void *)seg_addr, (void *)(EHDR_START_ADDR + phdr[i].p_offset), file_size);
+    char *fullpath = vfs_get_fullpath(node);
 
-            if (seg_size > file_size)
-            {
-                uint64_t bss_start = seg_addr + file_size;
-                uint64_t bss_size = seg_size - file_size;
-                memset((void *)bss_start, 0, bss_size);
+    vfs_close(node);
 
-                uint64_t page_remain = (bss_size % DEFAULT_PAGE_SIZE);
-                if (page_remain)
-                {
-                    uint64_t align_start = bss_start + bss_size - page_remain;
-                    memset((void *)align_start, 0, page_remain);
-                }
-            }
-        }
+    if (ret < 0)
+    {
+        // 旧的地址空间已经释放, 无法返回
+        free(fullpath);
+        execve_free_args(new_argv, argv_count, new_envp, envp_count);
+        task_exit(128 + SIGSEGV);
+        return (uint64_t)ret;
     }
 
     strncpy(current_task->name, fullpath, TASK_NAME_MAX);
@@ -710,7 +857,11 @@ uint64_t task_execve(const char *path, const char **argv, const char **envp)
 
     map_page_range(get_current_page_dir(true), USER_STACK_START, 0, USER_STACK_END - USER_STACK_START, PT_FLAG_R | PT_FLAG_W | PT_FLAG_U);
 
-    uint64_t stack = push_infos(current_task, USER_STACK_END, (char **)new_argv, (char **)new_envp, e_entry, (uint64_t)(load_start + ehdr->e_phoff), ehdr->e_phnum, interpreter_entry ? INTERPRETER_BASE_ADDR : load_start);
+#if defined(__x86_64__)
+    vdso_map(get_current_page_dir(true));
+#endif
+
+    uint64_t stack = push_infos(current_task, USER_STACK_END, (char **)new_argv, (char **)new_envp, ehdr.e_entry, (uint64_t)(load_start + ehdr.e_phoff), ehdr.e_phnum, interpreter_entry ? INTERPRETER_BASE_ADDR : load_start);
 
     char cmdline[DEFAULT_PAGE_SIZE];
     memset(cmdline, 0, sizeof(cmdline));
@@ -721,44 +872,19 @@ uint64_t task_execve(const char *path, const char **argv, const char **envp)
         cmdline_ptr += len;
     }
 
-    for (int i = 0; i < argv_count; i++)
-    {
-        if (new_argv[i])
-        {
-            free(new_argv[i]);
-        }
-    }
-    free(new_argv);
-    for (int i = 0; i < envp_count; i++)
-    {
-        if (new_envp[i])
-        {
-            free(new_envp[i]);
-        }
-    }
-    free(new_envp);
-
-    for (uint64_t i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (!current_task->fds[i])
-            continue;
+    execve_free_args(new_argv, argv_count, new_envp, envp_count);
 
-        if (current_task->fds[i]->flags & O_CLOEXEC)
-        {
-            vfs_close(current_task->fds[i]->node);
-            free(current_task->fds[i]);
-            current_task->fds[i] = NULL;
-        }
-    }
+    task_unshare_files(current_task);
+    fd_close_on_exec(current_task->files);
 
     current_task->cmdline = strdup(cmdline);
     current_task->load_start = load_start;
     current_task->load_end = load_end;
 
-    execve_lock = false;
-    can_schedule = true;
+    // 已不再使用父进程的地址空间和参数
+    task_vfork_done(current_task);
 
-    arch_to_user_mode(current_task->arch_context, interpreter_entry ? interpreter_entry : e_entry, stack);
+    arch_to_user_mode(current_task->arch_context, interpreter_entry ? interpreter_entry : ehdr.e_entry, stack);
 
     return (uint64_t)-EAGAIN;
 }
@@ -768,17 +894,63 @@ void sys_yield()
     arch_yield();
 }
 
-int task_block(task_t *task, task_state_t state, int timeout_ms)
+static hrtimer_restart_t task_block_timeout(hrtimer_t *timer)
 {
-    (void)timeout_ms;
-
-    task->state = state;
+    task_t *task = timer->data;
 
-    if (current_task == task)
+    if (task->state == TASK_BLOCKING)
     {
-        arch_enable_interrupt();
-
-        arch_pause();
+        task->status = (uint64_t)-ETIMEDOUT;
+        task->state = TASK_READY;
+    }
+
+    return HRTIMER_NORESTART;
+}
+
+int task_block(task_t *task, task_state_t state, int timeout_ms)
+{
+    uint64_t deadline = 0;
+
+    if (timeout_ms >= 0)
+        deadline = nanoTime() + (uint64_t)timeout_ms * 1000000ULL;
+
+    return task_block_until(task, state, deadline);
+}
+
+// deadline 为 0 表示不超时
+int task_block_until(task_t *task, task_state_t state, uint64_t deadline)
+{
+    task_block_prepare(task, state, deadline);
+
+    return task_block_wait(task, state, deadline);
+}
+
+// 在持有等待队列锁时调用, 解锁后再 task_block_wait, 这样唤醒不会丢失
+void task_block_prepare(task_t *task, task_state_t state, uint64_t deadline)
+{
+    task->status = EOK;
+    task->state = state;
+
+    if (deadline)
+    {
+        hrtimer_cancel(&task->block_timer);
+        hrtimer_init(&task->block_timer, task_block_timeout, task);
+        hrtimer_start_range(&task->block_timer, deadline, task->timer_slack_ns);
+    }
+}
+
+int task_block_wait(task_t *task, task_state_t state, uint64_t deadline)
+{
+    if (current_task == task)
+    {
+        // 阻塞的任务不会被 task_search 选中, 让出 CPU 直到被唤醒
+        while (task->state == state)
+        {
+            arch_yield();
+        }
+
+        if (deadline)
+            hrtimer_cancel(&task->block_timer);
     }
 
     arch_disable_interrupt();
@@ -792,12 +964,41 @@ void task_unblock(task_t *task, int reason)
     task->state = TASK_READY;
 }
 
+// 在中断中唤醒任务后调用, 被唤醒的任务比当前任务优先级高时在退出中断时切换
+void task_wake_preempt(task_t *task)
+{
+    if (task->cpu_id == current_cpu_id && current_task && task->prio < current_task->prio)
+        arch_this_cpu()->need_resched = true;
+}
+
+static void task_cancel_timers(task_t *task)
+{
+    hrtimer_cancel(&task->itimer_real.timer);
+    hrtimer_cancel(&task->block_timer);
+
+    for (int i = 0; i < MAX_TIMERS_NUM; i++)
+    {
+        if (task->timers[i])
+        {
+            hrtimer_cancel(&task->timers[i]->timer);
+            free(task->timers[i]);
+            task->timers[i] = NULL;
+        }
+    }
+}
+
 uint64_t task_exit(int64_t code)
 {
     arch_disable_interrupt();
 
     task_t *task = current_task;
 
+    task_cancel_timers(task);
+
+    futex_exit(task);
+
+    task_vfork_done(task);
+
     arch_context_free(task->arch_context);
 
     free_frames_bytes((void *)task->kernel_stack, STACK_SIZE);
@@ -805,29 +1006,21 @@ uint64_t task_exit(int64_t code)
 
     task->status = (uint64_t)code;
 
-    for (uint64_t i = 0; i < MAX_FD_NUM; i++)
-    {
-        if (task->fds[i])
-        {
-            vfs_close(task->fds[i]->node);
-            free(task->fds[i]);
-
-            task->fds[i] = NULL;
-        }
-    }
-
-    if (task->waitpid != 0 && tasks[task->waitpid])
-    {
-        task_unblock(tasks[task->waitpid], EOK);
-    }
+    // 共享的表由最后一个退出的任务关闭
+    fd_table_put(task->files);
+    task->files = NULL;
+    fs_info_put(task->fs);
+    task->fs = NULL;
 
     if (task->cmdline)
         free(task->cmdline);
 
     socket_on_exit_task(task->pid);
 
-    task->state = TASK_DIED;
+    task_exit_notify(task);
 
+    // 通知父进程后 task 随时可能被回收, 回收要等宽限期结束, 所以这里不能报告静止状态,
+    // 切换走以后由下一次中断或空闲循环报告
     task_t *next = task_search(TASK_READY, task->cpu_id);
 
     if (next)
@@ -837,8 +1030,9 @@ uint64_t task_exit(int64_t code)
     }
     else
     {
-        arch_set_current(idle_tasks[current_cpu_id]);
-        arch_switch_with_context(NULL, idle_tasks[current_cpu_id]->arch_context, idle_tasks[current_cpu_id]->kernel_stack);
+        task_t *idle = arch_this_cpu()->idle;
+        arch_set_current(idle);
+        arch_switch_with_context(NULL, idle->arch_context, idle->kernel_stack);
     }
 
     // never return !!!
@@ -846,115 +1040,399 @@ uint64_t task_exit(int64_t code)
     return (uint64_t)-EAGAIN;
 }
 
-uint64_t sys_waitpid(uint64_t pid, int *status, uint64_t options)
+#if defined(__x86_64__)
+#define TASK_TICK_NS APIC_TIMER_TICK_NS
+#else
+#define TASK_TICK_NS 10000000ULL
+#endif
+
+// 调用者持有 task_list_lock
+static void sibling_add(task_t **head, task_t *task)
 {
-    task_t *child = NULL;
-    uint64_t ret = -ECHILD;
+    task->sibling_prev = NULL;
+    task->sibling_next = *head;
+    if (*head)
+        (*head)->sibling_prev = task;
+    *head = task;
+}
+
+static void sibling_del(task_t **head, task_t *task)
+{
+    if (task->sibling_prev)
+        task->sibling_prev->sibling_next = task->sibling_next;
+    else
+        *head = task->sibling_next;
+    if (task->sibling_next)
+        task->sibling_next->sibling_prev = task->sibling_prev;
+    task->sibling_next = NULL;
+    task->sibling_prev = NULL;
+}
+
+// 等待项在等待者的栈上, 唤醒时不释放, 由等待者自己摘除
+static void wait_chldexit_wake(task_t *parent)
+{
+    for (task_block_list_t *entry = parent->wait_chldexit.next; entry; entry = entry->next)
+        task_unblock(entry->task, EOK);
+}
+
+static void wait_chldexit_remove(task_t *parent, task_block_list_t *wait)
+{
+    task_block_list_t *prev = &parent->wait_chldexit;
+    while (prev->next && prev->next != wait)
+        prev = prev->next;
+    if (prev->next)
+        prev->next = wait->next;
+}
+
+void task_link_child(task_t *parent, task_t *child)
+{
+    spin_lock_irqsave(&task_list_lock);
+    sibling_add(&parent->children, child);
+    spin_unlock_irqrestore(&task_list_lock);
+}
+
+// 子进程交给 init, 没有 init 时只断开链表
+static void task_reparent_children(task_t *task)
+{
+    task_t *reaper = task_find_by_pid(1);
+    if (reaper == task)
+        reaper = NULL;
+
+    bool has_zombie = task->zombies != NULL;
+
+    while (task->children)
+    {
+        task_t *child = task->children;
+        sibling_del(&task->children, child);
+        if (reaper)
+        {
+            child->ppid = reaper->pid;
+            sibling_add(&reaper->children, child);
+        }
+        else
+        {
+            child->ppid = child->pid;
+        }
+    }
+
+    while (task->zombies)
+    {
+        task_t *child = task->zombies;
+        sibling_del(&task->zombies, child);
+        if (reaper)
+        {
+            child->ppid = reaper->pid;
+            sibling_add(&reaper->zombies, child);
+        }
+        else
+        {
+            child->ppid = child->pid;
+        }
+    }
+
+    if (reaper && has_zombie)
+        wait_chldexit_wake(reaper);
+}
+
+// 标记为僵尸并移到父进程的 zombies 链表, 唤醒在 wait 中的父进程
+void task_exit_notify(task_t *task)
+{
+    spin_lock_irqsave(&task_list_lock);
+
+    task_reparent_children(task);
+
+    task->state = TASK_DIED;
+
+    task_t *parent = task->ppid != task->pid ? task_find_by_pid(task->ppid) : NULL;
+    if (parent)
+    {
+        sibling_del(&parent->children, task);
+        sibling_add(&parent->zombies, task);
+        wait_chldexit_wake(parent);
+    }
+
+    spin_unlock_irqrestore(&task_list_lock);
+}
+
+static bool wait_match(task_t *child, int idtype, uint64_t id)
+{
+    switch (idtype)
+    {
+    case P_ALL:
+        return true;
+    case P_PID:
+        return child->pid == id;
+    case P_PGID:
+        return (uint64_t)child->pgid == id;
+    default:
+        return false;
+    }
+}
+
+static void task_fill_rusage(task_t *task, bool children, struct rusage *rusage)
+{
+    uint64_t ticks = children ? task->cjiffies : task->jiffies - task->jiffies_base;
+    uint64_t ns = ticks * TASK_TICK_NS;
+
+    memset(rusage, 0, sizeof(struct rusage));
+    rusage->ru_utime.tv_sec = ns / 1000000000ULL;
+    rusage->ru_utime.tv_usec = (ns % 1000000000ULL) / 1000;
+}
+
+static void task_free_rcu(rcu_head_t *head)
+{
+    task_t *task = (task_t *)((char *)head - offsetof(task_t, rcu));
+
+    free(task->arch_context);
+    free(task);
+}
+
+// 回收一个已从 zombies 链表摘下的子进程
+// 调度器和 task_find_by_pid 不加锁遍历任务表, 结构体等所有读者离开后再释放
+static void task_release(task_t *child)
+{
+    current_task->cjiffies += child->jiffies - child->jiffies_base + child->cjiffies;
+
+    task_unregister(child);
+
+    free_page_table(child->arch_context->mm);
+
+    call_rcu(&child->rcu, task_free_rcu);
+}
+
+// 返回 0 并设置 *out 表示找到, *out 为 NULL 表示 WNOHANG 下没有已退出的子进程
+static int do_wait(int idtype, uint64_t id, uint64_t options, task_t **out)
+{
+    task_block_list_t wait = {.next = NULL, .task = current_task};
+
+    *out = NULL;
 
     while (1)
     {
+        task_t *child = NULL;
         bool has_child = false;
 
-        // 遍历所有任务查找符合条件的子进程
-        for (uint64_t i = 1; i < MAX_TASK_NUM; i++)
-        {
-            task_t *ptr = tasks[i];
-            if (!ptr || ptr->pid == ptr->ppid || ptr->ppid != current_task->pid)
-                continue;
+        spin_lock_irqsave(&task_list_lock);
 
-            // 处理不同pid参数情况
-            if (pid == (uint64_t)-1)
-            { // 任意子进程
-                child = ptr;
+        if (idtype == P_PID)
+        {
+            task_t *ptr = task_find_by_pid(id);
+            if (ptr && ptr != current_task && ptr->ppid == current_task->pid)
+            {
                 has_child = true;
-                if (child->state == TASK_DIED)
-                {
-                    goto rollback;
-                }
-                break;
+                if (ptr->state == TASK_DIED)
+                    child = ptr;
             }
-            else if (pid == 0)
-            { // 同进程组
-                if (ptr->pgid == current_task->pgid)
+        }
+        else
+        {
+            // P_ALL 时直接取 zombies 的表头
+            for (task_t *ptr = current_task->zombies; ptr; ptr = ptr->sibling_next)
+            {
+                if (wait_match(ptr, idtype, id))
                 {
                     child = ptr;
-                    has_child = true;
                     break;
                 }
             }
-            else if (pid > 0)
-            { // 指定PID
-                if (ptr->pid != pid)
-                    continue;
-            }
 
-            // 检查进程状态
-            if (ptr->state == TASK_DIED)
-            {
-                child = ptr;
-                // tasks[i] = NULL;
-                goto rollback;
-            }
-            else
-            {
-                child = ptr;
-                has_child = true;
-                break;
-            }
+            has_child = child != NULL;
+            for (task_t *ptr = current_task->children; ptr && !has_child; ptr = ptr->sibling_next)
+                has_child = wait_match(ptr, idtype, id);
         }
 
-        if (!has_child || !child)
+        if (child)
         {
-            if (options & WNOHANG)
-            {
-                return 0;
-            }
-            break;
+            if (!(options & WNOWAIT))
+                sibling_del(&current_task->zombies, child);
+            spin_unlock_irqrestore(&task_list_lock);
+            *out = child;
+            return 0;
         }
 
-        child->waitpid = current_task->pid;
+        if (!has_child)
+        {
+            spin_unlock_irqrestore(&task_list_lock);
+            return -ECHILD;
+        }
+
+        if (options & WNOHANG)
+        {
+            spin_unlock_irqrestore(&task_list_lock);
+            return 0;
+        }
+
+        wait.next = current_task->wait_chldexit.next;
+        current_task->wait_chldexit.next = &wait;
+        task_block_prepare(current_task, TASK_BLOCKING, 0);
 
-        current_task->state = TASK_BLOCKING;
+        spin_unlock_irqrestore(&task_list_lock);
 
-        while (current_task->state == TASK_BLOCKING)
+        int reason = task_block_wait(current_task, TASK_BLOCKING, 0);
+
+        spin_lock_irqsave(&task_list_lock);
+        wait_chldexit_remove(current_task, &wait);
+        spin_unlock_irqrestore(&task_list_lock);
+
+        if (reason != EOK)
+            return -EINTR;
+    }
+}
+
+static int wait_status(task_t *child)
+{
+    if (child->status < 128)
+        return (child->status & 0xff) << 8;
+
+    int sig = child->status - 128;
+    return sig | (0x80 << 8);
+}
+
+static void wait_convert_pid(int64_t pid, int *idtype, uint64_t *id)
+{
+    if (pid == -1)
+    {
+        *idtype = P_ALL;
+        *id = 0;
+    }
+    else if (pid == 0)
+    {
+        *idtype = P_PGID;
+        *id = current_task->pgid;
+    }
+    else if (pid < 0)
+    {
+        *idtype = P_PGID;
+        *id = -pid;
+    }
+    else
+    {
+        *idtype = P_PID;
+        *id = pid;
+    }
+}
+
+uint64_t sys_wait4(int64_t pid, int *status, uint64_t options, struct rusage *rusage)
+{
+    if (status && check_user_overflow((uint64_t)status, sizeof(int)))
+        return (uint64_t)-EFAULT;
+    if (rusage && check_user_overflow((uint64_t)rusage, sizeof(struct rusage)))
+        return (uint64_t)-EFAULT;
+
+    int idtype;
+    uint64_t id;
+    wait_convert_pid(pid, &idtype, &id);
+
+    task_t *child = NULL;
+    int ret = do_wait(idtype, id, options & (WNOHANG | WUNTRACED), &child);
+    if (ret < 0)
+        return (uint64_t)ret;
+    if (!child)
+        return 0;
+
+    if (status)
+        *status = wait_status(child);
+
+    if (rusage)
+    {
+        task_fill_rusage(child, false, rusage);
+        struct rusage cru;
+        task_fill_rusage(child, true, &cru);
+        rusage->ru_utime.tv_sec += cru.ru_utime.tv_sec;
+        rusage->ru_utime.tv_usec += cru.ru_utime.tv_usec;
+        if (rusage->ru_utime.tv_usec >= 1000000)
         {
-            arch_enable_interrupt();
-            arch_pause();
+            rusage->ru_utime.tv_sec++;
+            rusage->ru_utime.tv_usec -= 1000000;
         }
     }
 
-rollback:
-    if (child)
+    uint64_t child_pid = child->pid;
+
+    task_release(child);
+
+    return child_pid;
+}
+
+uint64_t sys_waitpid(uint64_t pid, int *status, uint64_t options)
+{
+    return sys_wait4((int64_t)pid, status, options, NULL);
+}
+
+uint64_t sys_waitid(int idtype, uint64_t id, struct siginfo *infop, uint64_t options, struct rusage *rusage)
+{
+    if (infop && check_user_overflow((uint64_t)infop, sizeof(struct siginfo)))
+        return (uint64_t)-EFAULT;
+    if (rusage && check_user_overflow((uint64_t)rusage, sizeof(struct rusage)))
+        return (uint64_t)-EFAULT;
+
+    if (idtype != P_ALL && idtype != P_PID && idtype != P_PGID)
+        return (uint64_t)-EINVAL;
+    if (!(options & (WEXITED | WSTOPPED | WCONTINUED)))
+        return (uint64_t)-EINVAL;
+
+    // 目前只有退出事件, 不支持 WSTOPPED/WCONTINUED
+    if (!(options & WEXITED))
+        return (uint64_t)-ECHILD;
+
+    if (idtype == P_PGID && id == 0)
+        id = current_task->pgid;
+
+    task_t *child = NULL;
+    int ret = do_wait(idtype, id, options & (WNOHANG | WNOWAIT), &child);
+    if (ret < 0)
+        return (uint64_t)ret;
+
+    if (infop)
     {
-        if (status)
+        memset(infop, 0, sizeof(struct siginfo));
+        if (child)
         {
+            infop->si_signo = SIGCHLD;
+            infop->si_pid = child->pid;
+            infop->si_uid = child->uid;
             if (child->status < 128)
             {
-                *status = (child->status & 0xff) << 8;
+                infop->si_code = CLD_EXITED;
+                infop->si_status = child->status & 0xff;
             }
             else
             {
-                int sig = child->status - 128;
-                *status = sig | (0x80 << 8);
+                infop->si_code = CLD_KILLED;
+                infop->si_status = child->status - 128;
             }
         }
+    }
 
-        ret = child->pid;
+    if (!child)
+        return 0;
 
-        tasks[child->pid] = NULL;
+    if (rusage)
+        task_fill_rusage(child, false, rusage);
 
-        free_page_table(child->arch_context->mm);
+    if (!(options & WNOWAIT))
+        task_release(child);
 
-        free(child->arch_context);
+    return 0;
+}
 
-        free(child);
-    }
-    else if (options & WNOHANG)
+uint64_t sys_getrusage(int who, struct rusage *usage)
+{
+    if (!usage || check_user_overflow((uint64_t)usage, sizeof(struct rusage)))
+        return (uint64_t)-EFAULT;
+
+    switch (who)
     {
-        ret = 0;
+    case RUSAGE_SELF:
+    case RUSAGE_THREAD:
+        task_fill_rusage(current_task, false, usage);
+        return 0;
+    case RUSAGE_CHILDREN:
+        task_fill_rusage(current_task, true, usage);
+        return 0;
+    default:
+        return (uint64_t)-EINVAL;
     }
-
-    return ret;
 }
 
 uint64_t sys_clone(struct pt_regs *regs, uint64_t flags, uint64_t newsp, int *parent_tid, int *child_tid, uint64_t tls)
@@ -997,41 +1475,21 @@ uint64_t sys_clone(struct pt_regs *regs, uint64_t flags, uint64_t newsp, int *pa
     child->pgid = current_task->pgid;
 
     child->jiffies = current_task->jiffies;
+    child->jiffies_base = current_task->jiffies;
 
-    child->cwd = current_task->cwd;
+    if (flags & CLONE_FS)
+        child->fs = fs_info_get(current_task->fs);
+    else
+        child->fs = fs_info_copy(current_task->fs);
     child->cmdline = current_task->cmdline;
 
-    child->mmap_start = USER_MMAP_START;
-    child->brk_start = USER_BRK_START;
-    child->brk_end = USER_BRK_START;
     child->load_start = current_task->load_start;
     child->load_end = current_task->load_end;
 
-    memset(child->fds, 0, sizeof(child->fds));
-    child->fds[0] = malloc(sizeof(fd_t));
-    child->fds[0]->node = vfs_open("/dev/stdin");
-    child->fds[0]->offset = 0;
-    child->fds[0]->flags = 0;
-    child->fds[1] = malloc(sizeof(fd_t));
-    child->fds[1]->node = vfs_open("/dev/stdout");
-    child->fds[1]->offset = 0;
-    child->fds[1]->flags = 0;
-    child->fds[2] = malloc(sizeof(fd_t));
-    child->fds[2]->node = vfs_open("/dev/stderr");
-    child->fds[2]->offset = 0;
-    child->fds[2]->flags = 0;
-
-    for (uint64_t i = 3; i < MAX_FD_NUM; i++)
-    {
-        if (current_task->fds[i])
-        {
-            child->fds[i] = vfs_dup(current_task->fds[i]);
-        }
-        else
-        {
-            child->fds[i] = NULL;
-        }
-    }
+    if (flags & CLONE_FILES)
+        child->files = fd_table_get(current_task->files);
+    else
+        child->files = fd_table_copy(current_task->files);
 
     memcpy(&child->term, &current_task->term, sizeof(termios));
 
@@ -1064,16 +1522,188 @@ uint64_t sys_clone(struct pt_regs *regs, uint64_t flags, uint64_t newsp, int *pa
     }
 
     child->tmp_rec_v = current_task->tmp_rec_v;
+    child->timer_slack_ns = current_task->timer_slack_ns;
+    child->static_prio = current_task->static_prio;
+    child->prio = current_task->static_prio;
+    child->policy = current_task->policy;
+    child->rt_priority = current_task->rt_priority;
+    child->nice = current_task->nice;
+    child->pi_blocked_on = NULL;
+    child->pi_owned = NULL;
 
     memcpy(child->rlim, current_task->rlim, sizeof(child->rlim));
 
     socket_on_new_task(child->pid);
 
+    child->vfork_parent = (flags & CLONE_VFORK) ? current_task : NULL;
+
+    task_register(child);
+    task_link_child(current_task, child);
+
     can_schedule = true;
 
     arch_enable_interrupt();
 
-    return child->pid;
+    uint64_t pid = child->pid;
+
+    if (flags & CLONE_VFORK)
+        task_vfork_wait(child);
+
+    return pid;
+}
+
+typedef struct spawn_args
+{
+    char *path;
+    char **argv;
+    char **envp;
+    int error;
+} spawn_args_t;
+
+static char **spawn_copy_strings(const char **strs)
+{
+    int count = 0;
+    if (strs && translate_address(get_current_page_dir(true), (uint64_t)strs) != 0)
+    {
+        while (strs[count] != NULL && translate_address(get_current_page_dir(true), (uint64_t)strs[count]) != 0)
+            count++;
+    }
+
+    char **copy = (char **)malloc((count + 1) * sizeof(char *));
+    for (int i = 0; i < count; i++)
+        copy[i] = strdup(strs[i]);
+    copy[count] = NULL;
+
+    return copy;
+}
+
+static void spawn_free_strings(char **strs)
+{
+    for (int i = 0; strs[i] != NULL; i++)
+        free(strs[i]);
+    free(strs);
+}
+
+static void spawn_args_free(spawn_args_t *args)
+{
+    free(args->path);
+    spawn_free_strings(args->argv);
+    spawn_free_strings(args->envp);
+    free(args);
+}
+
+// 子进程在内核态直接 execve, 只有失败时才会返回
+static void task_spawn_entry(uint64_t arg)
+{
+    spawn_args_t *args = (spawn_args_t *)arg;
+
+    args->error = (int)task_execve(args->path, (const char **)args->argv, (const char **)args->envp);
+
+    task_exit(127);
+}
+
+// 不复制父进程地址空间的 posix_spawn, 父进程等到子进程 execve 完成后返回
+uint64_t sys_spawn(const char *path, const char **argv, const char **envp)
+{
+#if defined(__x86_64__)
+    if (!path || check_user_overflow((uint64_t)path, 1))
+        return (uint64_t)-EFAULT;
+
+    spawn_args_t *args = malloc(sizeof(spawn_args_t));
+    args->path = strdup(path);
+    args->argv = spawn_copy_strings(argv);
+    args->envp = spawn_copy_strings(envp);
+    args->error = 0;
+
+    task_mm_info_t *mm = task_new_user_mm();
+    if (!mm)
+    {
+        spawn_args_free(args);
+        return (uint64_t)-ENOMEM;
+    }
+
+    arch_disable_interrupt();
+
+    can_schedule = false;
+
+    task_t *child = task_alloc(args->path, task_spawn_entry, (uint64_t)args);
+    if (child == NULL)
+    {
+        can_schedule = true;
+        free_page_table(mm);
+        spawn_args_free(args);
+        return (uint64_t)-EAGAIN;
+    }
+
+    // 从一开始就使用空的用户地址空间, execve 直接在里面装载
+    free(child->arch_context->mm);
+    child->arch_context->mm = mm;
+
+    child->ppid = current_task->pid;
+    child->uid = current_task->uid;
+    child->gid = current_task->gid;
+    child->euid = current_task->euid;
+    child->egid = current_task->egid;
+    child->pgid = current_task->pgid;
+
+    fs_info_put(child->fs);
+    child->fs = fs_info_copy(current_task->fs);
+    fd_table_put(child->files);
+    child->files = fd_table_copy(current_task->files);
+
+    child->blocked = current_task->blocked;
+
+    memcpy(&child->term, &current_task->term, sizeof(termios));
+
+    child->timer_slack_ns = current_task->timer_slack_ns;
+    child->static_prio = current_task->static_prio;
+    child->prio = current_task->static_prio;
+    child->policy = current_task->policy;
+    child->rt_priority = current_task->rt_priority;
+    child->nice = current_task->nice;
+
+    memcpy(child->rlim, current_task->rlim, sizeof(child->rlim));
+
+    child->vfork_parent = current_task;
+
+    task_register(child);
+    task_link_child(current_task, child);
+
+    can_schedule = true;
+
+    uint64_t pid = child->pid;
+
+    task_vfork_wait(child);
+
+    int error = args->error;
+    spawn_args_free(args);
+
+    if (error < 0)
+    {
+        // execve 失败的子进程已经退出, 直接回收
+        task_t *zombie = NULL;
+        if (do_wait(P_PID, pid, 0, &zombie) == 0 && zombie)
+            task_release(zombie);
+        return (uint64_t)error;
+    }
+
+    return pid;
+#else
+    return (uint64_t)-ENOSYS;
+#endif
+}
+
+uint64_t sys_unshare(uint64_t flags)
+{
+    if (flags & ~(CLONE_FILES | CLONE_FS))
+        return (uint64_t)-EINVAL;
+
+    if (flags & CLONE_FILES)
+        task_unshare_files(current_task);
+    if (flags & CLONE_FS)
+        task_unshare_fs(current_task);
+
+    return 0;
 }
 
 uint64_t sys_nanosleep(struct timespec *req, struct timespec *rem)
@@ -1086,34 +1716,176 @@ uint64_t sys_nanosleep(struct timespec *req, struct timespec *rem)
         return (uint64_t)-EINVAL;
     }
 
-    uint64_t start = nanoTime();
-    uint64_t target = start + (req->tv_sec * 1000000000ULL) + req->tv_nsec;
+    uint64_t target = nanoTime() + timespec_to_ns(req);
 
-    do
+    while (target > nanoTime())
     {
         if (signals_pending_quick(current_task))
         {
             if (rem)
             {
-                uint64_t remaining = target - nanoTime();
-                struct timespec remain_ts = {
-                    .tv_sec = remaining / 1000000000,
-                    .tv_nsec = remaining % 1000000000};
+                uint64_t now = nanoTime();
+                struct timespec remain_ts;
+                ns_to_timespec(target > now ? target - now : 0, &remain_ts);
                 memcpy(rem, &remain_ts, sizeof(struct timespec));
             }
             return (uint64_t)-EINTR;
         }
 
-        arch_enable_interrupt();
+        task_block_until(current_task, TASK_BLOCKING, target);
+    }
 
-        arch_pause();
-    } while (target > nanoTime());
+    return 0;
+}
 
-    arch_disable_interrupt();
+int sys_setpriority(int which, int who, int niceval)
+{
+    if (which != PRIO_PROCESS)
+        return -EINVAL;
+
+    if (niceval < MIN_NICE)
+        niceval = MIN_NICE;
+    if (niceval > MAX_NICE)
+        niceval = MAX_NICE;
+
+    rcu_read_lock();
+
+    task_t *task = who ? task_find_by_pid(who) : current_task;
+    if (!task)
+    {
+        rcu_read_unlock();
+        return -ESRCH;
+    }
+
+    // 实时任务只记录 nice, 回到 SCHED_NORMAL 时生效
+    task->nice = niceval;
+    if (task->policy == SCHED_NORMAL)
+    {
+        task->static_prio = NICE_TO_PRIO(niceval);
+        futex_pi_adjust(task);
+    }
+
+    rcu_read_unlock();
 
     return 0;
 }
 
+// 与 Linux 的系统调用一致, 返回 20 - nice
+int sys_getpriority(int which, int who)
+{
+    if (which != PRIO_PROCESS)
+        return -EINVAL;
+
+    rcu_read_lock();
+
+    task_t *task = who ? task_find_by_pid(who) : current_task;
+    int ret = task ? 20 - task->nice : -ESRCH;
+
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int task_setscheduler(task_t *task, int policy, int rt_priority)
+{
+    switch (policy)
+    {
+    case SCHED_NORMAL:
+        if (rt_priority != 0)
+            return -EINVAL;
+        break;
+    case SCHED_FIFO:
+    case SCHED_RR:
+        if (rt_priority < 1 || rt_priority > MAX_RT_PRIO - 1)
+            return -EINVAL;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    task->policy = policy;
+    task->rt_priority = rt_priority;
+    task->static_prio = policy == SCHED_NORMAL ? NICE_TO_PRIO(task->nice) : RT_PRIO(rt_priority);
+    futex_pi_adjust(task);
+
+    return 0;
+}
+
+int sys_sched_setscheduler(int pid, int policy, const struct sched_param *param)
+{
+    if (!param || check_user_overflow((uint64_t)param, sizeof(struct sched_param)))
+        return -EFAULT;
+
+    rcu_read_lock();
+
+    task_t *task = pid ? task_find_by_pid(pid) : current_task;
+    int ret = task ? task_setscheduler(task, policy, param->sched_priority) : -ESRCH;
+
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int sys_sched_getscheduler(int pid)
+{
+    rcu_read_lock();
+
+    task_t *task = pid ? task_find_by_pid(pid) : current_task;
+    int ret = task ? task->policy : -ESRCH;
+
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int sys_sched_setparam(int pid, const struct sched_param *param)
+{
+    if (!param || check_user_overflow((uint64_t)param, sizeof(struct sched_param)))
+        return -EFAULT;
+
+    rcu_read_lock();
+
+    task_t *task = pid ? task_find_by_pid(pid) : current_task;
+    int ret = task ? task_setscheduler(task, task->policy, param->sched_priority) : -ESRCH;
+
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int sys_sched_getparam(int pid, struct sched_param *param)
+{
+    if (!param || check_user_overflow((uint64_t)param, sizeof(struct sched_param)))
+        return -EFAULT;
+
+    rcu_read_lock();
+
+    task_t *task = pid ? task_find_by_pid(pid) : current_task;
+    int ret = task ? 0 : -ESRCH;
+    if (task)
+        param->sched_priority = task->rt_priority;
+
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int sys_sched_get_priority_max(int policy)
+{
+    if (policy == SCHED_FIFO || policy == SCHED_RR)
+        return MAX_RT_PRIO - 1;
+
+    return policy == SCHED_NORMAL ? 0 : -EINVAL;
+}
+
+int sys_sched_get_priority_min(int policy)
+{
+    if (policy == SCHED_FIFO || policy == SCHED_RR)
+        return 1;
+
+    return policy == SCHED_NORMAL ? 0 : -EINVAL;
+}
+
 uint64_t sys_prctl(uint64_t option, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5)
 {
     switch (option)
@@ -1139,87 +1911,45 @@ uint64_t sys_prctl(uint64_t option, uint64_t arg2, uint64_t arg3, uint64_t arg4,
         return 0;
 
     case PR_SET_TIMERSLACK:
-        current_task->timer_slack_ns = arg2;
+        current_task->timer_slack_ns = arg2 ? arg2 : TIMER_SLACK_DEFAULT_NS;
         return 0;
 
+    case PR_GET_TIMERSLACK:
+        return current_task->timer_slack_ns;
+
     default:
         return -ENOSYS; // 未实现的功能返回不支持
     }
 }
 
-void ms_to_timeval(uint64_t ms, struct timeval *tv)
+static void ns_to_timeval(uint64_t ns, struct timeval *tv)
 {
-    tv->tv_sec = ms / 1000;
-    tv->tv_usec = (ms % 1000) * 1000;
+    tv->tv_sec = ns / 1000000000ULL;
+    tv->tv_usec = (ns % 1000000000ULL) / 1000;
 }
 
-uint64_t timeval_to_ms(struct timeval tv)
+static uint64_t timeval_to_ns(struct timeval tv)
 {
-    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000;
 }
 
-extern int timerfdfs_id;
-
-void sched_update_itimer()
+static hrtimer_restart_t itimer_real_expire(hrtimer_t *timer)
 {
-    for (uint64_t i = 1; i < MAX_TASK_NUM; i++)
-    {
-        task_t *ptr = tasks[i];
-
-        if (!ptr)
-            break;
-
-        uint64_t rtAt = ptr->itimer_real.at;
-        uint64_t rtReset = ptr->itimer_real.reset;
-
-        if (rtAt && rtAt <= jiffies)
-        {
-            ptr->signal |= SIGMASK(SIGALRM);
-            if (ptr->state == TASK_BLOCKING)
-                task_unblock(ptr, EOK);
-
-            if (rtReset)
-            {
-                ptr->itimer_real.at = jiffies + rtReset;
-            }
-            else
-            {
-                ptr->itimer_real.at = 0;
-            }
-        }
+    task_t *task = timer->data;
 
-        for (int j = 0; j < MAX_TIMERS_NUM; j++)
-        {
-            if (ptr->timers[i] == NULL)
-                continue;
-            kernel_timer_t *kt = ptr->timers[j];
-            if (kt->expires && jiffies >= kt->expires)
-            {
-                ptr->signal |= SIGMASK(kt->sigev_signo);
+    task->signal |= SIGMASK(SIGALRM);
+    if (task->state == TASK_BLOCKING)
+        task_unblock(task, -SIGALRM);
 
-                if (kt->interval)
-                    kt->expires += kt->interval;
-                else
-                    kt->expires = 0;
-            }
-            if (current_task->fds[i] && current_task->fds[i]->node && current_task->fds[i]->node->fsid == timerfdfs_id)
-            {
-                timerfd_t *tfd = current_task->fds[i]->node->handle;
-                if (tfd->timer.expires && jiffies >= tfd->timer.expires)
-                {
-                    tfd->count++;
-                    if (tfd->timer.interval)
-                    {
-                        tfd->timer.expires += tfd->timer.interval;
-                    }
-                    else
-                    {
-                        tfd->timer.expires = 0;
-                    }
-                }
-            }
-        }
+    if (task->itimer_real.reset)
+    {
+        hrtimer_forward(timer, nanoTime(), task->itimer_real.reset);
+        task->itimer_real.at = timer->expires;
+        return HRTIMER_RESTART;
     }
+
+    task->itimer_real.at = 0;
+    return HRTIMER_NORESTART;
 }
 
 size_t sys_setitimer(int which, struct itimerval *value, struct itimerval *old)
@@ -1229,32 +1959,59 @@ size_t sys_setitimer(int which, struct itimerval *value, struct itimerval *old)
         return (size_t)-ENOSYS;
     }
 
-    uint64_t rt_at = current_task->itimer_real.at;
-    uint64_t rt_reset = current_task->itimer_real.reset;
-
     if (old)
     {
-        uint64_t realValue = rt_at - jiffies;
-        ms_to_timeval(realValue, &old->it_value);
-        ms_to_timeval(rt_reset, &old->it_interval);
+        ns_to_timeval(hrtimer_remaining(&current_task->itimer_real.timer), &old->it_value);
+        ns_to_timeval(current_task->itimer_real.reset, &old->it_interval);
     }
 
     if (value)
     {
-        uint64_t targValue = timeval_to_ms(value->it_value);
-        uint64_t targInterval = timeval_to_ms(value->it_interval);
+        uint64_t targValue = timeval_to_ns(value->it_value);
+        uint64_t targInterval = timeval_to_ns(value->it_interval);
+
+        hrtimer_cancel(&current_task->itimer_real.timer);
+
+        current_task->itimer_real.reset = targInterval;
 
         if (targValue)
-            current_task->itimer_real.at = jiffies + targValue;
+        {
+            current_task->itimer_real.at = nanoTime() + targValue;
+            hrtimer_init(&current_task->itimer_real.timer, itimer_real_expire, current_task);
+            hrtimer_start_range(&current_task->itimer_real.timer, current_task->itimer_real.at, current_task->timer_slack_ns);
+        }
         else
+        {
             current_task->itimer_real.at = 0ULL;
-
-        current_task->itimer_real.reset = targInterval;
+        }
     }
 
     return 0;
 }
 
+static hrtimer_restart_t posix_timer_expire(hrtimer_t *timer)
+{
+    kernel_timer_t *kt = timer->data;
+    task_t *task = kt->task;
+
+    if (kt->sigev_notify != SIGEV_NONE)
+    {
+        task->signal |= SIGMASK(kt->sigev_signo);
+        if (task->state == TASK_BLOCKING)
+            task_unblock(task, -kt->sigev_signo);
+    }
+
+    if (kt->interval)
+    {
+        hrtimer_forward(timer, nanoTime(), kt->interval);
+        kt->expires = timer->expires;
+        return HRTIMER_RESTART;
+    }
+
+    kt->expires = 0;
+    return HRTIMER_NORESTART;
+}
+
 int sys_timer_create(clockid_t clockid, struct sigevent *sevp, timer_t *timerid)
 {
     kernel_timer_t *kt = NULL;
@@ -1274,8 +2031,11 @@ int sys_timer_create(clockid_t clockid, struct sigevent *sevp, timer_t *timerid)
 
     memset(kt, 0, sizeof(kernel_timer_t));
 
+    kt->task = current_task;
     kt->clock_type = clockid;
+    kt->sigev_signo = SIGALRM;
     kt->sigev_notify = SIGEV_SIGNAL;
+    hrtimer_init(&kt->timer, posix_timer_expire, kt);
 
     if (sevp)
     {
@@ -1292,33 +2052,35 @@ int sys_timer_create(clockid_t clockid, struct sigevent *sevp, timer_t *timerid)
     return 0;
 }
 
-int sys_timer_settime(timer_t timerid, const struct itimerval *new_value, struct itimerval *old_value)
+int sys_timer_settime(timer_t timerid, int flags, const struct itimerspec *new_value, struct itimerspec *old_value)
 {
+    if (!new_value || check_user_overflow((uint64_t)new_value, sizeof(struct itimerspec)))
+        return -EFAULT;
+
     uint64_t idx = (uint64_t)timerid;
-    if (idx >= MAX_TIMERS_NUM)
+    if (idx >= MAX_TIMERS_NUM || !current_task->timers[idx])
         return -EINVAL;
 
     kernel_timer_t *kt = current_task->timers[idx];
 
-    struct itimerval kts;
+    struct itimerspec kts;
     memcpy(&kts, new_value, sizeof(*new_value));
 
-    uint64_t now = jiffies;
-    uint64_t interval = kts.it_interval.tv_sec * 1000 + kts.it_interval.tv_usec / 1000000;
-    uint64_t expires = kts.it_value.tv_sec * 1000 + kts.it_value.tv_usec / 1000000;
-
     if (old_value)
     {
-        struct itimerval old;
-        old.it_interval.tv_sec = kt->interval / 1000;
-        old.it_interval.tv_usec = (kt->interval % 1000) * 1000000;
-        old.it_value.tv_sec = (kt->expires - now) / 1000;
-        old.it_value.tv_usec = ((kt->expires - now) % 1000) * 1000000;
+        struct itimerspec old;
+        ns_to_timespec(kt->interval, &old.it_interval);
+        ns_to_timespec(hrtimer_remaining(&kt->timer), &old.it_value);
         memcpy(old_value, &old, sizeof(old));
     }
 
-    kt->interval = interval;
-    kt->expires = now + expires;
+    hrtimer_cancel(&kt->timer);
+
+    kt->interval = timespec_to_ns(&kts.it_interval);
+
+    kt->expires = timer_value_to_deadline(kt->clock_type, &kts.it_value, flags & TIMER_ABSTIME);
+    if (kt->expires)
+        hrtimer_start_range(&kt->timer, kt->expires, current_task->timer_slack_ns);
 
     return 0;
 }
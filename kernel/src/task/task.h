@@ -2,7 +2,12 @@
 
 #include <fs/vfs/pipe.h>
 #include <task/signal.h>
+#include <task/hrtimer.h>
 #include <fs/termios.h>
+#include <task/files.h>
+#include <task/pid.h>
+#include <task/percpu.h>
+#include <task/rcu.h>
 
 extern uint64_t jiffies;
 
@@ -37,8 +42,6 @@ extern uint64_t jiffies;
 #define AT_SYSINFO 32
 #define AT_SYSINFO_EHDR 33
 
-#define EHDR_START_ADDR 0x0000300000000000
-#define INTERPRETER_EHDR_ADDR 0x0000200000000000
 #define INTERPRETER_BASE_ADDR 0x0000100000000000
 
 #define USER_MMAP_START 0x0000400000000000
@@ -47,11 +50,8 @@ extern uint64_t jiffies;
 #define USER_BRK_START 0x0000700000000000
 #define USER_BRK_END 0x0000800000000000
 
-#define MAX_TASK_NUM 1024
-
 #define TASK_NAME_MAX 128
 
-#define MAX_FD_NUM 64
 
 #define current_task arch_get_current()
 
@@ -102,8 +102,9 @@ struct itimerval
 
 typedef struct int_timer_internal
 {
-    uint64_t at;
-    uint64_t reset;
+    uint64_t at;    // ns
+    uint64_t reset; // ns
+    hrtimer_t timer;
 } int_timer_internal_t;
 
 union sigval;
@@ -113,62 +114,82 @@ union sigval;
 #define SIGEV_THREAD 2    /* deliver via thread creation */
 #define SIGEV_THREAD_ID 4 /* deliver to thread */
 
+struct task;
+
 typedef struct kernel_timer
 {
+    struct task *task;
     clockid_t clock_type;
     int sigev_signo;
     union sigval sigev_value;
     int sigev_notify;
-    uint64_t expires;
-    uint64_t interval;
+    uint64_t expires;  // ns
+    uint64_t interval; // ns
+    hrtimer_t timer;
 } kernel_timer_t;
 
 #define MAX_TIMERS_NUM 8
 
 struct rlimit;
 struct fd;
+struct futex_pi_state;
 typedef struct fd fd_t;
 
 typedef struct task
 {
+    uint64_t syscall_stack;
     uint64_t pid;
     uint64_t ppid;
+    struct task *task_next;     // 全局任务链表
+    struct task *task_prev;
+    struct task *pid_hash_next; // pid 哈希链
+    struct task *children;      // 存活的子进程
+    struct task *zombies;       // 已退出但未回收的子进程
+    struct task *sibling_next;  // 在父进程的 children 或 zombies 链表中
+    struct task *sibling_prev;
+    task_block_list_t wait_chldexit; // 在 wait 中等待子进程退出的任务
+    struct task *vfork_parent;       // 借用其地址空间的 vfork 父进程, execve 或退出时清空
     int64_t uid;
     int64_t gid;
     int64_t euid;
     int64_t egid;
     int64_t pgid;
-    uint64_t waitpid;
     uint64_t status;
     uint32_t cpu_id;
     char name[TASK_NAME_MAX];
     uint64_t jiffies;
+    uint64_t jiffies_base; // 创建时继承的 jiffies, 不计入 rusage
+    uint64_t cjiffies;     // 已回收子进程的运行时间
     task_state_t state;
     task_state_t current_state;
     uint64_t kernel_stack;
-    uint64_t syscall_stack;
-    uint64_t mmap_start;
-    uint64_t brk_start;
-    uint64_t brk_end;
     uint64_t load_start;
     uint64_t load_end;
     arch_context_t *arch_context;
     sigaction_t actions[MAXSIG];
     uint64_t signal;
     uint64_t blocked;
-    vfs_node_t cwd;
-    fd_t *fds[MAX_FD_NUM];
+    fs_info_t *fs;
+    fd_table_t *files;
     uint64_t timer_slack_ns;
     termios term;
     uint32_t tmp_rec_v;
     char *cmdline;
     int_timer_internal_t itimer_real;
     kernel_timer_t *timers[MAX_TIMERS_NUM];
+    hrtimer_t block_timer;
+    int static_prio;                       // 普通任务为 120 + nice, 实时任务为 99 - rt_priority
+    int prio;                              // 有效优先级, 可能被优先级继承提升
+    int policy;                            // SCHED_NORMAL / SCHED_FIFO / SCHED_RR
+    int rt_priority;                       // 实时优先级 1..99, 普通任务为 0
+    int nice;
+    struct futex_pi_state *pi_blocked_on;  // 正在等待的 PI futex
+    struct futex_pi_state *pi_owned;       // 持有的 PI futex 链表
     struct rlimit rlim[16];
+    struct poll_table *poll_table; // poll/epoll 扫描期间登记等待队列
+    rcu_head_t rcu; // 回收后延迟释放, 无锁遍历任务表的读者可能还在访问
 } task_t;
 
-void sched_update_itimer();
-
 task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg);
 void task_init();
 
@@ -177,12 +198,71 @@ struct pt_regs;
 uint64_t task_fork(struct pt_regs *regs, bool vfork);
 uint64_t task_execve(const char *path, const char **argv, const char **envp);
 uint64_t task_exit(int64_t code);
+void task_link_child(task_t *parent, task_t *child);
+void task_exit_notify(task_t *task);
+void task_vfork_done(task_t *task);
 
 #define WNOHANG 1
 #define WUNTRACED 2
+#define WSTOPPED 2
+#define WEXITED 4
+#define WCONTINUED 8
+#define WNOWAIT 0x01000000
+
+#define P_ALL 0
+#define P_PID 1
+#define P_PGID 2
+
+#define CLD_EXITED 1
+#define CLD_KILLED 2
+
+#define RUSAGE_SELF 0
+#define RUSAGE_CHILDREN (-1)
+#define RUSAGE_THREAD 1
+
+struct rusage
+{
+    struct timeval ru_utime;
+    struct timeval ru_stime;
+    long ru_maxrss;
+    long ru_ixrss;
+    long ru_idrss;
+    long ru_isrss;
+    long ru_minflt;
+    long ru_majflt;
+    long ru_nswap;
+    long ru_inblock;
+    long ru_oublock;
+    long ru_msgsnd;
+    long ru_msgrcv;
+    long ru_nsignals;
+    long ru_nvcsw;
+    long ru_nivcsw;
+};
+
+// waitid 使用的 siginfo, 只包含 SIGCHLD 相关字段
+struct siginfo
+{
+    int si_signo;
+    int si_errno;
+    int si_code;
+    int __pad0;
+    int si_pid;
+    int si_uid;
+    int si_status;
+    int __pad1;
+    long si_utime;
+    long si_stime;
+    char __pad[80];
+};
 
 uint64_t sys_waitpid(uint64_t pid, int *status, uint64_t options);
+uint64_t sys_wait4(int64_t pid, int *status, uint64_t options, struct rusage *rusage);
+uint64_t sys_waitid(int idtype, uint64_t id, struct siginfo *infop, uint64_t options, struct rusage *rusage);
+uint64_t sys_getrusage(int who, struct rusage *usage);
 uint64_t sys_clone(struct pt_regs *regs, uint64_t flags, uint64_t newsp, int *parent_tid, int *child_tid, uint64_t tls);
+uint64_t sys_unshare(uint64_t flags);
+uint64_t sys_spawn(const char *path, const char **argv, const char **envp);
 struct timespec;
 uint64_t sys_nanosleep(struct timespec *req, struct timespec *rem);
 
@@ -190,6 +270,9 @@ size_t sys_setitimer(int which, struct itimerval *value, struct itimerval *old);
 
 task_t *task_search(task_state_t state, uint32_t cpu_id);
 int task_block(task_t *task, task_state_t state, int timeout_ms);
+int task_block_until(task_t *task, task_state_t state, uint64_t deadline);
+void task_block_prepare(task_t *task, task_state_t state, uint64_t deadline);
+int task_block_wait(task_t *task, task_state_t state, uint64_t deadline);
 void task_unblock(task_t *task, int reason);
 
 #define PR_SET_NAME 15
@@ -197,12 +280,51 @@ void task_unblock(task_t *task, int reason);
 #define PR_SET_SECCOMP 22
 #define PR_GET_SECCOMP 21
 #define PR_SET_TIMERSLACK 23
+#define PR_GET_TIMERSLACK 30
+
+#define TIMER_SLACK_DEFAULT_NS 50000
+
+// 数值越小优先级越高
+#define MAX_NICE 19
+#define MIN_NICE -20
+#define NICE_TO_PRIO(nice) ((nice) + 120)
+#define PRIO_TO_NICE(prio) ((prio) - 120)
+#define DEFAULT_PRIO NICE_TO_PRIO(0)
+
+// 实时任务的优先级总是高于普通任务
+#define MAX_RT_PRIO 100
+#define RT_PRIO(rt_priority) (MAX_RT_PRIO - 1 - (rt_priority))
+
+#define SCHED_NORMAL 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+
+struct sched_param
+{
+    int sched_priority;
+};
+
+#define PRIO_PROCESS 0
+#define PRIO_PGRP 1
+#define PRIO_USER 2
 #define SECCOMP_MODE_STRICT 1
 
+int sys_setpriority(int which, int who, int niceval);
+int sys_getpriority(int which, int who);
+
+int task_setscheduler(task_t *task, int policy, int rt_priority);
+void task_wake_preempt(task_t *task);
+
+int sys_sched_setscheduler(int pid, int policy, const struct sched_param *param);
+int sys_sched_getscheduler(int pid);
+int sys_sched_setparam(int pid, const struct sched_param *param);
+int sys_sched_getparam(int pid, struct sched_param *param);
+int sys_sched_get_priority_max(int policy);
+int sys_sched_get_priority_min(int policy);
+
 uint64_t sys_prctl(uint64_t options, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5);
 
 int sys_timer_create(clockid_t clockid, struct sigevent *sevp, timer_t *timerid);
-int sys_timer_settime(timer_t timerid, const struct itimerval *new_value, struct itimerval *old_value);
+struct itimerspec;
+int sys_timer_settime(timer_t timerid, int flags, const struct itimerspec *new_value, struct itimerspec *old_value);
 
-extern task_t *tasks[MAX_TASK_NUM];
-extern task_t *idle_tasks[MAX_CPU_NUM];
@@ -0,0 +1,181 @@
+#include <task/workqueue.h>
+#include <task/task.h>
+#include <arch/arch.h>
+#include <interrupt/softirq.h>
+
+static DEFINE_PER_CPU(worker_pool_t, worker_pools);
+
+void work_init(work_struct_t *work, work_func_t func, void *data)
+{
+    work->next = NULL;
+    work->func = func;
+    work->data = data;
+    work->pool = NULL;
+    work->pending = 0;
+}
+
+// 调用者持有 pool->lock
+static void worker_pool_insert(worker_pool_t *pool, work_struct_t *work)
+{
+    work->next = NULL;
+    work->pool = pool;
+
+    if (pool->tail)
+        pool->tail->next = work;
+    else
+        pool->head = work;
+    pool->tail = work;
+
+    if (pool->worker && pool->worker->state == TASK_BLOCKING)
+        task_unblock(pool->worker, EOK);
+}
+
+static void worker_pool_enqueue(worker_pool_t *pool, work_struct_t *work)
+{
+    spin_lock_irqsave(&pool->lock);
+    worker_pool_insert(pool, work);
+    spin_unlock_irqrestore(&pool->lock);
+}
+
+bool queue_work_on(uint32_t cpu, work_struct_t *work)
+{
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL))
+        return false;
+
+    worker_pool_enqueue(&per_cpu(worker_pools, cpu), work);
+
+    return true;
+}
+
+bool queue_work(work_struct_t *work)
+{
+    return queue_work_on(current_cpu_id, work);
+}
+
+static hrtimer_restart_t delayed_work_timer(hrtimer_t *timer)
+{
+    delayed_work_t *dwork = timer->data;
+
+    worker_pool_enqueue(&per_cpu(worker_pools, dwork->cpu), &dwork->work);
+
+    return HRTIMER_NORESTART;
+}
+
+void delayed_work_init(delayed_work_t *dwork, work_func_t func, void *data)
+{
+    work_init(&dwork->work, func, data);
+    hrtimer_init(&dwork->timer, delayed_work_timer, dwork);
+    dwork->cpu = 0;
+}
+
+bool queue_delayed_work(delayed_work_t *dwork, uint64_t delay_ns)
+{
+    if (!delay_ns)
+        return queue_work(&dwork->work);
+
+    if (__atomic_exchange_n(&dwork->work.pending, 1, __ATOMIC_ACQ_REL))
+        return false;
+
+    dwork->cpu = current_cpu_id;
+    hrtimer_start(&dwork->timer, nanoTime() + delay_ns);
+
+    return true;
+}
+
+bool cancel_work(work_struct_t *work)
+{
+    worker_pool_t *pool = work->pool;
+    if (!pool)
+        return false;
+
+    bool found = false;
+
+    spin_lock_irqsave(&pool->lock);
+
+    work_struct_t *prev = NULL;
+    for (work_struct_t *ptr = pool->head; ptr; prev = ptr, ptr = ptr->next)
+    {
+        if (ptr != work)
+            continue;
+
+        if (prev)
+            prev->next = work->next;
+        else
+            pool->head = work->next;
+        if (pool->tail == work)
+            pool->tail = prev;
+
+        work->next = NULL;
+        __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+        found = true;
+        break;
+    }
+
+    spin_unlock_irqrestore(&pool->lock);
+
+    return found;
+}
+
+bool cancel_delayed_work(delayed_work_t *dwork)
+{
+    if (hrtimer_cancel(&dwork->timer))
+    {
+        __atomic_store_n(&dwork->work.pending, 0, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    return cancel_work(&dwork->work);
+}
+
+static void worker_entry(uint64_t arg)
+{
+    worker_pool_t *pool = &per_cpu(worker_pools, arg);
+
+    while (1)
+    {
+        arch_enable_interrupt();
+
+        spin_lock_irqsave(&pool->lock);
+
+        work_struct_t *work = pool->head;
+        if (!work)
+        {
+            // 在持锁时进入阻塞状态, 入队方的唤醒不会丢失
+            task_block_prepare(current_task, TASK_BLOCKING, 0);
+            spin_unlock_irqrestore(&pool->lock);
+            task_block_wait(current_task, TASK_BLOCKING, 0);
+            continue;
+        }
+
+        pool->head = work->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        work->next = NULL;
+
+        // 先清除 pending, 回调中可以重新排队自己
+        __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+
+        spin_unlock_irqrestore(&pool->lock);
+
+        work->func(work);
+        pool->processed++;
+    }
+}
+
+void workqueue_init()
+{
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        worker_pool_t *pool = &per_cpu(worker_pools, cpu);
+
+        memset(pool, 0, sizeof(worker_pool_t));
+        pool->cpu = cpu;
+
+        char name[TASK_NAME_MAX];
+        sprintf(name, "kworker/%u", cpu);
+        pool->worker = task_create(name, worker_entry, cpu);
+        pool->worker->cpu_id = cpu;
+    }
+
+    softirq_init();
+}
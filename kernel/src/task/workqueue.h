@@ -0,0 +1,52 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <task/hrtimer.h>
+
+struct work_struct;
+struct worker_pool;
+struct task;
+
+typedef void (*work_func_t)(struct work_struct *work);
+
+// 回调在工作线程中执行, 开中断, 可以阻塞
+typedef struct work_struct
+{
+    struct work_struct *next;
+    work_func_t func;
+    void *data;
+    struct worker_pool *pool; // 最近一次排队所在的池
+    uint32_t pending;         // 已排队或定时器未到期, 执行前清除
+} work_struct_t;
+
+typedef struct delayed_work
+{
+    work_struct_t work;
+    hrtimer_t timer;
+    uint32_t cpu;
+} delayed_work_t;
+
+// 每个 CPU 一个工作线程, 只处理排在本 CPU 上的工作
+typedef struct worker_pool
+{
+    spinlock_t lock;
+    work_struct_t *head;
+    work_struct_t *tail;
+    struct task *worker;
+    uint32_t cpu;
+    uint64_t processed;
+} worker_pool_t;
+
+void work_init(work_struct_t *work, work_func_t func, void *data);
+void delayed_work_init(delayed_work_t *dwork, work_func_t func, void *data);
+
+// 已经在排队时返回 false
+bool queue_work_on(uint32_t cpu, work_struct_t *work);
+bool queue_work(work_struct_t *work);
+bool queue_delayed_work(delayed_work_t *dwork, uint64_t delay_ns);
+
+// 从队列中移除尚未开始执行的工作, 不等待正在执行的回调
+bool cancel_work(work_struct_t *work);
+bool cancel_delayed_work(delayed_work_t *dwork);
+
+void workqueue_init();
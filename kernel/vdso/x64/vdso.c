@@ -0,0 +1,161 @@
+// 映射到用户进程的 vDSO, 与内核分开编译 (-fPIC, 无 libc)
+#include <arch/x64/vdso/vdso_data.h>
+
+#define SYS_GETTIMEOFDAY 96
+#define SYS_TIME 201
+#define SYS_CLOCK_GETTIME 228
+#define SYS_GETCPU 309
+
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+#define CLOCK_MONOTONIC_RAW 4
+#define CLOCK_REALTIME_COARSE 5
+#define CLOCK_MONOTONIC_COARSE 6
+#define CLOCK_BOOTTIME 7
+
+#define NSEC_PER_SEC 1000000000ULL
+
+struct timespec
+{
+    long tv_sec;
+    long tv_nsec;
+};
+
+struct timeval
+{
+    long tv_sec;
+    long tv_usec;
+};
+
+extern const struct vdso_data vdso_data __attribute__((visibility("hidden")));
+
+static inline long vdso_syscall2(long nr, long arg1, long arg2)
+{
+    long ret;
+    asm volatile("syscall" : "=a"(ret) : "a"(nr), "D"(arg1), "S"(arg2) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline long vdso_syscall3(long nr, long arg1, long arg2, long arg3)
+{
+    long ret;
+    asm volatile("syscall" : "=a"(ret) : "a"(nr), "D"(arg1), "S"(arg2), "d"(arg3) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline uint64_t vdso_rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// 读取单调时间, 时钟源不可用时返回 0
+static inline int vdso_read_ns(uint64_t *mono, uint64_t *real, int coarse)
+{
+    const struct vdso_data *vd = &vdso_data;
+    uint32_t seq;
+
+    do
+    {
+        seq = vdso_read_begin(vd);
+
+        if (vd->clock_mode != VDSO_CLOCKMODE_TSC)
+            return 0;
+
+        if (coarse)
+        {
+            *mono = vd->coarse_ns;
+        }
+        else
+        {
+            uint64_t delta = vdso_rdtsc() - vd->tsc_base;
+            *mono = vd->tsc_ns_base + (uint64_t)(((unsigned __int128)delta * vd->tsc_mult) >> 32);
+        }
+        *real = *mono + vd->realtime_offset;
+    } while (vdso_read_retry(vd, seq));
+
+    return 1;
+}
+
+int __vdso_clock_gettime(int clock, struct timespec *ts)
+{
+    uint64_t mono, real, ns;
+
+    switch (clock)
+    {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+    case CLOCK_MONOTONIC_RAW:
+    case CLOCK_BOOTTIME:
+        if (!vdso_read_ns(&mono, &real, 0))
+            goto fallback;
+        break;
+    case CLOCK_REALTIME_COARSE:
+    case CLOCK_MONOTONIC_COARSE:
+        if (!vdso_read_ns(&mono, &real, 1))
+            goto fallback;
+        break;
+    default:
+        goto fallback;
+    }
+
+    ns = (clock == CLOCK_REALTIME || clock == CLOCK_REALTIME_COARSE) ? real : mono;
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+    return 0;
+
+fallback:
+    return vdso_syscall2(SYS_CLOCK_GETTIME, clock, (long)ts);
+}
+
+int __vdso_gettimeofday(struct timeval *tv, void *tz)
+{
+    uint64_t mono, real;
+
+    if (!vdso_read_ns(&mono, &real, 0))
+        return vdso_syscall2(SYS_GETTIMEOFDAY, (long)tv, (long)tz);
+
+    if (tv)
+    {
+        tv->tv_sec = real / NSEC_PER_SEC;
+        tv->tv_usec = (real % NSEC_PER_SEC) / 1000;
+    }
+
+    return 0;
+}
+
+long __vdso_time(long *t)
+{
+    uint64_t mono, real;
+
+    if (!vdso_read_ns(&mono, &real, 1))
+        return vdso_syscall2(SYS_TIME, (long)t, 0);
+
+    long sec = real / NSEC_PER_SEC;
+    if (t)
+        *t = sec;
+
+    return sec;
+}
+
+int __vdso_getcpu(unsigned *cpu, unsigned *node, void *unused)
+{
+    if (!vdso_data.rdtscp)
+        return vdso_syscall3(SYS_GETCPU, (long)cpu, (long)node, (long)unused);
+
+    uint32_t lo, hi, aux;
+    asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+
+    if (cpu)
+        *cpu = aux;
+    if (node)
+        *node = 0;
+
+    return 0;
+}
+
+int clock_gettime(int clock, struct timespec *ts) __attribute__((weak, alias("__vdso_clock_gettime")));
+int gettimeofday(struct timeval *tv, void *tz) __attribute__((weak, alias("__vdso_gettimeofday")));
+long time(long *t) __attribute__((weak, alias("__vdso_time")));
+int getcpu(unsigned *cpu, unsigned *node, void *unused) __attribute__((weak, alias("__vdso_getcpu")));
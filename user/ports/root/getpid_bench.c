@@ -0,0 +1,52 @@
+// getpid 系统调用延迟测试
+// gcc -O2 getpid_bench.c -o getpid_bench && ./getpid_bench [次数]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_ITERATIONS 1000000
+#define ROUNDS 5
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    if (iterations <= 0)
+        iterations = DEFAULT_ITERATIONS;
+
+    // 先跑一轮预热缓存和 TLB
+    for (long i = 0; i < iterations / 10; i++)
+        syscall(SYS_getpid);
+
+    double best = 0;
+    double total = 0;
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        long long start = now_ns();
+        // 直接发起系统调用, 不经过 libc 可能的缓存
+        for (long i = 0; i < iterations; i++)
+            syscall(SYS_getpid);
+        long long elapsed = now_ns() - start;
+
+        double per_call = (double)elapsed / iterations;
+        printf("round %d: %ld calls in %lld ns, %.1f ns/call\n", round, iterations, elapsed, per_call);
+
+        total += per_call;
+        if (round == 0 || per_call < best)
+            best = per_call;
+    }
+
+    printf("getpid: best %.1f ns/call, mean %.1f ns/call\n", best, total / ROUNDS);
+
+    return 0;
+}
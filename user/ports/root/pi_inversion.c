@@ -0,0 +1,135 @@
+// 优先级继承回归测试
+// gcc -O2 pi_inversion.c -o pi_inversion -lpthread && ./pi_inversion
+//
+// 低优先级线程持有 PTHREAD_PRIO_INHERIT 互斥锁, 中优先级线程占满所有 CPU 空转,
+// 高优先级线程随后等待该锁. 只有持有者被提升到高优先级才能在超时前释放锁
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOW_PRIO 10
+#define MEDIUM_PRIO 50
+#define HIGH_PRIO 80
+#define MAIN_PRIO 90
+
+#define HOLD_NS 20000000LL
+#define TIMEOUT_NS 5000000000LL
+#define MAX_SPINNERS 64
+
+static pthread_mutex_t lock;
+static volatile int low_locked = 0;
+static volatile int high_done = 0;
+static volatile int stop = 0;
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int set_fifo(int prio)
+{
+    struct sched_param param = {.sched_priority = prio};
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+static void *low_thread(void *arg)
+{
+    set_fifo(LOW_PRIO);
+
+    pthread_mutex_lock(&lock);
+    low_locked = 1;
+
+    // 持锁期间需要 CPU 时间, 被中优先级线程压住时无法前进
+    long long start = now_ns();
+    while (now_ns() - start < HOLD_NS)
+        ;
+
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static void *medium_thread(void *arg)
+{
+    set_fifo(MEDIUM_PRIO);
+
+    while (!stop)
+        ;
+
+    return NULL;
+}
+
+static void *high_thread(void *arg)
+{
+    set_fifo(HIGH_PRIO);
+
+    pthread_mutex_lock(&lock);
+    high_done = 1;
+    pthread_mutex_unlock(&lock);
+
+    return NULL;
+}
+
+int main()
+{
+    int ret = set_fifo(MAIN_PRIO);
+    if (ret)
+    {
+        printf("pi_inversion: SKIP, SCHED_FIFO unavailable (%d)\n", ret);
+        return 0;
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT))
+    {
+        printf("pi_inversion: SKIP, PTHREAD_PRIO_INHERIT unavailable\n");
+        return 0;
+    }
+    pthread_mutex_init(&lock, &attr);
+
+    long spinners = sysconf(_SC_NPROCESSORS_ONLN);
+    if (spinners < 1)
+        spinners = 1;
+    if (spinners > MAX_SPINNERS)
+        spinners = MAX_SPINNERS;
+
+    pthread_t low, high, medium[MAX_SPINNERS];
+
+    // 主线程优先级最高, 只有睡眠才能让出 CPU 给其他线程
+    struct timespec tick = {.tv_sec = 0, .tv_nsec = 10000000};
+
+    pthread_create(&low, NULL, low_thread, NULL);
+    while (!low_locked)
+        nanosleep(&tick, NULL);
+
+    for (long i = 0; i < spinners; i++)
+        pthread_create(&medium[i], NULL, medium_thread, NULL);
+
+    pthread_create(&high, NULL, high_thread, NULL);
+
+    // 睡眠醒来后总能抢占空转线程检查结果
+    long long start = now_ns();
+    while (!high_done && now_ns() - start < TIMEOUT_NS)
+        nanosleep(&tick, NULL);
+
+    long long elapsed = now_ns() - start;
+    int passed = high_done;
+
+    stop = 1;
+    for (long i = 0; i < spinners; i++)
+        pthread_join(medium[i], NULL);
+    pthread_join(high, NULL);
+    pthread_join(low, NULL);
+
+    if (passed)
+        printf("pi_inversion: PASS, high priority waiter got the lock after %lld us\n", elapsed / 1000);
+    else
+        printf("pi_inversion: FAIL, high priority waiter still blocked after %lld ms\n", elapsed / 1000000);
+
+    return passed ? 0 : 1;
+}